@@ -0,0 +1,256 @@
+// /bmp conversion cost and memory on the host build.
+//
+// Encodes a textured scene with libjpeg (baseline 4:2:2 like the OV2640,
+// plus 4:2:0 and restart-marker variants), converts it to each BMP format
+// through the streaming writer in TCP-segment-sized reads, and checks the
+// pixels against a full-frame libjpeg reference decode (JDCT_ISLOW,
+// replicated chroma). Reports the writer's peak allocation next to the
+// full RGB888 buffer a whole-frame conversion would need, and the time per
+// frame of both. JPEG files given after the iteration count are run too,
+// e.g. frames saved from /capture. Needs libjpeg (libjpeg-dev).
+//
+//   pio run -e native-bmp-bench && .pio/build/native-bmp-bench/program [iterations] [file.jpg...]
+
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+// libjpeg's boolean is an int; Arduino.h already has a bool one
+#define boolean jpeg_boolean
+#include <jpeglib.h>
+#undef boolean
+#include "bmp_stream.h"
+#include "esp_heap_caps.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define BENCH_QUALITY 80          // libjpeg scale; about the OV2640 at quality 12
+#define BENCH_CHUNK 1436          // One TCP segment, as AsyncTCP fills them
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Gradients, stripes, pixel noise and coloured shapes
+static void scenePixel(int x, int y, uint8_t* rgb) {
+    uint32_t hash = (uint32_t)(x * 73856093) ^ (uint32_t)(y * 19349663);
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995;
+    float noise = (float)((hash >> 16) % 9) - 4;
+    float value = 110 + 40 * sinf(x / 23.0f) * cosf(y / 31.0f) + 25 * ((x / 12 + y / 20) % 2) + noise;
+    float red = value + 50 * sinf(x / 70.0f);
+    float blue = value + 50 * cosf(y / 45.0f);
+    if ((x - 200) * (x - 200) + (y - 180) * (y - 180) < 80 * 80) {
+        red = 230 + noise;
+        value = 40 + noise;
+        blue = 60;
+    }
+    rgb[0] = (uint8_t)constrain(red, 0.0f, 255.0f);
+    rgb[1] = (uint8_t)constrain(value, 0.0f, 255.0f);
+    rgb[2] = (uint8_t)constrain(blue, 0.0f, 255.0f);
+}
+
+static std::vector<uint8_t> encodeScene(int width, int height, int v_samp, int restart) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char* out = nullptr;
+    unsigned long out_len = 0;
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, BENCH_QUALITY, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = v_samp;
+    cinfo.restart_interval = restart;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::vector<uint8_t> line(width * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int x = 0; x < width; x++) {
+            scenePixel(x, cinfo.next_scanline, &line[x * 3]);
+        }
+        JSAMPROW row = line.data();
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    std::vector<uint8_t> jpeg(out, out + out_len);
+    free(out);
+    jpeg_destroy_compress(&cinfo);
+    return jpeg;
+}
+
+// Whole-frame libjpeg decode, top-down, 3 or 1 bytes per pixel
+static bool referenceDecode(const std::vector<uint8_t>& jpeg, bool gray, std::vector<uint8_t>* pixels,
+                            int* width, int* height) {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)jpeg.data(), jpeg.size());
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    cinfo.dct_method = JDCT_ISLOW;
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    pixels->resize(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels->data() + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+// Runs one conversion in BENCH_CHUNK reads. Returns the BMP, or an empty
+// vector on failure; *peak is the writer's allocation.
+static std::vector<uint8_t> convert(const std::vector<uint8_t>& jpeg, BmpFormat format, size_t* peak) {
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    JpegDcResult result;
+    BmpWriter* writer = bmpWriterCreate(jpeg.data(), jpeg.size(), format, &result);
+    std::vector<uint8_t> bmp;
+    if (!writer) {
+        printf("  %s: %s\n", bmpFormatName(format), jpegDcResultName(result));
+        return bmp;
+    }
+    // All allocation happens in bmpWriterCreate()
+    *peak = free_before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    bmp.resize(writer->total);
+    size_t offset = 0, n;
+    while ((n = bmpWriterRead(writer, bmp.data() + offset, min((size_t)BENCH_CHUNK, bmp.size() - offset))) > 0) {
+        offset += n;
+    }
+    if (offset != bmp.size()) {
+        printf("  %s: stopped at %u of %u bytes\n", bmpFormatName(format), (unsigned)offset, (unsigned)bmp.size());
+        bmp.clear();
+    }
+    bmpWriterDestroy(writer);
+    return bmp;
+}
+
+static uint32_t le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Largest channel difference between the BMP and the reference, or -1 if
+// the headers are wrong
+static int compareToReference(const std::vector<uint8_t>& bmp, BmpFormat format, const std::vector<uint8_t>& rgb,
+                              const std::vector<uint8_t>& gray, int width, int height) {
+    static const int BITS[] = { 24, 8, 16 };
+    if (bmp.size() < 54 || bmp[0] != 'B' || bmp[1] != 'M' || le32(&bmp[2]) != bmp.size() ||
+        (int)le32(&bmp[18]) != width || (int)le32(&bmp[22]) != height || (bmp[28] | bmp[29] << 8) != BITS[format]) {
+        return -1;
+    }
+    size_t offset = le32(&bmp[10]);
+    size_t row_bytes = ((size_t)width * BITS[format] / 8 + 3) & ~(size_t)3;
+    if (offset + row_bytes * height != bmp.size()) {
+        return -1;
+    }
+
+    int worst = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* line = &bmp[offset + (height - 1 - y) * row_bytes];
+        for (int x = 0; x < width; x++) {
+            const uint8_t* ref = &rgb[((size_t)y * width + x) * 3];
+            int diff;
+            if (format == BMP_RGB24) {
+                diff = max(abs(line[x * 3] - ref[2]), max(abs(line[x * 3 + 1] - ref[1]), abs(line[x * 3 + 2] - ref[0])));
+            } else if (format == BMP_GRAY8) {
+                diff = abs(line[x] - gray[(size_t)y * width + x]);
+            } else {
+                uint16_t pixel = line[x * 2] | line[x * 2 + 1] << 8;
+                uint16_t expected = ((ref[0] & 0xF8) << 8) | ((ref[1] & 0xFC) << 3) | (ref[2] >> 3);
+                diff = pixel == expected ? 0 : 255;
+            }
+            worst = max(worst, diff);
+        }
+    }
+    return worst;
+}
+
+static void benchJpeg(const char* label, const std::vector<uint8_t>& jpeg, uint32_t iterations) {
+    std::vector<uint8_t> rgb, gray;
+    int width, height;
+    if (!referenceDecode(jpeg, false, &rgb, &width, &height) || !referenceDecode(jpeg, true, &gray, &width, &height)) {
+        printf("%-12s libjpeg cannot decode it\n", label);
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        referenceDecode(jpeg, false, &rgb, &width, &height);
+    }
+    double reference_ms = msSince(start) / iterations;
+    printf("%-12s %4dx%-4d %6.1f KB JPEG  libjpeg full frame %7.3f ms, %u KB RGB888 buffer\n",
+           label, width, height, jpeg.size() / 1024.0, reference_ms, (unsigned)(rgb.size() / 1024));
+
+    static const BmpFormat FORMATS[] = { BMP_RGB24, BMP_GRAY8, BMP_RGB565 };
+    for (BmpFormat format : FORMATS) {
+        size_t peak = 0;
+        std::vector<uint8_t> bmp = convert(jpeg, format, &peak);
+        if (bmp.empty()) {
+            continue;
+        }
+        int error = compareToReference(bmp, format, rgb, gray, width, height);
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            convert(jpeg, format, &peak);
+        }
+        double ms = msSince(start) / iterations;
+        printf("  %-7s %7u B  peak %6.1f KB (%4.1f%% of RGB888)  %7.3f ms  %6.1f MB/s  max error %s%d\n",
+               bmpFormatName(format), (unsigned)bmp.size(), peak / 1024.0, 100.0 * peak / rgb.size(), ms,
+               bmp.size() / ms / 1000.0, error < 0 ? "bad header " : "", max(error, 0));
+    }
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data->insert(data->end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50;
+    printf("%u iterations per conversion, reads of %d bytes\n", (unsigned)iterations, BENCH_CHUNK);
+
+    static const struct { const char* label; int width; int height; int v_samp; int restart; } SCENES[] = {
+        { "VGA 4:2:2", 640, 480, 1, 0 },
+        { "SVGA 4:2:2", 800, 600, 1, 0 },
+        { "VGA 4:2:0", 640, 480, 2, 0 },
+        { "VGA RST 7", 642, 478, 1, 7 }     // Partial MCUs and restart markers
+    };
+    for (const auto& scene : SCENES) {
+        benchJpeg(scene.label, encodeScene(scene.width, scene.height, scene.v_samp, scene.restart), iterations);
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::vector<uint8_t> jpeg;
+        if (!readFile(argv[i], &jpeg)) {
+            printf("%s: cannot read\n", argv[i]);
+            continue;
+        }
+        benchJpeg(argv[i], jpeg, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Hot-path cost of the /metrics registry on the host build.
+//
+// Times metricAdd() and metricObserve() against an unsynchronised increment
+// (the floor) and a mutex-guarded increment (what the registry avoids), on
+// one task and on two tasks pinned to different simulated cores.
+//
+//   pio run -e native-bench && .pio/build/native-bench/program [iterations]
+
+#include <Arduino.h>
+#include <chrono>
+#include <mutex>
+#include "metrics.h"
+
+// Linked with the whole firmware (renderMetrics() reads app state), but
+// setup() never runs
+char** host_argv = nullptr;
+
+static volatile uint32_t plain_counter;
+static std::mutex counter_lock;
+static uint32_t locked_counter;
+
+enum BenchOp { OP_PLAIN, OP_MUTEX, OP_COUNTER, OP_HISTOGRAM };
+
+static MetricCounter bench_counter;
+
+static void runOp(BenchOp op, uint32_t iterations) {
+    switch (op) {
+        case OP_PLAIN:
+            for (uint32_t i = 0; i < iterations; i++) {
+                plain_counter = plain_counter + 1;
+            }
+            break;
+        case OP_MUTEX:
+            for (uint32_t i = 0; i < iterations; i++) {
+                std::lock_guard<std::mutex> guard(counter_lock);
+                locked_counter++;
+            }
+            break;
+        case OP_COUNTER:
+            for (uint32_t i = 0; i < iterations; i++) {
+                metricAdd(bench_counter);
+            }
+            break;
+        case OP_HISTOGRAM:
+            // Spread values over every bucket, like real capture latencies
+            for (uint32_t i = 0; i < iterations; i++) {
+                metricObserve(metric_capture_latency, (i * 7919) % 1200000);
+            }
+            break;
+    }
+}
+
+struct BenchArgs {
+    BenchOp op;
+    uint32_t iterations;
+    SemaphoreHandle_t done;
+};
+
+// Workers are FreeRTOS tasks pinned to different cores so metricsCore()
+// picks distinct slots, as on the device
+static void benchTask(void* parameter) {
+    BenchArgs* args = (BenchArgs*)parameter;
+    runOp(args->op, args->iterations);
+    xSemaphoreGive(args->done);
+    vTaskDelete(NULL);
+}
+
+static double nsPerOp(BenchOp op, uint32_t iterations, int tasks) {
+    BenchArgs args = { op, iterations, xSemaphoreCreateCounting(tasks, 0) };
+    auto start = std::chrono::steady_clock::now();
+    for (int core = 0; core < tasks; core++) {
+        xTaskCreatePinnedToCore(benchTask, "bench", 4096, &args, 1, NULL, core);
+    }
+    for (int t = 0; t < tasks; t++) {
+        xSemaphoreTake(args.done, portMAX_DELAY);
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    vSemaphoreDelete(args.done);
+    return elapsed / ((double)iterations * tasks);
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000000;
+    const char* names[] = { "plain increment", "mutex increment", "metricAdd", "metricObserve" };
+
+    printf("%u iterations per task\n", (unsigned)iterations);
+    printf("%-18s %12s %12s\n", "operation", "1 task", "2 tasks");
+    for (int op = OP_PLAIN; op <= OP_HISTOGRAM; op++) {
+        double one = nsPerOp((BenchOp)op, iterations, 1);
+        double two = nsPerOp((BenchOp)op, iterations, 2);
+        printf("%-18s %9.2f ns %9.2f ns\n", names[op], one, two);
+    }
+
+    // Sanity: no updates lost under concurrency
+    uint64_t expected = (uint64_t)iterations * 3;
+    uint64_t counted = metricValue(bench_counter);
+    printf("metricAdd total %llu of %llu expected\n", (unsigned long long)counted, (unsigned long long)expected);
+    return counted == expected ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+// Motion detection cost per frame on the host build.
+//
+// Encodes a textured scene with a moving object at VGA and SVGA as baseline
+// 4:2:2 JPEGs, the layout the OV2640 produces, with real AC coefficients at
+// about the OV2640's quality 12. Then times the DC-only decode on its own
+// and the whole analysis (decode, compare, background update) through
+// analyzeMotionFrame(). JPEG files given after the iteration count are
+// timed too, e.g. frames saved from /capture.
+//
+//   pio run -e native-motion-bench && .pio/build/native-motion-bench/program [iterations] [file.jpg...]
+
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include <vector>
+#include "app.h"
+#include "jpeg_dc.h"
+#include "motion_detect.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define BENCH_FRAMES 8
+#define BENCH_QUALITY 80          // libjpeg scale; about the OV2640 at quality 12
+
+// ITU T.81 Annex K tables; one DC and one AC table serve all components
+static const uint8_t DC_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t AC_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t AC_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+static const uint8_t LUMA_QUANT[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+static const uint8_t CHROMA_QUANT[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
+static const uint8_t ZIGZAG[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+struct HuffCode {
+    uint16_t code;
+    uint8_t len;
+};
+
+struct BitWriter {
+    std::vector<uint8_t>& out;
+    uint32_t bits;
+    int count;
+
+    void put(uint32_t value, int len) {
+        for (int i = len - 1; i >= 0; i--) {
+            bits = (bits << 1) | ((value >> i) & 1);
+            if (++count == 8) {
+                out.push_back((uint8_t)bits);
+                if (bits == 0xFF) {
+                    out.push_back(0x00);
+                }
+                bits = count = 0;
+            }
+        }
+    }
+
+    void flush() {
+        if (count) {
+            put(0x7F, 8 - count);   // Pad with ones
+        }
+    }
+};
+
+static HuffCode dc_codes[256];
+static HuffCode ac_codes[256];
+static uint8_t luma_quant[64];
+static uint8_t chroma_quant[64];
+static float dct_cos[8][8];
+
+static void buildCodes(const uint8_t* bits, const uint8_t* values, HuffCode* out) {
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            out[values[k++]] = { code++, (uint8_t)len };
+        }
+        code <<= 1;
+    }
+}
+
+static void scaleQuant(const uint8_t* base, uint8_t* out, int quality) {
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        out[i] = (uint8_t)constrain((base[i] * scale + 50) / 100, 1, 255);
+    }
+}
+
+static void initEncoder() {
+    buildCodes(DC_BITS, DC_VALUES, dc_codes);
+    buildCodes(AC_BITS, AC_VALUES, ac_codes);
+    scaleQuant(LUMA_QUANT, luma_quant, BENCH_QUALITY);
+    scaleQuant(CHROMA_QUANT, chroma_quant, BENCH_QUALITY);
+    for (int u = 0; u < 8; u++) {
+        for (int x = 0; x < 8; x++) {
+            dct_cos[u][x] = (u ? 0.5f : 0.5f / sqrtf(2.0f)) * cosf((2 * x + 1) * u * (float)M_PI / 16);
+        }
+    }
+}
+
+static int magnitudeBits(int value) {
+    int size = 0;
+    for (int v = value < 0 ? -value : value; v; v >>= 1) {
+        size++;
+    }
+    return size;
+}
+
+static void putCoefficient(BitWriter& bits, int value, int size) {
+    bits.put(value < 0 ? value + (1 << size) - 1 : value, size);
+}
+
+// Forward DCT, quantization and entropy coding of one 8x8 block (pixels in
+// natural order, level-shifted)
+static void encodeBlock(BitWriter& bits, const float* block, const uint8_t* quant, int* predictor) {
+    float rows[64];
+    int coef[64];
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int x = 0; x < 8; x++) {
+                sum += dct_cos[u][x] * block[y * 8 + x];
+            }
+            rows[y * 8 + u] = sum;
+        }
+    }
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int y = 0; y < 8; y++) {
+                sum += dct_cos[v][y] * rows[y * 8 + u];
+            }
+            coef[v * 8 + u] = (int)lroundf(sum / quant[v * 8 + u]);
+        }
+    }
+
+    int diff = coef[0] - *predictor;
+    *predictor = coef[0];
+    int size = magnitudeBits(diff);
+    bits.put(dc_codes[size].code, dc_codes[size].len);
+    if (size) {
+        putCoefficient(bits, diff, size);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int value = coef[ZIGZAG[k]];
+        if (!value) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            bits.put(ac_codes[0xF0].code, ac_codes[0xF0].len);
+            run -= 16;
+        }
+        size = magnitudeBits(value);
+        HuffCode code = ac_codes[(run << 4) | size];
+        bits.put(code.code, code.len);
+        putCoefficient(bits, value, size);
+        run = 0;
+    }
+    if (run) {
+        bits.put(ac_codes[0x00].code, ac_codes[0x00].len);
+    }
+}
+
+static void putSegment(std::vector<uint8_t>& out, uint8_t marker, const std::vector<uint8_t>& payload) {
+    out.push_back(0xFF);
+    out.push_back(marker);
+    out.push_back((uint8_t)((payload.size() + 2) >> 8));
+    out.push_back((uint8_t)(payload.size() + 2));
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// Textured scene: gradients, stripes, pixel noise, and a bright patterned
+// square that moves with the frame number
+static void scenePixel(int x, int y, int frame, float* luma, float* cb, float* cr) {
+    uint32_t hash = (uint32_t)(x * 73856093) ^ (uint32_t)(y * 19349663) ^ (uint32_t)(frame * 83492791);
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995;
+    float noise = (float)((hash >> 16) % 9) - 4;
+    float value = 110 + 40 * sinf(x / 23.0f) * cosf(y / 31.0f) + 25 * ((x / 12 + y / 20) % 2) + noise;
+    int size = 96;
+    int ox = (frame * 24) % 400 + 40;
+    int oy = 80 + (frame * 8) % 120;
+    if (x >= ox && x < ox + size && y >= oy && y < oy + size) {
+        value = 200 + 40 * sinf((x - ox) / 5.0f) + noise;
+    }
+    *luma = constrain(value, 0.0f, 255.0f);
+    *cb = 128 + 20 * sinf(x / 50.0f);
+    *cr = 128 + 20 * cosf(y / 40.0f);
+}
+
+static std::vector<uint8_t> encodeFrame(int width, int height, int frame) {
+    std::vector<uint8_t> out = { 0xFF, 0xD8 };
+
+    std::vector<uint8_t> dqt;
+    for (int id = 0; id < 2; id++) {
+        dqt.push_back((uint8_t)id);
+        for (int k = 0; k < 64; k++) {
+            dqt.push_back((id ? chroma_quant : luma_quant)[ZIGZAG[k]]);
+        }
+    }
+    putSegment(out, 0xDB, dqt);
+
+    std::vector<uint8_t> sof = { 8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8),
+                                 (uint8_t)width, 3, 1, 0x21, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    putSegment(out, 0xC0, sof);
+
+    std::vector<uint8_t> dht = { 0x00 };
+    dht.insert(dht.end(), DC_BITS, DC_BITS + 16);
+    dht.insert(dht.end(), DC_VALUES, DC_VALUES + sizeof(DC_VALUES));
+    dht.push_back(0x10);
+    dht.insert(dht.end(), AC_BITS, AC_BITS + 16);
+    dht.insert(dht.end(), AC_VALUES, AC_VALUES + sizeof(AC_VALUES));
+    putSegment(out, 0xC4, dht);
+
+    std::vector<uint8_t> sos = { 3, 1, 0x00, 2, 0x00, 3, 0x00, 0, 63, 0 };
+    putSegment(out, 0xDA, sos);
+
+    BitWriter bits = { out, 0, 0 };
+    int predictor[3] = { 0, 0, 0 };
+    float y_blocks[2][64], cb_block[64], cr_block[64];
+    for (int my = 0; my < (height + 7) / 8; my++) {
+        for (int mx = 0; mx < (width + 15) / 16; mx++) {
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 16; x += 2) {
+                    float l0, l1, cb0, cb1, cr0, cr1;
+                    int px = min(mx * 16 + x, width - 2);
+                    int py = min(my * 8 + y, height - 1);
+                    scenePixel(px, py, frame, &l0, &cb0, &cr0);
+                    scenePixel(px + 1, py, frame, &l1, &cb1, &cr1);
+                    y_blocks[x / 8][y * 8 + x % 8] = l0 - 128;
+                    y_blocks[x / 8][y * 8 + x % 8 + 1] = l1 - 128;
+                    cb_block[y * 8 + x / 2] = (cb0 + cb1) / 2 - 128;
+                    cr_block[y * 8 + x / 2] = (cr0 + cr1) / 2 - 128;
+                }
+            }
+            encodeBlock(bits, y_blocks[0], luma_quant, &predictor[0]);
+            encodeBlock(bits, y_blocks[1], luma_quant, &predictor[0]);
+            encodeBlock(bits, cb_block, chroma_quant, &predictor[1]);
+            encodeBlock(bits, cr_block, chroma_quant, &predictor[2]);
+        }
+    }
+    bits.flush();
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+    return out;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data->insert(data->end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Largest difference between a decoded block mean and the scene's
+static int blockMeanError(const JpegDcImage& image) {
+    int worst = 0;
+    for (int by = 0; by < image.height / 8; by++) {
+        for (int bx = 0; bx < image.width / 8; bx++) {
+            float sum = 0, cb, cr, value;
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 8; x++) {
+                    scenePixel(bx * 8 + x, by * 8 + y, 0, &value, &cb, &cr);
+                    sum += value;
+                }
+            }
+            int error = abs(image.luma[by * image.blocks_x + bx] - (int)lroundf(sum / 64));
+            worst = max(worst, error);
+        }
+    }
+    return worst;
+}
+
+static void benchFrames(const char* label, const std::vector<std::vector<uint8_t> >& frames,
+                        int width, int height, uint32_t iterations, bool synthetic) {
+    static JpegDcDecoder decoder;
+    static uint8_t luma[MOTION_MAX_BLOCKS];
+    JpegDcImage image = { 0, 0, 0, 0, luma, sizeof(luma) };
+
+    size_t bytes = 0;
+    for (const std::vector<uint8_t>& frame : frames) {
+        bytes += frame.size();
+    }
+    JpegDcResult result = jpegDecodeDC(&decoder, frames[0].data(), frames[0].size(), &image, 0);
+    if (result != JPEG_DC_OK) {
+        printf("%-10s decode failed: %s\n", label, jpegDcResultName(result));
+        return;
+    }
+    if (synthetic) {
+        printf("%-10s block means within %d of the source\n", label, blockMeanError(image));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        const std::vector<uint8_t>& frame = frames[i % frames.size()];
+        jpegDecodeDC(&decoder, frame.data(), frame.size(), &image, 0);
+    }
+    double decode_ms = msSince(start) / iterations;
+
+    // Whole analysis, one frame after the other as the camera task does
+    resetMotionModel();
+    camera_fb_t fb = {};
+    fb.width = width;
+    fb.height = height;
+    fb.format = PIXFORMAT_JPEG;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        const std::vector<uint8_t>& frame = frames[i % frames.size()];
+        fb.buf = (uint8_t*)frame.data();
+        fb.len = frame.size();
+        analyzeMotionFrame(&fb);
+    }
+    double analysis_ms = msSince(start) / iterations;
+
+    MotionStats stats;
+    getMotionStats(&stats);
+    printf("%-10s %4ux%-4u %3dx%-3d blocks %7.1f KB  DC decode %7.3f ms  analysis %7.3f ms  score %d.%d%%\n",
+           label, image.width, image.height, image.blocks_x, image.blocks_y,
+           bytes / 1024.0 / frames.size(), decode_ms, analysis_ms,
+           max(stats.score, 0) / 10, max(stats.score, 0) % 10);
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+
+    eventQueue = xQueueCreate(10, sizeof(Event));
+    initMotionDetect();
+    setDefaultConfiguration();
+    g_config.motion.enabled = true;
+    g_config.motion.budget_us = 1000000;   // Time every frame, no skipping
+    initEncoder();
+
+    printf("%u iterations per size\n", (unsigned)iterations);
+    static const struct { const char* label; int width; int height; } SIZES[] = {
+        { "VGA", 640, 480 },
+        { "SVGA", 800, 600 }
+    };
+    for (const auto& size : SIZES) {
+        std::vector<std::vector<uint8_t> > frames;
+        for (int i = 0; i < BENCH_FRAMES; i++) {
+            frames.push_back(encodeFrame(size.width, size.height, i));
+        }
+        benchFrames(size.label, frames, size.width, size.height, iterations, true);
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::vector<std::vector<uint8_t> > frames(1);
+        if (!readFile(argv[i], &frames[0])) {
+            printf("%s: cannot read\n", argv[i]);
+            continue;
+        }
+        JpegDcDecoder* decoder = new JpegDcDecoder();
+        uint8_t* luma = new uint8_t[MOTION_MAX_BLOCKS];
+        JpegDcImage image = { 0, 0, 0, 0, luma, MOTION_MAX_BLOCKS };
+        JpegDcResult result = jpegDecodeDC(decoder, frames[0].data(), frames[0].size(), &image, 0);
+        delete decoder;
+        delete[] luma;
+        if (result != JPEG_DC_OK) {
+            printf("%s: %s\n", argv[i], jpegDcResultName(result));
+            continue;
+        }
+        benchFrames(argv[i], frames, image.width, image.height, iterations, false);
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+// /capture?roi= and rotate= transform cost and output size on the host
+// build.
+//
+// Encodes a textured scene with libjpeg (baseline 4:2:2 like the OV2640,
+// plus 4:2:0 and odd-size variants), cuts and rotates it through
+// createRoiView(), and decodes each view with libjpeg. The view must
+// decode to the same pixels as the source region, cropped and rotated
+// after decoding: a plain crop or 180 degree rotation matches exactly, 90
+// and 270 to within the IDCT's rounding of a transposed block.
+// Reports the time per frame and the bytes saved against sending the full
+// frame, and the time of a libjpeg full decode for comparison. JPEG files
+// given after the iteration count are run too. Needs libjpeg (libjpeg-dev).
+//
+//   pio run -e native-roi-bench && .pio/build/native-roi-bench/program [iterations] [file.jpg...]
+
+#include <Arduino.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+// libjpeg's boolean is an int; Arduino.h already has a bool one
+#define boolean jpeg_boolean
+#include <jpeglib.h>
+#undef boolean
+#include "roi_view.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define BENCH_QUALITY 80          // libjpeg scale; about the OV2640 at quality 12
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Gradients, stripes, pixel noise and coloured shapes
+static void scenePixel(int x, int y, uint8_t* rgb) {
+    uint32_t hash = (uint32_t)(x * 73856093) ^ (uint32_t)(y * 19349663);
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995;
+    float noise = (float)((hash >> 16) % 9) - 4;
+    float value = 110 + 40 * sinf(x / 23.0f) * cosf(y / 31.0f) + 25 * ((x / 12 + y / 20) % 2) + noise;
+    float red = value + 50 * sinf(x / 70.0f);
+    float blue = value + 50 * cosf(y / 45.0f);
+    if ((x - 200) * (x - 200) + (y - 180) * (y - 180) < 80 * 80) {
+        red = 230 + noise;
+        value = 40 + noise;
+        blue = 60;
+    }
+    rgb[0] = (uint8_t)constrain(red, 0.0f, 255.0f);
+    rgb[1] = (uint8_t)constrain(value, 0.0f, 255.0f);
+    rgb[2] = (uint8_t)constrain(blue, 0.0f, 255.0f);
+}
+
+static std::vector<uint8_t> encodeScene(int width, int height, int v_samp) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char* out = nullptr;
+    unsigned long out_len = 0;
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, BENCH_QUALITY, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = v_samp;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::vector<uint8_t> line(width * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int x = 0; x < width; x++) {
+            scenePixel(x, cinfo.next_scanline, &line[x * 3]);
+        }
+        JSAMPROW row = line.data();
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    std::vector<uint8_t> jpeg(out, out + out_len);
+    free(out);
+    jpeg_destroy_compress(&cinfo);
+    return jpeg;
+}
+
+// libjpeg full-size decode to RGB, top-down
+static bool decode(const uint8_t* jpeg, size_t len, std::vector<uint8_t>* pixels, int* width, int* height) {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)jpeg, len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_ISLOW;
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    size_t stride = (size_t)cinfo.output_width * 3;
+    pixels->resize(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels->data() + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+// Largest channel difference between the view and the source region it
+// claims to show, rotated
+static int compareView(const std::vector<uint8_t>& source, int source_width, const RoiView& view,
+                       const std::vector<uint8_t>& decoded) {
+    const JpegRect& r = view.applied;
+    int diff = 0;
+    for (int y = 0; y < view.height; y++) {
+        for (int x = 0; x < view.width; x++) {
+            int sx = x, sy = y;
+            if (view.spec.rotate == 90) {
+                sx = y;
+                sy = r.height - 1 - x;
+            } else if (view.spec.rotate == 180) {
+                sx = r.width - 1 - x;
+                sy = r.height - 1 - y;
+            } else if (view.spec.rotate == 270) {
+                sx = r.width - 1 - y;
+                sy = x;
+            }
+            const uint8_t* a = &decoded[((size_t)y * view.width + x) * 3];
+            const uint8_t* b = &source[((size_t)(r.y + sy) * source_width + r.x + sx) * 3];
+            for (int i = 0; i < 3; i++) {
+                diff = max(diff, abs((int)a[i] - (int)b[i]));
+            }
+        }
+    }
+    return diff;
+}
+
+static void benchJpeg(const char* label, const std::vector<uint8_t>& jpeg, uint32_t iterations) {
+    std::vector<uint8_t> full;
+    int width, height;
+    if (!decode(jpeg.data(), jpeg.size(), &full, &width, &height)) {
+        printf("%-12s libjpeg cannot decode it\n", label);
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        decode(jpeg.data(), jpeg.size(), &full, &width, &height);
+    }
+    printf("%-12s %4dx%-4d %6.1f KB JPEG  libjpeg decode %7.3f ms\n", label, width, height, jpeg.size() / 1024.0,
+           msSince(start) / iterations);
+
+    const RoiSpec SPECS[] = {
+        { 0, 0, 160, 120, 0 },                            // Corner
+        { width / 4, height / 4, width / 2, height / 2, 0 },  // Centre, unaligned on odd sizes
+        { width / 4, height / 4, width / 2, height / 2, 90 },
+        { 0, 0, 0, 0, 90 },                               // Whole frame
+        { 0, 0, 0, 0, 180 },
+        { 0, 0, 0, 0, 270 },
+        { width - 100, height - 70, 0, 0, 270 },          // Partial MCUs at the bottom right
+        { width, 0, 16, 16, 0 }                           // Past the right edge: outside
+    };
+    for (const RoiSpec& spec : SPECS) {
+        char name[48];
+        snprintf(name, sizeof(name), "%d,%d,%d,%d r%d", spec.x, spec.y, spec.width, spec.height, spec.rotate);
+        JpegDcResult result;
+        RoiView* view = createRoiView(jpeg.data(), jpeg.size(), spec, &result);
+        if (!view) {
+            printf("  %-22s %s\n", name, jpegDcResultName(result));
+            continue;
+        }
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            delete createRoiView(jpeg.data(), jpeg.size(), spec, &result);
+        }
+        double ms = msSince(start) / iterations;
+
+        std::vector<uint8_t> decoded;
+        int out_width, out_height;
+        if (decode(view->data, view->length, &decoded, &out_width, &out_height) && out_width == view->width &&
+            out_height == view->height) {
+            printf("  %-22s -> %d,%d %4dx%-4d %7u B (saves %5.1f%%)  %7.3f ms  max diff %d\n", name,
+                   view->applied.x, view->applied.y, out_width, out_height, (unsigned)view->length,
+                   100.0 - 100.0 * view->length / jpeg.size(), ms, compareView(full, width, *view, decoded));
+        } else {
+            printf("  %-22s output does not decode to %dx%d\n", name, view->width, view->height);
+        }
+        delete view;
+    }
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data->insert(data->end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50;
+    printf("%u iterations per transform\n", (unsigned)iterations);
+
+    static const struct { const char* label; int width; int height; int v_samp; } SCENES[] = {
+        { "VGA 4:2:2", 640, 480, 1 },
+        { "SVGA 4:2:2", 800, 600, 1 },
+        { "VGA 4:2:0", 640, 480, 2 },
+        { "642x478", 642, 478, 1 }          // Partial MCUs at both edges
+    };
+    for (const auto& scene : SCENES) {
+        benchJpeg(scene.label, encodeScene(scene.width, scene.height, scene.v_samp), iterations);
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::vector<uint8_t> jpeg;
+        if (!readFile(argv[i], &jpeg)) {
+            printf("%s: cannot read\n", argv[i]);
+            continue;
+        }
+        benchJpeg(argv[i], jpeg, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+// /capture?scale= conversion cost and output size on the host build.
+//
+// Encodes a textured scene with libjpeg (baseline 4:2:2 like the OV2640,
+// plus 4:2:0 and odd-size variants), makes the 1/2, 1/4 and 1/8
+// thumbnails through createThumbnail(), and decodes each one with libjpeg
+// to check it is a valid JPEG of the right size. Quality is the PSNR
+// against libjpeg's own scaled decode of the source (scale_denom, same
+// IDCT), so it measures the re-encode only. Also reports the time of that
+// libjpeg scaled decode for comparison. JPEG files given after the
+// iteration count are run too. Needs libjpeg (libjpeg-dev).
+//
+//   pio run -e native-thumbnail-bench && .pio/build/native-thumbnail-bench/program [iterations] [file.jpg...]
+
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+// libjpeg's boolean is an int; Arduino.h already has a bool one
+#define boolean jpeg_boolean
+#include <jpeglib.h>
+#undef boolean
+#include "thumbnail.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define BENCH_QUALITY 80          // libjpeg scale; about the OV2640 at quality 12
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Gradients, stripes, pixel noise and coloured shapes
+static void scenePixel(int x, int y, uint8_t* rgb) {
+    uint32_t hash = (uint32_t)(x * 73856093) ^ (uint32_t)(y * 19349663);
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995;
+    float noise = (float)((hash >> 16) % 9) - 4;
+    float value = 110 + 40 * sinf(x / 23.0f) * cosf(y / 31.0f) + 25 * ((x / 12 + y / 20) % 2) + noise;
+    float red = value + 50 * sinf(x / 70.0f);
+    float blue = value + 50 * cosf(y / 45.0f);
+    if ((x - 200) * (x - 200) + (y - 180) * (y - 180) < 80 * 80) {
+        red = 230 + noise;
+        value = 40 + noise;
+        blue = 60;
+    }
+    rgb[0] = (uint8_t)constrain(red, 0.0f, 255.0f);
+    rgb[1] = (uint8_t)constrain(value, 0.0f, 255.0f);
+    rgb[2] = (uint8_t)constrain(blue, 0.0f, 255.0f);
+}
+
+static std::vector<uint8_t> encodeScene(int width, int height, int v_samp) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char* out = nullptr;
+    unsigned long out_len = 0;
+    jpeg_mem_dest(&cinfo, &out, &out_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, BENCH_QUALITY, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = v_samp;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::vector<uint8_t> line(width * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int x = 0; x < width; x++) {
+            scenePixel(x, cinfo.next_scanline, &line[x * 3]);
+        }
+        JSAMPROW row = line.data();
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    std::vector<uint8_t> jpeg(out, out + out_len);
+    free(out);
+    jpeg_destroy_compress(&cinfo);
+    return jpeg;
+}
+
+// libjpeg decode at 1/scale to RGB, top-down
+static bool decode(const uint8_t* jpeg, size_t len, int scale, std::vector<uint8_t>* pixels, int* width,
+                   int* height) {
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)jpeg, len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.dct_method = JDCT_ISLOW;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    jpeg_start_decompress(&cinfo);
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    size_t stride = (size_t)cinfo.output_width * 3;
+    pixels->resize(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = pixels->data() + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+static double psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double d = (double)a[i] - b[i];
+        sum += d * d;
+    }
+    double mse = sum / a.size();
+    return mse == 0 ? 99.0 : 10 * log10(255.0 * 255.0 / mse);
+}
+
+static void benchJpeg(const char* label, const std::vector<uint8_t>& jpeg, uint32_t iterations) {
+    std::vector<uint8_t> full;
+    int width, height;
+    if (!decode(jpeg.data(), jpeg.size(), 1, &full, &width, &height)) {
+        printf("%-12s libjpeg cannot decode it\n", label);
+        return;
+    }
+    printf("%-12s %4dx%-4d %6.1f KB JPEG\n", label, width, height, jpeg.size() / 1024.0);
+
+    for (int scale = 2; scale <= 8; scale *= 2) {
+        JpegDcResult result;
+        Thumbnail* thumbnail = createThumbnail(jpeg.data(), jpeg.size(), scale, &result);
+        if (!thumbnail) {
+            printf("  1/%d: %s\n", scale, jpegDcResultName(result));
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            delete createThumbnail(jpeg.data(), jpeg.size(), scale, &result);
+        }
+        double ms = msSince(start) / iterations;
+
+        std::vector<uint8_t> reference, decoded;
+        int ref_width, ref_height, out_width, out_height;
+        decode(jpeg.data(), jpeg.size(), scale, &reference, &ref_width, &ref_height);
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            decode(jpeg.data(), jpeg.size(), scale, &reference, &ref_width, &ref_height);
+        }
+        double reference_ms = msSince(start) / iterations;
+
+        bool ok = decode(thumbnail->data, thumbnail->length, 1, &decoded, &out_width, &out_height) &&
+                  out_width == ref_width && out_height == ref_height && out_width == thumbnail->width &&
+                  out_height == thumbnail->height;
+        if (ok) {
+            printf("  1/%d %4dx%-4d %7u B (%5.1f%% of source)  %7.3f ms  libjpeg scaled decode %7.3f ms  PSNR %5.1f dB\n",
+                   scale, out_width, out_height, (unsigned)thumbnail->length, 100.0 * thumbnail->length / jpeg.size(),
+                   ms, reference_ms, psnr(decoded, reference));
+        } else {
+            printf("  1/%d %dx%d: output does not decode to %dx%d\n", scale, thumbnail->width, thumbnail->height,
+                   ref_width, ref_height);
+        }
+        delete thumbnail;
+    }
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data->insert(data->end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50;
+    printf("%u iterations per conversion\n", (unsigned)iterations);
+
+    static const struct { const char* label; int width; int height; int v_samp; } SCENES[] = {
+        { "VGA 4:2:2", 640, 480, 1 },
+        { "SVGA 4:2:2", 800, 600, 1 },
+        { "VGA 4:2:0", 640, 480, 2 },
+        { "642x478", 642, 478, 1 }          // Partial MCUs at every scale
+    };
+    for (const auto& scene : SCENES) {
+        benchJpeg(scene.label, encodeScene(scene.width, scene.height, scene.v_samp), iterations);
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::vector<uint8_t> jpeg;
+        if (!readFile(argv[i], &jpeg)) {
+            printf("%s: cannot read\n", argv[i]);
+            continue;
+        }
+        benchJpeg(argv[i], jpeg, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+// Cost of TRACE_SCOPE on the host build (built with -DENABLE_TRACE).
+//
+// Times a small function bare, with TRACE_SCOPE while no window is
+// recording (the normal state of a trace-enabled build), and while
+// recording into the rings. Without ENABLE_TRACE the macro expands to
+// nothing, so "bare" is also the cost of a normal build.
+//
+//   pio run -e native-trace-bench && .pio/build/native-trace-bench/program [iterations]
+
+#include <Arduino.h>
+#include <chrono>
+#include "trace.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+static volatile uint32_t sink;
+
+__attribute__((noinline)) static void bare(uint32_t i) {
+    sink = sink + i;
+}
+
+__attribute__((noinline)) static void traced(uint32_t i) {
+    TRACE_SCOPE("traced");
+    sink = sink + i;
+}
+
+template <typename Fn>
+static double nsPerCall(Fn fn, uint32_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        fn(i);
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / iterations;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000000;
+
+    printf("%u iterations\n", (unsigned)iterations);
+    double base = nsPerCall(bare, iterations);
+    printf("%-26s %8.2f ns\n", "bare call", base);
+
+    double idle = nsPerCall(traced, iterations);
+    printf("%-26s %8.2f ns  (%+.2f)\n", "TRACE_SCOPE, not recording", idle, idle - base);
+
+    if (!traceStart()) {
+        printf("traceStart() failed\n");
+        return 1;
+    }
+    double recording = nsPerCall(traced, iterations);
+    traceRelease();
+    printf("%-26s %8.2f ns  (%+.2f, two records)\n", "TRACE_SCOPE, recording", recording, recording - base);
+    return 0;
+}
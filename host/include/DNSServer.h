@@ -0,0 +1,14 @@
+#ifndef HOST_DNSSERVER_H
+#define HOST_DNSSERVER_H
+
+#include "WiFi.h"
+
+// The captive portal DNS is a no-op on the host
+class DNSServer {
+public:
+    bool start(uint16_t port, const String& domain, const IPAddress& ip) { return true; }
+    void stop() {}
+    void processNextRequest() {}
+};
+
+#endif // HOST_DNSSERVER_H
@@ -0,0 +1,327 @@
+#ifndef HOST_ESPASYNCWEBSERVER_H
+#define HOST_ESPASYNCWEBSERVER_H
+
+// ESPAsyncWebServer stand-in on POSIX sockets. One event-loop thread plays
+// the async_tcp task: it parses requests, runs handlers, and drives
+// responses through the same _respond()/_ack() protocol as the library,
+// with a 5744-byte send window (lwIP's TCP_SND_BUF), ACK callbacks once
+// bytes reach the kernel, and 500 ms poll callbacks. Responses written in
+// this tree therefore behave the same way here as on the device.
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include <functional>
+#include <vector>
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef enum {
+    HTTP_GET     = 0b00000001,
+    HTTP_POST    = 0b00000010,
+    HTTP_DELETE  = 0b00000100,
+    HTTP_PUT     = 0b00001000,
+    HTTP_PATCH   = 0b00010000,
+    HTTP_HEAD    = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY     = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+struct HostConnection;
+
+typedef std::function<void(void)> ArDisconnectHandler;
+typedef std::function<size_t(uint8_t*, size_t, size_t)> AwsResponseFiller;
+typedef std::function<String(const String&)> AwsTemplateProcessor;
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, const String&, size_t, uint8_t*, size_t, bool)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t)> ArBodyHandlerFunction;
+
+// Thread-safe: responses may write from any task, as with AsyncTCP
+class AsyncClient {
+public:
+    explicit AsyncClient(HostConnection* conn) : _conn(conn) {}
+
+    size_t space();
+    bool canSend() { return space() > 0; }
+    size_t add(const char* data, size_t size);
+    bool send() { return true; }
+    size_t write(const char* data, size_t size) { return add(data, size); }
+    size_t write(const char* data) { return add(data, strlen(data)); }
+    void close(bool now = false);
+    bool connected();
+    bool disconnecting();
+    void setRxTimeout(uint32_t timeout) {}
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    IPAddress localIP();
+    uint16_t localPort();
+
+private:
+    HostConnection* _conn;
+};
+
+class AsyncWebParameter {
+public:
+    AsyncWebParameter(const String& name, const String& value, bool form = false, bool file = false, size_t size = 0)
+        : _name(name), _value(value), _size(size), _isForm(form), _isFile(file) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+    size_t size() const { return _size; }
+    bool isPost() const { return _isForm; }
+    bool isFile() const { return _isFile; }
+
+private:
+    String _name;
+    String _value;
+    size_t _size;
+    bool _isForm;
+    bool _isFile;
+};
+
+class AsyncWebHeader {
+public:
+    AsyncWebHeader(const String& name, const String& value) : _name(name), _value(value) {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+    String toString() const { return _name + ": " + _value + "\r\n"; }
+
+private:
+    String _name;
+    String _value;
+};
+
+typedef enum {
+    RESPONSE_SETUP,
+    RESPONSE_HEADERS,
+    RESPONSE_CONTENT,
+    RESPONSE_WAIT_ACK,
+    RESPONSE_END,
+    RESPONSE_FAILED
+} WebResponseState;
+
+class AsyncWebServerResponse {
+protected:
+    int _code;
+    std::vector<AsyncWebHeader> _headers;
+    String _contentType;
+    size_t _contentLength;
+    bool _sendContentLength;
+    bool _chunked;
+    size_t _headLength;
+    size_t _sentLength;
+    size_t _ackedLength;
+    size_t _writtenLength;
+    WebResponseState _state;
+    const char* _responseCodeToString(int code);
+
+public:
+    AsyncWebServerResponse();
+    virtual ~AsyncWebServerResponse() {}
+    virtual void setCode(int code);
+    virtual void setContentLength(size_t len);
+    virtual void setContentType(const String& type);
+    virtual void addHeader(const String& name, const String& value);
+    virtual String _assembleHead(uint8_t version);
+    virtual bool _started() const { return _state > RESPONSE_SETUP; }
+    virtual bool _finished() const { return _state > RESPONSE_WAIT_ACK; }
+    virtual bool _failed() const { return _state == RESPONSE_FAILED; }
+    virtual bool _sourceValid() const { return false; }
+    virtual void _respond(AsyncWebServerRequest* request);
+    virtual size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time);
+};
+
+class AsyncAbstractResponse : public AsyncWebServerResponse {
+private:
+    String _head;
+
+protected:
+    AwsTemplateProcessor _callback;
+
+public:
+    AsyncAbstractResponse(AwsTemplateProcessor callback = nullptr) : _callback(callback) {}
+    void _respond(AsyncWebServerRequest* request) override;
+    size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override;
+    bool _sourceValid() const override { return false; }
+    virtual size_t _fillBuffer(uint8_t* buf, size_t maxLen) { return 0; }
+};
+
+class AsyncBasicResponse : public AsyncAbstractResponse {
+public:
+    AsyncBasicResponse(int code, const String& contentType = String(), const String& content = String());
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    String _content;
+    size_t _readLength;
+};
+
+class AsyncProgmemResponse : public AsyncAbstractResponse {
+public:
+    AsyncProgmemResponse(int code, const String& contentType, const uint8_t* content, size_t len,
+                         AwsTemplateProcessor callback = nullptr);
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    const uint8_t* _content;
+    size_t _readLength;
+};
+
+class AsyncCallbackResponse : public AsyncAbstractResponse {
+public:
+    AsyncCallbackResponse(const String& contentType, size_t len, AwsResponseFiller callback,
+                          AwsTemplateProcessor templateCallback = nullptr);
+    bool _sourceValid() const override { return !!(_content); }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    AwsResponseFiller _content;
+    size_t _filledLength;
+};
+
+class AsyncChunkedResponse : public AsyncAbstractResponse {
+public:
+    AsyncChunkedResponse(const String& contentType, AwsResponseFiller callback,
+                         AwsTemplateProcessor templateCallback = nullptr);
+    bool _sourceValid() const override { return !!(_content); }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    AwsResponseFiller _content;
+    size_t _filledLength;
+};
+
+class AsyncWebServerRequest {
+    friend bool hostDispatchRequest(AsyncWebServer* server, HostConnection* conn);
+
+public:
+    void* _tempObject;
+
+    AsyncWebServerRequest(AsyncWebServer* server, AsyncClient* client);
+    ~AsyncWebServerRequest();
+
+    AsyncClient* client() { return _client; }
+    uint8_t version() const { return _version; }
+    WebRequestMethodComposite method() const { return _method; }
+    const String& url() const { return _url; }
+    const String& host() const { return _host; }
+    const String& contentType() const { return _contentType; }
+    size_t contentLength() const { return _contentLength; }
+    const char* methodToString() const;
+
+    void onDisconnect(ArDisconnectHandler fn) { _onDisconnectfn = fn; }
+
+    void redirect(const String& url);
+
+    void send(AsyncWebServerResponse* response);
+    void send(int code, const String& contentType = String(), const String& content = String());
+    void send(const String& contentType, size_t len, AwsResponseFiller callback,
+              AwsTemplateProcessor templateCallback = nullptr);
+    void sendChunked(const String& contentType, AwsResponseFiller callback,
+                     AwsTemplateProcessor templateCallback = nullptr);
+
+    AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(),
+                                          const String& content = String());
+    AsyncWebServerResponse* beginResponse(int code, const String& contentType, const uint8_t* content,
+                                          size_t len, AwsTemplateProcessor callback = nullptr);
+    AsyncWebServerResponse* beginResponse(const String& contentType, size_t len, AwsResponseFiller callback,
+                                          AwsTemplateProcessor templateCallback = nullptr);
+    AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller callback,
+                                                 AwsTemplateProcessor templateCallback = nullptr);
+
+    size_t headers() const { return _headers.size(); }
+    bool hasHeader(const String& name) const;
+    AsyncWebHeader* getHeader(const String& name) const;
+    AsyncWebHeader* getHeader(size_t num) const;
+    const String& header(const char* name) const;
+
+    size_t params() const { return _params.size(); }
+    bool hasParam(const String& name, bool post = false, bool file = false) const;
+    AsyncWebParameter* getParam(const String& name, bool post = false, bool file = false) const;
+    AsyncWebParameter* getParam(size_t num) const;
+
+    size_t args() const { return params(); }
+    const String& arg(const String& name) const;
+    const String& arg(size_t i) const;
+    const String& argName(size_t i) const;
+    bool hasArg(const char* name) const;
+
+    // Host internals
+    void _onAck(size_t len, uint32_t time);
+    void _onPoll();
+    void _onDisconnect();
+    bool _responseFinished() const { return _response && _response->_finished(); }
+
+private:
+    void _addParams(const String& params, bool post);
+
+    AsyncWebServer* _server;
+    AsyncClient* _client;
+    AsyncWebServerResponse* _response;
+    ArDisconnectHandler _onDisconnectfn;
+
+    String _url;
+    String _host;
+    String _contentType;
+    uint8_t _version;
+    WebRequestMethodComposite _method;
+    size_t _contentLength;
+
+    mutable std::vector<AsyncWebHeader> _headers;
+    mutable std::vector<AsyncWebParameter> _params;
+};
+
+class AsyncCallbackWebHandler {
+public:
+    AsyncCallbackWebHandler() : _method(HTTP_ANY) {}
+    void setUri(const String& uri) { _uri = uri; }
+    void setMethod(WebRequestMethodComposite method) { _method = method; }
+    void onRequest(ArRequestHandlerFunction fn) { _onRequest = fn; }
+    void onUpload(ArUploadHandlerFunction fn) { _onUpload = fn; }
+    void onBody(ArBodyHandlerFunction fn) { _onBody = fn; }
+
+    bool canHandle(AsyncWebServerRequest* request) const;
+    void handleRequest(AsyncWebServerRequest* request);
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+
+private:
+    String _uri;
+    WebRequestMethodComposite _method;
+    ArRequestHandlerFunction _onRequest;
+    ArUploadHandlerFunction _onUpload;
+    ArBodyHandlerFunction _onBody;
+};
+
+// Listens on $HOST_HTTP_PORT when set, and on 8080 instead of 80 (which
+// needs root on Linux)
+class AsyncWebServer {
+public:
+    explicit AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+
+    void begin();
+    void end();
+
+    AsyncCallbackWebHandler& on(const char* uri, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody = nullptr);
+    void onNotFound(ArRequestHandlerFunction fn) { _catchAll.onRequest(fn); }
+    void reset();
+
+    // Host internals
+    AsyncCallbackWebHandler* _findHandler(AsyncWebServerRequest* request);
+    uint16_t _port() const { return _listenPort; }
+
+private:
+    uint16_t _listenPort;
+    std::vector<AsyncCallbackWebHandler*> _handlers;
+    AsyncCallbackWebHandler _catchAll;
+};
+
+#endif // HOST_ESPASYNCWEBSERVER_H
@@ -0,0 +1,42 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include "Arduino.h"
+#include <memory>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+struct HostFile;
+
+// Wraps a stdio FILE*; copies share the handle like fs::File does
+class File : public Stream {
+public:
+    File() {}
+    explicit File(std::shared_ptr<HostFile> impl) : _impl(impl) {}
+
+    operator bool() const;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t* buffer, size_t size);
+    bool seek(uint32_t pos);
+    size_t position() const;
+    size_t size() const;
+    void flush();
+    void close();
+    const char* name() const;
+
+private:
+    std::shared_ptr<HostFile> _impl;
+};
+
+namespace fs {
+typedef ::File File;
+}
+
+#endif // HOST_FS_H
@@ -0,0 +1,26 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include "Arduino.h"
+
+class IPAddress : public Printable {
+public:
+    IPAddress() : _addr{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr{a, b, c, d} {}
+    explicit IPAddress(uint32_t addr);
+
+    uint8_t operator[](int index) const { return _addr[index]; }
+    uint8_t& operator[](int index) { return _addr[index]; }
+    bool operator==(const IPAddress& other) const { return memcmp(_addr, other._addr, 4) == 0; }
+    bool operator!=(const IPAddress& other) const { return !(*this == other); }
+
+    String toString() const;
+    bool fromString(const char* address);
+    bool fromString(const String& address) { return fromString(address.c_str()); }
+    size_t printTo(Print& p) const override;
+
+private:
+    uint8_t _addr[4];
+};
+
+#endif // HOST_IPADDRESS_H
@@ -0,0 +1,44 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include "Arduino.h"
+#include <map>
+#include <vector>
+
+// NVS namespace persisted to $HOST_DATA_DIR/nvs/<namespace>.bin. The whole
+// namespace is rewritten on every put, which is fine at NVS write rates.
+class Preferences {
+public:
+    bool begin(const char* name, bool read_only = false, const char* partition = nullptr);
+    void end();
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+    size_t freeEntries();
+
+    size_t putString(const char* key, const String& value);
+    size_t putString(const char* key, const char* value);
+    String getString(const char* key, const String& default_value = String());
+
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buf, size_t max_len);
+
+    size_t putUInt(const char* key, uint32_t value);
+    uint32_t getUInt(const char* key, uint32_t default_value = 0);
+    size_t putInt(const char* key, int32_t value);
+    int32_t getInt(const char* key, int32_t default_value = 0);
+    size_t putBool(const char* key, bool value);
+    bool getBool(const char* key, bool default_value = false);
+
+private:
+    bool load();
+    bool save();
+
+    std::string _path;
+    bool _started = false;
+    bool _read_only = false;
+    std::map<std::string, std::vector<uint8_t> > _entries;
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,41 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include "FS.h"
+
+typedef enum {
+    CARD_NONE,
+    CARD_MMC,
+    CARD_SD,
+    CARD_SDHC,
+    CARD_UNKNOWN
+} sdcard_type_t;
+
+// SD card rooted at $HOST_DATA_DIR/sd (default ./host_data/sd)
+class SDFS {
+public:
+    bool begin(uint8_t ss_pin = 5);
+    void end();
+    sdcard_type_t cardType();
+    uint64_t cardSize();
+    uint64_t totalBytes();
+    uint64_t usedBytes();
+
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    File open(const char* path, const char* mode = FILE_READ);
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+    bool rmdir(const char* path);
+
+private:
+    bool _mounted = false;
+};
+
+extern SDFS SD;
+
+#endif // HOST_SD_H
@@ -0,0 +1,60 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF,
+    WIFI_STA,
+    WIFI_AP,
+    WIFI_AP_STA
+} wifi_mode_t;
+
+// Any station join succeeds immediately; the host's loopback address
+// stands in for the DHCP lease
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t mode) { _mode = mode; return true; }
+    wifi_mode_t getMode() { return _mode; }
+    wl_status_t begin(const char* ssid, const char* password = nullptr);
+    bool config(IPAddress ip, IPAddress gateway, IPAddress subnet,
+                IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifi_off = false);
+    bool reconnect();
+    bool setSleep(bool enable) { return true; }
+    wl_status_t status() { return _status; }
+    bool isConnected() { return _status == WL_CONNECTED; }
+    IPAddress localIP() { return _ip; }
+    String SSID() { return _ssid; }
+    int8_t RSSI() { return _status == WL_CONNECTED ? -55 : 0; }
+    String macAddress() { return "02:00:00:00:00:01"; }
+
+    bool softAPConfig(IPAddress ip, IPAddress gateway, IPAddress subnet);
+    bool softAP(const char* ssid, const char* password = nullptr);
+    bool softAPdisconnect(bool wifi_off = false);
+    IPAddress softAPIP() { return _ap_ip; }
+    uint8_t softAPgetStationNum() { return 0; }
+
+    int16_t scanNetworks() { return 0; }
+
+private:
+    wifi_mode_t _mode = WIFI_STA;
+    wl_status_t _status = WL_DISCONNECTED;
+    IPAddress _ip;
+    IPAddress _ap_ip;
+    String _ssid;
+};
+
+extern WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
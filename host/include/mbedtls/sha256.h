@@ -0,0 +1,6 @@
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+// Included by the firmware but not called; nothing to stand in for yet
+
+#endif // HOST_MBEDTLS_SHA256_H
@@ -0,0 +1,262 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+SPIClass SPI;
+
+static const std::chrono::steady_clock::time_point boot_time = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - boot_time).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - boot_time).count();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+void configTzTime(const char* tz, const char* server1, const char* server2, const char* server3) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+static std::mutex random_lock;
+static std::mt19937 random_engine(12345);
+
+long random(long max) {
+    return random(0, max);
+}
+
+long random(long min, long max) {
+    if (max <= min) {
+        return min;
+    }
+    std::lock_guard<std::mutex> guard(random_lock);
+    return min + (long)(random_engine() % (unsigned long)(max - min));
+}
+
+void randomSeed(unsigned long seed) {
+    std::lock_guard<std::mutex> guard(random_lock);
+    random_engine.seed(seed);
+}
+
+// GPIO levels are only recorded (the camera stand-in reads PWDN); pins
+// nothing has driven read as pulled up. LEDC has nothing attached.
+#define HOST_GPIO_COUNT 40
+
+static volatile uint8_t gpio_driven[HOST_GPIO_COUNT];
+static volatile uint8_t gpio_levels[HOST_GPIO_COUNT];
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin < HOST_GPIO_COUNT) {
+        gpio_levels[pin] = val ? HIGH : LOW;
+        gpio_driven[pin] = 1;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < HOST_GPIO_COUNT && gpio_driven[pin] ? gpio_levels[pin] : HIGH;
+}
+
+double ledcSetup(uint8_t channel, double freq, uint8_t resolution_bits) { return freq; }
+void ledcAttachPin(uint8_t pin, uint8_t channel) {}
+void ledcWrite(uint8_t channel, uint32_t duty) {}
+
+bool psramFound() {
+    return true;
+}
+
+// String
+
+void String::fromInteger(long long value, unsigned char base) {
+    if (value < 0 && base == DEC) {
+        fromInteger((unsigned long long)(-value), base);
+        _s.insert(_s.begin(), '-');
+    } else {
+        fromInteger((unsigned long long)value, base);
+    }
+}
+
+void String::fromInteger(unsigned long long value, unsigned char base) {
+    char buf[66];
+    char* p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    if (base < 2 || base > 36) {
+        base = DEC;
+    }
+    do {
+        int digit = (int)(value % base);
+        *--p = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value);
+    _s = p;
+}
+
+void String::fromDouble(double value, unsigned int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+    _s = buf;
+}
+
+bool String::equalsIgnoreCase(const String& s) const {
+    if (_s.size() != s._s.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < _s.size(); i++) {
+        if (tolower((unsigned char)_s[i]) != tolower((unsigned char)s._s[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return _s.size() >= suffix._s.size() &&
+           _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+        std::swap(from, to);
+    }
+    if (from >= _s.size()) {
+        return String();
+    }
+    return String(_s.substr(from, std::min((size_t)to, _s.size()) - from));
+}
+
+void String::toLowerCase() {
+    for (size_t i = 0; i < _s.size(); i++) {
+        _s[i] = (char)tolower((unsigned char)_s[i]);
+    }
+}
+
+void String::toUpperCase() {
+    for (size_t i = 0; i < _s.size(); i++) {
+        _s[i] = (char)toupper((unsigned char)_s[i]);
+    }
+}
+
+void String::trim() {
+    size_t begin = 0;
+    while (begin < _s.size() && isspace((unsigned char)_s[begin])) {
+        begin++;
+    }
+    size_t end = _s.size();
+    while (end > begin && isspace((unsigned char)_s[end - 1])) {
+        end--;
+    }
+    _s = _s.substr(begin, end - begin);
+}
+
+void String::replace(const String& find, const String& replacement) {
+    if (find._s.empty()) {
+        return;
+    }
+    size_t pos = 0;
+    while ((pos = _s.find(find._s, pos)) != std::string::npos) {
+        _s.replace(pos, find._s.size(), replacement._s);
+        pos += replacement._s.size();
+    }
+}
+
+// Print
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char small[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(small)) {
+        return write((const uint8_t*)small, len);
+    }
+
+    std::string large(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&large[0], large.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)large.data(), len);
+}
+
+// Serial
+
+static std::mutex serial_lock;
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    std::lock_guard<std::mutex> guard(serial_lock);
+    size_t n = fwrite(buffer, 1, size, stdout);
+    fflush(stdout);
+    return n;
+}
+
+void HardwareSerial::flush() {
+    fflush(stdout);
+}
+
+// IPAddress
+
+IPAddress::IPAddress(uint32_t addr) {
+    memcpy(_addr, &addr, 4);
+}
+
+String IPAddress::toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr[0], _addr[1], _addr[2], _addr[3]);
+    return String(buf);
+}
+
+bool IPAddress::fromString(const char* address) {
+    unsigned int a, b, c, d;
+    char tail;
+    if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 ||
+        a > 255 || b > 255 || c > 255 || d > 255) {
+        return false;
+    }
+    _addr[0] = a;
+    _addr[1] = b;
+    _addr[2] = c;
+    _addr[3] = d;
+    return true;
+}
+
+size_t IPAddress::printTo(Print& p) const {
+    return p.print(toString());
+}
@@ -0,0 +1,942 @@
+#include <ESPAsyncWebServer.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+#include "host.h"
+
+// lwIP defaults on the ESP32: the send window AsyncClient::space() reports,
+// and the async_tcp poll interval
+#define HOST_TCP_SND_BUF   5744
+#define HOST_POLL_MS       500
+#define HOST_MAX_HEAD      8192
+#define HOST_MAX_BODY      (16 * 1024 * 1024)
+
+struct HostConnection {
+    int fd;
+    std::mutex lock;
+    std::string out;       // Written by the application, not yet in the kernel
+    std::string in;        // Request bytes until dispatch
+    bool dispatched;
+    bool closing;          // close() requested: flush, then close
+    bool disconnected;
+    AsyncClient client;
+    AsyncWebServerRequest* request;
+    sockaddr_in remote;
+    sockaddr_in local;
+
+    explicit HostConnection(int f)
+        : fd(f), dispatched(false), closing(false), disconnected(false), client(this), request(nullptr) {}
+};
+
+static int listen_fd = -1;
+static int wake_pipe[2] = { -1, -1 };
+static std::vector<HostConnection*> connections;
+
+static void wakeLoop() {
+    char c = 1;
+    if (write(wake_pipe[1], &c, 1) < 0) {
+        // Pipe full: the loop is already due to wake up
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AsyncClient
+
+size_t AsyncClient::space() {
+    std::lock_guard<std::mutex> guard(_conn->lock);
+    if (_conn->disconnected || _conn->closing || _conn->out.size() >= HOST_TCP_SND_BUF) {
+        return 0;
+    }
+    return HOST_TCP_SND_BUF - _conn->out.size();
+}
+
+size_t AsyncClient::add(const char* data, size_t size) {
+    size_t n;
+    {
+        std::lock_guard<std::mutex> guard(_conn->lock);
+        if (_conn->disconnected || _conn->closing || _conn->out.size() >= HOST_TCP_SND_BUF) {
+            return 0;
+        }
+        n = min(size, HOST_TCP_SND_BUF - _conn->out.size());
+        _conn->out.append(data, n);
+    }
+    wakeLoop();
+    return n;
+}
+
+void AsyncClient::close(bool now) {
+    {
+        std::lock_guard<std::mutex> guard(_conn->lock);
+        _conn->closing = true;
+    }
+    wakeLoop();
+}
+
+bool AsyncClient::connected() {
+    std::lock_guard<std::mutex> guard(_conn->lock);
+    return !_conn->disconnected;
+}
+
+bool AsyncClient::disconnecting() {
+    std::lock_guard<std::mutex> guard(_conn->lock);
+    return _conn->closing;
+}
+
+IPAddress AsyncClient::remoteIP() {
+    return IPAddress((uint32_t)_conn->remote.sin_addr.s_addr);
+}
+
+uint16_t AsyncClient::remotePort() {
+    return ntohs(_conn->remote.sin_port);
+}
+
+IPAddress AsyncClient::localIP() {
+    return IPAddress((uint32_t)_conn->local.sin_addr.s_addr);
+}
+
+uint16_t AsyncClient::localPort() {
+    return ntohs(_conn->local.sin_port);
+}
+
+// ---------------------------------------------------------------------------
+// Responses (same state machine as the library)
+
+AsyncWebServerResponse::AsyncWebServerResponse()
+    : _code(0), _contentLength(0), _sendContentLength(true), _chunked(false), _headLength(0),
+      _sentLength(0), _ackedLength(0), _writtenLength(0), _state(RESPONSE_SETUP) {}
+
+const char* AsyncWebServerResponse::_responseCodeToString(int code) {
+    switch (code) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Time-out";
+        case 409: return "Conflict";
+        case 411: return "Length Required";
+        case 413: return "Request Entity Too Large";
+        case 415: return "Unsupported Media Type";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 507: return "Insufficient Storage";
+        default:  return "";
+    }
+}
+
+void AsyncWebServerResponse::setCode(int code) {
+    if (_state == RESPONSE_SETUP) {
+        _code = code;
+    }
+}
+
+void AsyncWebServerResponse::setContentLength(size_t len) {
+    if (_state == RESPONSE_SETUP) {
+        _contentLength = len;
+    }
+}
+
+void AsyncWebServerResponse::setContentType(const String& type) {
+    if (_state == RESPONSE_SETUP) {
+        _contentType = type;
+    }
+}
+
+void AsyncWebServerResponse::addHeader(const String& name, const String& value) {
+    _headers.push_back(AsyncWebHeader(name, value));
+}
+
+String AsyncWebServerResponse::_assembleHead(uint8_t version) {
+    if (version) {
+        addHeader("Accept-Ranges", "none");
+        if (_chunked) {
+            addHeader("Transfer-Encoding", "chunked");
+        }
+    }
+
+    String out;
+    char buf[300];
+    snprintf(buf, sizeof(buf), "HTTP/1.%d %d %s\r\n", version, _code, _responseCodeToString(_code));
+    out.concat(buf);
+    if (_sendContentLength) {
+        snprintf(buf, sizeof(buf), "Content-Length: %u\r\n", (unsigned)_contentLength);
+        out.concat(buf);
+    }
+    if (_contentType.length()) {
+        snprintf(buf, sizeof(buf), "Content-Type: %s\r\n", _contentType.c_str());
+        out.concat(buf);
+    }
+    for (size_t i = 0; i < _headers.size(); i++) {
+        snprintf(buf, sizeof(buf), "%s: %s\r\n", _headers[i].name().c_str(), _headers[i].value().c_str());
+        out.concat(buf);
+    }
+    _headers.clear();
+
+    out.concat("\r\n");
+    _headLength = out.length();
+    return out;
+}
+
+void AsyncWebServerResponse::_respond(AsyncWebServerRequest* request) {
+    _state = RESPONSE_END;
+    request->client()->close();
+}
+
+size_t AsyncWebServerResponse::_ack(AsyncWebServerRequest* request, size_t len, uint32_t time) {
+    return 0;
+}
+
+void AsyncAbstractResponse::_respond(AsyncWebServerRequest* request) {
+    addHeader("Connection", "close");
+    _head = _assembleHead(request->version());
+    _state = RESPONSE_HEADERS;
+    _ack(request, 0, 0);
+}
+
+size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest* request, size_t len, uint32_t time) {
+    if (!_sourceValid()) {
+        _state = RESPONSE_FAILED;
+        request->client()->close();
+        return 0;
+    }
+    _ackedLength += len;
+    size_t space = request->client()->space();
+
+    size_t headLen = _head.length();
+    if (_state == RESPONSE_HEADERS) {
+        if (space >= headLen) {
+            _state = RESPONSE_CONTENT;
+        } else {
+            String out = _head.substring(0, space);
+            _head = _head.substring(space);
+            _writtenLength += request->client()->write(out.c_str(), out.length());
+            return out.length();
+        }
+    }
+
+    if (_state == RESPONSE_CONTENT) {
+        // The head goes out with the first body bytes, which may come on a
+        // later call if the first fill returned RESPONSE_TRY_AGAIN
+        space = space > headLen ? space - headLen : 0;
+        if (!space) {
+            return 0;
+        }
+        size_t outLen;
+        if (_chunked) {
+            if (space <= 8) {
+                return 0;
+            }
+            outLen = space;
+        } else if (!_sendContentLength) {
+            outLen = space;
+        } else {
+            outLen = (_contentLength - _sentLength) > space ? space : (_contentLength - _sentLength);
+        }
+
+        std::vector<uint8_t> buf(outLen + headLen + 1);
+        if (headLen) {
+            memcpy(buf.data(), _head.c_str(), headLen);
+        }
+
+        size_t readLen = 0;
+        if (_chunked) {
+            readLen = _fillBuffer(buf.data() + headLen + 6, outLen - 8);
+            if (readLen == RESPONSE_TRY_AGAIN) {
+                return 0;
+            }
+            outLen = sprintf((char*)buf.data() + headLen, "%x", (unsigned)readLen) + headLen;
+            while (outLen < headLen + 4) {
+                buf[outLen++] = ' ';
+            }
+            buf[outLen++] = '\r';
+            buf[outLen++] = '\n';
+            outLen += readLen;
+            buf[outLen++] = '\r';
+            buf[outLen++] = '\n';
+        } else {
+            readLen = _fillBuffer(buf.data() + headLen, outLen);
+            if (readLen == RESPONSE_TRY_AGAIN) {
+                return 0;
+            }
+            outLen = readLen + headLen;
+        }
+
+        if (headLen) {
+            _head = String();
+        }
+        if (outLen) {
+            _writtenLength += request->client()->write((const char*)buf.data(), outLen);
+        }
+
+        if (_chunked) {
+            _sentLength += readLen;
+        } else {
+            _sentLength += outLen - headLen;
+        }
+
+        if ((_chunked && readLen == 0) || (!_sendContentLength && outLen == 0) ||
+            (!_chunked && _sentLength == _contentLength)) {
+            _state = RESPONSE_WAIT_ACK;
+        }
+        return outLen;
+    } else if (_state == RESPONSE_WAIT_ACK) {
+        if (!_sendContentLength || _ackedLength >= _writtenLength) {
+            _state = RESPONSE_END;
+            if (!_chunked && !_sendContentLength) {
+                request->client()->close(true);
+            }
+        }
+    }
+    return 0;
+}
+
+AsyncBasicResponse::AsyncBasicResponse(int code, const String& contentType, const String& content)
+    : _content(content), _readLength(0) {
+    _code = code;
+    _contentType = contentType;
+    _contentLength = _content.length();
+    if (_contentLength && !_contentType.length()) {
+        _contentType = "text/plain";
+    }
+}
+
+size_t AsyncBasicResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t n = min(maxLen, (size_t)_content.length() - _readLength);
+    memcpy(buf, _content.c_str() + _readLength, n);
+    _readLength += n;
+    return n;
+}
+
+AsyncProgmemResponse::AsyncProgmemResponse(int code, const String& contentType, const uint8_t* content,
+                                           size_t len, AwsTemplateProcessor callback)
+    : AsyncAbstractResponse(callback), _content(content), _readLength(0) {
+    _code = code;
+    _contentType = contentType;
+    _contentLength = len;
+}
+
+size_t AsyncProgmemResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t n = min(maxLen, _contentLength - _readLength);
+    memcpy(buf, _content + _readLength, n);
+    _readLength += n;
+    return n;
+}
+
+AsyncCallbackResponse::AsyncCallbackResponse(const String& contentType, size_t len, AwsResponseFiller callback,
+                                             AwsTemplateProcessor templateCallback)
+    : AsyncAbstractResponse(templateCallback), _content(callback), _filledLength(0) {
+    _code = 200;
+    _contentLength = len;
+    if (!len) {
+        _sendContentLength = false;
+    }
+    _contentType = contentType;
+}
+
+size_t AsyncCallbackResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t ret = _content(buf, maxLen, _filledLength);
+    if (ret != RESPONSE_TRY_AGAIN) {
+        _filledLength += ret;
+    }
+    return ret;
+}
+
+AsyncChunkedResponse::AsyncChunkedResponse(const String& contentType, AwsResponseFiller callback,
+                                           AwsTemplateProcessor templateCallback)
+    : AsyncAbstractResponse(templateCallback), _content(callback), _filledLength(0) {
+    _code = 200;
+    _contentLength = 0;
+    _contentType = contentType;
+    _sendContentLength = false;
+    _chunked = true;
+}
+
+size_t AsyncChunkedResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t ret = _content(buf, maxLen, _filledLength);
+    if (ret != RESPONSE_TRY_AGAIN) {
+        _filledLength += ret;
+    }
+    return ret;
+}
+
+// ---------------------------------------------------------------------------
+// Requests
+
+static String urlDecode(const String& text) {
+    String decoded;
+    const char* p = text.c_str();
+    while (*p) {
+        if (*p == '%' && isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+            char hex[3] = { p[1], p[2], 0 };
+            decoded += (char)strtol(hex, nullptr, 16);
+            p += 3;
+        } else {
+            decoded += *p == '+' ? ' ' : *p;
+            p++;
+        }
+    }
+    return decoded;
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* server, AsyncClient* client)
+    : _tempObject(nullptr), _server(server), _client(client), _response(nullptr), _version(0),
+      _method(HTTP_ANY), _contentLength(0) {}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+    delete _response;
+    if (_tempObject) {
+        free(_tempObject);
+    }
+}
+
+const char* AsyncWebServerRequest::methodToString() const {
+    switch (_method) {
+        case HTTP_GET: return "GET";
+        case HTTP_POST: return "POST";
+        case HTTP_DELETE: return "DELETE";
+        case HTTP_PUT: return "PUT";
+        case HTTP_PATCH: return "PATCH";
+        case HTTP_HEAD: return "HEAD";
+        case HTTP_OPTIONS: return "OPTIONS";
+        default: return "UNKNOWN";
+    }
+}
+
+void AsyncWebServerRequest::_addParams(const String& params, bool post) {
+    size_t start = 0;
+    while (start < params.length()) {
+        int end = params.indexOf('&', start);
+        if (end < 0) {
+            end = params.length();
+        }
+        String pair = params.substring(start, end);
+        int equal = pair.indexOf('=');
+        if (equal < 0) {
+            _params.push_back(AsyncWebParameter(urlDecode(pair), String(), post));
+        } else {
+            _params.push_back(AsyncWebParameter(urlDecode(pair.substring(0, equal)),
+                                                urlDecode(pair.substring(equal + 1)), post));
+        }
+        start = end + 1;
+    }
+}
+
+void AsyncWebServerRequest::redirect(const String& url) {
+    AsyncWebServerResponse* response = beginResponse(302);
+    response->addHeader("Location", url);
+    send(response);
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+    _response = response;
+    if (!_response) {
+        _client->close(true);
+        return;
+    }
+    if (!_response->_sourceValid()) {
+        delete response;
+        _response = nullptr;
+        send(500);
+    } else {
+        _response->_respond(this);
+    }
+}
+
+void AsyncWebServerRequest::send(int code, const String& contentType, const String& content) {
+    send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(const String& contentType, size_t len, AwsResponseFiller callback,
+                                 AwsTemplateProcessor templateCallback) {
+    send(beginResponse(contentType, len, callback, templateCallback));
+}
+
+void AsyncWebServerRequest::sendChunked(const String& contentType, AwsResponseFiller callback,
+                                        AwsTemplateProcessor templateCallback) {
+    send(beginChunkedResponse(contentType, callback, templateCallback));
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType,
+                                                             const String& content) {
+    return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType,
+                                                             const uint8_t* content, size_t len,
+                                                             AwsTemplateProcessor callback) {
+    return new AsyncProgmemResponse(code, contentType, content, len, callback);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(const String& contentType, size_t len,
+                                                             AwsResponseFiller callback,
+                                                             AwsTemplateProcessor templateCallback) {
+    return new AsyncCallbackResponse(contentType, len, callback, templateCallback);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginChunkedResponse(const String& contentType,
+                                                                    AwsResponseFiller callback,
+                                                                    AwsTemplateProcessor templateCallback) {
+    return new AsyncChunkedResponse(contentType, callback, templateCallback);
+}
+
+bool AsyncWebServerRequest::hasHeader(const String& name) const {
+    return getHeader(name) != nullptr;
+}
+
+AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
+    for (size_t i = 0; i < _headers.size(); i++) {
+        if (_headers[i].name().equalsIgnoreCase(name)) {
+            return &_headers[i];
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebHeader* AsyncWebServerRequest::getHeader(size_t num) const {
+    return num < _headers.size() ? &_headers[num] : nullptr;
+}
+
+const String& AsyncWebServerRequest::header(const char* name) const {
+    static const String empty;
+    AsyncWebHeader* h = getHeader(name);
+    return h ? h->value() : empty;
+}
+
+bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
+    return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool file) const {
+    for (size_t i = 0; i < _params.size(); i++) {
+        if (_params[i].name() == name && _params[i].isPost() == post && _params[i].isFile() == file) {
+            return &_params[i];
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(size_t num) const {
+    return num < _params.size() ? &_params[num] : nullptr;
+}
+
+const String& AsyncWebServerRequest::arg(const String& name) const {
+    static const String empty;
+    for (size_t i = 0; i < _params.size(); i++) {
+        if (_params[i].name() == name) {
+            return _params[i].value();
+        }
+    }
+    return empty;
+}
+
+const String& AsyncWebServerRequest::arg(size_t i) const {
+    static const String empty;
+    return i < _params.size() ? _params[i].value() : empty;
+}
+
+const String& AsyncWebServerRequest::argName(size_t i) const {
+    static const String empty;
+    return i < _params.size() ? _params[i].name() : empty;
+}
+
+bool AsyncWebServerRequest::hasArg(const char* name) const {
+    for (size_t i = 0; i < _params.size(); i++) {
+        if (_params[i].name() == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AsyncWebServerRequest::_onAck(size_t len, uint32_t time) {
+    // The response stays alive until the request is deleted
+    if (_response && !_response->_finished()) {
+        _response->_ack(this, len, time);
+    }
+}
+
+void AsyncWebServerRequest::_onPoll() {
+    if (_response && _client->canSend() && !_response->_finished()) {
+        _response->_ack(this, 0, 0);
+    }
+}
+
+void AsyncWebServerRequest::_onDisconnect() {
+    if (_onDisconnectfn) {
+        _onDisconnectfn();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Handlers
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest* request) const {
+    if (!_onRequest || !(_method & request->method())) {
+        return false;
+    }
+    if (_uri.length() && _uri.endsWith("*")) {
+        return request->url().startsWith(_uri.substring(0, _uri.length() - 1));
+    }
+    if (_uri.length() && _uri != request->url() && !request->url().startsWith(_uri + "/")) {
+        return false;
+    }
+    return true;
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest* request) {
+    if (_onRequest) {
+        _onRequest(request);
+    } else {
+        request->send(500);
+    }
+}
+
+void AsyncCallbackWebHandler::handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len,
+                                         size_t index, size_t total) {
+    if (_onBody) {
+        _onBody(request, data, len, index, total);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Server
+
+AsyncWebServer::AsyncWebServer(uint16_t port) : _listenPort(port) {}
+
+AsyncWebServer::~AsyncWebServer() {
+    reset();
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, ArRequestHandlerFunction onRequest) {
+    return on(uri, HTTP_ANY, onRequest);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest) {
+    return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody) {
+    AsyncCallbackWebHandler* handler = new AsyncCallbackWebHandler();
+    handler->setUri(uri);
+    handler->setMethod(method);
+    handler->onRequest(onRequest);
+    handler->onUpload(onUpload);
+    handler->onBody(onBody);
+    _handlers.push_back(handler);
+    return *handler;
+}
+
+void AsyncWebServer::reset() {
+    for (size_t i = 0; i < _handlers.size(); i++) {
+        delete _handlers[i];
+    }
+    _handlers.clear();
+}
+
+AsyncCallbackWebHandler* AsyncWebServer::_findHandler(AsyncWebServerRequest* request) {
+    for (size_t i = 0; i < _handlers.size(); i++) {
+        if (_handlers[i]->canHandle(request)) {
+            return _handlers[i];
+        }
+    }
+    return _catchAll.canHandle(request) ? &_catchAll : nullptr;
+}
+
+static WebRequestMethodComposite parseMethod(const String& method) {
+    if (method == "GET") return HTTP_GET;
+    if (method == "POST") return HTTP_POST;
+    if (method == "DELETE") return HTTP_DELETE;
+    if (method == "PUT") return HTTP_PUT;
+    if (method == "PATCH") return HTTP_PATCH;
+    if (method == "HEAD") return HTTP_HEAD;
+    if (method == "OPTIONS") return HTTP_OPTIONS;
+    return 0;
+}
+
+// Returns false while the request is incomplete
+bool hostDispatchRequest(AsyncWebServer* server, HostConnection* conn) {
+    size_t head_end = conn->in.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+        if (conn->in.size() > HOST_MAX_HEAD) {
+            conn->client.close();
+        }
+        return false;
+    }
+
+    AsyncWebServerRequest* request = new AsyncWebServerRequest(server, &conn->client);
+    String head(conn->in.substr(0, head_end));
+
+    // Request line
+    int line_end = head.indexOf("\r\n");
+    String line = line_end < 0 ? head : head.substring(0, line_end);
+    int sp1 = line.indexOf(' ');
+    int sp2 = line.indexOf(' ', sp1 + 1);
+    if (sp1 < 0 || sp2 < 0) {
+        delete request;
+        conn->client.close();
+        return false;
+    }
+    request->_method = parseMethod(line.substring(0, sp1));
+    String uri = line.substring(sp1 + 1, sp2);
+    request->_version = line.substring(sp2 + 1) == "HTTP/1.1" ? 1 : 0;
+    int query = uri.indexOf('?');
+    if (query >= 0) {
+        request->_addParams(uri.substring(query + 1), false);
+        uri = uri.substring(0, query);
+    }
+    request->_url = urlDecode(uri);
+
+    // Headers
+    size_t pos = line_end < 0 ? head.length() : line_end + 2;
+    while (pos < head.length()) {
+        int end = head.indexOf("\r\n", pos);
+        if (end < 0) {
+            end = head.length();
+        }
+        String field = head.substring(pos, end);
+        int colon = field.indexOf(':');
+        if (colon > 0) {
+            String name = field.substring(0, colon);
+            String value = field.substring(colon + 1);
+            value.trim();
+            request->_headers.push_back(AsyncWebHeader(name, value));
+            if (name.equalsIgnoreCase("Host")) {
+                request->_host = value;
+            } else if (name.equalsIgnoreCase("Content-Type")) {
+                request->_contentType = value;
+            } else if (name.equalsIgnoreCase("Content-Length")) {
+                request->_contentLength = value.toInt();
+            }
+        }
+        pos = end + 2;
+    }
+
+    if (request->_contentLength > HOST_MAX_BODY) {
+        delete request;
+        conn->client.close();
+        return false;
+    }
+    size_t body_start = head_end + 4;
+    if (conn->in.size() < body_start + request->_contentLength) {
+        delete request;
+        return false;
+    }
+
+    conn->dispatched = true;
+    conn->request = request;
+    std::string body = conn->in.substr(body_start, request->_contentLength);
+    conn->in.clear();
+
+    AsyncCallbackWebHandler* handler = server->_findHandler(request);
+    if (handler && !body.empty()) {
+        if (request->_contentType.startsWith("application/x-www-form-urlencoded")) {
+            request->_addParams(String(body), true);
+        } else if (request->_contentType.startsWith("multipart/")) {
+            Serial.println("AsyncWebServer (host): multipart uploads are not supported");
+        } else {
+            handler->handleBody(request, (uint8_t*)&body[0], body.size(), 0, body.size());
+        }
+    }
+    if (handler) {
+        handler->handleRequest(request);
+    } else {
+        request->send(404);
+    }
+    return true;
+}
+
+static void destroyConnection(HostConnection* conn) {
+    if (conn->request) {
+        conn->request->_onDisconnect();
+        delete conn->request;
+    }
+    close(conn->fd);
+    delete conn;
+}
+
+// Moves queued bytes into the kernel and reports them as ACKed
+static void flushConnection(HostConnection* conn) {
+    ssize_t n;
+    {
+        std::lock_guard<std::mutex> guard(conn->lock);
+        if (conn->out.empty()) {
+            return;
+        }
+        n = send(conn->fd, conn->out.data(), conn->out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            conn->out.erase(0, n);
+        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            conn->disconnected = true;
+        }
+    }
+    if (n > 0 && conn->request) {
+        conn->request->_onAck(n, 0);
+    }
+}
+
+static void acceptConnections() {
+    for (;;) {
+        sockaddr_in remote;
+        socklen_t len = sizeof(remote);
+        int fd = accept4(listen_fd, (sockaddr*)&remote, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        // A small kernel buffer keeps backpressure close to lwIP's
+        int sndbuf = HOST_TCP_SND_BUF;
+        int nodelay = 1;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        HostConnection* conn = new HostConnection(fd);
+        conn->remote = remote;
+        len = sizeof(conn->local);
+        getsockname(fd, (sockaddr*)&conn->local, &len);
+        connections.push_back(conn);
+    }
+}
+
+static void serverLoop(AsyncWebServer* server) {
+    hostRegisterThread("async_tcp", 0, 8192 * 2);
+    unsigned long last_poll = millis();
+    std::vector<pollfd> fds;
+
+    for (;;) {
+        fds.clear();
+        pollfd wake = { wake_pipe[0], POLLIN, 0 };
+        pollfd listener = { listen_fd, POLLIN, 0 };
+        fds.push_back(wake);
+        fds.push_back(listener);
+        for (size_t i = 0; i < connections.size(); i++) {
+            pollfd p = { connections[i]->fd, POLLIN, 0 };
+            std::lock_guard<std::mutex> guard(connections[i]->lock);
+            if (!connections[i]->out.empty()) {
+                p.events |= POLLOUT;
+            }
+            fds.push_back(p);
+        }
+
+        unsigned long elapsed = millis() - last_poll;
+        int timeout = elapsed >= HOST_POLL_MS ? 0 : (int)(HOST_POLL_MS - elapsed);
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        size_t polled = fds.size() - 2;
+        for (size_t i = 0; i < polled; i++) {
+            HostConnection* conn = connections[i];
+            short revents = fds[i + 2].revents;
+
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                char buf[4096];
+                ssize_t n = recv(conn->fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    std::lock_guard<std::mutex> guard(conn->lock);
+                    conn->disconnected = true;
+                } else if (n > 0 && !conn->dispatched) {
+                    conn->in.append(buf, n);
+                    hostDispatchRequest(server, conn);
+                }
+            }
+            if (revents & POLLOUT) {
+                flushConnection(conn);
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            acceptConnections();
+        }
+
+        // async_tcp's poll callback: lets stalled responses retry
+        if (millis() - last_poll >= HOST_POLL_MS) {
+            last_poll = millis();
+            for (size_t i = 0; i < connections.size(); i++) {
+                if (connections[i]->request) {
+                    connections[i]->request->_onPoll();
+                }
+            }
+        }
+
+        for (size_t i = 0; i < connections.size();) {
+            HostConnection* conn = connections[i];
+            bool done;
+            {
+                std::lock_guard<std::mutex> guard(conn->lock);
+                bool flushed = conn->out.empty();
+                done = conn->disconnected || (flushed && conn->closing) ||
+                       (flushed && conn->request && conn->request->_responseFinished());
+            }
+            if (done) {
+                connections.erase(connections.begin() + i);
+                destroyConnection(conn);
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
+void AsyncWebServer::begin() {
+    const char* port_env = getenv("HOST_HTTP_PORT");
+    if (port_env && atoi(port_env) > 0) {
+        _listenPort = atoi(port_env);
+    } else if (_listenPort == 80) {
+        _listenPort = 8080;
+    }
+
+    if (pipe2(wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        perror("pipe2");
+        exit(1);
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(_listenPort);
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+        Serial.printf("AsyncWebServer (host): cannot listen on port %u: %s\n", _listenPort, strerror(errno));
+        exit(1);
+    }
+    Serial.printf("AsyncWebServer (host): listening on http://127.0.0.1:%u/\n", _listenPort);
+
+    std::thread(serverLoop, this).detach();
+}
+
+void AsyncWebServer::end() {
+    // The loop thread lives for the whole process
+}
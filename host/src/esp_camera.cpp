@@ -0,0 +1,666 @@
+#include <Arduino.h>
+#include <esp_camera.h>
+#include <esp_heap_caps.h>
+#include "host.h"
+#include <dirent.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {   96,   96 },
+    {  160,  120 },
+    {  176,  144 },
+    {  240,  176 },
+    {  240,  240 },
+    {  320,  240 },
+    {  400,  296 },
+    {  480,  320 },
+    {  640,  480 },
+    {  800,  600 },
+    { 1024,  768 },
+    { 1280,  720 },
+    { 1280, 1024 },
+    { 1600, 1200 },
+};
+
+struct HostFrameBuffer {
+    camera_fb_t fb;
+    bool in_use;
+};
+
+static std::mutex cam_lock;
+static std::condition_variable cam_returned;
+static bool cam_initialized = false;
+static sensor_t cam_sensor;
+static HostFrameBuffer* cam_buffers = nullptr;
+static size_t cam_fb_count = 0;
+static size_t cam_fb_size = 0;
+static int cam_pin_pwdn = -1;
+static unsigned long cam_next_frame_us = 0;
+static uint32_t cam_frame_counter = 0;
+static std::vector<std::vector<uint8_t> > cam_replay;
+
+// ---------------------------------------------------------------------------
+// Synthetic JPEG: baseline YCbCr 4:2:2 (the OV2640's layout), DC-only blocks
+// forming a gradient with a bar that moves one step per frame, padded with
+// COM segments to the size the sensor produces at this resolution/quality.
+
+static const uint8_t dc_luma_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+// AC tables only ever need EOB, coded as a single 0 bit
+static const uint8_t ac_eob_bits[16] = { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t ac_eob_values[1] = { 0x00 };
+
+struct HuffCode {
+    uint16_t code;
+    uint8_t len;
+};
+
+static void buildCodes(const uint8_t* bits, const uint8_t* values, HuffCode* out) {
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            out[values[k]].code = code++;
+            out[values[k]].len = len;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : _out(out), _acc(0), _count(0) {}
+
+    void put(uint32_t bits, int len) {
+        for (int i = len - 1; i >= 0; i--) {
+            _acc = (_acc << 1) | ((bits >> i) & 1);
+            if (++_count == 8) {
+                emit();
+            }
+        }
+    }
+
+    void flush() {
+        // Pad the last byte with 1 bits
+        while (_count) {
+            put(1, 1);
+        }
+    }
+
+private:
+    void emit() {
+        _out.push_back(_acc);
+        if (_acc == 0xFF) {
+            _out.push_back(0x00);  // Byte stuffing
+        }
+        _acc = 0;
+        _count = 0;
+    }
+
+    std::vector<uint8_t>& _out;
+    uint8_t _acc;
+    int _count;
+};
+
+static void putMarker(std::vector<uint8_t>& out, uint8_t marker, size_t payload_len) {
+    out.push_back(0xFF);
+    out.push_back(marker);
+    out.push_back((payload_len + 2) >> 8);
+    out.push_back((payload_len + 2) & 0xFF);
+}
+
+static void putHuffmanTable(std::vector<uint8_t>& out, uint8_t table_class_id,
+                            const uint8_t* bits, const uint8_t* values, size_t count) {
+    putMarker(out, 0xC4, 1 + 16 + count);
+    out.push_back(table_class_id);
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + count);
+}
+
+static void encodeDC(BitWriter& bits, const HuffCode* table, int diff) {
+    int magnitude = diff < 0 ? -diff : diff;
+    int category = 0;
+    while (magnitude) {
+        category++;
+        magnitude >>= 1;
+    }
+    bits.put(table[category].code, table[category].len);
+    if (category) {
+        int value = diff < 0 ? diff - 1 : diff;
+        bits.put(value & ((1 << category) - 1), category);
+    }
+}
+
+// Target JPEG size for the OV2640 at this size and quality (VGA q10 ~ 40 KB)
+static size_t sensorFrameBytes(size_t width, size_t height, int quality) {
+    return width * height * 8 / (5 * (quality + 2));
+}
+
+static void synthesizeFrame(std::vector<uint8_t>& out, size_t width, size_t height,
+                            int quality, int brightness, uint32_t frame) {
+    static HuffCode dc_luma[12];
+    static HuffCode dc_chroma[12];
+    static HuffCode ac_eob[1];
+    static bool tables_built = false;
+    if (!tables_built) {
+        buildCodes(dc_luma_bits, dc_values, dc_luma);
+        buildCodes(dc_chroma_bits, dc_values, dc_chroma);
+        buildCodes(ac_eob_bits, ac_eob_values, ac_eob);
+        tables_built = true;
+    }
+
+    out.clear();
+    out.push_back(0xFF);
+    out.push_back(0xD8);
+
+    // JFIF APP0
+    static const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    putMarker(out, 0xE0, sizeof(jfif));
+    out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+    // One flat table: a quantized DC of v decodes to a block mean of v + 128
+    putMarker(out, 0xDB, 65);
+    out.push_back(0x00);
+    out.insert(out.end(), 64, 8);
+
+    // SOF0: Y at 2x1, Cb and Cr at 1x1
+    putMarker(out, 0xC0, 6 + 3 * 3);
+    out.push_back(8);
+    out.push_back(height >> 8);
+    out.push_back(height & 0xFF);
+    out.push_back(width >> 8);
+    out.push_back(width & 0xFF);
+    out.push_back(3);
+    static const uint8_t components[9] = { 1, 0x21, 0, 2, 0x11, 0, 3, 0x11, 0 };
+    out.insert(out.end(), components, components + 9);
+
+    putHuffmanTable(out, 0x00, dc_luma_bits, dc_values, sizeof(dc_values));
+    putHuffmanTable(out, 0x01, dc_chroma_bits, dc_values, sizeof(dc_values));
+    putHuffmanTable(out, 0x10, ac_eob_bits, ac_eob_values, sizeof(ac_eob_values));
+
+    // SOS: Y uses tables 0/0, chroma uses DC table 1 and the same AC table
+    putMarker(out, 0xDA, 1 + 3 * 2 + 3);
+    static const uint8_t scan[10] = { 3, 1, 0x00, 2, 0x10, 3, 0x10, 0, 63, 0 };
+    out.insert(out.end(), scan, scan + 10);
+
+    size_t mcus_x = (width + 15) / 16;
+    size_t mcus_y = (height + 7) / 8;
+    size_t blocks_x = mcus_x * 2;
+    size_t bar = (frame * 2) % blocks_x;
+    int prev_y = 0, prev_cb = 0, prev_cr = 0;
+
+    BitWriter bits(out);
+    for (size_t my = 0; my < mcus_y; my++) {
+        for (size_t mx = 0; mx < mcus_x; mx++) {
+            bool in_bar = false;
+            for (int b = 0; b < 2; b++) {
+                size_t bx = mx * 2 + b;
+                int y = (int)(bx * 160 / blocks_x) + (int)(my * 60 / mcus_y) - 110 + brightness * 16;
+                if (bx == bar || bx == bar + 1) {
+                    y = 100;
+                    in_bar = true;
+                }
+                y = constrain(y, -128, 127);
+                encodeDC(bits, dc_luma, y - prev_y);
+                bits.put(ac_eob[0].code, ac_eob[0].len);
+                prev_y = y;
+            }
+
+            int cb = in_bar ? -40 : 0;
+            int cr = in_bar ? 60 : 0;
+            encodeDC(bits, dc_chroma, cb - prev_cb);
+            bits.put(ac_eob[0].code, ac_eob[0].len);
+            encodeDC(bits, dc_chroma, cr - prev_cr);
+            bits.put(ac_eob[0].code, ac_eob[0].len);
+            prev_cb = cb;
+            prev_cr = cr;
+        }
+    }
+    bits.flush();
+
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+
+    // Pad to the sensor's size with +-5% per-frame variation. COM segments
+    // go right after SOI so parsers skip them like any other marker.
+    size_t target = sensorFrameBytes(width, height, quality);
+    target = target * (95 + (frame * 7919) % 11) / 100;
+    if (out.size() < target) {
+        std::vector<uint8_t> padding;
+        size_t missing = target - out.size();
+        while (missing > 4) {
+            size_t payload = min(missing - 4, (size_t)65533);
+            putMarker(padding, 0xFE, payload);
+            for (size_t i = 0; i < payload; i++) {
+                padding.push_back((uint8_t)(i * 31 + frame));
+            }
+            missing -= payload + 4;
+        }
+        out.insert(out.begin() + 2, padding.begin(), padding.end());
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Replay source
+
+static bool hasJpegExtension(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = name.substr(dot + 1);
+    for (size_t i = 0; i < ext.size(); i++) {
+        ext[i] = tolower(ext[i]);
+    }
+    return ext == "jpg" || ext == "jpeg";
+}
+
+static void loadReplayFrames(const char* dir) {
+    cam_replay.clear();
+    DIR* d = opendir(dir);
+    if (!d) {
+        Serial.printf("Camera stand-in: cannot open HOST_CAMERA_DIR %s\n", dir);
+        return;
+    }
+
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(d)) {
+        if (hasJpegExtension(entry->d_name)) {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+
+    for (size_t i = 0; i < names.size(); i++) {
+        std::string path = std::string(dir) + "/" + names[i];
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) {
+            continue;
+        }
+        std::vector<uint8_t> data;
+        uint8_t chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            data.insert(data.end(), chunk, chunk + n);
+        }
+        fclose(f);
+        if (data.size() > 4 && data[0] == 0xFF && data[1] == 0xD8) {
+            cam_replay.push_back(data);
+        }
+    }
+    Serial.printf("Camera stand-in: replaying %u JPEG files from %s\n", (unsigned)cam_replay.size(), dir);
+}
+
+// ---------------------------------------------------------------------------
+// Sensor
+
+// Frame period the OV2640 manages at 20 MHz XCLK, overridable for tests
+static unsigned long framePeriodUs(framesize_t framesize) {
+    const char* fps = getenv("HOST_CAMERA_FPS");
+    if (fps && atoi(fps) > 0) {
+        return 1000000UL / atoi(fps);
+    }
+    if (framesize <= FRAMESIZE_CIF) {
+        return 20000;
+    }
+    if (framesize <= FRAMESIZE_SVGA) {
+        return 40000;
+    }
+    return 80000;
+}
+
+// Simulated SCCB NACK: the write this many writes from now fails, once
+static std::atomic<int> sccb_fail_after(0);
+
+void hostFailSensorWrite(int after) {
+    sccb_fail_after.store(after);
+}
+
+static bool sccbWriteFails() {
+    int after = sccb_fail_after.load();
+    while (after > 0) {
+        if (sccb_fail_after.compare_exchange_weak(after, after - 1)) {
+            return after == 1;
+        }
+    }
+    return false;
+}
+
+#define STATUS_SETTER(name, field) \
+    static int name(sensor_t* s, int value) { \
+        if (sccbWriteFails()) { \
+            return -1; \
+        } \
+        s->status.field = value; \
+        return 0; \
+    }
+
+STATUS_SETTER(setContrast, contrast)
+STATUS_SETTER(setBrightness, brightness)
+STATUS_SETTER(setSaturation, saturation)
+STATUS_SETTER(setSharpness, sharpness)
+STATUS_SETTER(setDenoise, denoise)
+STATUS_SETTER(setColorbar, colorbar)
+STATUS_SETTER(setWhitebal, awb)
+STATUS_SETTER(setGainCtrl, agc)
+STATUS_SETTER(setExposureCtrl, aec)
+STATUS_SETTER(setHmirror, hmirror)
+STATUS_SETTER(setVflip, vflip)
+STATUS_SETTER(setAec2, aec2)
+STATUS_SETTER(setAwbGain, awb_gain)
+STATUS_SETTER(setAgcGain, agc_gain)
+STATUS_SETTER(setAecValue, aec_value)
+STATUS_SETTER(setSpecialEffect, special_effect)
+STATUS_SETTER(setWbMode, wb_mode)
+STATUS_SETTER(setAeLevel, ae_level)
+STATUS_SETTER(setDcw, dcw)
+STATUS_SETTER(setBpc, bpc)
+STATUS_SETTER(setWpc, wpc)
+STATUS_SETTER(setRawGma, raw_gma)
+STATUS_SETTER(setLenc, lenc)
+
+static int setQuality(sensor_t* s, int quality) {
+    if (quality < 0 || quality > 63 || sccbWriteFails()) {
+        return -1;
+    }
+    s->status.quality = quality;
+    return 0;
+}
+
+static int setFramesize(sensor_t* s, framesize_t framesize) {
+    if (framesize < 0 || framesize >= FRAMESIZE_INVALID || sccbWriteFails()) {
+        return -1;
+    }
+    s->status.framesize = framesize;
+    return 0;
+}
+
+static int setGainceiling(sensor_t* s, gainceiling_t gainceiling) {
+    if (sccbWriteFails()) {
+        return -1;
+    }
+    s->status.gainceiling = gainceiling;
+    return 0;
+}
+
+static int setPixformat(sensor_t* s, pixformat_t pixformat) {
+    // Only JPEG frames are synthesized
+    if (pixformat != PIXFORMAT_JPEG) {
+        return -1;
+    }
+    s->pixformat = pixformat;
+    return 0;
+}
+
+static int initStatus(sensor_t* s) { return 0; }
+static int resetSensor(sensor_t* s) { return 0; }
+// Simulated auto exposure: the exposure lines and gain the OV2640 would
+// settle on to bring the scene to luma 100, and the luma it reaches
+#define HOST_AEC_TARGET 100
+#define HOST_MAX_EXPOSURE_LINES 1248
+static std::atomic<int> scene_light(400);
+
+void hostSetSceneLight(int light) {
+    scene_light.store(light);
+}
+
+static std::atomic<bool> scene_frozen(false);
+
+void hostFreezeScene(bool frozen) {
+    scene_frozen.store(frozen);
+}
+
+static int getReg(sensor_t* s, int reg, int mask) {
+    uint32_t light = std::max(scene_light.load(), 1);
+    uint32_t wanted = (uint32_t)HOST_AEC_TARGET * HOST_MAX_EXPOSURE_LINES * 16 / light;
+    uint32_t lines = std::max(std::min(wanted / 16, (uint32_t)HOST_MAX_EXPOSURE_LINES), (uint32_t)1);
+    uint32_t gain16 = std::min(std::max(wanted / lines, (uint32_t)16), (uint32_t)16 * 16);
+
+    // Gain register: bits 7..4 each double, bits 3..0 add sixteenths
+    int doublings = 0;
+    uint32_t base = gain16;
+    while (base >= 32 && doublings < 4) {
+        base /= 2;
+        doublings++;
+    }
+    int gain_reg = ((0xF0 << (4 - doublings)) & 0xF0) | (int)(base - 16);
+    uint32_t applied16 = base << doublings;
+    int yavg = (int)std::min(light * lines * applied16 / (HOST_MAX_EXPOSURE_LINES * 16), (uint32_t)255);
+
+    switch (reg) {
+        case 0x100: return gain_reg & mask;               // GAIN
+        case 0x104: return (int)(lines & 0x03) & mask;    // REG04 AEC[1:0]
+        case 0x110: return (int)((lines >> 2) & 0xFF) & mask;  // AEC[9:2]
+        case 0x12F: return yavg & mask;                   // YAVG
+        case 0x145: return (int)((lines >> 10) & 0x3F) & mask; // REG45 AEC[15:10]
+        default:    return 0;
+    }
+}
+static int setReg(sensor_t* s, int reg, int mask, int value) { return 0; }
+
+static void initSensor(const camera_config_t* config) {
+    memset(&cam_sensor, 0, sizeof(cam_sensor));
+    cam_sensor.id.PID = OV2640_PID;
+    cam_sensor.slv_addr = 0x30;
+    cam_sensor.pixformat = config->pixel_format;
+    cam_sensor.xclk_freq_hz = config->xclk_freq_hz;
+    cam_sensor.status.framesize = config->frame_size;
+    cam_sensor.status.quality = config->jpeg_quality;
+    cam_sensor.status.awb = 1;
+    cam_sensor.status.aec = 1;
+    cam_sensor.status.agc = 1;
+
+    cam_sensor.init_status = initStatus;
+    cam_sensor.reset = resetSensor;
+    cam_sensor.set_pixformat = setPixformat;
+    cam_sensor.set_framesize = setFramesize;
+    cam_sensor.set_contrast = setContrast;
+    cam_sensor.set_brightness = setBrightness;
+    cam_sensor.set_saturation = setSaturation;
+    cam_sensor.set_sharpness = setSharpness;
+    cam_sensor.set_denoise = setDenoise;
+    cam_sensor.set_gainceiling = setGainceiling;
+    cam_sensor.set_quality = setQuality;
+    cam_sensor.set_colorbar = setColorbar;
+    cam_sensor.set_whitebal = setWhitebal;
+    cam_sensor.set_gain_ctrl = setGainCtrl;
+    cam_sensor.set_exposure_ctrl = setExposureCtrl;
+    cam_sensor.set_hmirror = setHmirror;
+    cam_sensor.set_vflip = setVflip;
+    cam_sensor.set_aec2 = setAec2;
+    cam_sensor.set_awb_gain = setAwbGain;
+    cam_sensor.set_agc_gain = setAgcGain;
+    cam_sensor.set_aec_value = setAecValue;
+    cam_sensor.set_special_effect = setSpecialEffect;
+    cam_sensor.set_wb_mode = setWbMode;
+    cam_sensor.set_ae_level = setAeLevel;
+    cam_sensor.set_dcw = setDcw;
+    cam_sensor.set_bpc = setBpc;
+    cam_sensor.set_wpc = setWpc;
+    cam_sensor.set_raw_gma = setRawGma;
+    cam_sensor.set_lenc = setLenc;
+    cam_sensor.get_reg = getReg;
+    cam_sensor.set_reg = setReg;
+}
+
+// ---------------------------------------------------------------------------
+// Driver API
+
+esp_err_t esp_camera_init(const camera_config_t* config) {
+    std::lock_guard<std::mutex> guard(cam_lock);
+    if (cam_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->pixel_format != PIXFORMAT_JPEG || config->frame_size >= FRAMESIZE_INVALID ||
+        config->fb_count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Like cam_hal, JPEG buffers are sized from the init frame size; larger
+    // frames after set_framesize() overflow them
+    const resolution_info_t& res = resolution[config->frame_size];
+    cam_fb_size = (size_t)res.width * res.height / 5;
+    cam_fb_count = config->fb_count;
+    uint32_t caps = config->fb_location == CAMERA_FB_IN_DRAM ? MALLOC_CAP_INTERNAL : MALLOC_CAP_SPIRAM;
+
+    cam_buffers = new HostFrameBuffer[cam_fb_count];
+    for (size_t i = 0; i < cam_fb_count; i++) {
+        memset(&cam_buffers[i], 0, sizeof(HostFrameBuffer));
+        cam_buffers[i].fb.buf = (uint8_t*)heap_caps_malloc(cam_fb_size, caps);
+        if (!cam_buffers[i].fb.buf) {
+            for (size_t j = 0; j < i; j++) {
+                heap_caps_free(cam_buffers[j].fb.buf);
+            }
+            delete[] cam_buffers;
+            cam_buffers = nullptr;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // The driver powers the sensor up through PWDN before probing it
+    cam_pin_pwdn = config->pin_pwdn;
+    if (cam_pin_pwdn >= 0) {
+        pinMode(cam_pin_pwdn, OUTPUT);
+        digitalWrite(cam_pin_pwdn, LOW);
+    }
+    initSensor(config);
+
+    const char* replay_dir = getenv("HOST_CAMERA_DIR");
+    if (replay_dir && *replay_dir) {
+        loadReplayFrames(replay_dir);
+    }
+
+    cam_next_frame_us = micros();
+    cam_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit() {
+    std::lock_guard<std::mutex> guard(cam_lock);
+    if (!cam_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (size_t i = 0; i < cam_fb_count; i++) {
+        heap_caps_free(cam_buffers[i].fb.buf);
+    }
+    delete[] cam_buffers;
+    cam_buffers = nullptr;
+    cam_fb_count = 0;
+    cam_initialized = false;
+    cam_returned.notify_all();
+    return ESP_OK;
+}
+
+camera_fb_t* esp_camera_fb_get() {
+    std::unique_lock<std::mutex> lock(cam_lock);
+    if (!cam_initialized) {
+        return nullptr;
+    }
+
+    // Sensor in power-down: no VSYNC, the driver times out
+    if (cam_pin_pwdn >= 0 && digitalRead(cam_pin_pwdn) == HIGH) {
+        lock.unlock();
+        delay(100);
+        Serial.println("cam_hal: Failed to get the frame on time!");
+        return nullptr;
+    }
+
+    // Wait for the sensor's next frame
+    unsigned long now = micros();
+    if ((long)(cam_next_frame_us - now) > 0) {
+        unsigned long wait_us = cam_next_frame_us - now;
+        lock.unlock();
+        delayMicroseconds(wait_us);
+        lock.lock();
+        if (!cam_initialized) {
+            return nullptr;
+        }
+    }
+    unsigned long period = framePeriodUs(cam_sensor.status.framesize);
+    now = micros();
+    cam_next_frame_us = (long)(now - cam_next_frame_us) > (long)period ? now + period : cam_next_frame_us + period;
+
+    // All buffers held by the application: the DMA has nowhere to write
+    HostFrameBuffer* free_fb = nullptr;
+    cam_returned.wait_for(lock, std::chrono::seconds(4), [&free_fb] {
+        if (!cam_initialized) {
+            return true;
+        }
+        for (size_t i = 0; i < cam_fb_count; i++) {
+            if (!cam_buffers[i].in_use) {
+                free_fb = &cam_buffers[i];
+                return true;
+            }
+        }
+        return false;
+    });
+    if (!free_fb) {
+        if (cam_initialized) {
+            Serial.println("cam_hal: Failed to get the frame on time!");
+        }
+        return nullptr;
+    }
+
+    const resolution_info_t& res = resolution[cam_sensor.status.framesize];
+    static uint32_t frozen_frame = 0;
+    uint32_t frame = cam_frame_counter++;
+    if (scene_frozen.load()) {
+        frame = frozen_frame;
+    }
+    frozen_frame = frame;
+
+    std::vector<uint8_t> synthesized;
+    const std::vector<uint8_t>* jpeg;
+    if (!cam_replay.empty()) {
+        jpeg = &cam_replay[frame % cam_replay.size()];
+    } else {
+        synthesizeFrame(synthesized, res.width, res.height, cam_sensor.status.quality,
+                        cam_sensor.status.brightness, frame);
+        jpeg = &synthesized;
+    }
+
+    if (jpeg->size() > cam_fb_size) {
+        Serial.println("cam_hal: FB-OVF");
+        return nullptr;
+    }
+
+    camera_fb_t* fb = &free_fb->fb;
+    memcpy(fb->buf, jpeg->data(), jpeg->size());
+    fb->len = jpeg->size();
+    fb->width = res.width;
+    fb->height = res.height;
+    fb->format = PIXFORMAT_JPEG;
+    // cam_hal stamps frames from esp_timer, the clock behind micros()
+    unsigned long stamp = micros();
+    fb->timestamp.tv_sec = stamp / 1000000UL;
+    fb->timestamp.tv_usec = stamp % 1000000UL;
+    free_fb->in_use = true;
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t* fb) {
+    if (!fb) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(cam_lock);
+    for (size_t i = 0; i < cam_fb_count; i++) {
+        if (&cam_buffers[i].fb == fb) {
+            cam_buffers[i].in_use = false;
+            cam_returned.notify_all();
+            return;
+        }
+    }
+}
+
+sensor_t* esp_camera_sensor_get() {
+    return cam_initialized ? &cam_sensor : nullptr;
+}
@@ -0,0 +1,204 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <atomic>
+#include <random>
+#include <mutex>
+#include <unistd.h>
+#include "host.h"
+
+// Simulated ESP32 with 4 MB PSRAM. Internal heap starts with what the
+// Arduino core, WiFi and AsyncTCP leave free on the device.
+#define HOST_HEAP_SIZE        327680
+#define HOST_HEAP_BASELINE    140000
+#define HOST_PSRAM_SIZE       4194252
+
+EspClass ESP;
+
+// Size and region live in front of each block so free() can credit it back
+struct AllocHeader {
+    size_t size;
+    uint32_t spiram;
+    uint32_t magic;
+};
+
+#define ALLOC_MAGIC 0x48435053
+#define HEADER_SIZE ((sizeof(AllocHeader) + 15) & ~(size_t)15)
+
+static std::atomic<size_t> internal_used(HOST_HEAP_BASELINE);
+static std::atomic<size_t> internal_peak(HOST_HEAP_BASELINE);
+static std::atomic<size_t> psram_used(0);
+static std::atomic<size_t> psram_peak(0);
+
+// Injected by hostSetHeapPressure(): bytes held back, and a cap on the
+// largest free block to stand in for fragmentation (0 = no cap)
+static std::mutex pressure_lock;
+static size_t internal_reserved = 0;
+static size_t psram_reserved = 0;
+static std::atomic<size_t> internal_block_cap(0);
+static std::atomic<size_t> psram_block_cap(0);
+
+static void notePeak(std::atomic<size_t>& peak, size_t used) {
+    size_t seen = peak.load();
+    while (used > seen && !peak.compare_exchange_weak(seen, used)) {
+    }
+}
+
+static bool useSpiram(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) && !(caps & MALLOC_CAP_INTERNAL);
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    bool spiram = useSpiram(caps);
+    std::atomic<size_t>& used = spiram ? psram_used : internal_used;
+    size_t limit = spiram ? HOST_PSRAM_SIZE : HOST_HEAP_SIZE;
+    size_t block_cap = (spiram ? psram_block_cap : internal_block_cap).load();
+    if (block_cap && size > block_cap) {
+        return nullptr;
+    }
+
+    size_t now = used.fetch_add(size) + size;
+    if (now > limit) {
+        used.fetch_sub(size);
+        return nullptr;
+    }
+    notePeak(spiram ? psram_peak : internal_peak, now);
+
+    uint8_t* block = (uint8_t*)malloc(HEADER_SIZE + size);
+    if (!block) {
+        used.fetch_sub(size);
+        return nullptr;
+    }
+    AllocHeader* header = (AllocHeader*)block;
+    header->size = size;
+    header->spiram = spiram;
+    header->magic = ALLOC_MAGIC;
+    return block + HEADER_SIZE;
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    void* ptr = heap_caps_malloc(n * size, caps);
+    if (ptr) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    // Shrinking stays in place and gives the tail back, as on the device
+    if (ptr && size) {
+        AllocHeader* header = (AllocHeader*)((uint8_t*)ptr - HEADER_SIZE);
+        if (size <= header->size) {
+            (header->spiram ? psram_used : internal_used).fetch_sub(header->size - size);
+            header->size = size;
+            return ptr;
+        }
+    }
+    void* fresh = heap_caps_malloc(size, caps);
+    if (fresh && ptr) {
+        AllocHeader* header = (AllocHeader*)((uint8_t*)ptr - HEADER_SIZE);
+        memcpy(fresh, ptr, min(size, header->size));
+        heap_caps_free(ptr);
+    }
+    return fresh;
+}
+
+void heap_caps_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    AllocHeader* header = (AllocHeader*)((uint8_t*)ptr - HEADER_SIZE);
+    if (header->magic != ALLOC_MAGIC) {
+        Serial.printf("heap_caps_free: %p was not allocated by heap_caps_malloc\n", ptr);
+        abort();
+    }
+    header->magic = 0;
+    (header->spiram ? psram_used : internal_used).fetch_sub(header->size);
+    free(header);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    return useSpiram(caps) ? HOST_PSRAM_SIZE : HOST_HEAP_SIZE;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return useSpiram(caps) ? HOST_PSRAM_SIZE - psram_used.load() : HOST_HEAP_SIZE - internal_used.load();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return useSpiram(caps) ? HOST_PSRAM_SIZE - psram_peak.load() : HOST_HEAP_SIZE - internal_peak.load();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    size_t free_size = heap_caps_get_free_size(caps);
+    size_t cap = (useSpiram(caps) ? psram_block_cap : internal_block_cap).load();
+    return cap ? min(free_size, cap) : free_size;
+}
+
+static size_t setReserve(std::atomic<size_t>& used, std::atomic<size_t>& peak, size_t limit,
+                         size_t& reserved, size_t target_free) {
+    size_t without = used.load() - reserved;
+    size_t reserve = limit - without > target_free ? limit - without - target_free : 0;
+    used.fetch_add(reserve);
+    used.fetch_sub(reserved);
+    reserved = reserve;
+    notePeak(peak, used.load());
+    return reserve;
+}
+
+void hostSetHeapPressure(size_t internal_free, size_t internal_block, size_t psram_free, size_t psram_block) {
+    std::lock_guard<std::mutex> guard(pressure_lock);
+    setReserve(internal_used, internal_peak, HOST_HEAP_SIZE, internal_reserved,
+               internal_free ? internal_free : HOST_HEAP_SIZE);
+    setReserve(psram_used, psram_peak, HOST_PSRAM_SIZE, psram_reserved,
+               psram_free ? psram_free : HOST_PSRAM_SIZE);
+    internal_block_cap = internal_block;
+    psram_block_cap = psram_block;
+}
+
+uint32_t EspClass::getHeapSize() { return HOST_HEAP_SIZE; }
+uint32_t EspClass::getFreeHeap() { return heap_caps_get_free_size(MALLOC_CAP_INTERNAL); }
+uint32_t EspClass::getMinFreeHeap() { return heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL); }
+uint32_t EspClass::getMaxAllocHeap() { return heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL); }
+uint32_t EspClass::getPsramSize() { return HOST_PSRAM_SIZE; }
+uint32_t EspClass::getFreePsram() { return heap_caps_get_free_size(MALLOC_CAP_SPIRAM); }
+uint32_t EspClass::getMinFreePsram() { return heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM); }
+uint32_t EspClass::getMaxAllocPsram() { return heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM); }
+
+void EspClass::restart() {
+    esp_restart();
+}
+
+// Restarting re-executes the binary with the same arguments
+void esp_restart() {
+    Serial.println("Restarting host process...");
+    fflush(stdout);
+    setenv("HOST_RESET_REASON", "sw", 1);
+    if (host_argv) {
+        execv("/proc/self/exe", host_argv);
+    }
+    exit(0);
+}
+
+esp_reset_reason_t esp_reset_reason() {
+    const char* reason = getenv("HOST_RESET_REASON");
+    return reason && strcmp(reason, "sw") == 0 ? ESP_RST_SW : ESP_RST_POWERON;
+}
+
+uint32_t esp_random() {
+    static std::mutex lock;
+    static std::random_device device;
+    std::lock_guard<std::mutex> guard(lock);
+    return device();
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        default: return "UNKNOWN_ERROR";
+    }
+}
@@ -0,0 +1,411 @@
+#include <Arduino.h>
+#include <pthread.h>
+#include <time.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "host.h"
+
+// FreeRTOS primitives on std::thread / std::mutex / std::condition_variable
+// (pthreads on Linux). Scheduling is left to the host kernel.
+
+struct HostTask {
+    std::string name;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t stack_depth;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notify_value;
+    pthread_t thread;
+    bool alive;              // Thread running; guarded by tasks_lock
+
+    HostTask(const char* n, UBaseType_t prio, BaseType_t c, uint32_t stack)
+        : name(n ? n : ""), priority(prio), core(c), stack_depth(stack), notify_value(0),
+          thread(), alive(false) {}
+};
+
+struct HostSemaphore {
+    std::mutex lock;
+    std::condition_variable changed;
+    UBaseType_t count;
+    UBaseType_t max_count;
+    bool is_mutex;
+    std::thread::id owner;
+    UBaseType_t depth;       // Recursive mutex nesting
+
+    HostSemaphore(UBaseType_t max, UBaseType_t initial, bool mutex)
+        : count(initial), max_count(max), is_mutex(mutex), depth(0) {}
+};
+
+struct HostQueue {
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<std::vector<uint8_t> > items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+
+    HostQueue(UBaseType_t len, UBaseType_t size) : length(len), item_size(size) {}
+};
+
+static std::mutex tasks_lock;
+static std::vector<HostTask*> tasks;
+static thread_local HostTask* current_task = nullptr;
+
+static std::recursive_mutex critical_lock;
+
+// Waits on cv until pred holds or ticks elapse; portMAX_DELAY waits forever
+template <typename Lock, typename Pred>
+static bool waitTicks(std::condition_variable& cv, Lock& lock, TickType_t ticks, Pred pred) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, pred);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+}
+
+// Tasks
+
+// Thrown by vTaskDelete() to unwind the calling task's thread
+struct TaskDeleted {};
+
+struct TaskStart {
+    TaskFunction_t code;
+    void* params;
+    HostTask* task;
+};
+
+static void setAlive(HostTask* task, bool alive) {
+    std::lock_guard<std::mutex> guard(tasks_lock);
+    task->thread = pthread_self();
+    task->alive = alive;
+}
+
+static void runTask(TaskStart start) {
+    current_task = start.task;
+    setAlive(start.task, true);
+    try {
+        start.code(start.params);
+    } catch (const TaskDeleted&) {
+        setAlive(start.task, false);
+        return;
+    }
+    // A FreeRTOS task function must not return
+    Serial.printf("Task %s returned without vTaskDelete()\n", start.task->name.c_str());
+    abort();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth,
+                                   void* params, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core_id) {
+    HostTask* task = new HostTask(name, priority, core_id, stack_depth);
+    {
+        std::lock_guard<std::mutex> guard(tasks_lock);
+        tasks.push_back(task);
+    }
+    if (handle) {
+        *handle = task;
+    }
+
+    TaskStart start = { code, params, task };
+    std::thread(runTask, start).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth,
+                       void* params, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(code, name, stack_depth, params, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != current_task) {
+        // Killing another thread is not possible; tasks in this tree only
+        // ever delete themselves
+        Serial.println("vTaskDelete: deleting another task is not supported on the host");
+        return;
+    }
+    // The record stays in the task list; handles to it may still be held
+    throw TaskDeleted();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t increment) {
+    TickType_t wake = *previous_wake + increment;
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(wake - now) > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(wake - now));
+    }
+    *previous_wake = wake;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (!current_task) {
+        // Threads not started by xTaskCreate get a record on first use
+        hostRegisterThread("thread", 1, 0);
+    }
+    return current_task;
+}
+
+void hostRegisterThread(const char* name, int core, uint32_t stack_depth) {
+    HostTask* task = new HostTask(name, 1, core, stack_depth);
+    current_task = task;
+    std::lock_guard<std::mutex> guard(tasks_lock);
+    task->thread = pthread_self();
+    task->alive = true;
+    tasks.push_back(task);
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    if (!task) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    // Host threads have megabytes of stack; report the configured depth
+    if (!task) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->stack_depth;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+    std::lock_guard<std::mutex> guard(tasks_lock);
+    return tasks.size();
+}
+
+// Run time is the thread's CPU time, so per-task load is real; stack
+// figures are the configured depth, as in uxTaskGetStackHighWaterMark()
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* total_run_time) {
+    std::lock_guard<std::mutex> guard(tasks_lock);
+    UBaseType_t count = 0;
+    for (size_t i = 0; i < tasks.size() && count < size; i++) {
+        HostTask* task = tasks[i];
+        if (!task->alive) {
+            continue;
+        }
+        clockid_t clock;
+        timespec cpu = {};
+        if (pthread_getcpuclockid(task->thread, &clock) == 0) {
+            clock_gettime(clock, &cpu);
+        }
+
+        TaskStatus_t& entry = status[count++];
+        entry.xHandle = task;
+        entry.pcTaskName = task->name.c_str();
+        entry.xTaskNumber = i + 1;
+        entry.eCurrentState = task == current_task ? eRunning : eReady;
+        entry.uxCurrentPriority = task->priority;
+        entry.uxBasePriority = task->priority;
+        entry.ulRunTimeCounter = (uint32_t)(cpu.tv_sec * 1000000ULL + cpu.tv_nsec / 1000);
+        entry.usStackHighWaterMark = task->stack_depth;
+    }
+    if (total_run_time) {
+        *total_run_time = micros();
+    }
+    return count;
+}
+
+BaseType_t xTaskGetAffinity(TaskHandle_t task) {
+    if (!task) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->core;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu) {
+    return NULL;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (!task) {
+        return pdFAIL;
+    }
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notify_value++;
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    HostTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->lock);
+    waitTicks(task->notified, lock, ticks, [task] { return task->notify_value != 0; });
+
+    uint32_t value = task->notify_value;
+    if (value) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+// Critical sections
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    critical_lock.lock();
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    critical_lock.unlock();
+}
+
+BaseType_t xPortGetCoreID() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    return task->core == tskNO_AFFINITY ? 0 : task->core;
+}
+
+// Semaphores
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new HostSemaphore(1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    return new HostSemaphore(1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return new HostSemaphore(1, 0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    return new HostSemaphore(max_count, initial_count, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    delete sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(sem->lock);
+    if (!waitTicks(sem->changed, lock, ticks, [sem] { return sem->count > 0; })) {
+        return pdFALSE;
+    }
+    sem->count--;
+    if (sem->is_mutex) {
+        sem->owner = std::this_thread::get_id();
+    }
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    std::lock_guard<std::mutex> guard(sem->lock);
+    if (sem->count >= sem->max_count) {
+        return pdFALSE;
+    }
+    if (sem->is_mutex) {
+        sem->owner = std::thread::id();
+    }
+    sem->count++;
+    sem->changed.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(sem->lock);
+    std::thread::id self = std::this_thread::get_id();
+    if (sem->depth && sem->owner == self) {
+        sem->depth++;
+        return pdTRUE;
+    }
+    if (!waitTicks(sem->changed, lock, ticks, [sem] { return sem->count > 0; })) {
+        return pdFALSE;
+    }
+    sem->count--;
+    sem->owner = self;
+    sem->depth = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    std::lock_guard<std::mutex> guard(sem->lock);
+    if (!sem->depth || sem->owner != std::this_thread::get_id()) {
+        return pdFALSE;
+    }
+    if (--sem->depth == 0) {
+        sem->owner = std::thread::id();
+        sem->count++;
+        sem->changed.notify_one();
+    }
+    return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem) {
+    std::lock_guard<std::mutex> guard(sem->lock);
+    return sem->count;
+}
+
+// Queues
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return new HostQueue(length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void* item, TickType_t ticks, bool front) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitTicks(queue->not_full, lock, ticks, [queue] { return queue->items.size() < queue->length; })) {
+        return pdFALSE;
+    }
+    const uint8_t* bytes = (const uint8_t*)item;
+    std::vector<uint8_t> copy(bytes, bytes + queue->item_size);
+    if (front) {
+        queue->items.push_front(copy);
+    } else {
+        queue->items.push_back(copy);
+    }
+    queue->not_empty.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return queueSend(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return queueSend(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return queueSend(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitTicks(queue->not_empty, lock, ticks, [queue] { return !queue->items.empty(); })) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    queue->not_full.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitTicks(queue->not_empty, lock, ticks, [queue] { return !queue->items.empty(); })) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->items.size();
+}
@@ -0,0 +1,210 @@
+#include <Arduino.h>
+#include <SD.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include "host.h"
+
+SDFS SD;
+
+struct HostFile {
+    FILE* f;
+    std::string name;
+    size_t size;
+
+    ~HostFile() {
+        if (f) {
+            fclose(f);
+        }
+    }
+};
+
+// File
+
+File::operator bool() const {
+    return _impl && _impl->f;
+}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+    if (!*this) {
+        return 0;
+    }
+    size_t n = fwrite(buffer, 1, size, _impl->f);
+    long pos = ftell(_impl->f);
+    if (pos > 0 && (size_t)pos > _impl->size) {
+        _impl->size = pos;
+    }
+    return n;
+}
+
+int File::available() {
+    if (!*this) {
+        return 0;
+    }
+    long pos = ftell(_impl->f);
+    return pos < 0 || (size_t)pos >= _impl->size ? 0 : (int)(_impl->size - pos);
+}
+
+int File::read() {
+    if (!*this) {
+        return -1;
+    }
+    int c = fgetc(_impl->f);
+    return c == EOF ? -1 : c;
+}
+
+int File::peek() {
+    if (!*this) {
+        return -1;
+    }
+    int c = fgetc(_impl->f);
+    if (c != EOF) {
+        ungetc(c, _impl->f);
+    }
+    return c == EOF ? -1 : c;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+    return *this ? fread(buffer, 1, size, _impl->f) : 0;
+}
+
+bool File::seek(uint32_t pos) {
+    return *this && fseek(_impl->f, pos, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+    return *this ? (size_t)ftell(_impl->f) : 0;
+}
+
+size_t File::size() const {
+    return _impl ? _impl->size : 0;
+}
+
+void File::flush() {
+    if (*this) {
+        fflush(_impl->f);
+    }
+}
+
+void File::close() {
+    if (_impl && _impl->f) {
+        fclose(_impl->f);
+        _impl->f = nullptr;
+    }
+}
+
+const char* File::name() const {
+    return _impl ? _impl->name.c_str() : "";
+}
+
+// SD card
+
+static std::string sdPath(const char* path) {
+    std::string root = hostDataPath("sd");
+    return path && path[0] == '/' ? root + path : root + "/" + (path ? path : "");
+}
+
+bool SDFS::begin(uint8_t ss_pin) {
+    _mounted = hostMakeDirs(hostDataPath("sd"));
+    return _mounted;
+}
+
+void SDFS::end() {
+    _mounted = false;
+}
+
+sdcard_type_t SDFS::cardType() {
+    return _mounted ? CARD_SDHC : CARD_NONE;
+}
+
+uint64_t SDFS::cardSize() {
+    return totalBytes();
+}
+
+uint64_t SDFS::totalBytes() {
+    struct statvfs vfs;
+    if (!_mounted || statvfs(hostDataPath("sd").c_str(), &vfs) != 0) {
+        return 0;
+    }
+    return (uint64_t)vfs.f_blocks * vfs.f_frsize;
+}
+
+uint64_t SDFS::usedBytes() {
+    struct statvfs vfs;
+    if (!_mounted || statvfs(hostDataPath("sd").c_str(), &vfs) != 0) {
+        return 0;
+    }
+    return (uint64_t)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+}
+
+bool SDFS::exists(const char* path) {
+    struct stat st;
+    return _mounted && stat(sdPath(path).c_str(), &st) == 0;
+}
+
+File SDFS::open(const char* path, const char* mode) {
+    if (!_mounted) {
+        return File();
+    }
+    std::string full = sdPath(path);
+    std::string fmode = std::string(mode) + "b";
+    if (fmode[0] == 'r') {
+        fmode = "rb";
+    }
+
+    FILE* f = fopen(full.c_str(), fmode.c_str());
+    if (!f) {
+        return File();
+    }
+    std::shared_ptr<HostFile> impl(new HostFile());
+    impl->f = f;
+    impl->name = path;
+    struct stat st;
+    impl->size = fstat(fileno(f), &st) == 0 ? st.st_size : 0;
+    return File(impl);
+}
+
+bool SDFS::remove(const char* path) {
+    return _mounted && unlink(sdPath(path).c_str()) == 0;
+}
+
+bool SDFS::rename(const char* from, const char* to) {
+    return _mounted && ::rename(sdPath(from).c_str(), sdPath(to).c_str()) == 0;
+}
+
+bool SDFS::mkdir(const char* path) {
+    return _mounted && ::mkdir(sdPath(path).c_str(), 0755) == 0;
+}
+
+bool SDFS::rmdir(const char* path) {
+    return _mounted && ::rmdir(sdPath(path).c_str()) == 0;
+}
+
+// Paths
+
+std::string hostDataPath(const char* sub) {
+    const char* root = getenv("HOST_DATA_DIR");
+    std::string path = root && *root ? root : "host_data";
+    if (sub && *sub) {
+        path += "/";
+        path += sub;
+    }
+    return path;
+}
+
+bool hostMakeDirs(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+        if (pos == path.size() || path[pos] == '/') {
+            std::string dir = path.substr(0, pos);
+            if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
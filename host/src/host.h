@@ -0,0 +1,39 @@
+#ifndef HOST_INTERNAL_H
+#define HOST_INTERNAL_H
+
+#include <stdint.h>
+#include <string>
+
+// Shared by the host stand-ins; not visible to firmware code
+
+// $HOST_DATA_DIR/<sub> (default ./host_data/<sub>), created on first use
+std::string hostDataPath(const char* sub);
+
+// mkdir -p
+bool hostMakeDirs(const std::string& path);
+
+// argv of this process, for ESP.restart()
+extern char** host_argv;
+
+// Gives the calling thread (the Arduino loop, the async_tcp stand-in) the
+// task record it would have on the device
+void hostRegisterThread(const char* name, int core, uint32_t stack_depth);
+
+// Simulates memory pressure: holds back enough of each heap to leave about
+// *_free bytes free and caps the largest free block at *_block (0 clears
+// either setting). Allocations larger than the block cap fail.
+void hostSetHeapPressure(size_t internal_free, size_t internal_block, size_t psram_free, size_t psram_block);
+
+// Makes the sensor write `after` writes from now fail once, like an SCCB
+// NACK (0 clears it)
+void hostFailSensorWrite(int after);
+
+// Scene brightness behind the simulated AEC registers, as the light index
+// camera_profiles.h computes from them (0 dark, 400 at start)
+void hostSetSceneLight(int light);
+
+// Stops (true) or restarts the moving bar in synthesized frames, so
+// consecutive frames come out identical
+void hostFreezeScene(bool frozen);
+
+#endif // HOST_INTERNAL_H
@@ -0,0 +1,93 @@
+#include <Arduino.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "host.h"
+#include "web_server.h"
+
+char** host_argv = nullptr;
+
+// First run: start from host/config.json (the example config with room for
+// the 16-client benchmark rounds) so the camera comes up without going
+// through the captive portal
+static void seedConfig() {
+    std::string dir = hostDataPath("sd/config");
+    std::string path = dir + "/config.json";
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        return;
+    }
+
+    const char* example = getenv("HOST_CONFIG_EXAMPLE");
+    if (!example) {
+        example = "host/config.json";
+    }
+    FILE* in = fopen(example, "rb");
+    if (!in) {
+        return;
+    }
+    hostMakeDirs(dir);
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out) {
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            fwrite(buf, 1, n, out);
+        }
+        fclose(out);
+        printf("Host: seeded %s from %s\n", path.c_str(), example);
+    }
+    fclose(in);
+}
+
+// Host-only hook for scripts/memory_pressure_test.py:
+//   /_host/heap?internal_free=&internal_block=&psram_free=&psram_block=
+// Parameters left out clear that part of the simulated pressure.
+static void handleHostHeap(AsyncWebServerRequest* request) {
+    static const char* const PARAMS[] = { "internal_free", "internal_block", "psram_free", "psram_block" };
+    size_t values[4] = {};
+    for (int i = 0; i < 4; i++) {
+        if (request->hasParam(PARAMS[i])) {
+            values[i] = strtoul(request->getParam(PARAMS[i])->value().c_str(), nullptr, 10);
+        }
+    }
+    hostSetHeapPressure(values[0], values[1], values[2], values[3]);
+
+    char body[160];
+    snprintf(body, sizeof(body),
+             "{\"internal_free\":%u,\"internal_block\":%u,\"psram_free\":%u,\"psram_block\":%u}",
+             ESP.getFreeHeap(), ESP.getMaxAllocHeap(), ESP.getFreePsram(), ESP.getMaxAllocPsram());
+    request->send(200, "application/json", body);
+}
+
+// Sensor fault and scene injection:
+//   /_host/sensor?fail_after=<n>   the n-th write from now fails
+//   /_host/sensor?light=<index>    scene brightness seen by the AEC registers
+//   /_host/sensor?frozen=<0|1>     stops the synthesized scene from moving
+static void handleHostSensor(AsyncWebServerRequest* request) {
+    if (request->hasParam("light")) {
+        hostSetSceneLight(atoi(request->getParam("light")->value().c_str()));
+    } else if (request->hasParam("frozen")) {
+        hostFreezeScene(atoi(request->getParam("frozen")->value().c_str()) != 0);
+    } else {
+        int after = 0;
+        if (request->hasParam("fail_after")) {
+            after = atoi(request->getParam("fail_after")->value().c_str());
+        }
+        hostFailSensorWrite(after);
+    }
+    request->send(200, "application/json", "{\"success\":true}");
+}
+
+int main(int argc, char** argv) {
+    host_argv = argv;
+    signal(SIGPIPE, SIG_IGN);
+    seedConfig();
+
+    hostRegisterThread("loopTask", 1, 8192);
+    server.on("/_host/heap", HTTP_GET, handleHostHeap);
+    server.on("/_host/sensor", HTTP_GET, handleHostSensor);
+    setup();
+    for (;;) {
+        loop();
+    }
+}
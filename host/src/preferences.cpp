@@ -0,0 +1,202 @@
+#include <Preferences.h>
+#include <sys/stat.h>
+#include "host.h"
+
+// NVS limits keys and namespace names to 15 characters
+#define NVS_KEY_NAME_MAX 15
+
+static bool validKey(const char* key) {
+    if (!key || !*key || strlen(key) > NVS_KEY_NAME_MAX) {
+        Serial.printf("nvs: invalid key \"%s\"\n", key ? key : "");
+        return false;
+    }
+    return true;
+}
+
+bool Preferences::begin(const char* name, bool read_only, const char* partition) {
+    if (_started) {
+        return false;
+    }
+    if (!validKey(name)) {
+        return false;
+    }
+
+    std::string dir = hostDataPath("nvs");
+    if (!hostMakeDirs(dir)) {
+        return false;
+    }
+    _path = dir + "/" + name + ".bin";
+    _read_only = read_only;
+    _entries.clear();
+
+    // Opening a namespace that was never written fails read-only, as on NVS
+    struct stat st;
+    if (stat(_path.c_str(), &st) != 0) {
+        if (read_only) {
+            return false;
+        }
+    } else if (!load()) {
+        return false;
+    }
+    _started = true;
+    return true;
+}
+
+void Preferences::end() {
+    _started = false;
+    _entries.clear();
+}
+
+// Layout: repeated [u8 key_len][key][u32 value_len][value]
+bool Preferences::load() {
+    FILE* f = fopen(_path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    bool ok = true;
+    int key_len;
+    while ((key_len = fgetc(f)) != EOF) {
+        std::string key(key_len, '\0');
+        uint32_t len = 0;
+        if (fread(&key[0], 1, key_len, f) != (size_t)key_len || fread(&len, sizeof(len), 1, f) != 1) {
+            ok = false;
+            break;
+        }
+        std::vector<uint8_t> value(len);
+        if (len && fread(value.data(), 1, len, f) != len) {
+            ok = false;
+            break;
+        }
+        _entries[key] = value;
+    }
+    fclose(f);
+    if (!ok) {
+        Serial.printf("nvs: %s is corrupt\n", _path.c_str());
+    }
+    return ok;
+}
+
+bool Preferences::save() {
+    std::string tmp = _path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    for (std::map<std::string, std::vector<uint8_t> >::const_iterator it = _entries.begin();
+         it != _entries.end(); ++it) {
+        uint8_t key_len = it->first.size();
+        uint32_t len = it->second.size();
+        fputc(key_len, f);
+        fwrite(it->first.data(), 1, key_len, f);
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(it->second.data(), 1, len, f);
+    }
+    bool ok = fclose(f) == 0;
+    // Replace atomically so a crash never leaves a half-written namespace
+    return ok && rename(tmp.c_str(), _path.c_str()) == 0;
+}
+
+bool Preferences::clear() {
+    if (!_started || _read_only) {
+        return false;
+    }
+    _entries.clear();
+    return save();
+}
+
+bool Preferences::remove(const char* key) {
+    if (!_started || _read_only || !validKey(key)) {
+        return false;
+    }
+    if (!_entries.erase(key)) {
+        return false;
+    }
+    return save();
+}
+
+bool Preferences::isKey(const char* key) {
+    return _started && key && _entries.count(key);
+}
+
+size_t Preferences::freeEntries() {
+    // Default nvs partition: 0x5000 bytes = 5 pages of 126 entries
+    size_t used = 0;
+    for (std::map<std::string, std::vector<uint8_t> >::const_iterator it = _entries.begin();
+         it != _entries.end(); ++it) {
+        used += 1 + (it->second.size() + 31) / 32;
+    }
+    return used < 630 ? 630 - used : 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (!_started || _read_only || !validKey(key) || (!value && len)) {
+        return 0;
+    }
+    const uint8_t* bytes = (const uint8_t*)value;
+    _entries[key] = std::vector<uint8_t>(bytes, bytes + len);
+    return save() ? len : 0;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!_started || !key) {
+        return 0;
+    }
+    std::map<std::string, std::vector<uint8_t> >::const_iterator it = _entries.find(key);
+    return it == _entries.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t max_len) {
+    size_t len = getBytesLength(key);
+    if (!len || !buf || len > max_len) {
+        return 0;
+    }
+    memcpy(buf, _entries[key].data(), len);
+    return len;
+}
+
+size_t Preferences::putString(const char* key, const String& value) {
+    return putString(key, value.c_str());
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    if (!value) {
+        return 0;
+    }
+    return putBytes(key, value, strlen(value)) == strlen(value) ? strlen(value) : 0;
+}
+
+String Preferences::getString(const char* key, const String& default_value) {
+    if (!isKey(key)) {
+        return default_value;
+    }
+    const std::vector<uint8_t>& value = _entries[key];
+    return String(std::string(value.begin(), value.end()));
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t default_value) {
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : default_value;
+}
+
+size_t Preferences::putInt(const char* key, int32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char* key, int32_t default_value) {
+    int32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : default_value;
+}
+
+size_t Preferences::putBool(const char* key, bool value) {
+    uint8_t byte = value;
+    return putBytes(key, &byte, 1);
+}
+
+bool Preferences::getBool(const char* key, bool default_value) {
+    uint8_t byte;
+    return getBytes(key, &byte, 1) == 1 ? byte != 0 : default_value;
+}
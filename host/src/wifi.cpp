@@ -0,0 +1,48 @@
+#include <WiFi.h>
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password) {
+    _ssid = ssid ? ssid : "";
+    if (_ip == IPAddress()) {
+        _ip = IPAddress(127, 0, 0, 1);
+    }
+    _status = WL_CONNECTED;
+    return _status;
+}
+
+bool WiFiClass::config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+    // Static addresses are reported but the server still binds every interface
+    _ip = ip;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifi_off) {
+    _status = WL_DISCONNECTED;
+    return true;
+}
+
+bool WiFiClass::reconnect() {
+    if (_ssid.isEmpty()) {
+        return false;
+    }
+    _status = WL_CONNECTED;
+    return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress ip, IPAddress gateway, IPAddress subnet) {
+    _ap_ip = ip;
+    return true;
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* password) {
+    if (_ap_ip == IPAddress()) {
+        _ap_ip = IPAddress(192, 168, 4, 1);
+    }
+    return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifi_off) {
+    _ap_ip = IPAddress();
+    return true;
+}
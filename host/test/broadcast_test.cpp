@@ -0,0 +1,155 @@
+// Frame broadcaster fan-out on the host build.
+//
+// A producer loop like the camera task's publishes frames from the camera
+// stand-in at a fixed sensor rate while rounds of 0 to 16 consumers read
+// them: fast ones copy every frame as soon as it is published, slow ones
+// take the newest frame five times a second and hold it longer than a
+// frame period, like a client on a slow link. Every consumer shares the
+// one capture, so the published frame rate must stay flat as consumers are
+// added, and fast consumers must see nearly every frame.
+//
+//   pio run -e native-broadcast-test && .pio/build/native-broadcast-test/program
+
+#include <Arduino.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "frame_broadcaster.h"
+#include "host_test.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define SENSOR_FPS        "50"
+#define ROUND_MS          1500
+#define WARMUP_MS         300
+#define SLOW_INTERVAL_MS  200
+#define SLOW_HOLD_MS      25      // Longer than the 20 ms frame period
+#define MIN_FPS_RATIO     0.9f
+
+static std::atomic<bool> producing(false);
+static std::atomic<bool> consuming(false);
+
+static void producer() {
+    while (producing.load()) {
+        if (!frameSlotAvailable()) {
+            delay(2);
+            continue;
+        }
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (fb) {
+            publishFrame(fb);
+        }
+    }
+}
+
+struct Consumer {
+    bool slow;
+    std::atomic<uint32_t> frames;
+    std::thread thread;
+};
+
+static void consume(Consumer* consumer) {
+    std::vector<uint8_t> copy;
+    uint32_t last_seq = 0;
+    while (consuming.load()) {
+        FrameRef frame = acquireFrame(last_seq);
+        if (!frame) {
+            delay(1);
+            continue;
+        }
+        // The "send": a copy out of the driver buffer
+        copy.assign(frame.data(), frame.data() + frame.length());
+        last_seq = frame.seq();
+        consumer->frames++;
+        if (consumer->slow) {
+            delay(SLOW_HOLD_MS);
+            frame.reset();
+            delay(SLOW_INTERVAL_MS - SLOW_HOLD_MS);
+        }
+    }
+}
+
+// Published frames/s with `count` consumers, every other one slow
+static float runRound(int count, float* fast_ratio) {
+    std::vector<Consumer*> consumers;
+    consuming.store(true);
+    for (int i = 0; i < count; i++) {
+        Consumer* consumer = new Consumer();
+        consumer->slow = i % 2 == 1;
+        consumer->frames.store(0);
+        consumer->thread = std::thread(consume, consumer);
+        consumers.push_back(consumer);
+    }
+
+    delay(WARMUP_MS);
+    uint32_t published = getFramesPublished();
+    std::vector<uint32_t> received;
+    for (Consumer* consumer : consumers) {
+        received.push_back(consumer->frames.load());
+    }
+    unsigned long started = millis();
+    delay(ROUND_MS);
+    float seconds = (millis() - started) / 1000.0f;
+    published = getFramesPublished() - published;
+
+    // Worst fast consumer against what was published
+    *fast_ratio = 1.0f;
+    for (size_t i = 0; i < consumers.size(); i++) {
+        if (!consumers[i]->slow && published) {
+            float ratio = (float)(consumers[i]->frames.load() - received[i]) / published;
+            *fast_ratio = min(*fast_ratio, ratio);
+        }
+    }
+
+    consuming.store(false);
+    for (Consumer* consumer : consumers) {
+        consumer->thread.join();
+        delete consumer;
+    }
+    return published / seconds;
+}
+
+int main() {
+    setenv("HOST_CAMERA_FPS", SENSOR_FPS, 1);
+    setDefaultConfiguration();
+    initFrameBroadcaster();
+
+    camera_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.pin_pwdn = -1;
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.frame_size = FRAMESIZE_VGA;
+    config.jpeg_quality = 12;
+    config.fb_count = frameBufferCount();
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    CHECK(esp_camera_init(&config) == ESP_OK, "camera stand-in up with %d buffers", (int)config.fb_count);
+
+    producing.store(true);
+    std::thread capture(producer);
+
+    float baseline = 0;
+    static const int ROUNDS[] = { 0, 1, 2, 4, 8, 16 };
+    for (int count : ROUNDS) {
+        float fast_ratio;
+        float fps = runRound(count, &fast_ratio);
+        if (count == 0) {
+            baseline = fps;
+            CHECK(fps > 40, "no consumers: %.1f fps published", fps);
+            continue;
+        }
+        CHECK(fps >= baseline * MIN_FPS_RATIO, "%2d consumers: %.1f fps published (%.0f%% of %.1f)", count, fps,
+              100 * fps / baseline, baseline);
+        CHECK(fast_ratio >= MIN_FPS_RATIO, "%2d consumers: slowest fast consumer saw %.0f%% of frames", count,
+              100 * fast_ratio);
+    }
+
+    producing.store(false);
+    capture.join();
+
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    CHECK(stats.bad_releases == 0, "no frame released twice");
+    return testResult();
+}
@@ -0,0 +1,267 @@
+// /capture and /bmp waiting for a new frame on the host build.
+//
+// Runs the firmware's handlers on the host web server with frames from the
+// camera stand-in, published only when the test asks. Requests that need a
+// newer frame than the cached one must not hold up the server while they
+// wait: /status answers at once, and every waiting /capture and /bmp is
+// answered with the next published frame, all of them sharing it. Thumbnail
+// waiters of the same frame share one job on the conversion task. With no
+// frame the wait ends in a 500 after CAPTURE_WAIT_TIMEOUT_MS, and a client
+// that hangs up while waiting is forgotten.
+//
+//   pio run -e native-capture-test && .pio/build/native-capture-test/program
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "app.h"
+#include "capture_response.h"
+#include "frame_convert.h"
+#include "web_server.h"
+#include "host_test.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define TEST_PORT    "18182"
+#define WAITERS      4
+#define HOLD_MS      300        // How long the test keeps waiters waiting
+
+static std::atomic<bool> running(true);
+static std::atomic<int> publish_requests(0);
+
+// The camera and web server tasks in one: publishes a frame from the
+// stand-in when asked and starts waiting responses between frames
+static void serve() {
+    while (running.load()) {
+        if (publish_requests.load() > 0 && frameSlotAvailable()) {
+            camera_fb_t* fb = esp_camera_fb_get();
+            if (fb) {
+                publishFrame(fb);
+                publish_requests--;
+            }
+        }
+        serviceCaptureResponses();
+        delay(2);
+    }
+}
+
+static void publishAndWait() {
+    uint32_t before = getFramesPublished();
+    publish_requests++;
+    while (getFramesPublished() == before) {
+        delay(1);
+    }
+}
+
+struct Reply {
+    int status;
+    std::string headers;
+    std::string body;
+    unsigned long elapsed_ms;
+};
+
+static int connectServer() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(getenv("HOST_HTTP_PORT")));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// One request on its own connection, read until the server closes it
+static void get(const char* path, Reply* reply) {
+    unsigned long started = millis();
+    *reply = Reply{ 0, "", "", 0 };
+    int fd = connectServer();
+    if (fd < 0) {
+        return;
+    }
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: test\r\n\r\n";
+    send(fd, request.data(), request.size(), 0);
+    std::string data;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        data.append(chunk, n);
+    }
+    close(fd);
+    reply->elapsed_ms = millis() - started;
+    size_t end = data.find("\r\n\r\n");
+    if (data.compare(0, 9, "HTTP/1.1 ") != 0 || end == std::string::npos) {
+        return;
+    }
+    reply->status = atoi(data.c_str() + 9);
+    reply->headers = data.substr(0, end);
+    reply->body = data.substr(end + 4);
+}
+
+static std::string header(const Reply& reply, const char* name) {
+    size_t at = reply.headers.find(std::string("\r\n") + name + ": ");
+    if (at == std::string::npos) {
+        return "";
+    }
+    at += strlen(name) + 4;
+    return reply.headers.substr(at, reply.headers.find("\r\n", at) - at);
+}
+
+static int waiting() {
+    CaptureResponseStats stats;
+    getCaptureResponseStats(&stats);
+    return stats.waiting;
+}
+
+// Waits up to timeout_ms for count responses to be waiting
+static bool waitForWaiters(int count, unsigned long timeout_ms) {
+    unsigned long started = millis();
+    while (waiting() != count) {
+        if (millis() - started > timeout_ms) {
+            return false;
+        }
+        delay(2);
+    }
+    return true;
+}
+
+static void testWaiters() {
+    publishAndWait();
+    uint32_t cached = getFramesPublished();
+
+    // max_age=0 always wants a frame newer than the cached one
+    static const char* paths[WAITERS] = {
+        "/capture?max_age=0", "/capture?max_age=0&scale=4", "/capture?max_age=0&scale=4", "/bmp?max_age=0&format=gray"
+    };
+    ConvertStats convert_before;
+    getConvertStats(&convert_before);
+    Reply replies[WAITERS];
+    std::vector<std::thread> clients;
+    for (int i = 0; i < WAITERS; i++) {
+        clients.emplace_back(get, paths[i], &replies[i]);
+    }
+    CHECK(waitForWaiters(WAITERS, 1000), "%d requests waiting for a new frame", WAITERS);
+
+    Reply status;
+    get("/status", &status);
+    CHECK(status.status == 200 && status.elapsed_ms < 100,
+          "/status answered in %lu ms while they wait", status.elapsed_ms);
+
+    delay(HOLD_MS);
+    bool none_answered = waiting() == WAITERS;
+    unsigned long published_at = millis();
+    publishAndWait();
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    unsigned long answered_ms = millis() - published_at;
+    CHECK(none_answered, "nothing answered before the next frame (%d ms)", HOLD_MS);
+
+    char expected[16];
+    snprintf(expected, sizeof(expected), "-%u\"", (unsigned)(cached + 1));
+    std::string etag = header(replies[0], "ETag");
+    CHECK(replies[0].status == 200 && etag.find(expected) != std::string::npos,
+          "/capture: got frame %u (%s)", (unsigned)(cached + 1), etag.c_str());
+    CHECK(replies[0].body.size() == (size_t)atoi(header(replies[0], "Content-Length").c_str()) &&
+          (uint8_t)replies[0].body[0] == 0xFF && (uint8_t)replies[0].body[1] == 0xD8,
+          "/capture: %u-byte JPEG", (unsigned)replies[0].body.size());
+    std::string thumb_etag = header(replies[1], "ETag");
+    snprintf(expected, sizeof(expected), "-%u/4\"", (unsigned)(cached + 1));
+    CHECK(replies[1].status == 200 && thumb_etag.find(expected) != std::string::npos &&
+          header(replies[2], "ETag") == thumb_etag && replies[1].body == replies[2].body &&
+          replies[1].body.size() < replies[0].body.size(),
+          "/capture?scale=4: both got the %u-byte thumbnail of the same frame", (unsigned)replies[1].body.size());
+    ConvertStats convert_after;
+    getConvertStats(&convert_after);
+    CHECK(convert_after.jobs == convert_before.jobs + 1 && convert_after.pending == 0,
+          "one conversion job for both thumbnail waiters, on the conversion task");
+    CHECK(replies[3].status == 200 && header(replies[3], "Content-Type") == "image/bmp" &&
+          replies[3].body.size() > 0 && replies[3].body[0] == 'B' && replies[3].body[1] == 'M',
+          "/bmp: %u-byte BMP", (unsigned)replies[3].body.size());
+    CHECK(answered_ms < 200, "all answered %lu ms after the frame was published", answered_ms);
+
+    // Fresh enough now: served at once
+    Reply cached_reply;
+    get("/capture", &cached_reply);
+    CHECK(cached_reply.status == 200 && header(cached_reply, "ETag") == etag && cached_reply.elapsed_ms < 100,
+          "/capture within max_age: cached frame in %lu ms", cached_reply.elapsed_ms);
+}
+
+static void testTimeout() {
+    CaptureResponseStats before;
+    getCaptureResponseStats(&before);
+    Reply reply;
+    std::thread client(get, "/capture?max_age=0", &reply);
+    CHECK(waitForWaiters(1, 1000), "request waiting with no frame coming");
+    Reply status;
+    get("/status", &status);
+    CHECK(status.status == 200 && status.elapsed_ms < 100, "/status answered in %lu ms meanwhile",
+          status.elapsed_ms);
+    client.join();
+
+    CaptureResponseStats after;
+    getCaptureResponseStats(&after);
+    CHECK(reply.status == 500 && reply.body.find("Failed to capture frame") != std::string::npos,
+          "no frame: 500 after %lu ms", reply.elapsed_ms);
+    CHECK(reply.elapsed_ms >= CAPTURE_WAIT_TIMEOUT_MS && reply.elapsed_ms < CAPTURE_WAIT_TIMEOUT_MS + 200,
+          "gave up after CAPTURE_WAIT_TIMEOUT_MS (%d ms)", CAPTURE_WAIT_TIMEOUT_MS);
+    CHECK(after.timeouts == before.timeouts + 1, "timeout counted in /status");
+}
+
+static void testHangUp() {
+    int fd = connectServer();
+    const char request[] = "GET /capture?max_age=0 HTTP/1.1\r\nHost: test\r\n\r\n";
+    send(fd, request, sizeof(request) - 1, 0);
+    bool waited = waitForWaiters(1, 1000);
+    close(fd);
+    delay(HOLD_MS);
+    publishAndWait();
+    delay(50);
+    CHECK(waited && waitForWaiters(0, 1000), "client gone while waiting: response dropped");
+}
+
+int main() {
+    if (!getenv("HOST_HTTP_PORT")) {
+        setenv("HOST_HTTP_PORT", TEST_PORT, 1);
+    }
+    setDefaultConfiguration();
+    cameraMutex = xSemaphoreCreateMutex();
+    initFrameBroadcaster();
+    initThumbnails();
+    initRoiViews();
+    initFrameConvert();
+
+    camera_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.pin_pwdn = -1;
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.frame_size = FRAMESIZE_VGA;
+    config.jpeg_quality = 12;
+    config.fb_count = frameBufferCount();
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    CHECK(esp_camera_init(&config) == ESP_OK, "camera stand-in up");
+    camera_initialized = true;              // Frames come from serve(), not the camera task
+    initWebServer();
+    delay(200);
+
+    std::thread server_task(serve);
+    testWaiters();
+    testTimeout();
+    testHangUp();
+    running.store(false);
+    server_task.join();
+
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    CHECK(stats.bad_releases == 0, "no frame released twice");
+    return testResult();
+}
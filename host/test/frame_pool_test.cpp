@@ -0,0 +1,287 @@
+// FrameRef and the descriptor pool under AddressSanitizer and UBSan.
+//
+// native-frame-pool-test builds the firmware and this program with
+// -fsanitize=address,undefined, so a reference dropped twice, a slot or
+// driver buffer touched after it was recycled or freed, or a refcount that
+// goes negative stops the run with a report, besides failing the checks
+// below. Covers acquire, share, move and reset, releases attempted twice
+// through every path FrameRef offers, a driver generation flush with
+// frames still held, a deinit waiting for a reader to finish copying, and
+// consumers reading under FrameReadGuard while the producer publishes and
+// the driver is torn down and brought back underneath them.
+//
+//   pio run -e native-frame-pool-test && .pio/build/native-frame-pool-test/program
+
+#include <Arduino.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "frame_broadcaster.h"
+#include "host_test.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define STRESS_MS       1500
+#define STRESS_READERS  6
+#define REPROVISION_MS  100     // Driver deinit and init during the stress run
+
+// A frame that is not a driver buffer: the camera stand-in ignores it
+// when it is returned, and the test frees it once the pool let go of it
+struct FakeFrame {
+    camera_fb_t fb;
+    std::vector<uint8_t> data;
+};
+
+static FakeFrame* mailbox_fake = nullptr;   // Left in the mailbox for the flush
+
+static FakeFrame* publishFake(size_t len) {
+    FakeFrame* frame = new FakeFrame();
+    frame->data.assign(len, (uint8_t)len);
+    memset(&frame->fb, 0, sizeof(frame->fb));
+    frame->fb.buf = frame->data.data();
+    frame->fb.len = len;
+    frame->fb.format = PIXFORMAT_JPEG;
+    publishFrame(&frame->fb);
+    return frame;
+}
+
+static int inUse() {
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    return stats.in_use;
+}
+
+static uint32_t badReleases() {
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    return stats.bad_releases;
+}
+
+static void testAcquireShareReset() {
+    int idle = inUse();
+    FakeFrame* fake = publishFake(100);
+    uint32_t seq = getFramesPublished();
+
+    FrameRef first = acquireFrame(seq - 1);
+    CHECK(first && first.seq() == seq && first.length() == 100 && first.data()[0] == 100,
+          "acquire: frame %u with its data", (unsigned)seq);
+    CHECK(!acquireFrame(seq), "acquire: nothing newer than the newest frame");
+
+    FrameRef second = first.share();
+    FrameRef third = std::move(second);
+    CHECK(!second && third && third.seq() == seq, "share and move: the moved-from handle is empty");
+    first.reset();
+    CHECK(inUse() == idle + 1, "reset: one reference dropped, the frame still held");
+
+    // Superseded: only the handle keeps it now
+    mailbox_fake = publishFake(50);
+    CHECK(inUse() == idle + 2 && third.data()[0] == 100, "superseded: held frame intact");
+    third.reset();
+    CHECK(inUse() == idle + 1, "last reference dropped: slot recycled");
+    CHECK(badReleases() == 0, "no frame released twice");
+    delete fake;
+}
+
+// Every way FrameRef could drop the same reference twice
+static void testDoubleRelease() {
+    int before = inUse();
+    FrameRef frame = acquireFrame(0);
+    CHECK((bool)frame, "newest frame acquired");
+
+    frame.reset();
+    frame.reset();                          // Already empty
+    FrameRef moved = acquireFrame(0);
+    FrameRef target = std::move(moved);
+    moved.reset();                          // Moved from
+    FrameRef& alias = target;
+    target = std::move(alias);              // Self move-assignment keeps the reference
+    CHECK((bool)target, "self move-assignment keeps the reference");
+    FrameRef other = target.share();
+    other = std::move(target);              // Overwrite drops the old one exactly once
+    target.reset();
+    other.reset();
+    {
+        FrameRef scoped = acquireFrame(0);
+        scoped.reset();
+    }                                       // Destructor after reset
+    CHECK(inUse() == before && badReleases() == 0, "resets, moves and destructors drop each reference once");
+}
+
+static camera_config_t cameraConfig() {
+    camera_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.pin_pwdn = -1;
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.frame_size = FRAMESIZE_QVGA;
+    config.jpeg_quality = 12;
+    config.fb_count = frameBufferCount();
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    return config;
+}
+
+// What provisionFrameBuffers() and deinitCamera() do
+static void deinitDriver() {
+    flushFrameBroadcaster();
+    esp_camera_deinit();
+}
+
+// Reads every byte, so AddressSanitizer sees a read of a freed buffer
+static bool frameIntact(const FrameRef& frame) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i < frame.length(); i++) {
+        sum ^= frame.data()[i];
+    }
+    return frame.data()[0] == 0xFF && frame.data()[frame.length() - 1] == 0xD9 && (sum | 1);
+}
+
+static void testGenerationFlush() {
+    camera_config_t config = cameraConfig();
+    CHECK(esp_camera_init(&config) == ESP_OK, "camera stand-in up");
+
+    camera_fb_t* fb = esp_camera_fb_get();
+    publishFrame(fb);
+    FrameRef held = acquireFrame(0);
+    FrameRef shared = held.share();
+    CHECK(held.valid() && held.fb() == fb, "driver frame held twice");
+
+    // What deinitializing the camera does: the buffers are freed, and the
+    // held frame must never be read or handed back to the driver again
+    flushFrameBroadcaster();
+    esp_camera_deinit();
+    CHECK(!held.valid() && !shared.valid(), "flushed: held frames invalid");
+    CHECK(!acquireFrame(0), "flushed: mailbox empty");
+    held.reset();
+    shared.reset();
+    CHECK(badReleases() == 0, "frames of the old generation dropped without touching the driver");
+    delete mailbox_fake;
+
+    // The next generation works as before
+    CHECK(esp_camera_init(&config) == ESP_OK, "camera stand-in back up");
+    publishFrame(esp_camera_fb_get());
+    FrameRef fresh = acquireFrame(0);
+    CHECK(fresh && fresh.valid() && fresh.data()[0] == 0xFF, "new generation: frame valid and readable");
+    fresh.reset();
+}
+
+// A reader copying out of a driver buffer on another core holds off the
+// deinit until it is done; later readers see the frame invalid
+static void testReaderDrain() {
+    publishFrame(esp_camera_fb_get());
+    FrameRef frame = acquireFrame(0);
+    std::atomic<bool> deinitialized(false);
+    std::thread deinit;
+    {
+        FrameReadGuard guard(frame);
+        CHECK(guard.ok(), "reader guard open on a driver frame");
+        deinit = std::thread([&deinitialized]() {
+            deinitDriver();
+            deinitialized.store(true);
+        });
+        delay(50);
+        CHECK(!deinitialized.load(), "deinit waits while the frame is read");
+        CHECK(frameIntact(frame), "frame readable to the end meanwhile");
+    }
+    deinit.join();
+    CHECK(deinitialized.load() && !frame.valid(), "guard closed: driver deinitialized, frame invalid");
+    {
+        FrameReadGuard late(frame);
+        CHECK(!late.ok() && frame.length() > 0, "later guard refuses the read, length still known");
+    }
+    frame.reset();
+    CHECK(badReleases() == 0, "reader drain: no frame released twice");
+
+    camera_config_t config = cameraConfig();
+    CHECK(esp_camera_init(&config) == ESP_OK, "camera stand-in back up after the drain");
+}
+
+// Consumers take, share, read and drop frames while the producer publishes
+// from the stand-in as fast as it can, and the driver buffers are freed and
+// reallocated every REPROVISION_MS
+static void testStress() {
+    std::atomic<bool> running(true);
+    std::atomic<uint32_t> reads(0);
+    std::atomic<uint32_t> corrupt(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < STRESS_READERS; i++) {
+        readers.emplace_back([&running, &reads, &corrupt, i]() {
+            uint32_t last_seq = 0;
+            std::vector<FrameRef> kept;
+            while (running.load()) {
+                FrameRef frame = acquireFrame(i % 2 ? last_seq : 0);
+                if (!frame) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                last_seq = frame.seq();
+                {
+                    FrameReadGuard guard(frame);
+                    if (guard.ok() && !frameIntact(frame)) {
+                        corrupt++;
+                    }
+                }
+                reads++;
+                // Some readers hold a couple of frames like a slow client
+                if (i % 3 == 0 && kept.size() < 2) {
+                    kept.push_back(frame.share());
+                } else if (!kept.empty()) {
+                    kept.erase(kept.begin());
+                }
+            }
+        });
+    }
+
+    camera_config_t config = cameraConfig();
+    unsigned long started = millis();
+    unsigned long reprovisioned = started;
+    int reprovisions = 0;
+    int init_failures = 0;
+    uint32_t published = getFramesPublished();
+    while (millis() - started < STRESS_MS) {
+        if (millis() - reprovisioned >= REPROVISION_MS) {
+            deinitDriver();
+            if (esp_camera_init(&config) != ESP_OK) {
+                init_failures++;
+            }
+            reprovisioned = millis();
+            reprovisions++;
+        }
+        if (!frameSlotAvailable()) {
+            std::this_thread::yield();
+            continue;
+        }
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (fb) {
+            publishFrame(fb);
+        }
+    }
+    running.store(false);
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    published = getFramesPublished() - published;
+    CHECK(published > 100 && reads.load() > published, "stress: %u frames published, %u reads by %d readers",
+          (unsigned)published, (unsigned)reads.load(), STRESS_READERS);
+    CHECK(reprovisions >= STRESS_MS / REPROVISION_MS - 1 && init_failures == 0,
+          "stress: driver buffers freed and reallocated %d times", reprovisions);
+    CHECK(corrupt.load() == 0, "stress: every frame read intact");
+    CHECK(badReleases() == 0, "stress: no frame released twice");
+}
+
+int main() {
+    setenv("HOST_CAMERA_FPS", "1000", 1);
+    setDefaultConfiguration();
+    initFrameBroadcaster();
+
+    testAcquireShareReset();
+    testDoubleRelease();
+    testGenerationFlush();
+    testReaderDrain();
+    testStress();
+
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    CHECK(stats.bad_releases == 0, "no frame released twice");
+    return testResult();
+}
@@ -0,0 +1,148 @@
+// /clip pre-event ring resizing on the host build.
+//
+// Fills the ring with frames of mixed sizes until it has wrapped, then
+// shrinks it the way the memory governor does under PSRAM pressure and
+// grows it back. Each resize must keep the newest frames that fit, byte
+// for byte and in order, and the ring must go on taking frames across
+// the new capacity as before.
+//
+//   pio run -e native-frame-ring-test && .pio/build/native-frame-ring-test/program
+
+#include <Arduino.h>
+#include <vector>
+#include "config.h"
+#include "frame_broadcaster.h"
+#include "frame_ring.h"
+#include "host_test.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define RING_KB 64
+
+// Data of frame seq: a pattern that shows a misplaced or torn copy
+static uint8_t patternByte(uint32_t seq, size_t i) {
+    return (uint8_t)(seq * 131 + i * 7 + (i >> 8));
+}
+
+// Sizes cycle through small and large so frames straddle the wrap point
+static size_t frameSize(uint32_t seq) {
+    static const size_t SIZES[] = { 3000, 7100, 1200, 9800, 4400, 6000 };
+    return SIZES[seq % (sizeof(SIZES) / sizeof(SIZES[0]))];
+}
+
+static void appendFrames(int count) {
+    for (int n = 0; n < count; n++) {
+        uint32_t seq = getFramesPublished() + 1;
+        static std::vector<uint8_t> data;
+        static camera_fb_t fb;
+        data.resize(frameSize(seq));
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = patternByte(seq, i);
+        }
+        memset(&fb, 0, sizeof(fb));
+        fb.buf = data.data();
+        fb.len = data.size();
+        fb.format = PIXFORMAT_JPEG;
+        publishFrame(&fb);
+        FrameRef frame = acquireFrame(seq - 1);
+        appendRingFrame(frame);
+    }
+}
+
+// Sequence numbers buffered, oldest first, each checked against its pattern
+static std::vector<uint32_t> bufferedFrames(bool* intact) {
+    std::vector<uint32_t> seqs;
+    *intact = true;
+    RingFrameInfo info;
+    uint32_t after = 0;
+    std::vector<uint8_t> copy;
+    while (findRingFrame(after, 0, &info)) {
+        copy.resize(info.len);
+        size_t copied = copyRingFrame(info.seq, 0, copy.data(), info.len);
+        bool ok = copied == info.len && info.len == frameSize(info.seq);
+        for (size_t i = 0; ok && i < info.len; i++) {
+            ok = copy[i] == patternByte(info.seq, i);
+        }
+        *intact = *intact && ok;
+        seqs.push_back(info.seq);
+        after = info.seq;
+    }
+    return seqs;
+}
+
+// The newest frames, by their sizes, that fit in capacity bytes
+static size_t expectedKept(const std::vector<uint32_t>& before, size_t capacity) {
+    size_t total = 0;
+    size_t kept = 0;
+    for (size_t i = before.size(); i-- > 0;) {
+        total += frameSize(before[i]);
+        if (total > capacity) {
+            break;
+        }
+        kept++;
+    }
+    return kept;
+}
+
+static bool consecutive(const std::vector<uint32_t>& seqs) {
+    for (size_t i = 1; i < seqs.size(); i++) {
+        if (seqs[i] != seqs[i - 1] + 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testResize(const char* name, size_t capacity) {
+    bool intact;
+    std::vector<uint32_t> before = bufferedFrames(&intact);
+    size_t kept = capacity >= RING_KB * 1024 ? before.size() : expectedKept(before, capacity);
+    FrameRingStats stats;
+    getFrameRingStats(&stats);
+    uint32_t dropped_before = stats.resize_dropped;
+
+    CHECK(resizeFrameRing(capacity), "%s to %u KB", name, (unsigned)(capacity / 1024));
+    std::vector<uint32_t> after = bufferedFrames(&intact);
+    getFrameRingStats(&stats);
+    CHECK(after.size() == kept && !after.empty() && after.back() == before.back() && consecutive(after),
+          "%s: newest %u of %u frames kept (%u..%u)", name, (unsigned)after.size(), (unsigned)before.size(),
+          after.empty() ? 0 : (unsigned)after.front(), after.empty() ? 0 : (unsigned)after.back());
+    CHECK(intact, "%s: kept frames intact", name);
+    CHECK(stats.resize_dropped - dropped_before == before.size() - kept && stats.used <= capacity,
+          "%s: %u dropped and counted, %u of %u bytes used", name,
+          (unsigned)(stats.resize_dropped - dropped_before), (unsigned)stats.used, (unsigned)capacity);
+
+    // Keeps taking frames, wrapping at the new capacity
+    appendFrames(40);
+    std::vector<uint32_t> later = bufferedFrames(&intact);
+    getFrameRingStats(&stats);
+    CHECK(intact && consecutive(later) && later.back() == getFramesPublished() && stats.used <= capacity,
+          "%s: 40 more frames appended and wrapped, %u buffered", name, (unsigned)later.size());
+}
+
+int main() {
+    setDefaultConfiguration();
+    g_config.clip.buffer_kb = RING_KB;
+    g_config.clip.buffer_seconds = 60;      // Size, not age, is the limit here
+    initFrameBroadcaster();
+    CHECK(initFrameRing(), "ring of %d KB", RING_KB);
+
+    appendFrames(50);
+    bool intact;
+    std::vector<uint32_t> filled = bufferedFrames(&intact);
+    CHECK(intact && consecutive(filled) && filled.back() == getFramesPublished(),
+          "filled and wrapped: %u frames intact", (unsigned)filled.size());
+
+    // Everything fits: frames from both sides of the wrap point are packed
+    FrameRingStats stats;
+    getFrameRingStats(&stats);
+    testResize("shrink to what is used", stats.used);
+    testResize("grow", RING_KB * 1024);
+    testResize("shrink", RING_KB * 1024 / 4);
+    testResize("grow back", RING_KB * 1024);
+    appendFrames(7);                        // Wrap point somewhere else
+    testResize("shrink again", RING_KB * 1024 / 3);
+    testResize("grow again", RING_KB * 1024);
+    return testResult();
+}
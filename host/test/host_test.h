@@ -0,0 +1,28 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+// Checks for the host tests in host/test/. Each test file is a program of
+// its own (one native-*-test environment each) that prints one line per
+// check and exits non-zero when any failed.
+
+#include <stdio.h>
+
+static int host_test_failures = 0;
+
+#define CHECK(cond, ...) do { \
+        bool passed_ = (cond); \
+        printf("%s  ", passed_ ? "ok  " : "FAIL"); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        if (!passed_) { \
+            host_test_failures++; \
+            printf("      %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+static inline int testResult() {
+    printf("%s\n", host_test_failures ? "FAILED" : "PASSED");
+    return host_test_failures ? 1 : 0;
+}
+
+#endif // HOST_TEST_H
@@ -0,0 +1,202 @@
+// MjpegStreamWriter on the host build.
+//
+// Publishes frames of 1, 3 and 50 times the TCP chunk size and checks that
+// the multipart part written across send-window-sized write() calls is
+// byte-identical to the boundary, part headers, JPEG and CRLF written in
+// one piece. Partial writes are resumed at odd sizes that split the
+// header, body and trailer at every boundary, and the frame must stay
+// pinned until its trailer is out.
+//
+//   pio run -e native-mjpeg-writer-test && .pio/build/native-mjpeg-writer-test/program
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "esp_heap_caps.h"
+#include "mjpeg_stream.h"
+#include "host_test.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define CHUNK 1436                // One TCP segment, about what the send window takes per call
+
+static uint32_t last_published = 0;
+
+// Publishes a fake frame of len patterned bytes. Not a driver buffer: the
+// camera stand-in ignores it when it is returned.
+static FrameRef publishTestFrame(camera_fb_t* fb, std::vector<uint8_t>& data, size_t len, int motion = -1) {
+    data.resize(len);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)(i * 31 + len);
+    }
+    memset(fb, 0, sizeof(*fb));
+    fb->buf = data.data();
+    fb->len = len;
+    fb->format = PIXFORMAT_JPEG;
+    publishFrame(fb, motion);
+    FrameRef frame = acquireFrame(last_published);
+    last_published = getFramesPublished();
+    return frame;
+}
+
+static std::string expectedPart(const uint8_t* body, size_t len, int motion) {
+    char header[128];
+    if (motion >= 0) {
+        snprintf(header, sizeof(header),
+                 "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                 "X-Motion-Score: %d.%d\r\n\r\n", (unsigned)len, motion / 10, motion % 10);
+    } else {
+        snprintf(header, sizeof(header),
+                 "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", (unsigned)len);
+    }
+    return std::string(header) + std::string((const char*)body, len) + "\r\n";
+}
+
+// Writes the whole part in calls of sizes[i % count] bytes. Fails on a call
+// that makes no progress or on remaining() disagreeing with what is left.
+static bool drain(MjpegStreamWriter& writer, const size_t* sizes, size_t count, std::string* out, int* calls) {
+    std::vector<uint8_t> buffer;
+    *calls = 0;
+    while (!writer.idle()) {
+        size_t want = sizes[*calls % count];
+        size_t before = writer.remaining();
+        buffer.resize(want);
+        size_t n = writer.write(buffer.data(), want);
+        if (n == 0 || n > want || writer.remaining() != before - n) {
+            return false;
+        }
+        if (n < want && !writer.idle()) {
+            return false;       // Short write with more to send
+        }
+        out->append((const char*)buffer.data(), n);
+        (*calls)++;
+    }
+    return true;
+}
+
+static void testChunked(size_t multiple) {
+    camera_fb_t fb;
+    std::vector<uint8_t> data;
+    size_t len = CHUNK * multiple;
+    FrameRef frame = publishTestFrame(&fb, data, len);
+    uint32_t seq = frame.seq();
+    std::string expected = expectedPart(data.data(), len, -1);
+
+    MjpegStreamWriter writer;
+    writer.begin(std::move(frame));
+    CHECK(writer.remaining() == expected.size(), "%2ux chunk: remaining() is the whole part up front",
+          (unsigned)multiple);
+    size_t sizes[] = { CHUNK };
+    std::string out;
+    int calls;
+    bool ok = drain(writer, sizes, 1, &out, &calls);
+    int expected_calls = (int)((expected.size() + CHUNK - 1) / CHUNK);
+    CHECK(ok && out == expected, "%2ux chunk: %u bytes in %d writes match the part written whole",
+          (unsigned)multiple, (unsigned)out.size(), calls);
+    CHECK(calls == expected_calls, "%2ux chunk: every write but the last fills the window (%d of %d)",
+          (unsigned)multiple, calls, expected_calls);
+    CHECK(writer.lastSeq() == seq, "%2ux chunk: frame %u marked sent", (unsigned)multiple, (unsigned)seq);
+}
+
+static void testResume() {
+    camera_fb_t fb;
+    std::vector<uint8_t> data;
+    size_t len = CHUNK * 3 + 17;
+    FrameRef frame = publishTestFrame(&fb, data, len, 523);
+    std::string expected = expectedPart(data.data(), len, 523);
+
+    // Odd sizes so resumes land inside the header, on every stage boundary
+    // and inside the two-byte trailer
+    static const size_t sizes[] = { 1, 7, 13, 64, CHUNK - 1, 3, 1, 2, 509 };
+    for (size_t start = 0; start < sizeof(sizes) / sizeof(sizes[0]); start++) {
+        MjpegStreamWriter writer;
+        writer.begin(frame.share());
+        std::string out;
+        int calls;
+        bool ok = drain(writer, sizes + start, sizeof(sizes) / sizeof(sizes[0]) - start, &out, &calls);
+        CHECK(ok && out == expected, "resume from %u-byte writes: %d calls, part intact", (unsigned)sizes[start],
+              calls);
+    }
+
+    // One byte at a time. Once a newer frame is published only the writer
+    // holds this one, and it must stay pinned until the trailer is out.
+    MjpegStreamWriter writer;
+    writer.begin(frame.share());
+    frame.reset();
+    camera_fb_t newer_fb;
+    std::vector<uint8_t> newer_data;
+    FrameRef newer = publishTestFrame(&newer_fb, newer_data, 64);
+    newer.reset();
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    int held = stats.in_use;
+    std::string out;
+    uint8_t byte;
+    bool pinned = true;
+    while (!writer.idle()) {
+        getFramePoolStats(&stats);
+        pinned = pinned && stats.in_use == held;
+        writer.write(&byte, 1);
+        out.push_back((char)byte);
+    }
+    getFramePoolStats(&stats);
+    CHECK(out == expected && pinned && stats.in_use == held - 1,
+          "byte-at-a-time resume: part intact, frame held until the trailer and released after it");
+}
+
+static void testConverted() {
+    camera_fb_t fb;
+    std::vector<uint8_t> data;
+    FrameRef frame = publishTestFrame(&fb, data, CHUNK * 3);
+
+    ConvertedFrame* converted = new ConvertedFrame();
+    converted->length = CHUNK + 5;
+    converted->data = (uint8_t*)heap_caps_malloc(converted->length, MALLOC_CAP_8BIT);
+    memset(converted->data, 0xA5, converted->length);
+    converted->seq = frame.seq();
+    converted->timestamp = frame.timestamp();
+    converted->width = converted->height = 0;
+    std::string expected = expectedPart(converted->data, converted->length, -1);
+
+    MjpegStreamWriter writer;
+    writer.begin(std::move(frame), ConvertedFrameRef(converted));
+    size_t sizes[] = { CHUNK };
+    std::string out;
+    int calls;
+    bool ok = drain(writer, sizes, 1, &out, &calls);
+    CHECK(ok && out == expected, "converted copy: %u bytes in %d writes", (unsigned)out.size(), calls);
+}
+
+static void testInvalidated() {
+    camera_fb_t fb;
+    std::vector<uint8_t> data;
+    FrameRef frame = publishTestFrame(&fb, data, CHUNK * 3);
+
+    MjpegStreamWriter writer;
+    writer.begin(std::move(frame));
+    uint8_t buffer[CHUNK];
+    size_t first = writer.write(buffer, sizeof(buffer));
+    flushFrameBroadcaster();            // What deinitializing the camera does
+    size_t second = writer.write(buffer, sizeof(buffer));
+    CHECK(first == CHUNK && second == 0 && writer.idle(),
+          "frame invalidated mid-part: write() returns 0 and drops it");
+}
+
+int main() {
+    setDefaultConfiguration();
+    initFrameBroadcaster();
+
+    testChunked(1);
+    testChunked(3);
+    testChunked(50);
+    testResume();
+    testConverted();
+    testInvalidated();
+
+    FramePoolStats stats;
+    getFramePoolStats(&stats);
+    CHECK(stats.bad_releases == 0, "no frame released twice");
+    return testResult();
+}
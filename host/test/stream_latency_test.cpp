@@ -0,0 +1,243 @@
+// /stream latency behind a throttled link on the host build.
+//
+// Runs the firmware's /stream handler on the host web server and publishes
+// 16 KB frames at 25 fps that carry their own publish time. Two clients
+// read over loopback: one as fast as it can, one through a 64 KB/s link
+// with a small receive buffer, a sixth of the offered rate. The throttled
+// client must get the newest frame each time its link drains instead of a
+// queue of old ones: its capture-to-receipt latency stays within a few
+// frame transfer times and does not grow over the run, and the frames it
+// cannot take are counted as dropped. The fast client must be unaffected.
+//
+//   pio run -e native-stream-latency-test && .pio/build/native-stream-latency-test/program
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "app.h"
+#include "mjpeg_stream.h"
+#include "web_server.h"
+#include "host_test.h"
+
+// Linked with the whole firmware, but setup() never runs
+char** host_argv = nullptr;
+
+#define TEST_PORT         "18181"
+#define FRAME_BYTES       16000
+#define FRAME_FPS         25
+#define LINK_BYTES_PER_S  64000
+#define RECV_BUFFER       4096
+#define RUN_MS            8000
+#define WARMUP_MS         1500
+
+struct FrameStamp {
+    uint32_t seq;
+    uint64_t published_us;
+};
+
+static std::atomic<bool> running(true);
+
+// The camera and web server tasks in one: publishes a frame every
+// 1/FRAME_FPS s and services paced clients in between. Frame buffers are
+// not reused (a held frame must stay intact); a run leaks a few MB.
+static void produce() {
+    unsigned long next_frame = millis();
+    uint32_t seq = 0;
+    while (running.load()) {
+        if ((long)(millis() - next_frame) >= 0 && frameSlotAvailable()) {
+            next_frame += 1000 / FRAME_FPS;
+            camera_fb_t* fb = new camera_fb_t();
+            fb->buf = new uint8_t[FRAME_BYTES]();
+            fb->len = FRAME_BYTES;
+            fb->format = PIXFORMAT_JPEG;
+            FrameStamp stamp = { ++seq, (uint64_t)micros() };
+            memcpy(fb->buf, &stamp, sizeof(stamp));
+            publishFrame(fb);
+        }
+        serviceStreamClients();
+        delay(2);
+    }
+}
+
+struct Client {
+    uint32_t link_bytes_per_s;      // 0 = unthrottled
+    std::vector<float> latency_ms;  // Per frame, by arrival
+    std::vector<unsigned long> arrival_ms;
+    bool connected;
+};
+
+static int connectStream(int recv_buffer) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout = { 0, 200000 };       // Lets the reader see the end of the run
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (recv_buffer) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &recv_buffer, sizeof(recv_buffer));
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(getenv("HOST_HTTP_PORT")));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    const char request[] = "GET /stream?fps=25 HTTP/1.1\r\nHost: test\r\n\r\n";
+    send(fd, request, sizeof(request) - 1, 0);
+    return fd;
+}
+
+// Reads parts until the run ends, recording each frame's latency. A
+// throttled client reads in small pieces at its link rate.
+static void receive(Client* client) {
+    int fd = connectStream(client->link_bytes_per_s ? RECV_BUFFER : 0);
+    client->connected = fd >= 0;
+    if (fd < 0) {
+        return;
+    }
+    std::string buffer;
+    char chunk[1024];
+    unsigned long started = millis();
+    uint64_t received = 0;
+    bool headers_done = false;
+    while (running.load()) {
+        size_t want = sizeof(chunk);
+        if (client->link_bytes_per_s) {
+            want = 512;
+            // Hold to the link rate
+            uint64_t allowed = (uint64_t)(millis() - started) * client->link_bytes_per_s / 1000;
+            if (received + want > allowed) {
+                delay(2);
+                continue;
+            }
+        }
+        ssize_t n = recv(fd, chunk, want, 0);
+        if (n < 0 && errno == EAGAIN) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+        buffer.append(chunk, n);
+
+        if (!headers_done) {
+            size_t end = buffer.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                continue;
+            }
+            buffer.erase(0, end + 4);
+            headers_done = true;
+        }
+        // Complete parts: boundary, part headers, body, CRLF
+        while (true) {
+            size_t header_end = buffer.find("\r\n\r\n");
+            size_t length_at = buffer.find("Content-Length: ");
+            if (header_end == std::string::npos || length_at == std::string::npos || length_at > header_end) {
+                break;
+            }
+            size_t length = strtoul(buffer.c_str() + length_at + 16, nullptr, 10);
+            size_t body = header_end + 4;
+            if (buffer.size() < body + length + 2) {
+                break;
+            }
+            FrameStamp stamp;
+            memcpy(&stamp, buffer.data() + body, sizeof(stamp));
+            client->latency_ms.push_back((micros() - stamp.published_us) / 1000.0f);
+            client->arrival_ms.push_back(millis() - started);
+            buffer.erase(0, body + length + 2);
+        }
+    }
+    close(fd);
+}
+
+// Latencies of frames that arrived in [from_ms, to_ms)
+static std::vector<float> window(const Client& client, unsigned long from_ms, unsigned long to_ms) {
+    std::vector<float> out;
+    for (size_t i = 0; i < client.latency_ms.size(); i++) {
+        if (client.arrival_ms[i] >= from_ms && client.arrival_ms[i] < to_ms) {
+            out.push_back(client.latency_ms[i]);
+        }
+    }
+    return out;
+}
+
+static float percentile(std::vector<float> values, float p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+static float mean(const std::vector<float>& values) {
+    float sum = 0;
+    for (float v : values) {
+        sum += v;
+    }
+    return values.empty() ? 0 : sum / values.size();
+}
+
+int main() {
+    if (!getenv("HOST_HTTP_PORT")) {
+        setenv("HOST_HTTP_PORT", TEST_PORT, 1);
+    }
+    setDefaultConfiguration();
+    g_config.stream.adaptive = false;       // Per-client pacing only
+    cameraMutex = xSemaphoreCreateMutex();
+    initFrameBroadcaster();
+    camera_initialized = true;              // No driver: frames come from produce()
+    initWebServer();
+    delay(200);
+
+    std::thread producer(produce);
+    Client fast = { 0, {}, {}, false };
+    Client slow = { LINK_BYTES_PER_S, {}, {}, false };
+    std::thread fast_thread(receive, &fast);
+    std::thread slow_thread(receive, &slow);
+
+    delay(RUN_MS - 500);
+    StreamClientStats stats[2];
+    int count = getStreamClientStats(stats, 2);
+    uint32_t dropped = 0;
+    for (int i = 0; i < count; i++) {
+        dropped = max(dropped, stats[i].frames_dropped);
+    }
+    delay(500);
+    running.store(false);
+    fast_thread.join();
+    slow_thread.join();
+    producer.join();
+
+    CHECK(fast.connected && slow.connected, "two /stream clients connected");
+
+    float transfer_ms = 1000.0f * FRAME_BYTES / LINK_BYTES_PER_S;
+    std::vector<float> steady = window(slow, WARMUP_MS, RUN_MS);
+    unsigned long middle = (WARMUP_MS + RUN_MS) / 2;
+    std::vector<float> first = window(slow, WARMUP_MS, middle);
+    std::vector<float> second = window(slow, middle, RUN_MS);
+    float slow_fps = steady.size() * 1000.0f / (RUN_MS - WARMUP_MS);
+    float link_fps = (float)LINK_BYTES_PER_S / FRAME_BYTES;
+    CHECK(slow_fps >= link_fps * 0.6f && slow_fps <= link_fps * 1.1f,
+          "throttled client: %.1f frames/s through a link that carries %.1f", slow_fps, link_fps);
+    CHECK(percentile(steady, 0.95f) <= 4 * transfer_ms,
+          "throttled client: p95 latency %.0f ms, under 4 frame transfers (%.0f ms)", percentile(steady, 0.95f),
+          4 * transfer_ms);
+    CHECK(mean(second) <= mean(first) * 1.25f + transfer_ms / 2,
+          "throttled client: latency not growing (%.0f ms, then %.0f ms)", mean(first), mean(second));
+    CHECK(dropped > 0, "throttled client: %u frames left out instead of queued", (unsigned)dropped);
+
+    std::vector<float> fast_steady = window(fast, WARMUP_MS, RUN_MS);
+    float fast_fps = fast_steady.size() * 1000.0f / (RUN_MS - WARMUP_MS);
+    CHECK(fast_fps >= FRAME_FPS * 0.9f, "fast client: %.1f frames/s of %d", fast_fps, FRAME_FPS);
+    CHECK(percentile(fast_steady, 0.95f) < 100, "fast client: p95 latency %.0f ms",
+          percentile(fast_steady, 0.95f));
+    return testResult();
+}
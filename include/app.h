@@ -7,6 +7,10 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "config.h"
+#include "frame_broadcaster.h"
+#include "camera_settings.h"
+#include "camera_profiles.h"
 
 // Task handles
 extern TaskHandle_t cameraTaskHandle;
@@ -39,7 +43,9 @@ enum EventType {
     EVENT_OTA_START,
     EVENT_OTA_PROGRESS,
     EVENT_OTA_COMPLETE,
-    EVENT_RESTART_REQUESTED
+    EVENT_RESTART_REQUESTED,
+    EVENT_MOTION_DETECTED,      // data: score in per mille
+    EVENT_MOTION_ENDED          // data: event duration in ms
 };
 
 struct Event {
@@ -54,12 +60,133 @@ void webServerTask(void* parameter);
 void watchdogTask(void* parameter);
 void sdCardTask(void* parameter);
 
-// Camera functions
+// Camera power. Standby powers the sensor down (PWDN, or the OV2640 COM2
+// standby bit without a PWDN line) and keeps the driver, its frame buffers
+// and the sensor registers; off deinitializes the driver.
+enum CameraPowerMode {
+    CAMERA_POWER_ACTIVE,
+    CAMERA_POWER_STANDBY,
+    CAMERA_POWER_OFF
+};
+
+struct CameraPowerStats {
+    CameraPowerMode mode;
+    unsigned long since;          // millis() of the last mode change
+    uint32_t last_wake_us;        // Wake request to first frame, 0 before the first wake
+    const char* last_wake_path;   // "standby", "reinit" or "none"
+    uint32_t registers_restored;  // Settings written by the last wake
+    uint32_t wakes;
+};
+
+// Driver frame buffers. Sized from the framesize and quality in use, or
+// for camera.ready_framesize when PSRAM has room, so switching up to it
+// needs no reallocation.
+struct CameraBufferStats {
+    int buffer_framesize;         // Init framesize the driver buffers were sized from
+    size_t buffer_bytes;          // Per buffer
+    int fb_count;
+    int ready_framesize;          // Configured, -1 when off
+    bool ready;                   // Buffers currently cover ready_framesize
+    uint32_t reconfigs;
+    uint32_t reprovisions;        // Reconfigurations that reallocated the buffers
+    uint32_t failed;              // Reallocations that fell back to the old buffers
+    uint32_t frames_discarded;    // Pre-switch/pre-wake frames dropped
+    uint32_t last_reconfig_us;
+    const char* last_path;        // "in_place", "reprovision" or "failed"
+};
+
+// Timing of the last profile switch (camera_profiles.h), measured to the
+// first frame captured after every register write had landed
+struct CameraSwitchStats {
+    bool pending;                 // Waiting for that frame
+    uint32_t latency_us;          // Switch request to that frame
+    uint32_t frames_lost;         // Frames the old capture rate would have delivered meanwhile
+    uint32_t frames_discarded;    // Of those, captured mid-switch and dropped
+};
+
+// Camera functions. Once the tasks run, the ones that change the driver or
+// sensor are called from the camera task only; other tasks queue a camera
+// request (below).
 bool initCamera();
 void deinitCamera();
 bool reinitCamera();
-camera_fb_t* captureFrame();
-void releaseFrame(camera_fb_t* fb);
+bool standbyCamera();             // False if the camera is not initialized
+bool wakeCamera();                // From standby, or a full init when off
+void getCameraPowerStats(CameraPowerStats* stats);
+
+// Applies the fields of target selected by mask (camera_settings.h) in one
+// pass under cameraMutex, skipping values the sensor already has. A failed
+// write rolls the batch back and returns false; g_config.camera changes only
+// on success. Framesize/quality changes reallocate the driver buffers when
+// the frames would not fit (or the buffers are more than twice too big);
+// streams keep running. Off or in standby only the config is updated.
+// With persist false (stream adaptation) the sensor and buffers change but
+// g_config.camera does not, buffers are never shrunk, and nothing is
+// applied (false) while the camera is off or in standby.
+bool updateCameraSettings(const CameraSettings& target, CameraSettingMask mask, CameraSettingsResult* result,
+                          bool persist = true);
+void getCameraBufferStats(CameraBufferStats* stats);
+
+// Camera changes run by the camera task between captures, so the task
+// asking for one never waits on cameraMutex or a driver reinit. A request
+// gets a ticket (0 when every slot is taken); the camera task wakes the
+// web server task after running each one.
+enum CameraRequestType {
+    CAMERA_REQUEST_SETTINGS,      // updateCameraSettings()
+    CAMERA_REQUEST_PROFILE,       // activateCameraProfile()
+    CAMERA_REQUEST_STANDBY,       // standbyCamera()
+    CAMERA_REQUEST_WAKE,          // wakeCamera()
+    CAMERA_REQUEST_OFF            // deinitCamera()
+};
+
+enum CameraRequestState {
+    CAMERA_REQUEST_QUEUED,
+    CAMERA_REQUEST_RUNNING,
+    CAMERA_REQUEST_DONE,
+    CAMERA_REQUEST_UNKNOWN        // Cancelled, collected or never issued
+};
+
+struct CameraRequest {
+    CameraRequestType type;
+    CameraSettings target;        // SETTINGS
+    CameraSettingMask mask;
+    bool persist;
+    char profile[PROFILE_NAME_LEN];   // PROFILE
+    const char* source;
+};
+
+struct CameraRequestOutcome {
+    bool ok;
+    CameraSettingsResult result;
+    uint32_t elapsed_us;          // Run time in the camera task
+};
+
+void initCameraRequests();
+
+// Queues request. With reply false nobody collects the outcome and the
+// slot frees itself once the request has run.
+uint32_t requestCamera(const CameraRequest& request, bool reply);
+
+// State of ticket; when done, fills *outcome and frees the slot
+CameraRequestState cameraRequestState(uint32_t ticket, CameraRequestOutcome* outcome);
+
+// Drops ticket if it has not started and returns true
+bool cancelCameraRequest(uint32_t ticket);
+
+// Stops waiting for ticket: it still runs, with its outcome discarded
+void releaseCameraRequest(uint32_t ticket);
+
+// Bracket an updateCameraSettings() call that should be timed as a switch.
+// After an applied switch, frames captured before it finished are dropped.
+void beginCameraSwitch();
+void endCameraSwitch(bool applied);
+void getCameraSwitchStats(CameraSwitchStats* stats);
+// Returns the newest published frame if it is at most max_age_ms old.
+// Otherwise returns an empty ref and sets *wait_seq to the frame to wait
+// past: acquireFrame(*wait_seq) returns the camera task's next capture.
+// Never waits and never touches the driver.
+FrameRef captureFrame(uint32_t max_age_ms, uint32_t* wait_seq);
+void getCaptureCacheStats(uint32_t* hits, uint32_t* misses);
 
 // LED functions
 void initLED();
@@ -0,0 +1,54 @@
+#ifndef BMP_STREAM_H
+#define BMP_STREAM_H
+
+#include <Arduino.h>
+#include "jpeg_rows.h"
+
+// JPEG to BMP conversion for /bmp, streamed. BMP stores its scanlines
+// bottom-up, so the writer decodes the JPEG one MCU row at a time from the
+// last row up (jpeg_rows.h) and converts one scanline per call into a line
+// buffer. Peak memory is the decoder tables, one MCU row of samples per
+// component and one scanline, never a full frame.
+//
+// Colour conversion and chroma upsampling (replication) match libjpeg with
+// do_fancy_upsampling off.
+
+enum BmpFormat {
+    BMP_RGB24,          // 24-bit BGR
+    BMP_GRAY8,          // 8-bit palette of grays, luma only
+    BMP_RGB565          // 16-bit BI_BITFIELDS
+};
+
+#define BMP_MAX_HEADER 66   // File and info headers plus RGB565 masks
+
+struct BmpWriter {
+    JpegRowDecoder decoder;
+    BmpFormat format;
+    int width;
+    int height;
+    uint8_t header[BMP_MAX_HEADER];
+    size_t header_len;
+    size_t pixel_offset;    // Header plus palette
+    size_t row_bytes;       // Scanline, padded to 4 bytes
+    size_t total;           // File size
+    size_t position;        // Bytes emitted so far
+    int decoded_row;        // MCU row in the decoder planes, -1 for none
+    int line_y;             // Image line in line_buffer, -1 for none
+    uint8_t* line_buffer;
+};
+
+// "rgb24", "gray" or "rgb565"
+bool parseBmpFormat(const String& name, BmpFormat* format);
+const char* bmpFormatName(BmpFormat format);
+
+// Prepares the conversion of jpeg, which must stay valid until
+// bmpWriterDestroy(). Returns nullptr and sets *result on failure.
+BmpWriter* bmpWriterCreate(const uint8_t* jpeg, size_t len, BmpFormat format, JpegDcResult* result);
+
+// Copies the next bytes of the BMP file into buffer. Returns 0 at the end
+// of the file or when the JPEG data fails to decode.
+size_t bmpWriterRead(BmpWriter* writer, uint8_t* buffer, size_t maxLen);
+
+void bmpWriterDestroy(BmpWriter* writer);
+
+#endif // BMP_STREAM_H
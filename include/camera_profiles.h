@@ -0,0 +1,113 @@
+#ifndef CAMERA_PROFILES_H
+#define CAMERA_PROFILES_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "camera_settings.h"
+
+// Named camera profiles: every CameraSettings field (LED and
+// ready_framesize included) plus the capture rate. Each profile is one
+// small NVS blob in its own namespace, so saving or deleting one never
+// rewrites config.json; all of them are cached in RAM at boot. Activating
+// a profile writes only the registers that differ from the sensor
+// (updateCameraSettings()) and is timed to the first frame that carries it.
+// Like /control, activation changes the running settings only.
+//
+// The scheduler checks its rules every PROFILE_SCHEDULE_INTERVAL_MS from
+// the web server task. The first rule that matches picks the profile, and
+// it has to keep matching for PROFILE_SCHEDULE_HOLD samples before the
+// profile is queued for activation on the camera task. Rules act on changes only: a profile picked by
+// hand stays until a different rule starts matching.
+//
+//   time         local [from, to) window, wraps past midnight; needs SNTP
+//   light_below  smoothed light index under the threshold
+//   light_above  smoothed light index over the threshold
+//
+// The light index is the average luma the scene would give at full
+// exposure and 1x gain, from the OV2640's YAVG, AEC and gain registers. It
+// does not depend on the exposure settings of the active profile, so a
+// night profile with more gain does not switch itself back off. Leave a gap
+// between the below and above thresholds.
+
+#define PROFILE_MAX 8
+#define PROFILE_NAME_LEN 16                // Including the terminator
+#define PROFILE_RULE_MAX 8
+#define PROFILE_TZ_LEN 48                  // POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+#define PROFILE_SCHEDULE_INTERVAL_MS 5000
+#define PROFILE_SCHEDULE_HOLD 3            // Consecutive samples a rule must match
+#define PROFILE_LIGHT_SMOOTHING 4          // Light index EMA weight 1/n
+#define PROFILE_NTP_SERVER "pool.ntp.org"
+#define PROFILE_JSON_SIZE 1536             // POST /profile and /profiles/schedule bodies
+
+struct CameraProfile {
+    char name[PROFILE_NAME_LEN];
+    CameraSettings camera;
+    int capture_fps;
+};
+
+enum ProfileRuleType {
+    PROFILE_RULE_TIME,
+    PROFILE_RULE_LIGHT_BELOW,
+    PROFILE_RULE_LIGHT_ABOVE
+};
+
+struct ProfileRule {
+    ProfileRuleType type;
+    char profile[PROFILE_NAME_LEN];
+    uint16_t from_minute;              // TIME: local minutes since midnight
+    uint16_t to_minute;
+    int light;                         // LIGHT_*: threshold on the light index
+};
+
+struct ProfileSchedule {
+    bool enabled;
+    char tz[PROFILE_TZ_LEN];
+    int rule_count;
+    ProfileRule rules[PROFILE_RULE_MAX];
+};
+
+struct CameraProfileState {
+    char active[PROFILE_NAME_LEN];     // Last profile activated, "" if none since boot
+    const char* source;                // "request" or "schedule"
+    uint32_t switches;
+    unsigned long last_switch;         // millis() of the last activation
+    int written;                       // Registers the last switch wrote
+    int skipped;                       // Registers it found already set
+    bool deferred;                     // Camera was off or in standby
+    uint32_t apply_us;                 // updateCameraSettings() for the last switch
+    int light;                         // Smoothed light index, -1 before the first sample
+    int rule;                          // Schedule rule matching now, -1 for none
+    bool clock_valid;                  // Local time known (SNTP answered)
+};
+
+// Loads the profiles and the schedule from NVS. Call once at boot.
+void initCameraProfiles();
+
+// Copies of the cached profiles, by slot or by name; false if absent
+int getCameraProfileCount();
+bool getCameraProfile(int slot, CameraProfile* profile);
+bool findCameraProfile(const char* name, CameraProfile* profile);
+
+// Creates or replaces a profile. False when the name is invalid, every
+// slot is taken, or NVS refuses the write.
+bool saveCameraProfile(const CameraProfile& profile);
+bool deleteCameraProfile(const char* name);
+void clearCameraProfiles();
+
+// Applies a stored profile. False if there is no such profile or the
+// sensor rejected it (rolled back as for /control); result says which.
+// Camera task only: other tasks queue a CAMERA_REQUEST_PROFILE (app.h).
+bool activateCameraProfile(const char* name, const char* source, CameraSettingsResult* result);
+
+// Validates and stores a schedule; rules may name profiles saved later
+bool setProfileSchedule(const ProfileSchedule& schedule);
+void getProfileSchedule(ProfileSchedule* schedule);
+const char* profileRuleTypeName(ProfileRuleType type);
+
+// Light index sample and schedule evaluation. Runs once per second in the
+// web server task and does its work every PROFILE_SCHEDULE_INTERVAL_MS.
+void updateProfileSchedule();
+
+void getCameraProfileState(CameraProfileState* state);
+
+#endif // CAMERA_PROFILES_H
@@ -0,0 +1,60 @@
+#ifndef CAMERA_RESPONSE_H
+#define CAMERA_RESPONSE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "app.h"
+
+// Builds the reply to a finished camera request: returns the status and
+// sets the JSON body. arg is what the handler passed along.
+typedef int (*CameraReplyBuilder)(const CameraRequest& request, const CameraRequestOutcome& outcome, int arg,
+                                  String* body);
+
+// Reply to a handler that queued a camera request (app.h). Like
+// AsyncCaptureResponse it assembles no head until the reply is known:
+// serviceCameraResponses() starts it from the web server task once the
+// camera task has run the request, or with a 503 when the request has not
+// started after CAMERA_REQUEST_TIMEOUT_MS. A client that goes away first
+// leaves the request to run unreported.
+class AsyncCameraResponse : public AsyncAbstractResponse {
+public:
+    AsyncCameraResponse(uint32_t ticket, const CameraRequest& request, CameraReplyBuilder build, int arg);
+    ~AsyncCameraResponse();
+
+    void _respond(AsyncWebServerRequest* request) override;
+    size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override;
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+    // Called from the request's disconnect handler before it is deleted
+    void close();
+
+    // Starts the reply if its request has run or the wait timed out
+    void resume();
+
+private:
+    void startLocked();
+
+    uint32_t _ticket;              // 0 once collected or cancelled
+    CameraRequest _camera_request;
+    CameraReplyBuilder _build;
+    int _arg;
+    AsyncWebServerRequest* _request;
+    SemaphoreHandle_t _lock;       // Recursive: starting the reply sends its first bytes
+    unsigned long _wait_start;
+    bool _started;
+    bool _closed;
+    String _body;
+    size_t _offset;
+
+    AsyncCameraResponse* _next;    // Waiting response registry
+    friend void serviceCameraResponses();
+};
+
+void initCameraResponses();
+
+// Starts waiting replies whose camera request has run. Runs in the web
+// server task, which the camera task wakes after each request.
+void serviceCameraResponses();
+
+#endif // CAMERA_RESPONSE_H
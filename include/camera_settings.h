@@ -0,0 +1,61 @@
+#ifndef CAMERA_SETTINGS_H
+#define CAMERA_SETTINGS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "esp_camera.h"
+
+// Table of the CameraSettings fields shared by initCamera(), standby wake
+// and /control. Each entry knows its valid range and, for fields backed by
+// a sensor register, how to read the value the sensor has (from
+// sensor_t::status, which the driver updates on every successful write)
+// and how to write it. Names are looked up through a perfect hash.
+
+struct CameraSettingField {
+    const char* name;
+    int CameraSettings::*member;
+    int16_t min;
+    int16_t max;
+    int (*read)(const sensor_t* s);         // nullptr for config-only fields
+    int (*write)(sensor_t* s, int value);   // 0 on success
+};
+
+#define CAMERA_SETTING_FIELDS 24            // Entries in the table
+#define CAMERA_SETTING_COUNT 23             // Of those, backed by a sensor register
+#define CAMERA_SETTING_SLOT_BITS 6          // Perfect-hash slots: top bits of the hash
+#define CAMERA_SETTING_SLOT_COUNT (1 << CAMERA_SETTING_SLOT_BITS)
+
+// Field bitmasks, by table index
+typedef uint32_t CameraSettingMask;
+#define CAMERA_SETTINGS_ALL ((CameraSettingMask)((1UL << CAMERA_SETTING_FIELDS) - 1))
+#define CAMERA_SETTING_BIT(index) ((CameraSettingMask)1 << (index))
+
+// Table indices the camera code treats specially
+#define CAMERA_SETTING_FRAMESIZE 0
+#define CAMERA_SETTING_QUALITY 1
+#define CAMERA_SETTING_LED 23
+
+struct CameraSettingsResult {
+    int written;                         // Sensor writes that took effect
+    int skipped;                         // Requested fields the sensor already had
+    const CameraSettingField* failed;    // Write that failed, nullptr if none
+    int rolled_back;                     // Writes undone after the failure
+    bool deferred;                       // Camera off or in standby: config only
+};
+
+// nullptr for unknown names
+const CameraSettingField* findCameraSetting(const char* name);
+const CameraSettingField* cameraSettingField(int index);
+
+static inline bool cameraSettingInRange(const CameraSettingField* field, int value) {
+    return value >= field->min && value <= field->max;
+}
+
+// Writes the sensor fields selected by mask whose target value differs from
+// the sensor, or all of them when force is set, in table order. If a write
+// fails, the writes already made are undone in reverse order and false is
+// returned. Config-only fields in mask are ignored.
+bool writeCameraSettings(sensor_t* s, const CameraSettings& target, CameraSettingMask mask,
+                         bool force, CameraSettingsResult* result);
+
+#endif // CAMERA_SETTINGS_H
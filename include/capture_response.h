@@ -0,0 +1,89 @@
+#ifndef CAPTURE_RESPONSE_H
+#define CAPTURE_RESPONSE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "config.h"
+#include "frame_broadcaster.h"
+#include "bmp_stream.h"
+#include "thumbnail.h"
+#include "roi_view.h"
+
+// What a /capture or /bmp request asked for
+struct CaptureOptions {
+    bool bmp;                  // /bmp, else /capture
+    int scale;                 // /capture?scale=, 1 for the full frame
+    RoiSpec roi;               // /capture?roi=&rotate=
+    BmpFormat format;          // /bmp?format=
+    uint32_t etag_boot;        // Boot id in the ETag
+    String if_none_match;      // Request header, empty when absent
+};
+
+struct CaptureResponseStats {
+    uint32_t timeouts;         // Waits that ended without a frame or its conversion
+    uint32_t not_modified;     // 304 replies
+    int waiting;               // Responses waiting now
+};
+
+// Reply to /capture or /bmp. The handler never waits: it passes the cached
+// frame when captureFrame() had a fresh one, or the sequence to wait past.
+// A waiting response assembles no head and AsyncTCP callbacks into it
+// write nothing; serviceCaptureResponses() starts it from the web server
+// task once the camera task publishes the next frame, or with a 500 after
+// CAPTURE_WAIT_TIMEOUT_MS. A ?scale= or ?roi= reply then waits the same
+// way for the conversion task (frame_convert.h), with a 503 when that
+// takes past CAPTURE_WAIT_TIMEOUT_MS. The status (200, 304 on a matching
+// ETag, a conversion error), length and headers are only known then, so
+// they are set and counted for /metrics at that point.
+class AsyncCaptureResponse : public AsyncAbstractResponse {
+public:
+    AsyncCaptureResponse(const CaptureOptions& options, FrameRef frame, uint32_t wait_seq);
+    ~AsyncCaptureResponse();
+
+    void _respond(AsyncWebServerRequest* request) override;
+    size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override;
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+    // Called from the request's disconnect handler before it is deleted
+    void close();
+
+    // Starts the reply if its frame has arrived or the wait timed out
+    void resume();
+
+private:
+    void startLocked();
+    bool prepare(FrameRef& frame);
+    void prepareError(int code, const String& body, bool retry_later);
+
+    CaptureOptions _options;
+    AsyncWebServerRequest* _request;
+    SemaphoreHandle_t _lock;       // Recursive: starting the reply sends its first bytes
+    uint32_t _wait_seq;
+    unsigned long _wait_start;
+    bool _started;
+    bool _closed;
+
+    // The body: an error or 304 in _body, else a converted copy, a BMP
+    // conversion of _frame, or _frame itself. Before the start, _frame is
+    // the cached frame passed in or the one waiting for its conversion.
+    FrameRef _frame;
+    ConvertedFrameRef _converted;
+    BmpWriter* _bmp;
+    String _body;
+    size_t _offset;
+
+    AsyncCaptureResponse* _next;   // Waiting response registry
+    friend void serviceCaptureResponses();
+    friend void getCaptureResponseStats(CaptureResponseStats* stats);
+};
+
+void initCaptureResponses();
+
+// Starts waiting /capture and /bmp replies whose frame has arrived. Runs
+// in the web server task after each published frame.
+void serviceCaptureResponses();
+
+void getCaptureResponseStats(CaptureResponseStats* stats);
+
+#endif // CAPTURE_RESPONSE_H
@@ -21,21 +21,102 @@
 #define DEFAULT_CONTRAST 0                 // -2 to 2
 #define DEFAULT_SATURATION 0               // -2 to 2
 
+// Default capture rate and stream adaptation bounds
+#define DEFAULT_CAPTURE_FPS 20
+#define DEFAULT_STREAM_MAX_QUALITY 30
+#define DEFAULT_STREAM_MIN_FRAMESIZE FRAMESIZE_QVGA
+
+// Default /stream admission limits
+#define DEFAULT_STREAM_MAX_CLIENTS 4
+#define DEFAULT_STREAM_MAX_KBPS 0          // Total /stream egress in KB/s, 0 = unlimited
+#define ADMISSION_MAX_CLIENTS 16           // Highest admission.max_clients accepted
+#define ADMISSION_MAX_TRUSTED 4
+#define ADMISSION_TOKEN_LEN 33
+
+// Default pre-event ring for /clip
+#define DEFAULT_CLIP_BUFFER_KB 1024
+#define DEFAULT_CLIP_BUFFER_SECONDS 10
+#define CLIP_MAX_BUFFER_KB 3072            // Highest clip.buffer_kb accepted
+#define CLIP_MAX_BUFFER_SECONDS 120
+#define CLIP_MIN_BUFFER_KB 64              // Smaller rings are not allocated
+#define CLIP_PSRAM_RESERVE_KB 1664         // PSRAM left for frame buffers and pressure headroom, besides /burst
+#define CLIP_MAX_AFTER_SECONDS 60
+
+// Default motion detection (motion_detect.h)
+#define DEFAULT_MOTION_THRESHOLD 12        // Block mean change, luma levels
+#define DEFAULT_MOTION_TRIGGER_PERMILLE 20 // Changed blocks per mille that start an event
+#define DEFAULT_MOTION_BUDGET_US 8000      // Average analysis time per captured frame
+#define DEFAULT_MOTION_HOLD_MS 3000        // Quiet time before an event ends
+#define MOTION_MIN_BUDGET_US 1000
+#define MOTION_MAX_BUDGET_US 100000
+
+// Default activity-adaptive capture rate (scene_activity.h)
+#define DEFAULT_ACTIVITY_IDLE_FPS 2
+#define DEFAULT_ACTIVITY_IDLE_AFTER_MS 10000  // Static this long before dropping to idle_fps
+#define DEFAULT_ACTIVITY_SIZE_PERCENT 5       // JPEG size change that counts as a change
+#define DEFAULT_ACTIVITY_THRESHOLD 6          // Signature cell change, luma levels
+
+// /burst capture buffer, preallocated in PSRAM
+#define BURST_BUFFER_KB 1024
+#define BURST_MAX_FRAMES 30
+#define BURST_MAX_INTERVAL_MS 1000
+
 // Memory and performance settings
 #define MAX_WIFI_NETWORKS 3
-#define CONFIG_JSON_SIZE 2048
+// Config document at the most the schema allows: every network with a
+// static IP, every trusted address and each string at its longest. Keys
+// are counted too, as loading copies them. Expanded where ArduinoJson is
+// included.
+#define CONFIG_JSON_SIZE \
+    (JSON_OBJECT_SIZE(13) + JSON_ARRAY_SIZE(MAX_WIFI_NETWORKS) + \
+     MAX_WIFI_NETWORKS * (JSON_OBJECT_SIZE(6) + 2 * JSON_ARRAY_SIZE(4) + 32 + 64) + \
+     JSON_OBJECT_SIZE(25) + JSON_OBJECT_SIZE(5) + /* camera, stream */ \
+     JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(ADMISSION_MAX_TRUSTED) + ADMISSION_TOKEN_LEN + \
+     ADMISSION_MAX_TRUSTED * 16 + /* admission */ \
+     JSON_OBJECT_SIZE(2) + 2 * JSON_OBJECT_SIZE(5) + /* clip, motion, activity */ \
+     65 + 32 + CONFIG_JSON_KEY_BYTES) /* password hash, OTA password */
+#define CONFIG_JSON_KEY_BYTES 640          // Every key name in the config once, with its terminator
+#define JSON_BODY_MAX 4096                 // Largest POST /control, /profile and /profiles/schedule body
+#define CONTROL_JSON_SIZE 1024             // POST /control batch (every camera setting fits)
+#define STATUS_JSON_SIZE 4096              // GET /status without its sessions: ~170 slots plus strings
+#define STATUS_SESSION_JSON_SIZE 128       // Each stream session listed in /status: 8 slots
+#define STATUS_JSON_MAX_SIZE 16384         // Largest /status document tried after an overflow
+#define STATUS_MAX_SESSIONS 8
 #define STREAM_BOUNDARY "frame"
-#define DEFAULT_FRAMERATE 10
+#define DEFAULT_FRAMERATE 10               // Per-client /stream rate when ?fps= is not given
+#define DEFAULT_CAPTURE_MAX_AGE_MS 1000    // Oldest cached frame /capture serves without ?max_age=
+#define CAPTURE_WAIT_TIMEOUT_MS 1000       // Longest /capture and /bmp wait for a new frame
+#define CAMERA_MAX_REQUESTS 4              // Camera changes queued for the camera task
+#define CAMERA_REQUEST_TIMEOUT_MS 2000     // Longest a camera change waits to start before a 503
+#define CAMERA_RETRY_AFTER_S 1             // Retry-After on a camera change refused as busy
+#define STREAM_MAX_FPS 30
+#define STREAM_STATIC_KEEPALIVE_MS 10000  // Longest gap /stream?skip_static=1 leaves between frames
+#define CAMERA_FB_COUNT 3                  // Default driver frame buffers with PSRAM
+#define DEFAULT_FRAME_POOL_DEPTH (CAMERA_FB_COUNT + 1)  // Frame descriptors (driver buffers + 1)
+#define FRAME_POOL_MAX_DEPTH 8
+#define CAMERA_FB_HEADROOM_PERCENT 50      // Frame buffer room over the expected JPEG size
+#define CAMERA_READY_PSRAM_RESERVE (256 * 1024)  // PSRAM left free when sizing for ready_framesize
+#define DEFAULT_READY_FRAMESIZE -1         // Largest framesize to keep buffers for, -1 = current only
 
 // Task priorities and core affinity
 #define CAMERA_TASK_PRIORITY 2
 #define WEB_TASK_PRIORITY 2
 #define SD_TASK_PRIORITY 1
 #define WATCHDOG_TASK_PRIORITY 3
+#define CONVERT_TASK_PRIORITY 1            // Thumbnail/ROI conversions, below capture and pacing
 
 #define CAMERA_CORE 1
 #define WEB_CORE 0
 #define SD_CORE 0
+#define CONVERT_CORE 1                     // Leaves core 0 to WiFi and async_tcp
+
+// Task stack sizes in bytes; see /tasks for measured high-water marks
+#define CAMERA_TASK_STACK 8192
+#define WEB_TASK_STACK 8192
+#define WATCHDOG_TASK_STACK 4096
+#define SD_TASK_STACK 4096
+#define CONVERT_TASK_STACK 8192
+#define ASYNC_TCP_TASK_STACK 16384         // Fixed by AsyncTCP (8192 * 2)
 
 // WiFi network configuration structure
 struct WiFiNetwork {
@@ -73,6 +154,51 @@ struct CameraSettings {
     int raw_gma;       // Gamma correction
     int lenc;          // Lens correction
     int led_intensity; // Flash LED 0-255
+    int ready_framesize; // Keep frame buffers for up to this framesize, -1 off
+};
+
+// Capture rate and stream bandwidth adaptation bounds
+struct StreamSettings {
+    int capture_fps;   // Camera task capture rate shared by all consumers
+    int frame_pool_depth; // Shared frame descriptors, applied at boot
+    bool adaptive;     // Step quality/framesize down while clients are congested
+    int max_quality;   // Highest (worst) quality number adaptation may use
+    int min_framesize; // Smallest framesize adaptation may use
+};
+
+// /stream admission control. Clients presenting the operator token (?token=
+// or "Authorization: Bearer") or connecting from a trusted address get a
+// higher priority class; see mjpeg_stream.h
+struct AdmissionSettings {
+    int max_clients;   // Concurrent /stream clients, 0 = unlimited
+    int max_kbps;      // Total /stream egress in KB/s, 0 = unlimited
+    char operator_token[ADMISSION_TOKEN_LEN];  // Empty disables the operator class
+    int trusted_count;
+    uint8_t trusted_ips[ADMISSION_MAX_TRUSTED][4];
+};
+
+// Pre-event frame ring for /clip, allocated in PSRAM at boot
+struct ClipSettings {
+    int buffer_kb;      // Ring size, 0 disables /clip
+    int buffer_seconds; // Longest history kept, whichever limit hits first
+};
+
+// Motion detection on the captured JPEGs, in the camera task
+struct MotionSettings {
+    bool enabled;
+    int threshold;        // Change in a block's mean luma that marks it changed
+    int trigger_permille; // Changed blocks per mille that count as motion
+    int budget_us;        // Per-frame analysis budget; frames are skipped to stay in it
+    int hold_ms;          // Motion ends after this long below the trigger
+};
+
+// Capture rate drop while consecutive frames are near-identical
+struct ActivitySettings {
+    bool enabled;
+    int idle_fps;         // Capture rate while idle
+    int idle_after_ms;    // Static time before going idle
+    int size_percent;     // JPEG size change that marks a frame changed
+    int threshold;        // DC signature cell change that marks a frame changed
 };
 
 // System configuration structure
@@ -80,6 +206,11 @@ struct SystemConfig {
     WiFiNetwork networks[MAX_WIFI_NETWORKS];
     int network_count;
     CameraSettings camera;
+    StreamSettings stream;
+    AdmissionSettings admission;
+    ClipSettings clip;
+    MotionSettings motion;
+    ActivitySettings activity;
     char admin_password_hash[65];  // SHA256 hash
     bool ota_enabled;
     char ota_password[32];
@@ -94,7 +225,8 @@ extern bool g_config_loaded;
 
 // Configuration management functions
 bool loadConfiguration();
-bool saveConfiguration();
+bool saveConfiguration();     // Deferred (returns true) under memory pressure
+bool configSaveDeferred();
 bool resetConfiguration();
 bool validateConfiguration(const JsonDocument& doc);
 void setDefaultConfiguration();
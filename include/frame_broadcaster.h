@@ -0,0 +1,133 @@
+#ifndef FRAME_BROADCASTER_H
+#define FRAME_BROADCASTER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <memory>
+#include "esp_camera.h"
+
+// Pooled descriptor for a captured frame shared by every consumer. The
+// driver buffer is returned with esp_camera_fb_return() when the last
+// reference is dropped. Only FrameRef and the broadcaster touch these.
+struct FrameSlot {
+    camera_fb_t* fb;
+    const uint8_t* buf;        // fb->buf and fb->len at publish, so the
+    size_t len;                // length stays readable after a deinit
+    uint32_t seq;              // Monotonic frame sequence number
+    unsigned long timestamp;   // millis() at capture
+    uint32_t generation;       // Driver generation the buffer belongs to
+    int16_t motion;            // Motion score in per mille, -1 if not analysed
+    uint32_t scene;            // Advances on changed frames (scene_activity.h), 0 if unknown
+    std::atomic<int> refs;     // Mailbox + consumers currently holding it
+    std::atomic<bool> in_use;  // Claimed by the producer or still referenced
+};
+
+// Move-only owning handle to one reference on a pooled frame. The
+// reference is dropped exactly once, when the handle is reset, overwritten
+// or destroyed, so a frame can be held safely across async sends.
+class FrameRef {
+public:
+    FrameRef() : _slot(nullptr) {}
+    FrameRef(FrameRef&& other) : _slot(other._slot) { other._slot = nullptr; }
+    FrameRef& operator=(FrameRef&& other);
+    ~FrameRef() { reset(); }
+
+    FrameRef(const FrameRef&) = delete;
+    FrameRef& operator=(const FrameRef&) = delete;
+
+    explicit operator bool() const { return _slot != nullptr; }
+
+    // False once the driver that produced the buffer was deinitialized
+    bool valid() const;
+
+    // Takes an additional reference on the same frame
+    FrameRef share() const;
+
+    void reset();
+
+    // Accessors - only call on a non-empty handle. Read data() only under
+    // a FrameReadGuard, unless on the camera task (which is the one that
+    // deinitializes the driver).
+    const uint8_t* data() const { return _slot->buf; }
+    size_t length() const { return _slot->len; }
+    uint32_t seq() const { return _slot->seq; }
+    unsigned long timestamp() const { return _slot->timestamp; }
+    int motion() const { return _slot->motion; }
+    uint32_t scene() const { return _slot->scene; }
+    const camera_fb_t* fb() const { return _slot->fb; }
+
+private:
+    explicit FrameRef(FrameSlot* slot) : _slot(slot) {}
+
+    FrameSlot* _slot;
+    friend FrameRef acquireFrame(uint32_t last_seq);
+};
+
+// Keeps the driver buffers alive while a frame's data is read outside the
+// camera task: flushFrameBroadcaster(), and so esp_camera_deinit(), waits
+// until every open guard is gone. Check ok() first and read only while the
+// guard lives. Hold it for a bounded copy or conversion, never across a
+// wait, and never while taking cameraMutex.
+class FrameReadGuard {
+public:
+    explicit FrameReadGuard(const FrameRef& frame);
+    ~FrameReadGuard();
+
+    FrameReadGuard(const FrameReadGuard&) = delete;
+    FrameReadGuard& operator=(const FrameReadGuard&) = delete;
+
+    // False for an empty handle or a frame of a deinitialized driver
+    bool ok() const { return _ok; }
+
+private:
+    bool _held;
+    bool _ok;
+};
+
+// A JPEG made from a frame (thumbnail.h, roi_view.h). It owns a copy of the
+// data, so it outlives the frame and does not hold a driver buffer.
+struct ConvertedFrame {
+    uint8_t* data;             // heap_caps allocation, freed on destruction
+    size_t length;
+    uint32_t seq;              // Frame it was made from
+    unsigned long timestamp;   // Capture time of that frame
+    int width;
+    int height;
+
+    virtual ~ConvertedFrame();
+};
+
+typedef std::shared_ptr<const ConvertedFrame> ConvertedFrameRef;
+
+// Descriptor pool counters for /status
+struct FramePoolStats {
+    int depth;               // Descriptors in the pool
+    int in_use;              // Descriptors holding a frame right now
+    uint32_t exhausted;      // Times the producer had to wait for a descriptor
+    uint32_t dropped;        // Captured frames returned unpublished
+    uint32_t bad_releases;   // Releases of a frame that was already free
+};
+
+// Broadcaster lifecycle. The pool is sized from stream.frame_pool_depth on
+// first init; frameBufferCount() is the driver fb_count that fits it.
+void initFrameBroadcaster();
+void flushFrameBroadcaster();
+int frameBufferCount();
+
+// Producer side - only the camera task calls these
+bool frameSlotAvailable();
+void publishFrame(camera_fb_t* fb, int motion = -1, uint32_t scene = 0);
+
+// Consumer side of the lock-free latest-frame mailbox: returns the newest
+// frame with seq > last_seq, or an empty handle when nothing newer has been
+// published yet. Never blocks.
+FrameRef acquireFrame(uint32_t last_seq);
+
+// Stream client bookkeeping
+void addStreamClient();
+void removeStreamClient();
+int getStreamClientCount();
+uint32_t getFramesPublished();
+void getFramePoolStats(FramePoolStats* stats);
+
+#endif // FRAME_BROADCASTER_H
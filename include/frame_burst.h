@@ -0,0 +1,45 @@
+#ifndef FRAME_BURST_H
+#define FRAME_BURST_H
+
+#include <Arduino.h>
+
+// Burst capture for /burst. The camera task grabs N frames back to back
+// (or on a fixed interval) into a PSRAM buffer allocated at boot, while the
+// response streams out whatever has been captured so far. Capture timing
+// therefore never waits on the network. One burst runs at a time.
+
+struct BurstFrameInfo {
+    const uint8_t* data;
+    size_t len;
+    unsigned long timestamp_us;  // micros() when the driver handed it over
+};
+
+struct BurstSummary {
+    int requested;
+    int captured;
+    uint32_t interval_ms;        // Requested spacing, 0 = sensor rate
+    uint32_t mean_interval_us;   // Achieved spacing between frames
+    uint32_t min_interval_us;
+    uint32_t max_interval_us;
+    bool truncated;              // Buffer full or camera stopped early
+};
+
+bool initBurstBuffer();
+
+// Web side: reserves the burst buffer. Returns false if disabled or busy;
+// on success the caller owns the burst until releaseBurst().
+bool requestBurst(int count, uint32_t interval_ms);
+void releaseBurst();
+
+int getBurstFrameCount();
+bool getBurstFrame(int index, BurstFrameInfo* info);
+bool burstComplete();
+void getBurstSummary(BurstSummary* summary);
+
+// Camera task side
+bool takeBurstRequest(int* count, uint32_t* interval_ms);
+bool storeBurstFrame(const uint8_t* data, size_t len, unsigned long timestamp_us);
+bool burstCancelled();
+void finishBurst();
+
+#endif // FRAME_BURST_H
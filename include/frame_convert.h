@@ -0,0 +1,53 @@
+#ifndef FRAME_CONVERT_H
+#define FRAME_CONVERT_H
+
+#include <Arduino.h>
+#include "frame_broadcaster.h"
+#include "thumbnail.h"
+#include "roi_view.h"
+
+// Thumbnail and ROI conversions for /stream and /capture, run by a task of
+// their own so that neither async_tcp nor the web server task ever decodes
+// a frame. A response asks for its conversion from its fill or start
+// callback and gets the result when it is ready, or CONVERT_PENDING and
+// returns RESPONSE_TRY_AGAIN; the conversion task wakes the web server
+// task after each job, which resumes the waiting responses.
+//
+// Requests for the same frame and conversion share one job, and the
+// thumbnail.h and roi_view.h caches behind it. A job holds its frame until
+// it has been converted.
+
+#define CONVERT_MAX_JOBS 8
+
+enum ConvertState {
+    CONVERT_PENDING,           // Queued or converting; ask again later
+    CONVERT_DONE,
+    CONVERT_FAILED
+};
+
+// A thumbnail when scale is over 1, else the ROI view of roi
+struct ConvertSpec {
+    int scale;
+    RoiSpec roi;
+};
+
+struct ConvertStats {
+    uint32_t jobs;             // Conversions handed to the task
+    uint32_t shared;           // Requests answered by an existing job
+    uint32_t busy;             // Requests turned away with every job pending
+    int pending;               // Jobs queued or converting now
+    uint32_t last_wait_ms;     // Queued to converted, last job
+    uint32_t max_wait_ms;
+};
+
+// Creates the job table and starts the conversion task
+void initFrameConvert();
+
+// Looks up or queues the conversion of frame. Sets *out when done, and
+// *result when failed. Never blocks on a conversion.
+ConvertState requestConversion(const FrameRef& frame, const ConvertSpec& spec, ConvertedFrameRef* out,
+                               JpegDcResult* result);
+
+void getConvertStats(ConvertStats* stats);
+
+#endif // FRAME_CONVERT_H
@@ -0,0 +1,57 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <Arduino.h>
+#include "frame_broadcaster.h"
+
+// Pre-event ring of recent JPEG frames in PSRAM. Frames are variable-size,
+// so they are packed back to back in one buffer with wraparound and found
+// through a separate index; the oldest frames are evicted as space or the
+// configured retention runs out.
+
+// Index entry / lookup result for one buffered frame
+struct RingFrameInfo {
+    size_t offset;           // Start of the JPEG data in the ring buffer
+    size_t len;
+    uint32_t seq;            // Frame sequence number from the broadcaster
+    unsigned long timestamp; // millis() at capture
+};
+
+struct FrameRingStats {
+    bool enabled;
+    size_t capacity;           // Ring buffer bytes
+    size_t used;               // Bytes held by buffered frames
+    int frames;
+    unsigned long oldest_timestamp;  // millis() of the oldest frame, 0 if empty
+    uint32_t oversized;        // Frames too large to buffer
+    uint32_t resize_dropped;   // Frames that did not fit a shrunk ring
+};
+
+// Allocates the ring from clip.buffer_kb / clip.buffer_seconds on first
+// call, smaller when PSRAM cannot spare that much next to the frame and
+// burst buffers. Returns false when disabled or out of PSRAM.
+bool initFrameRing();
+bool frameRingEnabled();
+
+// Capacity allocated by initFrameRing(), which a shrunk ring grows back to
+size_t frameRingGrantedCapacity();
+
+// Reallocates the ring to capacity bytes. The newest buffered frames that
+// fit are kept. Shrinking is done in place; a grow that does not fit keeps
+// the current buffer and returns false.
+bool resizeFrameRing(size_t capacity);
+
+// Copies a published frame into the ring. Camera task only.
+void appendRingFrame(const FrameRef& frame);
+
+// Finds the oldest buffered frame with seq > after_seq captured at or
+// after not_before. Returns false if there is none (yet).
+bool findRingFrame(uint32_t after_seq, unsigned long not_before, RingFrameInfo* info);
+
+// Copies up to len bytes of frame seq starting at offset. Returns 0 when
+// the frame has been evicted since it was found.
+size_t copyRingFrame(uint32_t seq, size_t offset, uint8_t* dst, size_t len);
+
+void getFrameRingStats(FrameRingStats* stats);
+
+#endif // FRAME_RING_H
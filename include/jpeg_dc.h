@@ -0,0 +1,100 @@
+#ifndef JPEG_DC_H
+#define JPEG_DC_H
+
+#include <Arduino.h>
+
+// DC-only decoder for the baseline Huffman JPEGs the OV2640 produces.
+// Walks the entropy-coded data once: DC coefficients are decoded and
+// dequantized, AC coefficients are only Huffman-decoded far enough to be
+// skipped. No IDCT, no colour conversion. The result is the mean luma of
+// every 8x8 luma block, which is a 1/8-scale greyscale image of the frame.
+//
+// Interleaved scans with up to 3 components and luma sampling up to 2x2
+// (4:2:2 from the OV2640, 4:2:0, 4:4:4) and restart intervals are
+// supported; progressive and arithmetic-coded files are not.
+
+#define JPEG_HUFF_LOOKAHEAD 9             // Codes up to this long decode in one lookup
+#define JPEG_MAX_COMPONENTS 3
+#define JPEG_MAX_BLOCKS_PER_MCU 10
+
+enum JpegDcResult {
+    JPEG_DC_OK,
+    JPEG_DC_UNSUPPORTED,    // Not baseline/extended Huffman, or unusual sampling
+    JPEG_DC_CORRUPT,        // Bad marker structure or entropy data
+    JPEG_DC_TOO_LARGE,      // Block grid larger than the output buffer
+    JPEG_DC_TIMEOUT,        // Deadline passed
+    JPEG_DC_NO_MEMORY,      // Working buffers could not be allocated (jpeg_rows.h)
+    JPEG_DC_OUTSIDE         // Crop region starts past the frame's edge (jpeg_transform.h)
+};
+
+struct JpegHuffTable {
+    uint16_t lookup[1 << JPEG_HUFF_LOOKAHEAD];  // (code length << 8) | symbol, 0 if longer
+    int32_t maxcode[18];                         // Canonical decode for the longer codes
+    int32_t valoffset[17];
+    uint8_t values[256];
+    bool defined;
+};
+
+// Tables persist between frames: the OV2640 sends the same ones every
+// time, so only the frame's DHT segments are re-read. About 12 KB; keep one
+// per decoding task.
+struct JpegDcDecoder {
+    JpegHuffTable dc[4];
+    JpegHuffTable ac[4];
+    uint16_t quant[4][64];           // DQT tables in zigzag order
+};
+
+struct JpegComponent {
+    uint8_t id;
+    uint8_t h;                       // Sampling factors
+    uint8_t v;
+    uint8_t quant;                   // DQT table
+    uint8_t dc_table;                // From SOS
+    uint8_t ac_table;
+};
+
+// Frame and scan headers of a supported JPEG, components[0] being luma
+struct JpegFrame {
+    uint16_t width;
+    uint16_t height;
+    JpegComponent components[JPEG_MAX_COMPONENTS];
+    int component_count;             // 1 or 3, all in the one scan
+    uint16_t restart_interval;       // MCUs, 0 = none
+    int mcu_w;                       // MCU size in pixels
+    int mcu_h;
+    int mcus_x;
+    int mcus_y;
+    const uint8_t* data;             // Entropy-coded data up to the end of the file
+    const uint8_t* end;
+};
+
+struct JpegDcImage {
+    uint16_t width;                  // Frame size in pixels
+    uint16_t height;
+    uint16_t blocks_x;               // Luma block grid, padded to whole MCUs
+    uint16_t blocks_y;
+    uint8_t* luma;                   // Caller's buffer, blocks_x * blocks_y means
+    size_t capacity;
+};
+
+// Natural (row-major) index of the k-th coefficient in zigzag order
+extern const uint8_t JPEG_NATURAL_ORDER[64];
+
+// Reads the marker segments up to the start of scan into frame and the
+// tables into decoder. Shared with the row decoder (jpeg_rows.h).
+JpegDcResult jpegParseFrame(JpegDcDecoder* decoder, const uint8_t* jpeg, size_t len, JpegFrame* frame);
+
+// Decodes the luma block means of jpeg into image->luma. Stops with
+// JPEG_DC_TIMEOUT once micros() passes deadline_us (checked once per MCU
+// row); 0 means no deadline.
+JpegDcResult jpegDecodeDC(JpegDcDecoder* decoder, const uint8_t* jpeg, size_t len,
+                          JpegDcImage* image, uint32_t deadline_us);
+
+const char* jpegDcResultName(JpegDcResult result);
+
+// Decoder shared by the camera task's frame analyses (motion_detect.h,
+// scene_activity.h), allocated on first use, in internal RAM when it fits.
+// nullptr when there is no memory. Camera task only.
+JpegDcDecoder* cameraDcDecoder();
+
+#endif // JPEG_DC_H
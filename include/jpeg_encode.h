@@ -0,0 +1,60 @@
+#ifndef JPEG_ENCODE_H
+#define JPEG_ENCODE_H
+
+#include <Arduino.h>
+#include "jpeg_dc.h"
+
+// Baseline JPEG encoder fed one MCU row at a time, for re-encoding frames
+// decoded by jpeg_rows.h (thumbnail.h) or transcoding their coefficients
+// (jpeg_transform.h). It keeps the source's component layout and
+// quantisation tables, so nothing is resampled and the output has the
+// camera's quality. Huffman coding uses the standard tables of ITU
+// T.81 Annex K, which the OV2640 uses too. The forward DCT is libjpeg's
+// accurate integer one (jfdctint.c).
+
+struct JpegHuffCode {
+    uint16_t code;
+    uint8_t len;
+};
+
+struct JpegEncoder {
+    uint8_t* out;
+    size_t capacity;
+    size_t len;
+    bool overflow;                   // Ran out of capacity; output is unusable
+    uint32_t bits;                   // Pending bits, right-aligned
+    int count;
+    int width;
+    int height;
+    JpegComponent components[JPEG_MAX_COMPONENTS];
+    int component_count;
+    int mcus_x;
+    int mcus_y;
+    int rows_done;
+    int predictor[JPEG_MAX_COMPONENTS];
+    uint16_t divisors[4][64];        // 8 * quantiser, natural order
+    JpegHuffCode codes[4][256];      // Luma DC, luma AC, chroma DC, chroma AC
+};
+
+// Writes the headers into out. components are in scan order with their
+// sampling factors and quant table ids; quant holds the tables (zigzag
+// order, as JpegDcDecoder does).
+bool jpegEncodeBegin(JpegEncoder* encoder, uint8_t* out, size_t capacity, int width, int height,
+                     const JpegComponent* components, int component_count, const uint16_t (*quant)[64]);
+
+// Encodes the next MCU row. Plane c holds comp.v * 8 lines of at least
+// mcus_x * comp.h * 8 samples; sample x of line y is planes[c][y * stride[c] + x].
+void jpegEncodeRow(JpegEncoder* encoder, uint8_t* const* planes, const int* stride);
+
+// Encodes the next MCU row from quantised coefficients, for lossless
+// transcoding (jpeg_transform.h). Component c has comp.v rows of blocks;
+// block x of row y is the 64 coefficients (zigzag order, for the quant
+// table given to jpegEncodeBegin()) at blocks[c] + (y * stride[c] + x) * 64.
+// DC must be within +-1024 and AC within +-1023.
+void jpegEncodeCoefficientRow(JpegEncoder* encoder, const int16_t* const* blocks, const int* stride);
+
+// Flushes the entropy-coded data and writes EOI. Returns the JPEG length,
+// or 0 when the output did not fit or rows are missing.
+size_t jpegEncodeEnd(JpegEncoder* encoder);
+
+#endif // JPEG_ENCODE_H
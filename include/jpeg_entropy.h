@@ -0,0 +1,128 @@
+#ifndef JPEG_ENTROPY_H
+#define JPEG_ENTROPY_H
+
+#include "jpeg_dc.h"
+
+// Entropy-decoding primitives shared by the JPEG decoders (jpeg_dc.cpp,
+// jpeg_rows.cpp). Inline: they are the inner loop of both.
+
+// MSB-first bit reader over entropy-coded data. Undoes 0xFF00 stuffing and
+// stops at the next marker, feeding zero bits after it; the marker is left
+// for the restart handling.
+struct JpegBitReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t bits;             // Valid bits left-aligned
+    int count;
+    bool at_marker;
+
+    inline void fill() {
+        while (count <= 24) {
+            uint32_t byte = 0;
+            if (!at_marker && p < end) {
+                byte = *p++;
+                if (byte == 0xFF) {
+                    if (p < end && *p == 0x00) {
+                        p++;
+                    } else {
+                        at_marker = true;
+                        p--;
+                        byte = 0;
+                    }
+                }
+            }
+            bits |= byte << (24 - count);
+            count += 8;
+        }
+    }
+
+    inline uint32_t take(int n) {
+        uint32_t value = bits >> (32 - n);
+        bits <<= n;
+        count -= n;
+        return value;
+    }
+
+    inline void drop(int n) {
+        bits <<= n;
+        count -= n;
+    }
+};
+
+static inline int jpegExtend(int value, int size) {
+    return value < (1 << (size - 1)) ? value - (1 << size) + 1 : value;
+}
+
+// Huffman symbol, or -1 for a code the table does not have. Needs at least
+// 16 bits buffered.
+static inline int jpegDecodeSymbol(JpegBitReader& br, const JpegHuffTable& table) {
+    uint16_t entry = table.lookup[br.bits >> (32 - JPEG_HUFF_LOOKAHEAD)];
+    if (entry) {
+        br.drop(entry >> 8);
+        return entry & 0xFF;
+    }
+    for (int len = JPEG_HUFF_LOOKAHEAD + 1; len <= 16; len++) {
+        int32_t code = (int32_t)(br.bits >> (32 - len));
+        if (code <= table.maxcode[len]) {
+            br.drop(len);
+            return table.values[(code + table.valoffset[len]) & 0xFF];
+        }
+    }
+    return -1;
+}
+
+// Adds the block's DC difference to *predictor. False on a bad code.
+static inline bool jpegDecodeDcDiff(JpegBitReader& br, const JpegHuffTable& dc, int* predictor) {
+    br.fill();
+    int size = jpegDecodeSymbol(br, dc);
+    if (size < 0 || size > 11) {
+        return false;
+    }
+    if (size) {
+        br.fill();
+        *predictor += jpegExtend((int)br.take(size), size);
+    }
+    return true;
+}
+
+// Huffman-decodes the block's AC coefficients only far enough to skip them
+static inline bool jpegSkipAc(JpegBitReader& br, const JpegHuffTable& ac) {
+    for (int k = 1; k < 64;) {
+        br.fill();
+        int rs = jpegDecodeSymbol(br, ac);
+        if (rs < 0) {
+            return false;
+        }
+        int run = rs >> 4;
+        int bits = rs & 0x0F;
+        if (bits) {
+            if (br.count < bits) {
+                br.fill();
+            }
+            br.drop(bits);
+            k += run + 1;
+        } else if (run == 15) {
+            k += 16;
+        } else {
+            break;          // End of block
+        }
+    }
+    return true;
+}
+
+// Skips to the next RSTn marker and resets the reader after it
+static inline bool jpegRestart(JpegBitReader& br) {
+    br.bits = 0;
+    br.count = 0;
+    while (br.p + 1 < br.end) {
+        if (br.p[0] == 0xFF && br.p[1] >= 0xD0 && br.p[1] <= 0xD7) {
+            br.p += 2;
+            br.at_marker = false;
+            return true;
+        }
+        br.p++;
+    }
+    return false;
+}
+
+#endif // JPEG_ENTROPY_H
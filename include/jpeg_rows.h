@@ -0,0 +1,63 @@
+#ifndef JPEG_ROWS_H
+#define JPEG_ROWS_H
+
+#include <Arduino.h>
+#include "jpeg_dc.h"
+
+// Full baseline JPEG decoder that produces one MCU row at a time, in any
+// row order, without a frame-sized output buffer. jpegRowsBegin() walks the
+// entropy-coded data once (Huffman only, like jpeg_dc.h) and checkpoints
+// the bit reader, DC predictors and restart count at the start of every
+// MCU row; jpegRowsDecode() resumes from a checkpoint and runs the full
+// decode (dequantisation, integer IDCT) of that row into per-component
+// sample planes. Colour conversion and upsampling are left to the caller.
+//
+// With scale 2, 4 or 8 each block is transformed straight to 4x4, 2x2 or
+// 1x1 samples (scale 8 needs no AC coefficients at all), giving the image
+// at 1/scale size for about the cost of entropy decoding. A sequential
+// decoder skips the index pass and checkpoints, but takes its rows in
+// order only.
+//
+// The IDCTs are the accurate integer ones of libjpeg (jidctint.c,
+// jidctred.c), so output matches libjpeg's JDCT_ISLOW decode at the same
+// scale.
+
+struct JpegRowCheckpoint {
+    uint32_t offset;                 // Reader position in the entropy-coded data
+    uint32_t bits;
+    int8_t count;
+    bool at_marker;
+    uint16_t restarts_left;
+    int16_t predictor[JPEG_MAX_COMPONENTS];
+};
+
+struct JpegRowDecoder {
+    JpegDcDecoder tables;
+    JpegFrame frame;
+    bool luma_only;                  // Chroma is entropy-decoded but not transformed
+    int scale;                       // Blocks come out 8 / scale samples square
+    bool sequential;
+    JpegRowCheckpoint* checkpoints;  // frame.mcus_y of them, none when sequential
+    JpegRowCheckpoint next;          // Sequential: where row next_row starts
+    int next_row;
+    uint8_t* planes[JPEG_MAX_COMPONENTS];  // One MCU row of samples per component
+    int stride[JPEG_MAX_COMPONENTS];       // Plane width, comp.h * 8 / scale per MCU
+    uint8_t* buffer;                 // Holds checkpoints and planes
+    size_t buffer_size;
+};
+
+// Parses jpeg, indexes its MCU rows and allocates the working buffers (in
+// internal RAM when they fit). decoder must start zeroed; jpeg must stay
+// valid until jpegRowsEnd(). scale is 1, 2, 4 or 8. A sequential decoder
+// only finds corrupt data when it reaches it.
+JpegDcResult jpegRowsBegin(JpegRowDecoder* decoder, const uint8_t* jpeg, size_t len, bool luma_only,
+                           int scale = 1, bool sequential = false);
+
+// Decodes MCU row `row` into decoder->planes: sample x of line y (0 to
+// comp.v * 8 / scale - 1) of component c is planes[c][y * stride[c] + x].
+JpegDcResult jpegRowsDecode(JpegRowDecoder* decoder, int row);
+
+// Frees the working buffers; the decoder can be begun again
+void jpegRowsEnd(JpegRowDecoder* decoder);
+
+#endif // JPEG_ROWS_H
@@ -0,0 +1,43 @@
+#ifndef JPEG_TRANSFORM_H
+#define JPEG_TRANSFORM_H
+
+#include <Arduino.h>
+#include "jpeg_dc.h"
+
+// Lossless crop and rotation of a baseline JPEG in the coefficient domain,
+// like jpegtran: the region's blocks are Huffman-decoded to quantised
+// coefficients, moved and, for rotations, transposed and sign-flipped
+// (mirroring a block negates its odd frequencies), then Huffman-coded
+// again (jpeg_encode.h). There is no IDCT or requantisation, so the output
+// has exactly the source's coefficients.
+//
+// Crops can only start on an MCU boundary, so the region's origin moves
+// to the MCU that contains it. Its size is kept where the image edge is
+// the output's edge; on an axis the rotation mirrors it is rounded to whole
+// MCUs instead (down at the frame edge), as a partial MCU would end up on
+// the wrong side. 90 and 270 degree rotations swap each component's
+// sampling factors (4:2:2 becomes 4:4:0) and transpose the quant tables.
+
+enum JpegRotation {
+    JPEG_ROTATE_NONE,
+    JPEG_ROTATE_90,            // Clockwise
+    JPEG_ROTATE_180,
+    JPEG_ROTATE_270
+};
+
+struct JpegRect {
+    int x;
+    int y;
+    int width;                 // 0 = to the right edge
+    int height;                // 0 = to the bottom edge
+};
+
+// Cuts region out of jpeg (clamped to the frame) and rotates it. On
+// success *out is a heap_caps allocation of *out_len bytes (in PSRAM when
+// present) for the caller to free, and *applied is the source region it
+// shows. Returns JPEG_DC_OUTSIDE when the region starts right of or below
+// the frame.
+JpegDcResult jpegTransform(const uint8_t* jpeg, size_t len, const JpegRect& region, JpegRotation rotation,
+                           uint8_t** out, size_t* out_len, JpegRect* applied);
+
+#endif // JPEG_TRANSFORM_H
@@ -0,0 +1,77 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <Arduino.h>
+
+// Memory-pressure governor. Tracks free bytes and the largest free block
+// of internal RAM and PSRAM separately and maps each region to a pressure
+// level. The overall level is the higher of the two, and each level adds
+// load-shedding actions to the ones below it:
+//
+//   ELEVATED  New /stream and /clip clients get 503 with Retry-After;
+//             config writes are deferred until pressure clears
+//   HIGH      Stream quality/framesize held MEM_HIGH_ADAPT_STEPS down
+//   CRITICAL  Stream quality/framesize held MEM_CRITICAL_ADAPT_STEPS down
+//
+// Separately, the /clip ring (the largest PSRAM user we control) is shrunk
+// while PSRAM is at HIGH or above. It is restored once PSRAM is back to NORMAL.
+//
+// A level is entered as soon as either figure drops below its threshold.
+// Levels are left one at a time, once both figures are
+// MEM_HYSTERESIS_PERCENT above the thresholds of the current level.
+
+enum MemoryLevel {
+    MEM_NORMAL,
+    MEM_ELEVATED,
+    MEM_HIGH,
+    MEM_CRITICAL,
+    MEM_LEVEL_COUNT
+};
+
+#define MEM_HYSTERESIS_PERCENT    25
+#define MEM_RETRY_AFTER_S         10
+#define MEM_HIGH_ADAPT_STEPS      2
+#define MEM_CRITICAL_ADAPT_STEPS  4
+#define MEM_RING_SHRINK_DIVISOR   4    // Shrunk /clip ring is this fraction of configured
+
+struct MemoryRegionState {
+    uint32_t free_bytes;
+    uint32_t largest_block;
+    uint32_t min_free;
+    MemoryLevel level;
+};
+
+struct MemoryGovernorState {
+    MemoryLevel level;
+    MemoryRegionState internal;
+    MemoryRegionState psram;       // Zero without PSRAM
+    bool psram_present;
+    int adapt_steps;               // Stream adaptation floor in force
+    bool ring_shrunk;
+    uint32_t ring_shrinks;         // Times the ring was shrunk
+    MemoryLevel ring_shrink_level; // PSRAM level that caused the last shrink
+    bool config_deferred;          // A config save is waiting for pressure to clear
+    uint32_t streams_refused;
+    uint32_t transitions;
+    unsigned long last_change;     // millis() of the last level change, 0 if none
+};
+
+// Samples both heaps and applies the actions for the resulting level.
+// Runs once per second in the web server task.
+void updateMemoryGovernor();
+
+MemoryLevel memoryLevel();
+const char* memoryLevelName(MemoryLevel level);
+
+// Admission check for new stream clients; counts the refusal when false
+bool memoryAdmitsStream();
+
+// True while config writes are deferred
+bool memoryDefersWrites();
+
+// Minimum stream adaptation level to hold for the current level
+int memoryAdaptSteps();
+
+void getMemoryGovernorState(MemoryGovernorState* state);
+
+#endif // MEMORY_GOVERNOR_H
@@ -0,0 +1,113 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+
+// Counters and fixed-bucket histograms for /metrics (Prometheus text
+// format). Every metric is a static object. Each core has its own slots,
+// which are bumped with one relaxed atomic add, so hot-path updates never
+// allocate, lock or contend with the other core. The exporter sums the
+// slots when /metrics is scraped.
+
+#define METRICS_CORES        2
+#define METRICS_MAX_BUCKETS  10
+
+struct MetricCounter {
+    uint32_t value[METRICS_CORES];
+};
+
+// Values are recorded in the histogram's base unit (us, ms, bytes); the
+// exporter scales them to Prometheus base units. Bucket counts and sums
+// are 32-bit per core. The exporter widens sums to 64 bits on each scrape,
+// so they survive wrapping as long as scrapes are more frequent than wraps.
+struct MetricHistogram {
+    const uint32_t* bounds;    // Ascending upper bounds; one extra +Inf bucket
+    uint8_t bucket_count;
+    uint32_t counts[METRICS_CORES][METRICS_MAX_BUCKETS + 1];
+    uint32_t sum[METRICS_CORES];
+
+    // Exporter-owned
+    uint64_t sum_total;
+    uint32_t sum_seen[METRICS_CORES];
+};
+
+static inline int metricsCore() {
+    return xPortGetCoreID() & (METRICS_CORES - 1);
+}
+
+static inline void metricAdd(MetricCounter& counter, uint32_t n = 1) {
+    __atomic_fetch_add(&counter.value[metricsCore()], n, __ATOMIC_RELAXED);
+}
+
+static inline void metricObserve(MetricHistogram& histogram, uint32_t value) {
+    int core = metricsCore();
+    uint8_t i = 0;
+    while (i < histogram.bucket_count && value > histogram.bounds[i]) {
+        i++;
+    }
+    __atomic_fetch_add(&histogram.counts[core][i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram.sum[core], value, __ATOMIC_RELAXED);
+}
+
+uint64_t metricValue(const MetricCounter& counter);
+
+// HTTP routes counted by /metrics; anything else is counted as "other"
+enum MetricRoute {
+    ROUTE_ROOT,
+    ROUTE_STATUS,
+    ROUTE_SLEEPSTATUS,
+    ROUTE_CAPTURE,
+    ROUTE_STREAM,
+    ROUTE_CLIP,
+    ROUTE_BURST,
+    ROUTE_BMP,
+    ROUTE_CONTROL,
+    ROUTE_SLEEP,
+    ROUTE_WAKE,
+    ROUTE_RESTART,
+    ROUTE_FACTORY_RESET,
+    ROUTE_WIFI_CONNECT,
+    ROUTE_METRICS,
+    ROUTE_TRACE,
+    ROUTE_TASKS,
+    ROUTE_SESSIONS,
+    ROUTE_PROFILE,
+    ROUTE_PROFILES,
+    ROUTE_PROFILE_SCHEDULE,
+    ROUTE_MOTION,
+    ROUTE_OTHER,
+    ROUTE_COUNT
+};
+
+// Instrumented metrics
+extern MetricHistogram metric_capture_latency;  // esp_camera_fb_get(), us
+extern MetricHistogram metric_frame_size;       // Captured JPEG, bytes
+extern MetricHistogram metric_stream_send;      // One frame to one /stream client, ms
+extern MetricHistogram metric_control_apply;    // One /control batch applied to the sensor, us
+extern MetricHistogram metric_motion_analysis;  // Motion detection on one frame, us
+extern MetricCounter metric_stream_dropped;     // Frames skipped for slow /stream links
+extern MetricCounter metric_stream_denied;      // /stream clients over the admission limits
+extern MetricCounter metric_stream_evicted;     // /stream clients ended for a higher class
+extern MetricCounter metric_stream_static_skipped;  // Unchanged frames left out for skip_static clients
+extern MetricCounter metric_stream_bytes_saved;     // ... and their JPEG bytes
+extern MetricCounter metric_capture_failures;   // esp_camera_fb_get() returned NULL
+extern MetricCounter metric_motion_events;      // Motion events started
+extern MetricCounter metric_config_saves;
+extern MetricCounter metric_config_save_failures;
+extern MetricCounter metric_wifi_disconnects;
+extern MetricCounter metric_wifi_reconnects;
+
+// Counts one HTTP response by route (matched on the URL path) and status
+// class
+void metricsCountHttp(const char* url, int code);
+
+// Polls the WiFi link for disconnects and reconnects. Called periodically
+// by the watchdog task.
+void metricsPollWiFi();
+
+// Renders every metric plus point-in-time gauges (heap, clients, RSSI...)
+// in Prometheus text exposition format
+String renderMetrics();
+
+#endif // METRICS_H
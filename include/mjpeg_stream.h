@@ -0,0 +1,325 @@
+#ifndef MJPEG_STREAM_H
+#define MJPEG_STREAM_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "app.h"
+#include "config.h"
+#include "frame_broadcaster.h"
+#include "frame_ring.h"
+#include "frame_burst.h"
+#include "thumbnail.h"
+#include "roi_view.h"
+
+#define MJPEG_CONTENT_TYPE "multipart/x-mixed-replace; boundary=" STREAM_BOUNDARY
+
+// Resumable writer for one multipart/x-mixed-replace part. A frame is
+// pinned with begin() and its boundary, part headers, JPEG body and
+// trailing CRLF are emitted across as many write() calls as the TCP send
+// window requires, copying straight from fb->buf at the current offset.
+// A part can carry a converted copy of the frame instead (thumbnail.h,
+// roi_view.h); the frame itself is not held then.
+class MjpegStreamWriter {
+public:
+    MjpegStreamWriter();
+    ~MjpegStreamWriter();
+
+    // True when no frame is pinned and the next part can be started
+    bool idle() const { return !_frame && !_converted; }
+
+    // Starts a new part, holding the frame (or its converted copy, when
+    // given) until its trailer is written
+    void begin(FrameRef frame, ConvertedFrameRef converted = ConvertedFrameRef());
+
+    // Copies up to maxLen bytes of the current part into buffer. The frame
+    // is released once its trailer has been emitted. Returns 0 only when
+    // the pinned frame was invalidated (camera deinitialized).
+    size_t write(uint8_t* buffer, size_t maxLen);
+
+    // Drops the pinned frame without sending the rest of the part
+    void abort();
+
+    // Marks frame as handled without sending it
+    void skip(const FrameRef& frame) { _last_seq = frame.seq(); }
+
+    uint32_t lastSeq() const { return _last_seq; }
+
+    // Bytes of the current part that have not been written yet
+    size_t remaining() const;
+
+private:
+    enum Stage {
+        STAGE_HEADER,
+        STAGE_BODY,
+        STAGE_TRAILER
+    };
+
+    const uint8_t* bodyData() const { return _converted ? _converted->data : _frame.data(); }
+    size_t bodyLength() const { return _converted ? _converted->length : _frame.length(); }
+
+    FrameRef _frame;
+    ConvertedFrameRef _converted;
+    Stage _stage;
+    size_t _offset;
+    size_t _header_len;
+    uint32_t _last_seq;
+    char _header[128];
+};
+
+// /stream priority classes, lowest first. When the server is full an
+// arriving client evicts the newest client of the lowest class below its
+// own, or is denied if there is none. Egress under admission.max_kbps is
+// shared between clients in proportion to their class weight.
+enum StreamClass {
+    STREAM_CLASS_GUEST,
+    STREAM_CLASS_TRUSTED,      // Connecting from admission.trusted_ips
+    STREAM_CLASS_OPERATOR,     // Presented admission.operator_token
+    STREAM_CLASS_COUNT
+};
+
+enum StreamAdmission {
+    STREAM_ADMIT,
+    STREAM_ADMIT_EVICT,        // Admitted by ending a lower-class client
+    STREAM_DENY_CLIENTS,       // admission.max_clients reached
+    STREAM_DENY_BANDWIDTH      // A share of admission.max_kbps would be under one frame/s
+};
+
+#define STREAM_RETRY_AFTER_S 10
+#define STREAM_MAX_SESSIONS  16     // Listed by /sessions
+
+// Per-client link statistics for /status and /sessions
+struct StreamClientStats {
+    uint32_t id;
+    StreamClass stream_class;
+    IPAddress remote_ip;
+    int fps;                   // Requested
+    float fps_measured;        // Frames sent per second over the last sample
+    uint32_t frames_sent;
+    uint32_t frames_dropped;
+    uint32_t bytes_sent;
+    uint32_t throughput;
+    uint32_t share;            // Egress allotted in bytes/s, 0 = unlimited
+    uint32_t backlog;
+    uint32_t latency_ms;
+    uint32_t connected_ms;
+    bool congested;
+    bool evicted;              // Ending after its current frame
+    int scale;                 // Frames sent at 1/scale size (thumbnail.h)
+    RoiSpec roi;               // Crop and rotation sent (roi_view.h)
+    bool skip_static;          // Leaves out frames of an unchanged scene
+    uint32_t static_skipped;
+    uint32_t bytes_saved;      // JPEG bytes of the frames left out
+};
+
+struct StreamAdmissionStats {
+    int clients;               // Admitted and not evicted, /clip included
+    int clips;                 // Of which /clip responses
+    int max_clients;
+    uint32_t egress;           // Sum of client throughput, bytes/s
+    uint32_t max_egress;       // bytes/s, 0 = unlimited
+    uint32_t denied;
+    uint32_t evicted;
+};
+
+// Global quality/framesize stepping driven by congested clients
+struct StreamAdaptationState {
+    bool enabled;
+    int level;               // 0 = configured settings, higher = degraded
+    int memory_floor;        // Minimum level held by the memory governor
+    int quality;
+    int framesize;
+    int congested_clients;
+    const char* last_action;
+    unsigned long last_change;  // millis() of the last step
+};
+
+// MJPEG response for one /stream connection. Each client is paced on its
+// own deadline: the fill callback never blocks, it returns
+// RESPONSE_TRY_AGAIN until the deadline has passed and a newer frame
+// exists. AsyncTCP only calls back on ACKs and 500 ms poll ticks, so idle
+// clients are resumed by serviceStreamClients() from the web server task.
+// With skip_static a frame whose scene number (scene_activity.h) matches
+// the last one sent is left out, unless STREAM_STATIC_KEEPALIVE_MS passed.
+// With a scale over 1 each frame is sent as its cached thumbnail, and with
+// an active roi as its cached crop and rotation (roi_view.h). Conversions
+// run on the conversion task (frame_convert.h); the client waits for its
+// frame's conversion without blocking, and a frame that fails to convert
+// is skipped.
+class AsyncMjpegResponse : public AsyncAbstractResponse {
+public:
+    AsyncMjpegResponse(int fps, StreamClass stream_class, IPAddress remote_ip, bool skip_static = false,
+                       int scale = 1, const RoiSpec& roi = RoiSpec());
+    ~AsyncMjpegResponse();
+
+    void _respond(AsyncWebServerRequest* request) override;
+    size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override;
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+    // Called from the request's disconnect handler before it is deleted
+    void close();
+
+    // Sends the next frame if the client is idle and its deadline passed
+    void resume();
+
+    int fps() const { return _fps; }
+
+private:
+    size_t sendLocked(AsyncWebServerRequest* request, size_t len, uint32_t time);
+    size_t backlog() const;
+    bool hasCredit(unsigned long now);
+
+    MjpegStreamWriter _writer;
+    AsyncWebServerRequest* _request;
+    SemaphoreHandle_t _lock;
+    uint32_t _interval_ms;
+    unsigned long _next_due;
+    int _fps;
+    bool _waiting;
+    bool _backlogged;
+    bool _congested;
+    bool _closed;
+
+    // Link measurements
+    uint32_t _bytes_written;
+    uint32_t _bytes_acked;
+    uint32_t _sample_acked;
+    unsigned long _sample_time;
+    uint32_t _throughput;         // Acked bytes/s over the last sample
+    uint32_t _frames_sent;
+    uint32_t _frames_dropped;     // Frames lost to a slow link, not pacing
+    uint32_t _sample_dropped;
+    uint32_t _latency_ms;         // Capture to last byte queued, last frame
+    unsigned long _frame_timestamp;
+    unsigned long _send_start;    // millis() when the current frame was picked
+    uint32_t _sample_sent;
+    float _fps_measured;
+    size_t _frame_len;            // Last frame started, for egress estimates
+    int _scale;                   // Sending thumbnails at 1/scale when over 1
+    RoiSpec _roi;                 // Sending this crop and rotation when active
+    FrameRef _converting;         // Picked, waiting for its conversion
+
+    // Static frame skipping
+    bool _skip_static;
+    uint32_t _last_scene;         // Scene of the last frame sent, 0 before one
+    uint32_t _static_skipped;
+    uint32_t _bytes_saved;
+
+    // Admission and egress scheduling
+    uint32_t _id;
+    StreamClass _class;
+    IPAddress _remote_ip;
+    unsigned long _connected;
+    bool _evicted;                // Set by admitStreamClient(), read by the fill callback
+    uint32_t _share;              // Set by scheduleStreamEgress()
+    bool _share_fixed;
+    int32_t _credit;              // Bytes the client may send before waiting
+    unsigned long _credit_time;
+
+    AsyncMjpegResponse* _next;  // Stream client registry
+    friend void serviceStreamClients();
+    friend void updateStreamAdaptation();
+    friend void scheduleStreamEgress();
+    friend StreamAdmission admitStreamClient(StreamClass stream_class);
+    friend void getStreamAdmissionStats(StreamAdmissionStats* stats);
+    friend int getStreamClientStats(StreamClientStats* out, int max);
+};
+
+// MJPEG response for /clip: replays frames from the pre-event ring captured
+// since start_time, then follows live frames into the ring until end_time
+// and ends the response. A clip is admitted like a /stream client and
+// counts against admission.max_clients while it runs; frames go out as
+// fast as the link and its weighted share of admission.max_kbps allow.
+// Clips are never evicted. A frame evicted from the ring mid-part ends the
+// clip early.
+class AsyncClipResponse : public AsyncAbstractResponse {
+public:
+    AsyncClipResponse(unsigned long start_time, unsigned long end_time, StreamClass stream_class);
+    ~AsyncClipResponse();
+
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    enum Stage {
+        STAGE_IDLE,
+        STAGE_HEADER,
+        STAGE_BODY,
+        STAGE_TRAILER
+    };
+
+    unsigned long _start_time;
+    unsigned long _end_time;
+    RingFrameInfo _frame;
+    uint32_t _last_seq;
+    Stage _stage;
+    size_t _offset;
+    size_t _header_len;
+    char _header[96];
+
+    // Admission and egress scheduling, as for AsyncMjpegResponse
+    StreamClass _class;
+    size_t _frame_len;            // Last frame started
+    uint32_t _share;              // Set by scheduleStreamEgress()
+    int32_t _credit;
+    unsigned long _credit_time;
+
+    AsyncClipResponse* _next;     // Clip registry, under the stream client lock
+    friend void scheduleStreamEgress();
+    friend StreamAdmission admitStreamClient(StreamClass stream_class);
+    friend void getStreamAdmissionStats(StreamAdmissionStats* stats);
+};
+
+// multipart/mixed response for /burst. Sends each burst frame as soon as
+// the camera task has stored it, with its capture time in an
+// X-Timestamp-Us part header, then a JSON part with the achieved frame
+// interval. Owns the burst and releases it when destroyed.
+class AsyncBurstResponse : public AsyncAbstractResponse {
+public:
+    AsyncBurstResponse();
+    ~AsyncBurstResponse();
+
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    bool nextPart();
+
+    int _index;              // Next burst frame to send
+    bool _summary_sent;
+    bool _closed;
+    const uint8_t* _body;
+    size_t _body_len;
+    size_t _header_len;
+    size_t _offset;          // Position within header + body + trailer
+    char _header[128];
+    char _summary[256];
+};
+
+void initMjpegStreaming();
+
+// Samples client throughput and steps the sensor quality/framesize within
+// the configured bounds. Runs once per second in the web server task.
+void updateStreamAdaptation();
+void resetStreamAdaptation();
+void getStreamAdaptation(StreamAdaptationState* state);
+int getStreamClientStats(StreamClientStats* out, int max);
+
+// Decides whether a new /stream or /clip client of the given class may
+// start, evicting a lower-class /stream client if that makes room. Called
+// before the response is created.
+StreamAdmission admitStreamClient(StreamClass stream_class);
+void getStreamAdmissionStats(StreamAdmissionStats* stats);
+const char* streamClassName(StreamClass stream_class);
+
+// Splits admission.max_kbps between clients: max-min fair by class weight,
+// so clients asking for less than their share leave the rest to others.
+// Clips want all they can get and keep their weighted share.
+// Runs once per second in the web server task.
+void scheduleStreamEgress();
+
+// Wakes paced stream clients that are waiting for their next frame.
+// Runs in the web server task after each published frame.
+void serviceStreamClients();
+
+#endif // MJPEG_STREAM_H
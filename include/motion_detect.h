@@ -0,0 +1,75 @@
+#ifndef MOTION_DETECT_H
+#define MOTION_DETECT_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Motion detection on the JPEGs the camera already produces. The camera
+// task decodes only the DC coefficients of each frame (jpeg_dc.h), i.e. the
+// mean luma of every 8x8 block, and compares them with a per-block
+// background model:
+//
+//   - the mean difference over all blocks is subtracted first, so an
+//     exposure step does not light up the whole frame
+//   - a block changed when it is more than motion.threshold off, and at
+//     least one of its 4 neighbours changed too (drops sensor noise)
+//   - the score is changed blocks per mille of the frame
+//   - the background follows each block with an EMA, slower on changed
+//     blocks so a person standing still takes a while to fade in
+//
+// Motion starts after MOTION_TRIGGER_FRAMES analysed frames at or above
+// motion.trigger_permille and ends motion.hold_ms after the last one;
+// both post an event to eventQueue. Analysis runs before the frame is
+// published, on CAMERA_CORE. When it takes longer than motion.budget_us,
+// only every n-th frame is analysed so the average stays in the budget;
+// a frame that would need more than MOTION_MAX_STRIDE is abandoned.
+
+#define MOTION_MAX_BLOCKS_X (1600 / 8)                     // UXGA
+#define MOTION_MAX_BLOCKS (MOTION_MAX_BLOCKS_X * (1200 / 8))
+#define MOTION_WARMUP_FRAMES 4           // Frames learned before scoring after a reset
+#define MOTION_TRIGGER_FRAMES 2          // Consecutive frames over the trigger
+#define MOTION_MAX_STRIDE 4
+#define MOTION_LEARN_SHIFT 4             // Background EMA weight 1/16
+#define MOTION_LEARN_SHIFT_CHANGED 6     // 1/64 on changed blocks
+
+#define MOTION_MASK_MAX_BYTES ((MOTION_MAX_BLOCKS + 7) / 8)
+
+struct MotionStats {
+    bool enabled;
+    bool active;                  // Inside a motion event
+    int score;                    // Per mille of blocks changed, last analysed frame, -1 before one
+    int blocks_changed;
+    int blocks_x;                 // Block grid of the last analysed frame
+    int blocks_y;
+    uint32_t events;
+    unsigned long last_event;     // millis() motion last started, 0 if never
+    uint32_t analyzed;
+    uint32_t skipped;             // Frames left out to stay in the budget
+    uint32_t timeouts;            // Frames abandoned past the hard deadline
+    uint32_t errors;              // Frames the DC decoder could not read
+    uint32_t last_us;             // Decode and compare time of the last analysed frame
+    int stride;                   // Analysing every n-th frame
+    const char* last_error;       // jpegDcResultName() of the last failure, or "none"
+};
+
+// Creates the stats lock; buffers are allocated on the first analysed frame
+void initMotionDetect();
+
+// Analyses fb if it is this frame's turn. Returns its score in per mille,
+// or -1 when motion detection is off or the frame was not analysed. Only
+// the camera task calls this.
+int analyzeMotionFrame(const camera_fb_t* fb);
+
+// Drops the background model (next frames learn it again); call when the
+// picture changes for reasons other than motion, e.g. a profile switch or a
+// wake from standby. Framesize changes reset it by themselves.
+void resetMotionModel();
+
+void getMotionStats(MotionStats* stats);
+
+// Copies the changed-block mask of the last analysed frame: one bit per
+// block in raster order, MSB first, (blocks_x * blocks_y + 7) / 8 bytes.
+// Returns the bytes written, 0 when there is no mask or it does not fit.
+size_t getMotionMask(uint8_t* mask, size_t size, int* blocks_x, int* blocks_y);
+
+#endif // MOTION_DETECT_H
@@ -0,0 +1,69 @@
+#ifndef ROI_VIEW_H
+#define ROI_VIEW_H
+
+#include <Arduino.h>
+#include "frame_broadcaster.h"
+#include "jpeg_transform.h"
+
+// Cropped and rotated views of camera frames for /capture?roi=&rotate=
+// and /stream?roi=&rotate=. The crop and rotation are lossless
+// (jpeg_transform.h): the region's coefficients are copied, never
+// requantised, so a view costs one Huffman decode and re-encode of the
+// frame instead of a full decode.
+//
+// Every viewer reads the one broadcast capture. The newest views are
+// cached by frame sequence and region, so viewers asking for the same
+// region of the same frame cost one transform. Transforms are serialised
+// and run in the caller's task; /capture and /stream call in from the
+// conversion task (frame_convert.h).
+
+#define ROI_CACHE_ENTRIES 4
+
+// Requested view. All zero is the whole frame unrotated.
+struct RoiSpec {
+    int x;
+    int y;
+    int width;                    // 0 = whole frame
+    int height;
+    int rotate;                   // Degrees clockwise: 0, 90, 180 or 270
+};
+
+struct RoiView : ConvertedFrame {
+    RoiSpec spec;
+    JpegRect applied;             // Source region shown, after MCU alignment
+};
+
+typedef std::shared_ptr<const RoiView> RoiViewRef;
+
+struct RoiStats {
+    uint32_t transforms;
+    uint32_t cache_hits;
+    uint32_t failures;
+    uint32_t last_us;             // Transform time, last transform
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t last_bytes;          // Output size, last transform
+    uint32_t source_bytes;        // Input size, last transform
+    uint32_t served;              // Views handed out, transformed or cached
+    uint64_t bytes_saved;         // Source minus view size, over every view served
+    const char* last_error;       // jpegDcResultName() of the last failure, or "none"
+};
+
+// Creates the cache lock
+void initRoiViews();
+
+// True when spec asks for a crop or a rotation
+bool roiActive(const RoiSpec& spec);
+
+// Returns the view of frame, from the cache when it was made already.
+// Returns an empty reference and sets *result when the frame cannot be
+// transformed or was invalidated meanwhile.
+RoiViewRef getRoiView(const FrameRef& frame, const RoiSpec& spec, JpegDcResult* result);
+
+// Uncached transform of any baseline JPEG, for benches. seq and timestamp
+// are left 0; delete the result.
+RoiView* createRoiView(const uint8_t* jpeg, size_t len, const RoiSpec& spec, JpegDcResult* result);
+
+void getRoiStats(RoiStats* stats);
+
+#endif // ROI_VIEW_H
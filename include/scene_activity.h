@@ -0,0 +1,54 @@
+#ifndef SCENE_ACTIVITY_H
+#define SCENE_ACTIVITY_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Activity-adaptive capture rate. The camera task compares every captured
+// frame with the last frame that changed the scene (the reference):
+//
+//   - a JPEG size more than activity.size_percent off the reference is a
+//     change, without looking any further
+//   - otherwise the DC coefficients are decoded (jpeg_dc.h) and averaged
+//     into a ACTIVITY_SIGNATURE_W x ACTIVITY_SIGNATURE_H grid; with the
+//     mean difference removed (exposure), any cell more than
+//     activity.threshold off the reference is a change
+//
+// After activity.idle_after_ms without a change the capture rate drops to
+// activity.idle_fps. The first changed frame restores the configured rate
+// for the next capture. Every changed frame advances the scene number that
+// goes out with the frame, so /stream?skip_static=1 clients can leave out
+// frames that show nothing new.
+
+#define ACTIVITY_SIGNATURE_W 32             // 20x20 pixel cells at VGA
+#define ACTIVITY_SIGNATURE_H 24
+#define ACTIVITY_DECODE_DEADLINE_US 20000  // A slower decode counts as a change
+
+struct ActivityStats {
+    bool enabled;
+    bool idle;                    // Capturing at activity.idle_fps
+    int capture_fps;              // Rate the camera task runs at right now
+    uint32_t idle_ms;             // Time spent idle and active since boot
+    uint32_t active_ms;
+    uint32_t idle_entries;
+    uint32_t wakes;               // Idle periods ended by a changed frame
+    unsigned long last_change;    // millis() of the last changed frame, 0 if never
+    uint32_t frames_static;
+    uint32_t frames_changed;
+    uint32_t signatures;          // Frames that needed the DC signature
+    uint32_t signature_failures;  // Decodes that failed or ran out of time
+    uint32_t frames_avoided;      // Estimated captures not taken while idle
+    uint32_t kb_avoided;          // ... and their estimated JPEG bytes, KB
+};
+
+// Classifies fb and adjusts the capture rate. Returns its scene number,
+// which only advances on changed frames (on every frame while activity is
+// off). Only the camera task calls this.
+uint32_t updateSceneActivity(const camera_fb_t* fb);
+
+// Capture rate for the camera task's pacing
+int activityCaptureFps();
+
+void getSceneActivityStats(ActivityStats* stats);
+
+#endif // SCENE_ACTIVITY_H
@@ -0,0 +1,59 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Per-task telemetry for /tasks: stack high-water marks measured against
+// the stack each task was created with, and CPU share per task and per
+// core over the last sample interval. Sampled by the watchdog task.
+//
+// Needs configUSE_TRACE_FACILITY (enabled in the Arduino core). CPU figures
+// also need configGENERATE_RUN_TIME_STATS; without it they are reported as
+// unknown and only the stack data is collected.
+
+#define TASK_STATS_MAX_TASKS   24
+#define TASK_STACK_MIN_FREE    512    // Bytes never touched; less is near overflow
+#define TASK_STACK_HEADROOM    1024   // Kept above the measured peak when sizing
+#define TASK_STACK_ROUNDING    512
+
+enum TaskStackFlag {
+    STACK_OK,
+    STACK_NEAR_OVERFLOW,
+    STACK_OVER_PROVISIONED,
+    STACK_SIZE_UNKNOWN       // Created by the core or IDF; only the free space is known
+};
+
+struct TaskStat {
+    char name[configMAX_TASK_NAME_LEN];
+    eTaskState state;
+    UBaseType_t priority;
+    int core;                    // Pinned core, -1 if the task may run on either
+    uint32_t stack_size;         // Bytes, 0 if unknown
+    uint32_t stack_free_min;     // High-water mark: bytes never used, in bytes
+    uint32_t stack_recommended;  // Peak use plus headroom, 0 if the size is unknown
+    TaskStackFlag flag;
+    float cpu_percent;           // Of one core over the interval, < 0 if unknown
+};
+
+struct TaskStatsSnapshot {
+    uint32_t interval_ms;        // Covered by the CPU figures
+    bool runtime_stats;          // CPU figures available
+    float core_load[2];          // Percent busy, < 0 if unknown
+    int task_count;
+    TaskStat tasks[TASK_STATS_MAX_TASKS];
+};
+
+// Takes a sample. Called periodically by the watchdog task; CPU figures
+// appear from the second call on.
+void sampleTaskStats();
+
+// Copies the latest sample. Returns false if no sample has been taken or
+// task stats are not supported by this build.
+bool getTaskStats(TaskStatsSnapshot* snapshot);
+
+const char* taskStackFlagName(TaskStackFlag flag);
+const char* taskStateName(eTaskState state);
+
+#endif // TASK_STATS_H
@@ -0,0 +1,62 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <Arduino.h>
+#include "frame_broadcaster.h"
+#include "jpeg_dc.h"
+
+// Downscaled JPEGs of camera frames for /capture?scale= and /stream?scale=.
+// The frame is decoded one MCU row at a time with the IDCT reduced to
+// 8/scale samples per block (jpeg_rows.h), and the strip is re-encoded
+// straight away (jpeg_encode.h) with the frame's own sampling and
+// quantisation tables, so no full-size pixels ever exist. Scale 8 only
+// needs the DC coefficients.
+//
+// The newest thumbnail of each scale is cached by frame sequence: any
+// number of viewers of the same frame at the same scale cost one
+// conversion. Conversions are serialised and run in the caller's task;
+// /capture and /stream call in from the conversion task (frame_convert.h).
+
+#define THUMBNAIL_SCALES 3              // 2, 4 and 8
+#define THUMBNAIL_MAX_BYTES_PER_BLOCK 128  // Output buffer reserve per 8x8 block
+
+struct Thumbnail : ConvertedFrame {
+    int scale;
+};
+
+typedef std::shared_ptr<const Thumbnail> ThumbnailRef;
+
+struct ThumbnailStats {
+    int scale;
+    uint32_t conversions;
+    uint32_t cache_hits;
+    uint32_t failures;
+    uint32_t last_us;             // Decode and re-encode time, last conversion
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t last_bytes;          // Output size, last conversion
+    uint32_t source_bytes;        // Input size, last conversion
+    int width;                    // Of the last conversion
+    int height;
+    const char* last_error;       // jpegDcResultName() of the last failure, or "none"
+};
+
+// Creates the cache lock
+void initThumbnails();
+
+// True for 2, 4 and 8
+bool isThumbnailScale(int scale);
+
+// Returns frame at 1/scale size, from the cache when this frame was
+// converted already. Returns an empty reference and sets *result when the
+// frame cannot be converted or was invalidated meanwhile.
+ThumbnailRef getThumbnail(const FrameRef& frame, int scale, JpegDcResult* result);
+
+// Uncached conversion of any baseline JPEG, for benches. seq and
+// timestamp are left 0; delete the result.
+Thumbnail* createThumbnail(const uint8_t* jpeg, size_t len, int scale, JpegDcResult* result);
+
+// One entry per scale, smallest scale first
+void getThumbnailStats(ThumbnailStats* stats);
+
+#endif // THUMBNAIL_H
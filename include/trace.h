@@ -0,0 +1,100 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Event tracer for diagnosing stream stutter. Instrumented code marks
+// begin/end/instant events with static string names; while a /trace window
+// is recording they go into a per-core ring of fixed-size records (time,
+// name pointer, task), and the window is returned as Chrome/Perfetto trace
+// JSON.
+//
+// Compiled in only with -DENABLE_TRACE (the esp32cam-debug env); otherwise
+// every TRACE_* macro expands to nothing.
+
+#define TRACE_RING_RECORDS        2048   // Per core, in PSRAM (16 bytes each)
+#define TRACE_RING_RECORDS_DRAM   256    // Per core, without PSRAM
+#define TRACE_DEFAULT_WINDOW_MS   2000
+#define TRACE_MAX_WINDOW_MS       10000
+
+#ifdef ENABLE_TRACE
+
+#include <ESPAsyncWebServer.h>
+
+extern bool trace_recording;
+
+void traceRecord(const char* name, char phase);
+
+static inline bool traceActive() {
+    return __atomic_load_n(&trace_recording, __ATOMIC_RELAXED);
+}
+
+#define TRACE_BEGIN(name)   do { if (traceActive()) traceRecord(name, 'B'); } while (0)
+#define TRACE_END(name)     do { if (traceActive()) traceRecord(name, 'E'); } while (0)
+#define TRACE_INSTANT(name) do { if (traceActive()) traceRecord(name, 'i'); } while (0)
+
+// Begin/end pair for the enclosing block
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : _name(name) { TRACE_BEGIN(_name); }
+    ~TraceScope() { TRACE_END(_name); }
+
+private:
+    const char* _name;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+// Claims the tracer, clears the rings and starts recording. Returns false
+// if a window is already running or being sent, or the rings cannot be
+// allocated. The claim is held until traceRelease().
+bool traceStart();
+void traceStop();
+void traceRelease();
+
+// Chrome trace JSON for /trace. Waits out the recording window (the
+// tracer is already started), then streams the recorded events. Releases
+// the tracer when destroyed.
+class AsyncTraceResponse : public AsyncAbstractResponse {
+public:
+    explicit AsyncTraceResponse(uint32_t window_ms);
+    ~AsyncTraceResponse();
+
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+    enum Stage {
+        STAGE_RECORDING,
+        STAGE_HEADER,
+        STAGE_TASKS,
+        STAGE_EVENTS,
+        STAGE_FOOTER,
+        STAGE_DONE
+    };
+
+    bool nextLine();
+
+    unsigned long _end_time;
+    uint32_t _window_ms;
+    Stage _stage;
+    int _core;
+    uint32_t _index;       // Next record on _core, as a sequence number
+    int _task;             // Next task metadata entry
+    size_t _line_len;
+    size_t _line_offset;
+    char _line[256];
+};
+
+#else
+
+#define TRACE_BEGIN(name)   do {} while (0)
+#define TRACE_END(name)     do {} while (0)
+#define TRACE_INSTANT(name) do {} while (0)
+#define TRACE_SCOPE(name)   do {} while (0)
+
+#endif // ENABLE_TRACE
+
+#endif // TRACE_H
@@ -12,11 +12,24 @@ void initWebServer();
 
 // Route handlers
 void handleStatus(AsyncWebServerRequest *request);
+void handleMetrics(AsyncWebServerRequest *request);
+void handleTrace(AsyncWebServerRequest *request);
+void handleTasks(AsyncWebServerRequest *request);
+void handleSessions(AsyncWebServerRequest *request);
 void handleSleepStatus(AsyncWebServerRequest *request);
 void handleCapture(AsyncWebServerRequest *request);
 void handleStream(AsyncWebServerRequest *request);
+void handleClip(AsyncWebServerRequest *request);
+void handleBurst(AsyncWebServerRequest *request);
 void handleBMP(AsyncWebServerRequest *request);
 void handleControl(AsyncWebServerRequest *request);
+void handleControlBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleProfiles(AsyncWebServerRequest *request);
+void handleProfile(AsyncWebServerRequest *request);
+void handleProfileDelete(AsyncWebServerRequest *request);
+void handleProfileSave(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleProfileSchedule(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleMotion(AsyncWebServerRequest *request);
 void handleSleep(AsyncWebServerRequest *request);
 void handleWake(AsyncWebServerRequest *request);
 void handleRestart(AsyncWebServerRequest *request);
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Generates the perfect-hash slot table for the camera setting names.
+
+findCameraSetting() in src/camera_settings.cpp hashes a name with FNV-1a
+(offset basis XOR a seed) and uses the top bits as a slot index (the low
+bits of FNV-1a only depend on the low bits of the seed and the input). This
+searches for the smallest seed that gives every name its own slot and
+prints the seed and the slot table to paste into the source. Rerun it
+whenever a field is added to or renamed in CAMERA_SETTING_TABLE.
+
+    ./scripts/gen_setting_hash.py
+"""
+
+import re
+import sys
+from pathlib import Path
+
+SOURCE = Path(__file__).resolve().parent.parent / "src" / "camera_settings.cpp"
+TABLE_BITS = 6          # CAMERA_SETTING_SLOTS = 64
+FNV_OFFSET = 0x811C9DC5
+FNV_PRIME = 0x01000193
+
+
+def fnv1a(name, seed):
+    h = FNV_OFFSET ^ seed
+    for byte in name.encode():
+        h ^= byte
+        h = (h * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def table_names():
+    text = SOURCE.read_text()
+    start = text.index("CAMERA_SETTING_TABLE[] = {")
+    end = text.index("};", start)
+    return re.findall(r"(?:SENSOR|CONFIG)_FIELD\((\w+)", text[start:end])
+
+
+def main():
+    names = table_names()
+    slots = 1 << TABLE_BITS
+    for seed in range(1 << 20):
+        table = [0] * slots
+        for index, name in enumerate(names):
+            slot = fnv1a(name, seed) >> (32 - TABLE_BITS)
+            if table[slot]:
+                break
+            table[slot] = index + 1
+        else:
+            print("#define CAMERA_SETTING_HASH_SEED 0x%08x" % seed)
+            print("static const uint8_t CAMERA_SETTING_SLOTS[CAMERA_SETTING_SLOT_COUNT] = {")
+            for row in range(0, slots, 16):
+                print("    " + ", ".join("%2d" % v for v in table[row:row + 16]) + ("," if row + 16 < slots else ""))
+            print("};")
+            return 0
+    print("no seed found; raise TABLE_BITS", file=sys.stderr)
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,336 @@
+#!/usr/bin/env python3
+"""Load and soak harness for the stream server.
+
+Runs a fixed mix of concurrent /stream, /capture and /status sessions
+against a running server (normally the native host build), samples server
+heap from /status, and writes the results as JSON. A second mode compares
+two result files and exits non-zero when a metric regressed.
+
+    ./scripts/load_test.py run --port 8080 --stream 8 --capture 4 --status 2 \\
+        --duration 60 --seed 1 --output results.json
+    ./scripts/load_test.py compare baseline.json results.json --tolerance 10
+
+Request timing jitter comes from the seed, so two runs with the same
+arguments issue the same request schedule.
+"""
+
+import argparse
+import http.client
+import json
+import math
+import os
+import random
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from stream_benchmark import StreamClient  # noqa: E402
+
+RESULT_VERSION = 1
+
+
+def percentile(values, pct):
+    """Nearest-rank percentile; 0.0 for an empty list."""
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    rank = max(1, int(math.ceil(pct / 100.0 * len(ordered))))
+    return ordered[rank - 1]
+
+
+def distribution(values):
+    return {
+        "p50": percentile(values, 50),
+        "p99": percentile(values, 99),
+        "max": max(values) if values else 0.0,
+    }
+
+
+def http_get(host, port, path, timeout=10.0):
+    """Returns (status, body bytes, seconds to last byte)."""
+    start = time.monotonic()
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.request("GET", path)
+        response = conn.getresponse()
+        body = response.read()
+        return response.status, body, time.monotonic() - start
+    finally:
+        conn.close()
+
+
+class RequestClient(threading.Thread):
+    """Issues one GET at a time with seeded exponential think time between them."""
+
+    def __init__(self, host, port, path, interval, deadline, rng):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.path = path
+        self.interval = interval
+        self.deadline = deadline
+        self.rng = rng
+        self.latencies = []
+        self.bytes = 0
+        self.ok = 0
+        self.failed = 0
+        self.errors = []
+
+    def run(self):
+        # Stagger the first request so clients do not arrive in lockstep
+        time.sleep(self.rng.uniform(0, self.interval))
+        while time.monotonic() < self.deadline:
+            try:
+                status, body, elapsed = http_get(self.host, self.port, self.path)
+                if status in (200, 304):
+                    self.ok += 1
+                    self.bytes += len(body)
+                    self.latencies.append(elapsed * 1000.0)
+                else:
+                    self.failed += 1
+                    self.errors.append("HTTP %d" % status)
+            except (OSError, http.client.HTTPException) as e:
+                self.failed += 1
+                self.errors.append(str(e))
+            time.sleep(self.rng.expovariate(1.0 / self.interval))
+
+
+class HeapSampler(threading.Thread):
+    """Polls /status for heap figures until the deadline."""
+
+    FIELDS = ("free_heap", "min_free_heap", "free_psram")
+
+    def __init__(self, host, port, interval, deadline, start):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.interval = interval
+        self.deadline = deadline
+        self.start_time = start
+        self.samples = []
+
+    def run(self):
+        while time.monotonic() < self.deadline:
+            sample = {"t": round(time.monotonic() - self.start_time, 3)}
+            try:
+                status, body, _ = http_get(self.host, self.port, "/status")
+                doc = json.loads(body.decode()) if status == 200 else {}
+            except (OSError, ValueError, http.client.HTTPException):
+                doc = {}
+            for field in self.FIELDS:
+                sample[field] = doc.get(field)
+            self.samples.append(sample)
+            time.sleep(self.interval)
+
+
+def summarize_requests(clients, elapsed):
+    latencies = [ms for c in clients for ms in c.latencies]
+    errors = [e for c in clients for e in c.errors]
+    return {
+        "clients": len(clients),
+        "requests": sum(c.ok + c.failed for c in clients),
+        "ok": sum(c.ok for c in clients),
+        "failed": len(errors),
+        "requests_per_s": sum(c.ok for c in clients) / elapsed,
+        "bytes_per_s": sum(c.bytes for c in clients) / elapsed,
+        "latency_ms": distribution(latencies),
+        "errors": sorted(set(errors)),
+    }
+
+
+def summarize_streams(clients, start, elapsed):
+    sessions = []
+    all_gaps = []
+    for client in clients:
+        # The first gap runs from connect to the first frame
+        arrivals = [start] + client.arrivals
+        gaps = [(b - a) * 1000.0 for a, b in zip(arrivals, arrivals[1:])]
+        all_gaps.extend(gaps[1:])
+        sessions.append({
+            "frames": client.frames,
+            "fps": client.frames / elapsed,
+            "bytes_per_s": client.bytes / elapsed,
+            "first_frame_ms": gaps[0] if gaps else None,
+            "gap_ms": distribution(gaps[1:]),
+            "error": client.error,
+        })
+    fps = [s["fps"] for s in sessions]
+    return {
+        "clients": len(clients),
+        "fps_mean": sum(fps) / len(fps) if fps else 0.0,
+        "fps_min": min(fps) if fps else 0.0,
+        "bytes_per_s": sum(c.bytes for c in clients) / elapsed,
+        "gap_ms": distribution(all_gaps),
+        "failed": sum(1 for c in clients if c.error),
+        "sessions": sessions,
+    }
+
+
+def summarize_heap(samples):
+    free = [s["free_heap"] for s in samples if s["free_heap"] is not None]
+    psram = [s["free_psram"] for s in samples if s["free_psram"] is not None]
+    return {
+        "free_heap_min": min(free) if free else None,
+        "free_heap_last": free[-1] if free else None,
+        "free_heap_drift": free[-1] - free[0] if len(free) > 1 else None,
+        "free_psram_min": min(psram) if psram else None,
+        "samples": samples,
+    }
+
+
+def run(args):
+    stream_path = "/stream" + ("?fps=%d" % args.fps if args.fps else "")
+    capture_path = "/capture" + ("?max_age=%d" % args.max_age if args.max_age is not None else "")
+    rng = random.Random(args.seed)
+
+    start = time.monotonic()
+    deadline = start + args.duration
+    streams = [StreamClient(args.host, args.port, stream_path, deadline) for _ in range(args.stream)]
+    captures = [RequestClient(args.host, args.port, capture_path, args.capture_interval, deadline,
+                              random.Random(rng.random())) for _ in range(args.capture)]
+    statuses = [RequestClient(args.host, args.port, "/status", args.status_interval, deadline,
+                              random.Random(rng.random())) for _ in range(args.status)]
+    sampler = HeapSampler(args.host, args.port, args.heap_interval, deadline, start)
+
+    workers = streams + captures + statuses + [sampler]
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join(args.duration + 15)
+    elapsed = time.monotonic() - start
+
+    result = {
+        "version": RESULT_VERSION,
+        "config": {
+            "host": args.host,
+            "port": args.port,
+            "duration": args.duration,
+            "seed": args.seed,
+            "stream_clients": args.stream,
+            "capture_clients": args.capture,
+            "status_clients": args.status,
+            "fps": args.fps,
+        },
+        "started": time.strftime("%Y-%m-%dT%H:%M:%S", time.localtime()),
+        "elapsed": elapsed,
+        "stream": summarize_streams(streams, start, elapsed),
+        "capture": summarize_requests(captures, elapsed),
+        "status": summarize_requests(statuses, elapsed),
+        "heap": summarize_heap(sampler.samples),
+    }
+
+    text = json.dumps(result, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+
+    s, c = result["stream"], result["capture"]
+    sys.stderr.write("stream: %d clients, %.1f fps mean, %.1f min, gap p99 %.0f ms, %.1f KB/s, %d failed\n" % (
+        s["clients"], s["fps_mean"], s["fps_min"], s["gap_ms"]["p99"], s["bytes_per_s"] / 1024.0, s["failed"]))
+    sys.stderr.write("capture: %d ok, %d failed, p50 %.0f ms, p99 %.0f ms\n" % (
+        c["ok"], c["failed"], c["latency_ms"]["p50"], c["latency_ms"]["p99"]))
+    return 1 if s["failed"] or c["failed"] or result["status"]["failed"] else 0
+
+
+# (path, True when larger is better)
+COMPARED_METRICS = [
+    (("stream", "fps_mean"), True),
+    (("stream", "fps_min"), True),
+    (("stream", "bytes_per_s"), True),
+    (("stream", "gap_ms", "p50"), False),
+    (("stream", "gap_ms", "p99"), False),
+    (("stream", "gap_ms", "max"), False),
+    (("stream", "failed"), False),
+    (("capture", "requests_per_s"), True),
+    (("capture", "latency_ms", "p50"), False),
+    (("capture", "latency_ms", "p99"), False),
+    (("capture", "failed"), False),
+    (("status", "latency_ms", "p99"), False),
+    (("status", "failed"), False),
+    (("heap", "free_heap_min"), True),
+    (("heap", "free_psram_min"), True),
+]
+
+
+def lookup(doc, path):
+    for key in path:
+        if not isinstance(doc, dict) or key not in doc:
+            return None
+        doc = doc[key]
+    return doc
+
+
+def compare(args):
+    with open(args.baseline) as f:
+        base = json.load(f)
+    with open(args.candidate) as f:
+        cand = json.load(f)
+
+    if base.get("config") != cand.get("config"):
+        print("warning: runs used different configurations; comparison may not be meaningful")
+
+    tolerance = args.tolerance / 100.0
+    regressions = 0
+    print("%-28s %14s %14s %9s" % ("metric", "baseline", "candidate", "change"))
+    for path, higher_is_better in COMPARED_METRICS:
+        old, new = lookup(base, path), lookup(cand, path)
+        if old is None or new is None:
+            continue
+        change = (new - old) / float(old) if old else (0.0 if new == old else float("inf"))
+        worse = -change if higher_is_better else change
+        # Counters like "failed" regress on any increase; latencies also need
+        # to move by more than timer noise
+        if path[-1] == "failed":
+            regressed = new > old
+        else:
+            regressed = worse > tolerance
+            if any(key.endswith("_ms") for key in path):
+                regressed = regressed and abs(new - old) >= args.min_delta_ms
+        regressions += regressed
+        print("%-28s %14.1f %14.1f %8.1f%% %s" % (
+            ".".join(path), old, new, change * 100.0, " REGRESSION" if regressed else ""))
+
+    print("%d regression(s) beyond %.0f%%" % (regressions, args.tolerance))
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load/soak harness for /stream, /capture and /status")
+    sub = parser.add_subparsers(dest="command")
+    sub.required = True
+
+    r = sub.add_parser("run", help="run a load test and write JSON results")
+    r.add_argument("--host", default="127.0.0.1")
+    r.add_argument("--port", type=int, default=8080)
+    r.add_argument("--stream", type=int, default=4, help="concurrent /stream clients (default: 4)")
+    r.add_argument("--capture", type=int, default=2, help="concurrent /capture clients (default: 2)")
+    r.add_argument("--status", type=int, default=1, help="concurrent /status clients (default: 1)")
+    r.add_argument("--duration", type=float, default=30.0, help="seconds to run (default: 30)")
+    r.add_argument("--seed", type=int, default=1, help="seed for request timing jitter (default: 1)")
+    r.add_argument("--fps", type=int, default=0, help="?fps= for /stream clients (default: server)")
+    r.add_argument("--max-age", type=int, default=None, help="?max_age= for /capture clients")
+    r.add_argument("--capture-interval", type=float, default=0.5,
+                   help="mean seconds between /capture requests per client (default: 0.5)")
+    r.add_argument("--status-interval", type=float, default=1.0,
+                   help="mean seconds between /status requests per client (default: 1)")
+    r.add_argument("--heap-interval", type=float, default=1.0,
+                   help="seconds between heap samples (default: 1)")
+    r.add_argument("--output", "-o", help="write results here instead of stdout")
+
+    c = sub.add_parser("compare", help="compare two result files and flag regressions")
+    c.add_argument("baseline")
+    c.add_argument("candidate")
+    c.add_argument("--tolerance", type=float, default=10.0,
+                   help="percent change allowed before a metric counts as regressed (default: 10)")
+    c.add_argument("--min-delta-ms", type=float, default=5.0,
+                   help="ignore latency changes smaller than this (default: 5)")
+
+    args = parser.parse_args()
+    return run(args) if args.command == "run" else compare(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Memory-pressure check for the native host build.
+
+Steps the simulated heap through the governor's levels with the host-only
+/_host/heap hook and checks the load shedding at each one: stream
+admission, deferred config writes, stream degradation and the /clip ring.
+Pressure is released at the end and everything must come back.
+
+    ./scripts/memory_pressure_test.py --port 8080
+
+Only works against the native build; firmware has no /_host/heap.
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import time
+
+# Two governor ticks: a level change is applied on the next 1 s sample
+SETTLE_S = 2.5
+
+
+class Checker:
+    def __init__(self, host, port):
+        self.host = host
+        self.port = port
+        self.failures = 0
+
+    def request(self, method, path, body=None, headers=None, read=True):
+        """Returns (status, headers dict, body bytes). Streams are not read."""
+        conn = http.client.HTTPConnection(self.host, self.port, timeout=10.0)
+        try:
+            conn.request(method, path, body=body, headers=headers or {})
+            response = conn.getresponse()
+            data = response.read() if read else b""
+            return response.status, dict(response.getheaders()), data
+        finally:
+            conn.close()
+
+    def status(self):
+        _, _, body = self.request("GET", "/status")
+        return json.loads(body)
+
+    def pressure(self, **figures):
+        query = "&".join("%s=%d" % item for item in sorted(figures.items()))
+        code, _, _ = self.request("GET", "/_host/heap?" + query)
+        if code != 200:
+            raise RuntimeError("/_host/heap returned %d; is this the native build?" % code)
+        time.sleep(SETTLE_S)
+        return self.status()
+
+    def check(self, name, ok, detail=""):
+        print("%s  %s%s" % ("PASS" if ok else "FAIL", name, ("  (%s)" % detail) if detail and not ok else ""))
+        if not ok:
+            self.failures += 1
+
+    def check_refused(self, path):
+        code, headers, _ = self.request("GET", path)
+        retry = headers.get("Retry-After")
+        self.check("%s refused with 503 and Retry-After" % path, code == 503 and retry is not None,
+                   "status %d, Retry-After %s" % (code, retry))
+
+    def check_admitted(self, path):
+        code, _, _ = self.request("GET", path, read=False)
+        self.check("%s admitted" % path, code == 200, "status %d" % code)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Step the host build through memory-pressure levels")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    args = parser.parse_args()
+
+    c = Checker(args.host, args.port)
+    base = c.pressure(internal_free=0, internal_block=0, psram_free=0, psram_block=0)
+    adaptation = base["stream"]["adaptation"]
+    base_quality = adaptation["quality"]
+    base_framesize = adaptation["framesize"]
+    base_capacity = base["clip_buffer"]["capacity"]
+    base_shrinks = base["memory"]["actions"]["ring_shrinks"]
+    transitions = base["memory"]["transitions"]
+    c.check("baseline level normal", base["memory"]["level"] == "normal", base["memory"]["level"])
+    c.check_admitted("/stream")
+
+    # Elevated: new streams refused, config writes held back
+    s = c.pressure(internal_free=40000)
+    c.check("elevated on low internal free", s["memory"]["level"] == "elevated", s["memory"]["level"])
+    refused = s["memory"]["streams_refused"]
+    c.check_refused("/stream")
+    c.check_refused("/clip")
+    s = c.status()
+    c.check("refusals counted", s["memory"]["streams_refused"] >= refused + 2,
+            "%d -> %d" % (refused, s["memory"]["streams_refused"]))
+    c.request("POST", "/wifi-connect", body=json.dumps({"ssid": "pressure-test", "password": "pressure-test"}),
+              headers={"Content-Type": "application/json"})
+    s = c.status()
+    c.check("config save deferred", s["memory"]["config_deferred"] is True)
+
+    # High: stream held below its configured quality/framesize
+    s = c.pressure(internal_free=26000)
+    adaptation = s["stream"]["adaptation"]
+    c.check("high on lower internal free", s["memory"]["level"] == "high", s["memory"]["level"])
+    c.check("memory floor applied", adaptation["memory_floor"] > 0, adaptation["memory_floor"])
+    c.check("stream degraded",
+            adaptation["quality"] > base_quality or adaptation["framesize"] < base_framesize,
+            "quality %d framesize %d" % (adaptation["quality"], adaptation["framesize"]))
+
+    # Critical: fragmentation alone is enough
+    s = c.pressure(internal_free=0, internal_block=6000)
+    c.check("critical on small largest block", s["memory"]["level"] == "critical", s["memory"]["level"])
+    c.check("deeper floor at critical", s["stream"]["adaptation"]["memory_floor"] > adaptation["memory_floor"],
+            s["stream"]["adaptation"]["memory_floor"])
+
+    # PSRAM pressure shrinks the /clip ring. The memory given back eases
+    # the level a step per sample, so the level is read as it was at the
+    # shrink, not as it is by the time we look.
+    s = c.pressure(internal_block=0, psram_free=200000)
+    actions = s["memory"]["actions"]
+    if base["clip_buffer"]["enabled"]:
+        c.check("psram under pressure", actions["ring_shrinks"] == base_shrinks + 1 and
+                actions["ring_shrink_level"] in ("high", "critical"),
+                "%d shrink(s) at %s" % (actions["ring_shrinks"] - base_shrinks, actions["ring_shrink_level"]))
+        c.check("clip ring shrunk", actions["ring_shrunk"] and s["clip_buffer"]["capacity"] < base_capacity,
+                "capacity %d of %d" % (s["clip_buffer"]["capacity"], base_capacity))
+    else:
+        # Nothing to give back: the level holds
+        c.check("psram under pressure", s["memory"]["psram"]["level"] in ("high", "critical"),
+                s["memory"]["psram"]["level"])
+        print("SKIP  clip ring disabled in config")
+
+    # Release: levels step back down one per sample
+    c.pressure(internal_free=0, internal_block=0, psram_free=0, psram_block=0)
+    deadline = time.monotonic() + 15
+    s = c.status()
+    while s["memory"]["level"] != "normal" and time.monotonic() < deadline:
+        time.sleep(1)
+        s = c.status()
+    time.sleep(SETTLE_S)
+    s = c.status()
+    adaptation = s["stream"]["adaptation"]
+    c.check("level back to normal", s["memory"]["level"] == "normal", s["memory"]["level"])
+    c.check("transitions recorded", s["memory"]["transitions"] > transitions)
+    c.check("memory floor cleared", adaptation["memory_floor"] == 0, adaptation["memory_floor"])
+    c.check("stream restored", adaptation["quality"] == base_quality and adaptation["framesize"] == base_framesize,
+            "quality %d framesize %d" % (adaptation["quality"], adaptation["framesize"]))
+    c.check("clip ring restored", s["clip_buffer"]["capacity"] == base_capacity and
+            not s["memory"]["actions"]["ring_shrunk"],
+            "capacity %d of %d" % (s["clip_buffer"]["capacity"], base_capacity))
+    c.check("deferred config flushed", s["memory"]["config_deferred"] is False)
+    c.check_admitted("/stream")
+
+    print("%d check(s) failed" % c.failures if c.failures else "all checks passed")
+    return 1 if c.failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
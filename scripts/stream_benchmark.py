@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Throughput benchmark for /stream.
+
+Opens 1..N concurrent /stream clients against a running server (the native
+host build or a real board) and reports delivered frames/s and bytes/s per
+client count.
+
+    ./scripts/stream_benchmark.py --port 8080 --clients 1,2,4,8,16 --duration 10
+"""
+
+import argparse
+import socket
+import sys
+import threading
+import time
+
+
+class StreamClient(threading.Thread):
+    """Reads one multipart /stream response and counts complete JPEG parts."""
+
+    def __init__(self, host, port, path, deadline):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.path = path
+        self.deadline = deadline
+        self.frames = 0
+        self.bytes = 0
+        self.arrivals = []  # time.monotonic() at the end of each frame
+        self.error = None
+
+    def run(self):
+        try:
+            self._stream()
+        except (OSError, ValueError) as e:
+            self.error = str(e)
+
+    def _stream(self):
+        sock = socket.create_connection((self.host, self.port), timeout=5)
+        try:
+            request = "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n" % (self.path, self.host)
+            sock.sendall(request.encode())
+            reader = sock.makefile("rb")
+
+            status = reader.readline()
+            if b" 200 " not in status:
+                raise ValueError("unexpected status: %r" % status.strip())
+            while reader.readline() not in (b"\r\n", b""):
+                pass
+
+            while time.monotonic() < self.deadline:
+                length = self._read_part_header(reader)
+                if length is None:
+                    break
+                body = reader.read(length + 2)  # JPEG plus trailing CRLF
+                if len(body) < length:
+                    break
+                self.frames += 1
+                self.bytes += length
+                self.arrivals.append(time.monotonic())
+        finally:
+            sock.close()
+
+    @staticmethod
+    def _read_part_header(reader):
+        length = None
+        while True:
+            line = reader.readline()
+            if not line:
+                return None
+            if line == b"\r\n":
+                if length is not None:
+                    return length
+                continue  # Blank line between parts
+            if line.lower().startswith(b"content-length:"):
+                length = int(line.split(b":", 1)[1])
+
+
+def run_round(args, clients):
+    path = "/stream"
+    if args.fps:
+        path += "?fps=%d" % args.fps
+
+    start = time.monotonic()
+    deadline = start + args.duration
+    workers = [StreamClient(args.host, args.port, path, deadline) for _ in range(clients)]
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join(args.duration + 10)
+    elapsed = time.monotonic() - start
+
+    frames = sum(w.frames for w in workers)
+    total = sum(w.bytes for w in workers)
+    errors = [w.error for w in workers if w.error]
+    per_client = [w.frames / elapsed for w in workers]
+    return {
+        "clients": clients,
+        "frames_per_s": frames / elapsed,
+        "bytes_per_s": total / elapsed,
+        "min_client_fps": min(per_client) if per_client else 0.0,
+        "max_client_fps": max(per_client) if per_client else 0.0,
+        "errors": errors,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure /stream throughput with concurrent clients")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--clients", default="1,2,4,8,16",
+                        help="comma-separated client counts to run (default: 1,2,4,8,16)")
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds per round (default: 10)")
+    parser.add_argument("--fps", type=int, default=0, help="?fps= requested by each client (default: server)")
+    parser.add_argument("--settle", type=float, default=2.0,
+                        help="pause between rounds so closed streams drain (default: 2)")
+    args = parser.parse_args()
+
+    counts = [int(c) for c in args.clients.split(",") if c.strip()]
+    print("%-8s %10s %12s %10s %10s  %s" % ("clients", "frames/s", "KB/s", "min fps", "max fps", "errors"))
+    failed = False
+    for i, clients in enumerate(counts):
+        if i:
+            time.sleep(args.settle)
+        result = run_round(args, clients)
+        print("%-8d %10.1f %12.1f %10.1f %10.1f  %d" % (
+            result["clients"], result["frames_per_s"], result["bytes_per_s"] / 1024.0,
+            result["min_client_fps"], result["max_client_fps"], len(result["errors"])))
+        for error in sorted(set(result["errors"])):
+            print("         ! %s" % error)
+        failed = failed or bool(result["errors"])
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,219 @@
+#include "bmp_stream.h"
+#include "esp_heap_caps.h"
+
+#define BMP_FILE_HEADER 14
+#define BMP_INFO_HEADER 40
+#define BMP_GRAY_PALETTE 1024   // 256 BGRX entries
+
+static const char* const FORMAT_NAMES[] = { "rgb24", "gray", "rgb565" };
+
+bool parseBmpFormat(const String& name, BmpFormat* format) {
+    for (int i = 0; i < 3; i++) {
+        if (name == FORMAT_NAMES[i]) {
+            *format = (BmpFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* bmpFormatName(BmpFormat format) {
+    return FORMAT_NAMES[format];
+}
+
+static uint8_t* put16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t value) {
+    p = put16(p, value & 0xFFFF);
+    return put16(p, value >> 16);
+}
+
+static void buildHeader(BmpWriter* writer, int bits) {
+    uint8_t* p = writer->header;
+    *p++ = 'B';
+    *p++ = 'M';
+    p = put32(p, writer->total);
+    p = put32(p, 0);
+    p = put32(p, writer->pixel_offset);
+
+    // Positive height: bottom-up rows
+    p = put32(p, BMP_INFO_HEADER);
+    p = put32(p, writer->width);
+    p = put32(p, writer->height);
+    p = put16(p, 1);
+    p = put16(p, bits);
+    p = put32(p, writer->format == BMP_RGB565 ? 3 : 0);    // BI_BITFIELDS or BI_RGB
+    p = put32(p, writer->row_bytes * writer->height);
+    p = put32(p, 2835);                                     // 72 dpi
+    p = put32(p, 2835);
+    p = put32(p, writer->format == BMP_GRAY8 ? 256 : 0);
+    p = put32(p, 0);
+    if (writer->format == BMP_RGB565) {
+        p = put32(p, 0xF800);
+        p = put32(p, 0x07E0);
+        p = put32(p, 0x001F);
+    }
+    writer->header_len = p - writer->header;
+}
+
+BmpWriter* bmpWriterCreate(const uint8_t* jpeg, size_t len, BmpFormat format, JpegDcResult* result) {
+    // The decoder tables are touched for every symbol: internal RAM first
+    BmpWriter* writer = (BmpWriter*)heap_caps_malloc(sizeof(BmpWriter), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!writer) {
+        writer = (BmpWriter*)heap_caps_malloc(sizeof(BmpWriter), MALLOC_CAP_8BIT);
+    }
+    if (!writer) {
+        *result = JPEG_DC_NO_MEMORY;
+        return nullptr;
+    }
+    memset(writer, 0, sizeof(BmpWriter));
+
+    *result = jpegRowsBegin(&writer->decoder, jpeg, len, format == BMP_GRAY8);
+    if (*result != JPEG_DC_OK) {
+        bmpWriterDestroy(writer);
+        return nullptr;
+    }
+
+    const JpegFrame& frame = writer->decoder.frame;
+    static const int BYTES_PER_PIXEL[] = { 3, 1, 2 };
+    writer->format = format;
+    writer->width = frame.width;
+    writer->height = frame.height;
+    writer->row_bytes = ((size_t)frame.width * BYTES_PER_PIXEL[format] + 3) & ~(size_t)3;
+    writer->line_buffer = (uint8_t*)heap_caps_malloc(writer->row_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!writer->line_buffer) {
+        writer->line_buffer = (uint8_t*)heap_caps_malloc(writer->row_bytes, MALLOC_CAP_8BIT);
+    }
+    if (!writer->line_buffer) {
+        *result = JPEG_DC_NO_MEMORY;
+        bmpWriterDestroy(writer);
+        return nullptr;
+    }
+    memset(writer->line_buffer, 0, writer->row_bytes);     // Row padding stays zero
+
+    writer->pixel_offset = BMP_FILE_HEADER + BMP_INFO_HEADER + (format == BMP_RGB565 ? 12 : 0) +
+                           (format == BMP_GRAY8 ? BMP_GRAY_PALETTE : 0);
+    writer->total = writer->pixel_offset + writer->row_bytes * writer->height;
+    writer->decoded_row = -1;
+    writer->line_y = -1;
+    buildHeader(writer, BYTES_PER_PIXEL[format] * 8);
+    return writer;
+}
+
+// YCbCr to RGB in libjpeg's fixed point (jdcolor.c, 16 fraction bits)
+static inline void ycc2rgb(int y, int cb, int cr, uint8_t* rgb) {
+    cb -= 128;
+    cr -= 128;
+    int r = y + ((91881 * cr + 32768) >> 16);
+    int g = y + ((-22554 * cb - 46802 * cr + 32768) >> 16);
+    int b = y + ((116130 * cb + 32768) >> 16);
+    rgb[0] = (uint8_t)(r < 0 ? 0 : r > 255 ? 255 : r);
+    rgb[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+    rgb[2] = (uint8_t)(b < 0 ? 0 : b > 255 ? 255 : b);
+}
+
+// Fills line_buffer with image line y, decoding its MCU row if needed
+static bool convertLine(BmpWriter* writer, int y) {
+    JpegRowDecoder& decoder = writer->decoder;
+    const JpegFrame& frame = decoder.frame;
+    int row = y / frame.mcu_h;
+    if (row != writer->decoded_row) {
+        if (jpegRowsDecode(&decoder, row) != JPEG_DC_OK) {
+            return false;
+        }
+        writer->decoded_row = row;
+    }
+
+    int line = y % frame.mcu_h;
+    const uint8_t* luma = decoder.planes[0] + line * decoder.stride[0];
+    uint8_t* out = writer->line_buffer;
+    int width = writer->width;
+    if (writer->format == BMP_GRAY8) {
+        memcpy(out, luma, width);
+        writer->line_y = y;
+        return true;
+    }
+
+    // Sampling factors are 1 or 2 with luma the largest (jpegParseFrame),
+    // so chroma replication is a shift
+    const uint8_t* cb = luma;
+    const uint8_t* cr = luma;
+    int cb_shift = 0, cr_shift = 0;
+    bool colour = frame.component_count == 3;
+    if (colour) {
+        int hmax = frame.mcu_w / 8;
+        int vmax = frame.mcu_h / 8;
+        const JpegComponent& cb_comp = frame.components[1];
+        const JpegComponent& cr_comp = frame.components[2];
+        cb = decoder.planes[1] + line * cb_comp.v / vmax * decoder.stride[1];
+        cr = decoder.planes[2] + line * cr_comp.v / vmax * decoder.stride[2];
+        cb_shift = hmax / cb_comp.h - 1;
+        cr_shift = hmax / cr_comp.h - 1;
+    }
+
+    uint8_t rgb[3];
+    for (int x = 0; x < width; x++) {
+        if (colour) {
+            ycc2rgb(luma[x], cb[x >> cb_shift], cr[x >> cr_shift], rgb);
+        } else {
+            rgb[0] = rgb[1] = rgb[2] = luma[x];
+        }
+        if (writer->format == BMP_RGB24) {
+            out[0] = rgb[2];
+            out[1] = rgb[1];
+            out[2] = rgb[0];
+            out += 3;
+        } else {
+            uint16_t pixel = ((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3);
+            out[0] = pixel & 0xFF;
+            out[1] = pixel >> 8;
+            out += 2;
+        }
+    }
+    writer->line_y = y;
+    return true;
+}
+
+size_t bmpWriterRead(BmpWriter* writer, uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen && writer->position < writer->total) {
+        size_t pos = writer->position;
+        size_t len;
+        if (pos < writer->header_len) {
+            len = min(maxLen - written, writer->header_len - pos);
+            memcpy(buffer + written, writer->header + pos, len);
+        } else if (pos < writer->pixel_offset) {
+            // Gray palette: entry i is (i, i, i, 0)
+            len = min(maxLen - written, writer->pixel_offset - pos);
+            for (size_t i = 0; i < len; i++) {
+                size_t index = pos - writer->header_len + i;
+                buffer[written + i] = (index & 3) == 3 ? 0 : index >> 2;
+            }
+        } else {
+            size_t offset = pos - writer->pixel_offset;
+            int y = writer->height - 1 - (int)(offset / writer->row_bytes);
+            size_t column = offset % writer->row_bytes;
+            if (writer->line_y != y && !convertLine(writer, y)) {
+                return written;
+            }
+            len = min(maxLen - written, writer->row_bytes - column);
+            memcpy(buffer + written, writer->line_buffer + column, len);
+        }
+        written += len;
+        writer->position += len;
+    }
+    return written;
+}
+
+void bmpWriterDestroy(BmpWriter* writer) {
+    if (!writer) {
+        return;
+    }
+    jpegRowsEnd(&writer->decoder);
+    heap_caps_free(writer->line_buffer);
+    heap_caps_free(writer);
+}
@@ -1,12 +1,191 @@
 #include "app.h"
 #include "config.h"
 #include "camera_pins.h"
+#include "frame_broadcaster.h"
+#include "frame_ring.h"
+#include "frame_burst.h"
+#include "mjpeg_stream.h"
+#include "capture_response.h"
+#include "camera_response.h"
+#include "metrics.h"
+#include "trace.h"
+#include "task_stats.h"
+#include "memory_governor.h"
+#include "camera_settings.h"
+#include "camera_profiles.h"
+#include "motion_detect.h"
+#include "scene_activity.h"
 #include <esp_camera.h>
 #include <esp_system.h>
 #include <esp_heap_caps.h>
 
+// OV2640 COM2 (sensor register bank), for boards without a PWDN line
+#define OV2640_COM2_REG      0x109
+#define OV2640_COM2_STANDBY  0x10
+
+// Sensor restart after PWDN is released, before registers are written
+#define CAMERA_WAKE_SETTLE_MS 5
+
+static CameraPowerStats camera_power = { CAMERA_POWER_OFF, 0, 0, "none", 0, 0 };
+static uint32_t wake_started_us = 0;   // micros() of the pending wake
+static bool wake_pending = false;      // Waiting for the first frame after a wake
+
+// Frames the driver captured before a wake or a framesize switch come out
+// first and are dropped
+static uint32_t discard_before_us = 0;
+static bool discard_pending = false;
+
+// Pins and buffer placement from the first init; provisionFrameBuffers()
+// reinitializes the driver from it with a different buffer size
+static camera_config_t camera_config = {};
+static CameraBufferStats camera_buffers = {};
+
+// Profile switch timing. last_frame_us is the capture time of the newest
+// frame; the gap from the last one before a switch to the first one after
+// it, at the rate in force before, gives the frames the switch cost.
+static CameraSwitchStats camera_switch = {};
+static uint32_t last_frame_us = 0;
+static uint32_t switch_started_us = 0;
+static uint32_t switch_last_frame_us = 0;
+static uint32_t switch_interval_us = 0;
+static uint32_t switch_discarded_before = 0;
+
+// Camera requests (app.h). A slot whose request is running is only
+// touched by the camera task; cancelling it just drops the reply.
+struct CameraRequestSlot {
+    bool used;
+    bool reply;                    // Outcome kept until collected
+    CameraRequestState state;
+    uint32_t ticket;
+    CameraRequest request;
+    CameraRequestOutcome outcome;
+};
+
+static SemaphoreHandle_t requests_lock = nullptr;
+static CameraRequestSlot requests[CAMERA_MAX_REQUESTS];
+static uint32_t next_ticket = 1;
+
+// Powers the sensor down or up without touching the driver. Registers are
+// kept through power-down as long as the sensor supply stays on.
+static void setSensorPower(bool on) {
+#if PWDN_GPIO_NUM >= 0
+    digitalWrite(PWDN_GPIO_NUM, on ? LOW : HIGH);
+#else
+    sensor_t *s = esp_camera_sensor_get();
+    if (s) {
+        s->set_reg(s, OV2640_COM2_REG, OV2640_COM2_STANDBY, on ? 0 : OV2640_COM2_STANDBY);
+    }
+#endif
+}
+
+// JPEG size the OV2640 is expected to produce at this framesize and quality,
+// with headroom for detailed scenes (VGA at quality 10 averages ~40 KB)
+static size_t jpegBytesFor(int framesize, int quality) {
+    const resolution_info_t& res = resolution[framesize];
+    size_t bytes = (size_t)res.width * res.height * 8 / (5 * (max(quality, 0) + 2));
+    return bytes * (100 + CAMERA_FB_HEADROOM_PERCENT) / 100;
+}
+
+// The driver sizes each JPEG buffer from the init framesize
+static size_t driverBufferBytes(int framesize) {
+    return (size_t)resolution[framesize].width * resolution[framesize].height / 5;
+}
+
+// Init framesize with the smallest driver buffers that hold a frame at
+// framesize/quality; the largest the OV2640 has when nothing holds it
+static int bufferFramesizeFor(int framesize, int quality) {
+    size_t needed = jpegBytesFor(framesize, quality);
+    int best = FRAMESIZE_UXGA;
+    for (int fs = 0; fs <= FRAMESIZE_UXGA; fs++) {
+        size_t bytes = driverBufferBytes(fs);
+        if (bytes >= needed && bytes < driverBufferBytes(best)) {
+            best = fs;
+        }
+    }
+    if (driverBufferBytes(best) < needed) {
+        Serial.printf("WARNING: framesize %d at quality %d may overflow the largest frame buffers\n",
+                      framesize, quality);
+    }
+    return best;
+}
+
+// Buffer size to provision for framesize/quality: just enough for it, or
+// enough for camera.ready_framesize as well while PSRAM has room for it
+static int targetBufferFramesize(int framesize, int quality) {
+    int fit = bufferFramesizeFor(framesize, quality);
+    int ready_fs = g_config.camera.ready_framesize;
+    if (ready_fs < 0 || ready_fs > FRAMESIZE_UXGA || camera_config.fb_location != CAMERA_FB_IN_PSRAM) {
+        camera_buffers.ready = false;
+        return fit;
+    }
+    
+    int ready = bufferFramesizeFor(ready_fs, quality);
+    if (driverBufferBytes(ready) <= driverBufferBytes(fit)) {
+        camera_buffers.ready = true;
+        return fit;
+    }
+    
+    // Current buffers are freed before the new ones are allocated
+    size_t available = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) + camera_buffers.buffer_bytes * camera_buffers.fb_count;
+    size_t wanted = driverBufferBytes(ready) * camera_config.fb_count + CAMERA_READY_PSRAM_RESERVE;
+    camera_buffers.ready = available >= wanted;
+    return camera_buffers.ready ? ready : fit;
+}
+
+static void recordBuffers(int buffer_framesize) {
+    camera_buffers.buffer_framesize = buffer_framesize;
+    camera_buffers.buffer_bytes = driverBufferBytes(buffer_framesize);
+    camera_buffers.fb_count = camera_config.fb_count;
+}
+
+// Driver (re)init with buffers sized for buffer_framesize, then every
+// setting in target. Caller holds cameraMutex once the camera task runs.
+static bool startDriver(int buffer_framesize, const CameraSettings& target) {
+    camera_config.frame_size = (framesize_t)buffer_framesize;
+    camera_config.jpeg_quality = target.quality;
+    esp_err_t err = esp_camera_init(&camera_config);
+    if (err != ESP_OK) {
+        Serial.printf("Camera init failed with error 0x%x\n", err);
+        return false;
+    }
+    
+    sensor_t *s = esp_camera_sensor_get();
+    if (s) {
+        CameraSettingsResult result;
+        writeCameraSettings(s, target, CAMERA_SETTINGS_ALL, true, &result);
+    }
+    recordBuffers(buffer_framesize);
+    return true;
+}
+
+// Swaps the driver's frame buffers for ones sized for buffer_framesize.
+// The descriptor pool and stream clients stay; frames from the old buffers
+// are invalidated through the broadcaster generation. Falls back to the
+// old size if the new buffers cannot be allocated. Caller holds cameraMutex.
+static bool provisionFrameBuffers(int buffer_framesize, const CameraSettings& target) {
+    int previous = camera_buffers.buffer_framesize;
+    flushFrameBroadcaster();
+    esp_camera_deinit();
+    if (startDriver(buffer_framesize, target)) {
+        camera_buffers.reprovisions++;
+        return true;
+    }
+    
+    camera_buffers.failed++;
+    Serial.printf("Frame buffers for framesize %d unavailable, keeping framesize %d buffers\n",
+                  buffer_framesize, previous);
+    if (!startDriver(previous, g_config.camera)) {
+        camera_initialized = false;
+        camera_sleeping = true;
+        camera_power.mode = CAMERA_POWER_OFF;
+        camera_power.since = millis();
+    }
+    return false;
+}
+
 bool initCamera() {
-    camera_config_t config;
+    camera_config_t& config = camera_config;
+    config = camera_config_t();
     config.ledc_channel = LEDC_CHANNEL_0;
     config.ledc_timer = LEDC_TIMER_0;
     config.pin_d0 = Y2_GPIO_NUM;
@@ -28,68 +207,62 @@ bool initCamera() {
     config.xclk_freq_hz = 20000000;
     config.pixel_format = PIXFORMAT_JPEG;
     
-    // Init with high specs to pre-allocate larger buffers
+    // Sizes the shared frame pool on first init; the driver gets one
+    // buffer fewer than there are descriptors
+    initFrameBroadcaster();
+    initFrameRing();
+    initBurstBuffer();
+    
+    // Buffers are sized for the configured framesize and quality (or
+    // camera.ready_framesize) through frame_size at init
     if (psramFound()) {
-        config.frame_size = FRAMESIZE_VGA;  // Start with VGA for better compatibility
-        config.jpeg_quality = 10;
-        config.fb_count = 2;  // Double buffering for smooth streaming
+        config.fb_count = frameBufferCount();  // Frames in flight to clients plus capture
+        config.fb_location = CAMERA_FB_IN_PSRAM;
         config.grab_mode = CAMERA_GRAB_LATEST; // Always get latest frame
         Serial.println("PSRAM found, using optimized streaming settings");
     } else {
-        config.frame_size = FRAMESIZE_HVGA;
-        config.jpeg_quality = 12;
         config.fb_count = 1;
+        config.fb_location = CAMERA_FB_IN_DRAM;
         config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
         Serial.println("PSRAM not found, using conservative settings");
     }
     
     // Camera init
-    esp_err_t err = esp_camera_init(&config);
-    if (err != ESP_OK) {
-        Serial.printf("Camera init failed with error 0x%x\n", err);
+    camera_buffers.buffer_bytes = 0;
+    int buffer_framesize = targetBufferFramesize(g_config.camera.framesize, g_config.camera.quality);
+    if (!startDriver(buffer_framesize, g_config.camera)) {
         return false;
     }
+    Serial.printf("Frame buffers: %d x %u bytes (framesize %d)%s\n", (int)config.fb_count,
+                  (unsigned)camera_buffers.buffer_bytes, buffer_framesize,
+                  camera_buffers.ready ? ", ready for camera.ready_framesize" : "");
     
-    // Apply configuration settings
-    sensor_t *s = esp_camera_sensor_get();
-    if (s) {
-        s->set_framesize(s, (framesize_t)g_config.camera.framesize);
-        s->set_quality(s, g_config.camera.quality);
-        s->set_brightness(s, g_config.camera.brightness);
-        s->set_contrast(s, g_config.camera.contrast);
-        s->set_saturation(s, g_config.camera.saturation);
-        s->set_gainceiling(s, (gainceiling_t)g_config.camera.gainceiling);
-        s->set_colorbar(s, g_config.camera.colorbar);
-        s->set_whitebal(s, g_config.camera.awb);
-        s->set_gain_ctrl(s, g_config.camera.agc);
-        s->set_exposure_ctrl(s, g_config.camera.aec);
-        s->set_hmirror(s, g_config.camera.hmirror);
-        s->set_vflip(s, g_config.camera.vflip);
-        s->set_awb_gain(s, g_config.camera.awb_gain);
-        s->set_agc_gain(s, g_config.camera.agc_gain);
-        s->set_aec_value(s, g_config.camera.aec_value);
-        s->set_special_effect(s, g_config.camera.special_effect);
-        s->set_wb_mode(s, g_config.camera.wb_mode);
-        s->set_ae_level(s, g_config.camera.ae_level);
-        s->set_dcw(s, g_config.camera.dcw);
-        s->set_bpc(s, g_config.camera.bpc);
-        s->set_wpc(s, g_config.camera.wpc);
-        s->set_raw_gma(s, g_config.camera.raw_gma);
-        s->set_lenc(s, g_config.camera.lenc);
-    }
+    resetStreamAdaptation();
     
     camera_initialized = true;
     camera_sleeping = false;
     camera_init_time = millis();
+    camera_power.mode = CAMERA_POWER_ACTIVE;
+    camera_power.since = millis();
     
     return true;
 }
 
 void deinitCamera() {
     if (camera_initialized) {
+        // Hold the camera mutex so the camera task is not mid-capture, and
+        // make sure no driver buffer is handed back after deinit
+        xSemaphoreTake(cameraMutex, portMAX_DELAY);
+        flushFrameBroadcaster();
         esp_camera_deinit();
+        xSemaphoreGive(cameraMutex);
         camera_initialized = false;
         camera_sleeping = true;
+        camera_power.mode = CAMERA_POWER_OFF;
+        camera_power.since = millis();
+        wake_pending = false;
+        discard_pending = false;
+        camera_switch.pending = false;
         Serial.println("Camera deinitialized");
     }
 }
@@ -100,24 +273,407 @@ bool reinitCamera() {
     return initCamera();
 }
 
-camera_fb_t* captureFrame() {
-    if (!camera_initialized || camera_sleeping) {
-        return nullptr;
+bool standbyCamera() {
+    if (!camera_initialized) {
+        return false;
     }
     
-    if (xSemaphoreTake(cameraMutex, portMAX_DELAY) == pdTRUE) {
-        camera_fb_t *fb = esp_camera_fb_get();
+    // Under the mutex the camera task is between captures; it stops
+    // grabbing as soon as camera_sleeping is set
+    xSemaphoreTake(cameraMutex, portMAX_DELAY);
+    if (!camera_sleeping) {
+        camera_sleeping = true;
+        wake_pending = false;
+        camera_switch.pending = false;
+        setSensorPower(false);
+        camera_power.mode = CAMERA_POWER_STANDBY;
+        camera_power.since = millis();
+        Serial.println("Camera in standby (sensor powered down, frame buffers kept)");
+    }
+    xSemaphoreGive(cameraMutex);
+    return true;
+}
+
+bool wakeCamera() {
+    if (!camera_initialized) {
+        // Powered off: full driver init and every register
+        wake_started_us = micros();
+        if (!initCamera()) {
+            return false;
+        }
+        wake_pending = true;
+        camera_power.last_wake_path = "reinit";
+        camera_power.registers_restored = CAMERA_SETTING_COUNT;
+        camera_power.wakes++;
+        return true;
+    }
+    if (!camera_sleeping) {
+        return true;
+    }
+    
+    xSemaphoreTake(cameraMutex, portMAX_DELAY);
+    wake_started_us = micros();
+    setSensorPower(true);
+    delay(CAMERA_WAKE_SETTLE_MS);
+    
+    // Registers survived power-down; only settings changed in standby
+    // (config or /control) need writing, unless those need bigger buffers
+    int restored = 0;
+    int buffer_framesize = targetBufferFramesize(g_config.camera.framesize, g_config.camera.quality);
+    sensor_t *s = esp_camera_sensor_get();
+    if (driverBufferBytes(buffer_framesize) > camera_buffers.buffer_bytes) {
+        provisionFrameBuffers(buffer_framesize, g_config.camera);
+        restored = CAMERA_SETTING_COUNT;
+    } else if (s) {
+        CameraSettingsResult result;
+        writeCameraSettings(s, g_config.camera, CAMERA_SETTINGS_ALL, false, &result);
+        restored = result.written;
+    }
+    resetStreamAdaptation();
+    
+    discard_before_us = wake_started_us;
+    discard_pending = true;
+    wake_pending = true;
+    resetMotionModel();
+    camera_sleeping = false;
+    camera_power.mode = CAMERA_POWER_ACTIVE;
+    camera_power.since = millis();
+    camera_power.last_wake_path = "standby";
+    camera_power.registers_restored = restored;
+    camera_power.wakes++;
+    xSemaphoreGive(cameraMutex);
+    return true;
+}
+
+void getCameraPowerStats(CameraPowerStats* stats) {
+    *stats = camera_power;
+}
+
+bool updateCameraSettings(const CameraSettings& target, CameraSettingMask mask, CameraSettingsResult* result,
+                          bool persist) {
+    CameraSettingsResult local;
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+    
+    CameraSettings next = g_config.camera;
+    for (int i = 0; i < CAMERA_SETTING_FIELDS; i++) {
+        if (mask & CAMERA_SETTING_BIT(i)) {
+            const CameraSettingField* field = cameraSettingField(i);
+            next.*field->member = target.*field->member;
+        }
+    }
+    bool led_changed = next.led_intensity != g_config.camera.led_intensity;
+    bool resized = persist && (next.framesize != g_config.camera.framesize || next.quality != g_config.camera.quality);
+    
+    // Off or in standby the sensor is written on init/wake
+    if (!camera_initialized || camera_sleeping) {
+        if (!persist) {
+            return false;
+        }
+        g_config.camera = next;
+        result->deferred = true;
+    } else {
+        uint32_t started = micros();
+        bool ok = true;
+        xSemaphoreTake(cameraMutex, portMAX_DELAY);
+        sensor_t *s = esp_camera_sensor_get();
+        
+        // Stream adaptation may run the sensor off the configured
+        // framesize/quality; compare the fields being written with the sensor
+        if (s) {
+            bool framesize_changed = (mask & CAMERA_SETTING_BIT(CAMERA_SETTING_FRAMESIZE)) &&
+                                     next.framesize != s->status.framesize;
+            bool quality_changed = (mask & CAMERA_SETTING_BIT(CAMERA_SETTING_QUALITY)) &&
+                                   next.quality != s->status.quality;
+            resized = resized || framesize_changed || quality_changed;
+        }
+        int buffer_framesize = targetBufferFramesize(next.framesize, next.quality);
+        size_t needed = driverBufferBytes(buffer_framesize);
+        
+        // Grow when the frames would not fit; shrink only when it gives back
+        // at least half, so alternating profiles do not reallocate every time.
+        // Transient changes never shrink: the configured settings come back.
+        bool grow = needed > camera_buffers.buffer_bytes;
+        bool shrink = persist && needed * 2 <= camera_buffers.buffer_bytes;
+        if (resized && (grow || shrink)) {
+            ok = provisionFrameBuffers(buffer_framesize, next);
+            camera_buffers.last_path = ok ? "reprovision" : "failed";
+            result->written = ok ? CAMERA_SETTING_COUNT : 0;
+        } else {
+            // One pass under the mutex: no frame is captured half-applied
+            ok = s && writeCameraSettings(s, next, mask, false, result);
+            camera_buffers.last_path = "in_place";
+        }
+        
+        if (ok) {
+            if (persist) {
+                g_config.camera = next;
+            }
+            if (resized) {
+                // The frame in flight during the switch is dropped
+                discard_before_us = micros();
+                discard_pending = true;
+            }
+        }
+        if (resized) {
+            camera_buffers.reconfigs++;
+            camera_buffers.last_reconfig_us = micros() - started;
+        }
         xSemaphoreGive(cameraMutex);
-        return fb;
+        
+        if (!ok) {
+            return false;
+        }
+        if (resized) {
+            Serial.printf("Camera reconfigured to framesize %d quality %d (%s, %u us)\n", next.framesize,
+                          next.quality, camera_buffers.last_path, (unsigned)camera_buffers.last_reconfig_us);
+        }
     }
     
+    if (led_changed) {
+        setLED(next.led_intensity);
+    }
+    if (resized && persist) {
+        resetStreamAdaptation();
+    }
+    return true;
+}
+
+void initCameraRequests() {
+    if (!requests_lock) {
+        requests_lock = xSemaphoreCreateMutex();
+    }
+}
+
+// Caller holds requests_lock
+static CameraRequestSlot* findRequest(uint32_t ticket) {
+    for (CameraRequestSlot& slot : requests) {
+        if (slot.used && slot.ticket == ticket) {
+            return &slot;
+        }
+    }
     return nullptr;
 }
 
-void releaseFrame(camera_fb_t* fb) {
-    if (fb) {
-        esp_camera_fb_return(fb);
+uint32_t requestCamera(const CameraRequest& request, bool reply) {
+    if (!requests_lock) {
+        return 0;
+    }
+    xSemaphoreTake(requests_lock, portMAX_DELAY);
+    CameraRequestSlot* free_slot = nullptr;
+    for (CameraRequestSlot& slot : requests) {
+        if (!slot.used) {
+            free_slot = &slot;
+            break;
+        }
+    }
+    uint32_t ticket = 0;
+    if (free_slot) {
+        ticket = next_ticket++;
+        if (next_ticket == 0) {
+            next_ticket = 1;
+        }
+        free_slot->used = true;
+        free_slot->reply = reply;
+        free_slot->state = CAMERA_REQUEST_QUEUED;
+        free_slot->ticket = ticket;
+        free_slot->request = request;
+    }
+    xSemaphoreGive(requests_lock);
+    
+    if (ticket && cameraTaskHandle) {
+        xTaskNotifyGive(cameraTaskHandle);
+    }
+    return ticket;
+}
+
+CameraRequestState cameraRequestState(uint32_t ticket, CameraRequestOutcome* outcome) {
+    if (!requests_lock) {
+        return CAMERA_REQUEST_UNKNOWN;
+    }
+    xSemaphoreTake(requests_lock, portMAX_DELAY);
+    CameraRequestSlot* slot = findRequest(ticket);
+    CameraRequestState state = slot ? slot->state : CAMERA_REQUEST_UNKNOWN;
+    if (state == CAMERA_REQUEST_DONE) {
+        *outcome = slot->outcome;
+        slot->used = false;
+    }
+    xSemaphoreGive(requests_lock);
+    return state;
+}
+
+bool cancelCameraRequest(uint32_t ticket) {
+    if (!requests_lock) {
+        return false;
+    }
+    xSemaphoreTake(requests_lock, portMAX_DELAY);
+    CameraRequestSlot* slot = findRequest(ticket);
+    bool dropped = slot && slot->state == CAMERA_REQUEST_QUEUED;
+    if (dropped) {
+        slot->used = false;
+    }
+    xSemaphoreGive(requests_lock);
+    return dropped;
+}
+
+void releaseCameraRequest(uint32_t ticket) {
+    if (!requests_lock) {
+        return;
+    }
+    xSemaphoreTake(requests_lock, portMAX_DELAY);
+    CameraRequestSlot* slot = findRequest(ticket);
+    if (slot && slot->state == CAMERA_REQUEST_DONE) {
+        slot->used = false;
+    } else if (slot) {
+        slot->reply = false;
+    }
+    xSemaphoreGive(requests_lock);
+}
+
+static void runCameraRequest(const CameraRequest& request, CameraRequestOutcome* outcome) {
+    uint32_t started = micros();
+    switch (request.type) {
+        case CAMERA_REQUEST_SETTINGS:
+            outcome->ok = updateCameraSettings(request.target, request.mask, &outcome->result, request.persist);
+            break;
+        case CAMERA_REQUEST_PROFILE:
+            outcome->ok = activateCameraProfile(request.profile, request.source, &outcome->result);
+            break;
+        case CAMERA_REQUEST_STANDBY:
+            outcome->ok = standbyCamera();
+            break;
+        case CAMERA_REQUEST_WAKE:
+            outcome->ok = wakeCamera();
+            break;
+        case CAMERA_REQUEST_OFF:
+            deinitCamera();
+            outcome->ok = true;
+            break;
+    }
+    outcome->elapsed_us = micros() - started;
+}
+
+// Runs the queued requests, oldest first. Camera task only.
+static void runCameraRequests() {
+    if (!requests_lock) {
+        return;
+    }
+    while (true) {
+        xSemaphoreTake(requests_lock, portMAX_DELAY);
+        CameraRequestSlot* next = nullptr;
+        for (CameraRequestSlot& slot : requests) {
+            if (slot.used && slot.state == CAMERA_REQUEST_QUEUED &&
+                (!next || (int32_t)(slot.ticket - next->ticket) < 0)) {
+                next = &slot;
+            }
+        }
+        if (!next) {
+            xSemaphoreGive(requests_lock);
+            return;
+        }
+        next->state = CAMERA_REQUEST_RUNNING;
+        CameraRequest request = next->request;
+        xSemaphoreGive(requests_lock);
+        
+        CameraRequestOutcome outcome;
+        memset(&outcome, 0, sizeof(outcome));
+        runCameraRequest(request, &outcome);
+        
+        xSemaphoreTake(requests_lock, portMAX_DELAY);
+        if (next->reply) {
+            next->outcome = outcome;
+            next->state = CAMERA_REQUEST_DONE;
+        } else {
+            next->used = false;
+        }
+        xSemaphoreGive(requests_lock);
+        
+        // Waiting replies resume from there
+        if (webServerTaskHandle) {
+            xTaskNotifyGive(webServerTaskHandle);
+        }
+    }
+}
+
+void getCameraBufferStats(CameraBufferStats* stats) {
+    *stats = camera_buffers;
+    stats->ready_framesize = g_config.camera.ready_framesize;
+}
+
+static uint32_t frameTimestampUs(const camera_fb_t* fb) {
+    return (uint32_t)((uint64_t)fb->timestamp.tv_sec * 1000000ULL + fb->timestamp.tv_usec);
+}
+
+// No cameraMutex here: a capture in progress would hold the switch up
+// twice, and a frame landing in between is counted either way
+void beginCameraSwitch() {
+    camera_switch.pending = false;
+    switch_started_us = micros();
+    switch_last_frame_us = __atomic_load_n(&last_frame_us, __ATOMIC_RELAXED);
+    switch_interval_us = 1000000 / constrain(g_config.stream.capture_fps, 1, STREAM_MAX_FPS);
+    switch_discarded_before = __atomic_load_n(&camera_buffers.frames_discarded, __ATOMIC_RELAXED);
+}
+
+void endCameraSwitch(bool applied) {
+    xSemaphoreTake(cameraMutex, portMAX_DELAY);
+    if (applied && camera_initialized && !camera_sleeping) {
+        // Frames exposed while the registers changed may carry a mix of
+        // both profiles
+        discard_before_us = micros();
+        discard_pending = true;
+        camera_switch.pending = true;
+        resetMotionModel();
+    } else {
+        camera_switch.pending = false;
+        camera_switch.latency_us = 0;
+        camera_switch.frames_lost = 0;
+        camera_switch.frames_discarded = 0;
+    }
+    xSemaphoreGive(cameraMutex);
+}
+
+void getCameraSwitchStats(CameraSwitchStats* stats) {
+    *stats = camera_switch;
+}
+
+// First frame after a switch: how long it took and what it cost
+static void finishCameraSwitch(const camera_fb_t* fb) {
+    uint32_t captured = frameTimestampUs(fb);
+    uint32_t gap = switch_last_frame_us ? captured - switch_last_frame_us : 0;
+    camera_switch.pending = false;
+    camera_switch.latency_us = micros() - switch_started_us;
+    camera_switch.frames_lost = gap > switch_interval_us
+        ? (gap + switch_interval_us / 2) / switch_interval_us - 1 : 0;
+    camera_switch.frames_discarded = camera_buffers.frames_discarded - switch_discarded_before;
+    Serial.printf("Camera switch: first frame after %u ms, %u frame(s) lost (%u discarded)\n",
+                  (unsigned)(camera_switch.latency_us / 1000), (unsigned)camera_switch.frames_lost,
+                  (unsigned)camera_switch.frames_discarded);
+}
+
+// Snapshot cache counters for /status
+static uint32_t capture_cache_hits = 0;
+static uint32_t capture_cache_misses = 0;
+
+// The caller waits for the next frame without blocking (capture_response.h)
+FrameRef captureFrame(uint32_t max_age_ms, uint32_t* wait_seq) {
+    TRACE_SCOPE("captureFrame");
+    FrameRef frame = acquireFrame(0);
+    if (frame && millis() - frame.timestamp() <= max_age_ms) {
+        capture_cache_hits++;
+        return frame;
     }
+    
+    // Stale or nothing captured yet - anything newer was grabbed after now
+    capture_cache_misses++;
+    *wait_seq = frame ? frame.seq() : 0;
+    return FrameRef();
+}
+
+void getCaptureCacheStats(uint32_t* hits, uint32_t* misses) {
+    *hits = capture_cache_hits;
+    *misses = capture_cache_misses;
 }
 
 void initLED() {
@@ -182,28 +738,192 @@ const char* getResetReason() {
     }
 }
 
-// Camera task - handles frame capture and processing
+// Grabs one frame under cameraMutex, then with the mutex released runs
+// motion detection and the scene activity check on it and publishes it to
+// the mailbox and the clip ring. The buffer cannot be freed meanwhile:
+// deinit and reprovisioning run on this task too (camera requests). Burst
+// frames are copied into the burst buffer first and are not analysed; if
+// every pool slot is still pinned they are handed straight back instead
+// of published, so a burst never waits on stream clients.
+static bool grabFrame(bool burst) {
+    TRACE_SCOPE("grabFrame");
+    camera_fb_t *fb = nullptr;
+    if (xSemaphoreTake(cameraMutex, portMAX_DELAY) == pdTRUE) {
+        if (camera_initialized && !camera_sleeping) {
+            uint32_t started = micros();
+            fb = esp_camera_fb_get();
+            
+            // After a standby wake or a framesize switch the driver may still
+            // hold frames captured before it; they come out first and are dropped
+            for (int stale = 0; fb && discard_pending && stale < (int)frameBufferCount() &&
+                 (int32_t)(frameTimestampUs(fb) - discard_before_us) < 0; stale++) {
+                esp_camera_fb_return(fb);
+                camera_buffers.frames_discarded++;
+                fb = esp_camera_fb_get();
+            }
+            if (fb) {
+                discard_pending = false;
+                if (camera_switch.pending) {
+                    finishCameraSwitch(fb);
+                }
+                __atomic_store_n(&last_frame_us, frameTimestampUs(fb), __ATOMIC_RELAXED);
+            }
+            metricObserve(metric_capture_latency, micros() - started);
+            if (fb && wake_pending) {
+                wake_pending = false;
+                camera_power.last_wake_us = micros() - wake_started_us;
+                Serial.printf("Camera wake (%s): first frame after %u ms, %u settings restored\n",
+                              camera_power.last_wake_path, (unsigned)(camera_power.last_wake_us / 1000),
+                              (unsigned)camera_power.registers_restored);
+            }
+            if (!fb) {
+                metricAdd(metric_capture_failures);
+            }
+        }
+        xSemaphoreGive(cameraMutex);
+    }
+    if (!fb) {
+        return false;
+    }
+    
+    metricObserve(metric_frame_size, fb->len);
+    if (burst) {
+        storeBurstFrame(fb->buf, fb->len, micros());
+    }
+    
+    if (!burst || frameSlotAvailable()) {
+        // Scored before publishing so the score goes out with the frame
+        if (burst) {
+            publishFrame(fb);
+        } else {
+            int motion = analyzeMotionFrame(fb);
+            publishFrame(fb, motion, updateSceneActivity(fb));
+        }
+        
+        // Keep a copy for /clip pre-event replay
+        if (frameRingEnabled()) {
+            FrameRef latest = acquireFrame(0);
+            appendRingFrame(latest);
+        }
+    } else {
+        esp_camera_fb_return(fb);
+    }
+    
+    // Let the web server task hand the new frame to waiting clients
+    if (webServerTaskHandle) {
+        xTaskNotifyGive(webServerTaskHandle);
+    }
+    return true;
+}
+
+// Runs a /burst request: frames back to back at the sensor rate, or on a
+// fixed interval, without the regular capture pacing in between
+static void runBurst(int count, uint32_t interval_ms) {
+    TickType_t last_wake = xTaskGetTickCount();
+    int failures = 0;
+    
+    while (getBurstFrameCount() < count && !burstCancelled() &&
+           camera_initialized && !camera_sleeping) {
+        int stored = getBurstFrameCount();
+        if (!grabFrame(true)) {
+            if (++failures >= 3) {
+                break;
+            }
+            continue;
+        }
+        if (getBurstFrameCount() == stored) {
+            break;  // Burst buffer full
+        }
+        if (interval_ms && getBurstFrameCount() < count) {
+            vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(interval_ms));
+        }
+    }
+    
+    finishBurst();
+}
+
+// vTaskDelayUntil() that runs camera requests as they are queued
+static void waitForNextCapture(TickType_t* last_wake, TickType_t period) {
+    *last_wake += period;
+    while (true) {
+        TickType_t left = *last_wake - xTaskGetTickCount();
+        if ((int32_t)left <= 0) {
+            return;
+        }
+        ulTaskNotifyTake(pdTRUE, left);
+        runCameraRequests();
+    }
+}
+
+// Camera task - owns the sensor. Grabs frames continuously at the
+// configured rate and publishes them to the latest-frame mailbox that
+// /capture and /stream read from; runs bursts and camera requests in
+// between.
 void cameraTask(void* parameter) {
     Serial.println("Camera task started on core " + String(xPortGetCoreID()));
     
     TickType_t xLastWakeTime = xTaskGetTickCount();
-    const TickType_t xFrequency = pdMS_TO_TICKS(100); // 10 Hz
+    int burst_count;
+    uint32_t burst_interval;
     
     while (true) {
-        // This task can be used for periodic camera maintenance
-        // or frame preprocessing if needed
+        runCameraRequests();
         
-        vTaskDelayUntil(&xLastWakeTime, xFrequency);
+        if (!camera_initialized || camera_sleeping) {
+            // A burst requested just before sleep ends with what it has
+            if (takeBurstRequest(&burst_count, &burst_interval)) {
+                finishBurst();
+            }
+            // New requests (such as a wake) notify to cut this short
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+            xLastWakeTime = xTaskGetTickCount();
+            continue;
+        }
+        
+        if (takeBurstRequest(&burst_count, &burst_interval)) {
+            runBurst(burst_count, burst_interval);
+            xLastWakeTime = xTaskGetTickCount();
+            continue;
+        }
+        
+        if (!frameSlotAvailable()) {
+            // Every buffer is still pinned by a consumer that is sending it
+            vTaskDelay(pdMS_TO_TICKS(2));
+            continue;
+        }
+        
+        if (!grabFrame(false)) {
+            Serial.println("Camera capture failed");
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+        
+        // Drops to activity.idle_fps while the scene is static
+        int fps = max(activityCaptureFps(), 1);
+        waitForNextCapture(&xLastWakeTime, pdMS_TO_TICKS(1000 / fps));
     }
 }
 
-// Web server task - handles HTTP requests
+// Web server task - paces stream clients; HTTP itself runs in async_tcp
 void webServerTask(void* parameter) {
     Serial.println("Web server task started on core " + String(xPortGetCoreID()));
     
+    unsigned long last_adaptation = millis();
+    
     while (true) {
-        // Web server runs asynchronously, just keep task alive
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Woken by every published frame, or periodically for client
+        // deadlines that fall between frames
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        serviceStreamClients();
+        serviceCaptureResponses();
+        serviceCameraResponses();
+        
+        if (millis() - last_adaptation >= 1000) {
+            last_adaptation = millis();
+            updateMemoryGovernor();
+            updateStreamAdaptation();
+            scheduleStreamEgress();
+            updateProfileSchedule();
+        }
     }
 }
 
@@ -215,10 +935,9 @@ void watchdogTask(void* parameter) {
     const TickType_t xFrequency = pdMS_TO_TICKS(5000); // 5 seconds
     
     while (true) {
-        // Monitor heap and system health
-        if (ESP.getFreeHeap() < 10000) {
-            Serial.println("WARNING: Low heap memory!");
-        }
+        // Heap pressure is handled by the memory governor in the web server task
+        metricsPollWiFi();
+        sampleTaskStats();
         
         vTaskDelayUntil(&xLastWakeTime, xFrequency);
     }
@@ -0,0 +1,497 @@
+#include "camera_profiles.h"
+#include "app.h"
+#include <Preferences.h>
+#include <time.h>
+
+#define PROFILE_NVS_NAMESPACE "camprofiles"
+#define PROFILE_SCHEDULE_KEY "schedule"
+#define PROFILE_FORMAT_VERSION 1
+
+// OV2640 sensor-bank registers behind the light index
+#define OV2640_GAIN_REG   0x100
+#define OV2640_REG04      0x104    // AEC[1:0]
+#define OV2640_AEC_REG    0x110    // AEC[9:2]
+#define OV2640_YAVG_REG   0x12F
+#define OV2640_REG45      0x145    // AEC[15:10]
+#define OV2640_MAX_EXPOSURE_LINES 1248
+
+// A clock before this has not been set by SNTP
+#define PROFILE_CLOCK_VALID_AFTER 1577836800  // 2020-01-01
+
+// NVS form of a profile, one blob per slot ("p0".."p7"). Values follow the
+// camera_settings.h table order: a new field changes the size and old blobs
+// are ignored; bump the version if the table is ever reordered.
+struct __attribute__((packed)) StoredProfile {
+    uint8_t version;
+    char name[PROFILE_NAME_LEN];
+    int16_t values[CAMERA_SETTING_FIELDS];
+    int8_t ready_framesize;
+    uint8_t capture_fps;
+};
+
+struct StoredSchedule {
+    uint8_t version;
+    ProfileSchedule schedule;
+};
+
+static const char* const RULE_TYPE_NAMES[] = { "time", "light_below", "light_above" };
+
+// Guards everything below. Taken before cameraMutex, never while holding it.
+static SemaphoreHandle_t profile_mutex = nullptr;
+static Preferences profile_prefs;
+static CameraProfile profiles[PROFILE_MAX];
+static bool slot_used[PROFILE_MAX];
+static ProfileSchedule schedule = {};
+static CameraProfileState profile_state = {};
+
+// Schedule evaluation, web server task only
+static unsigned long last_sample = 0;
+static int candidate_rule = -1;
+static int candidate_samples = 0;
+static bool sntp_started = false;
+
+static void slotKey(int slot, char* key) {
+    key[0] = 'p';
+    key[1] = '0' + slot;
+    key[2] = '\0';
+}
+
+static bool validProfileName(const char* name) {
+    size_t len = name ? strlen(name) : 0;
+    if (len == 0 || len >= PROFILE_NAME_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int findSlot(const char* name) {
+    for (int i = 0; i < PROFILE_MAX; i++) {
+        if (slot_used[i] && strcmp(profiles[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void packProfile(const CameraProfile& profile, StoredProfile* stored) {
+    memset(stored, 0, sizeof(*stored));
+    stored->version = PROFILE_FORMAT_VERSION;
+    strlcpy(stored->name, profile.name, sizeof(stored->name));
+    for (int i = 0; i < CAMERA_SETTING_FIELDS; i++) {
+        stored->values[i] = (int16_t)(profile.camera.*cameraSettingField(i)->member);
+    }
+    stored->ready_framesize = (int8_t)profile.camera.ready_framesize;
+    stored->capture_fps = (uint8_t)profile.capture_fps;
+}
+
+// False for a blob from another format or with values out of range
+static bool unpackProfile(const StoredProfile& stored, CameraProfile* profile) {
+    if (stored.version != PROFILE_FORMAT_VERSION) {
+        return false;
+    }
+    memset(profile, 0, sizeof(*profile));
+    memcpy(profile->name, stored.name, sizeof(profile->name));
+    profile->name[PROFILE_NAME_LEN - 1] = '\0';
+    for (int i = 0; i < CAMERA_SETTING_FIELDS; i++) {
+        const CameraSettingField* field = cameraSettingField(i);
+        if (!cameraSettingInRange(field, stored.values[i])) {
+            return false;
+        }
+        profile->camera.*field->member = stored.values[i];
+    }
+    profile->camera.ready_framesize = stored.ready_framesize;
+    profile->capture_fps = stored.capture_fps;
+    return validProfileName(profile->name) && profile->capture_fps >= 1 && profile->capture_fps <= STREAM_MAX_FPS;
+}
+
+static bool scheduleHasTimeRules(const ProfileSchedule& s) {
+    for (int i = 0; i < s.rule_count; i++) {
+        if (s.rules[i].type == PROFILE_RULE_TIME) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void applyTimezone() {
+    if (schedule.tz[0]) {
+        setenv("TZ", schedule.tz, 1);
+        tzset();
+    }
+}
+
+// SNTP is only started for a schedule that needs the time of day
+static void startClock() {
+    if (!sntp_started && wifi_connected && schedule.enabled && scheduleHasTimeRules(schedule)) {
+        configTzTime(schedule.tz[0] ? schedule.tz : "UTC0", PROFILE_NTP_SERVER);
+        sntp_started = true;
+        Serial.printf("Profile schedule: time sync started (%s)\n", PROFILE_NTP_SERVER);
+    }
+}
+
+void initCameraProfiles() {
+    if (!profile_mutex) {
+        profile_mutex = xSemaphoreCreateMutex();
+    }
+    memset(slot_used, 0, sizeof(slot_used));
+    memset(&schedule, 0, sizeof(schedule));
+    profile_state.source = "none";
+    profile_state.light = -1;
+    profile_state.rule = -1;
+
+    // A namespace that was never written does not open read-only
+    if (!profile_prefs.begin(PROFILE_NVS_NAMESPACE, true)) {
+        return;
+    }
+    int loaded = 0;
+    for (int i = 0; i < PROFILE_MAX; i++) {
+        char key[4];
+        slotKey(i, key);
+        StoredProfile stored;
+        if (profile_prefs.getBytesLength(key) != sizeof(stored)) {
+            continue;
+        }
+        profile_prefs.getBytes(key, &stored, sizeof(stored));
+        if (unpackProfile(stored, &profiles[i])) {
+            slot_used[i] = true;
+            loaded++;
+        } else {
+            Serial.printf("Camera profile slot %d unreadable, ignored\n", i);
+        }
+    }
+
+    StoredSchedule stored_schedule;
+    if (profile_prefs.getBytesLength(PROFILE_SCHEDULE_KEY) == sizeof(stored_schedule)) {
+        profile_prefs.getBytes(PROFILE_SCHEDULE_KEY, &stored_schedule, sizeof(stored_schedule));
+        if (stored_schedule.version == PROFILE_FORMAT_VERSION &&
+            stored_schedule.schedule.rule_count >= 0 && stored_schedule.schedule.rule_count <= PROFILE_RULE_MAX) {
+            schedule = stored_schedule.schedule;
+            schedule.tz[PROFILE_TZ_LEN - 1] = '\0';
+        }
+    }
+    profile_prefs.end();
+
+    applyTimezone();
+    Serial.printf("Camera profiles: %d loaded, schedule %s with %d rule(s)\n", loaded,
+                  schedule.enabled ? "enabled" : "disabled", schedule.rule_count);
+}
+
+int getCameraProfileCount() {
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    int count = 0;
+    for (int i = 0; i < PROFILE_MAX; i++) {
+        count += slot_used[i];
+    }
+    xSemaphoreGive(profile_mutex);
+    return count;
+}
+
+bool getCameraProfile(int slot, CameraProfile* profile) {
+    if (slot < 0 || slot >= PROFILE_MAX) {
+        return false;
+    }
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    bool used = slot_used[slot];
+    if (used) {
+        *profile = profiles[slot];
+    }
+    xSemaphoreGive(profile_mutex);
+    return used;
+}
+
+bool findCameraProfile(const char* name, CameraProfile* profile) {
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    int slot = name ? findSlot(name) : -1;
+    if (slot >= 0) {
+        *profile = profiles[slot];
+    }
+    xSemaphoreGive(profile_mutex);
+    return slot >= 0;
+}
+
+bool saveCameraProfile(const CameraProfile& profile) {
+    if (!validProfileName(profile.name)) {
+        return false;
+    }
+
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    int slot = findSlot(profile.name);
+    for (int i = 0; slot < 0 && i < PROFILE_MAX; i++) {
+        if (!slot_used[i]) {
+            slot = i;
+        }
+    }
+
+    bool ok = false;
+    if (slot >= 0 && profile_prefs.begin(PROFILE_NVS_NAMESPACE, false)) {
+        char key[4];
+        slotKey(slot, key);
+        StoredProfile stored;
+        packProfile(profile, &stored);
+        ok = profile_prefs.putBytes(key, &stored, sizeof(stored)) == sizeof(stored);
+        profile_prefs.end();
+    }
+    if (ok) {
+        profiles[slot] = profile;
+        slot_used[slot] = true;
+        Serial.printf("Camera profile %s saved (slot %d, %u bytes)\n", profile.name, slot,
+                      (unsigned)sizeof(StoredProfile));
+    }
+    xSemaphoreGive(profile_mutex);
+    return ok;
+}
+
+bool deleteCameraProfile(const char* name) {
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    int slot = name ? findSlot(name) : -1;
+    bool ok = false;
+    if (slot >= 0 && profile_prefs.begin(PROFILE_NVS_NAMESPACE, false)) {
+        char key[4];
+        slotKey(slot, key);
+        ok = profile_prefs.remove(key);
+        profile_prefs.end();
+    }
+    if (ok) {
+        slot_used[slot] = false;
+        Serial.printf("Camera profile %s deleted\n", name);
+    }
+    xSemaphoreGive(profile_mutex);
+    return ok;
+}
+
+void clearCameraProfiles() {
+    if (!profile_mutex) {
+        return;
+    }
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    if (profile_prefs.begin(PROFILE_NVS_NAMESPACE, false)) {
+        profile_prefs.clear();
+        profile_prefs.end();
+    }
+    memset(slot_used, 0, sizeof(slot_used));
+    memset(&schedule, 0, sizeof(schedule));
+    xSemaphoreGive(profile_mutex);
+}
+
+// Caller holds profile_mutex
+static bool applyProfile(const CameraProfile& profile, const char* source, CameraSettingsResult* result) {
+    int previous_ready = g_config.camera.ready_framesize;
+    g_config.camera.ready_framesize = profile.camera.ready_framesize;
+
+    beginCameraSwitch();
+    uint32_t started = micros();
+    bool ok = updateCameraSettings(profile.camera, CAMERA_SETTINGS_ALL, result);
+    uint32_t elapsed = micros() - started;
+    endCameraSwitch(ok && !result->deferred);
+
+    if (!ok) {
+        g_config.camera.ready_framesize = previous_ready;
+        Serial.printf("Camera profile %s not applied\n", profile.name);
+        return false;
+    }
+    g_config.stream.capture_fps = profile.capture_fps;
+
+    strlcpy(profile_state.active, profile.name, sizeof(profile_state.active));
+    profile_state.source = source;
+    profile_state.switches++;
+    profile_state.last_switch = millis();
+    profile_state.written = result->written;
+    profile_state.skipped = result->skipped;
+    profile_state.deferred = result->deferred;
+    profile_state.apply_us = elapsed;
+    Serial.printf("Camera profile %s activated (%s): %d register(s) written, %d unchanged, %u us\n",
+                  profile.name, source, result->written, result->skipped, (unsigned)elapsed);
+    return true;
+}
+
+bool activateCameraProfile(const char* name, const char* source, CameraSettingsResult* result) {
+    CameraSettingsResult local;
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    int slot = name ? findSlot(name) : -1;
+    bool ok = false;
+    if (slot >= 0) {
+        CameraProfile profile = profiles[slot];
+        ok = applyProfile(profile, source, result);
+    }
+    xSemaphoreGive(profile_mutex);
+    return ok;
+}
+
+bool setProfileSchedule(const ProfileSchedule& next) {
+    if (next.rule_count < 0 || next.rule_count > PROFILE_RULE_MAX) {
+        return false;
+    }
+    for (int i = 0; i < next.rule_count; i++) {
+        const ProfileRule& rule = next.rules[i];
+        if (!validProfileName(rule.profile) || rule.from_minute >= 24 * 60 || rule.to_minute >= 24 * 60) {
+            return false;
+        }
+    }
+
+    StoredSchedule stored;
+    memset(&stored, 0, sizeof(stored));
+    stored.version = PROFILE_FORMAT_VERSION;
+    stored.schedule = next;
+    stored.schedule.tz[PROFILE_TZ_LEN - 1] = '\0';
+
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    bool ok = false;
+    if (profile_prefs.begin(PROFILE_NVS_NAMESPACE, false)) {
+        ok = profile_prefs.putBytes(PROFILE_SCHEDULE_KEY, &stored, sizeof(stored)) == sizeof(stored);
+        profile_prefs.end();
+    }
+    if (ok) {
+        bool tz_changed = strcmp(schedule.tz, stored.schedule.tz) != 0;
+        schedule = stored.schedule;
+        candidate_rule = -1;
+        candidate_samples = 0;
+        applyTimezone();
+        if (tz_changed) {
+            sntp_started = false;
+        }
+        Serial.printf("Profile schedule %s with %d rule(s)\n", schedule.enabled ? "enabled" : "disabled",
+                      schedule.rule_count);
+    }
+    xSemaphoreGive(profile_mutex);
+    return ok;
+}
+
+void getProfileSchedule(ProfileSchedule* out) {
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    *out = schedule;
+    xSemaphoreGive(profile_mutex);
+}
+
+const char* profileRuleTypeName(ProfileRuleType type) {
+    return type <= PROFILE_RULE_LIGHT_ABOVE ? RULE_TYPE_NAMES[type] : "unknown";
+}
+
+// Scene light from the registers the AEC loop settled on: average luma
+// scaled to full exposure and 1x gain. -1 if the sensor cannot be read.
+static int readLightIndex() {
+    if (!camera_initialized || camera_sleeping) {
+        return -1;
+    }
+    int yavg = -1, gain = -1, aec_high = -1, aec_mid = -1, aec_low = -1;
+    xSemaphoreTake(cameraMutex, portMAX_DELAY);
+    sensor_t *s = esp_camera_sensor_get();
+    if (s && s->id.PID == OV2640_PID && camera_initialized && !camera_sleeping) {
+        yavg = s->get_reg(s, OV2640_YAVG_REG, 0xFF);
+        gain = s->get_reg(s, OV2640_GAIN_REG, 0xFF);
+        aec_high = s->get_reg(s, OV2640_REG45, 0x3F);
+        aec_mid = s->get_reg(s, OV2640_AEC_REG, 0xFF);
+        aec_low = s->get_reg(s, OV2640_REG04, 0x03);
+    }
+    xSemaphoreGive(cameraMutex);
+    if (yavg < 0 || gain < 0 || aec_high < 0 || aec_mid < 0 || aec_low < 0) {
+        return -1;
+    }
+
+    // Gain: each of bits 7..4 doubles it, bits 3..0 add sixteenths
+    uint32_t gain16 = (uint32_t)(16 + (gain & 0x0F)) << __builtin_popcount(gain >> 4);
+    uint32_t lines = max((aec_high << 10) | (aec_mid << 2) | aec_low, 1);
+    uint32_t light = (uint32_t)yavg * OV2640_MAX_EXPOSURE_LINES * 16 / (lines * gain16);
+    return (int)min(light, (uint32_t)65535);
+}
+
+// Local minutes since midnight, -1 while the clock is not set
+static int localMinute() {
+    time_t now = time(nullptr);
+    if (now < PROFILE_CLOCK_VALID_AFTER) {
+        return -1;
+    }
+    struct tm local;
+    localtime_r(&now, &local);
+    return local.tm_hour * 60 + local.tm_min;
+}
+
+static bool ruleMatches(const ProfileRule& rule, int minute, int light) {
+    switch (rule.type) {
+        case PROFILE_RULE_TIME:
+            if (minute < 0) {
+                return false;
+            }
+            if (rule.from_minute <= rule.to_minute) {
+                return minute >= rule.from_minute && minute < rule.to_minute;
+            }
+            return minute >= rule.from_minute || minute < rule.to_minute;
+        case PROFILE_RULE_LIGHT_BELOW:
+            return light >= 0 && light < rule.light;
+        case PROFILE_RULE_LIGHT_ABOVE:
+            return light >= 0 && light > rule.light;
+        default:
+            return false;
+    }
+}
+
+void updateProfileSchedule() {
+    if (!profile_mutex || millis() - last_sample < PROFILE_SCHEDULE_INTERVAL_MS) {
+        return;
+    }
+    last_sample = millis();
+
+    // Sampled without profile_mutex: it takes cameraMutex
+    int sample = readLightIndex();
+
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    if (sample >= 0) {
+        // The last value is kept through standby
+        profile_state.light = profile_state.light < 0 ? sample
+            : profile_state.light + (sample - profile_state.light) / PROFILE_LIGHT_SMOOTHING;
+    }
+    startClock();
+    int minute = localMinute();
+    profile_state.clock_valid = minute >= 0;
+
+    int match = -1;
+    for (int i = 0; schedule.enabled && i < schedule.rule_count; i++) {
+        if (ruleMatches(schedule.rules[i], minute, profile_state.light)) {
+            match = i;
+            break;
+        }
+    }
+    if (match != candidate_rule) {
+        candidate_rule = match;
+        candidate_samples = 0;
+    }
+    candidate_samples++;
+    profile_state.rule = match;
+
+    // Fires once, when the rule has held long enough
+    if (match >= 0 && candidate_samples == PROFILE_SCHEDULE_HOLD) {
+        const ProfileRule& rule = schedule.rules[match];
+        int slot = findSlot(rule.profile);
+        if (slot < 0) {
+            Serial.printf("Profile schedule: rule %d names unknown profile %s\n", match, rule.profile);
+        } else if (strcmp(profile_state.active, rule.profile) != 0) {
+            // Applied by the camera task; nobody waits for the outcome
+            CameraRequest request;
+            memset(&request, 0, sizeof(request));
+            request.type = CAMERA_REQUEST_PROFILE;
+            strlcpy(request.profile, rule.profile, sizeof(request.profile));
+            request.source = "schedule";
+            if (!requestCamera(request, false)) {
+                Serial.printf("Profile schedule: camera busy, retrying profile %s\n", rule.profile);
+                candidate_samples--;
+            }
+        }
+    }
+    xSemaphoreGive(profile_mutex);
+}
+
+void getCameraProfileState(CameraProfileState* state) {
+    xSemaphoreTake(profile_mutex, portMAX_DELAY);
+    *state = profile_state;
+    xSemaphoreGive(profile_mutex);
+}
@@ -0,0 +1,131 @@
+#include "camera_response.h"
+#include "config.h"
+#include "metrics.h"
+#include "web_server.h"
+
+static SemaphoreHandle_t camera_responses_lock = NULL;
+static AsyncCameraResponse* camera_responses_head = nullptr;
+
+void initCameraResponses() {
+    if (!camera_responses_lock) {
+        camera_responses_lock = xSemaphoreCreateMutex();
+    }
+}
+
+AsyncCameraResponse::AsyncCameraResponse(uint32_t ticket, const CameraRequest& request, CameraReplyBuilder build,
+                                         int arg)
+    : _ticket(ticket), _camera_request(request), _build(build), _arg(arg), _request(nullptr), _wait_start(millis()), _started(false),
+      _closed(false), _offset(0), _next(nullptr) {
+    _code = 200;
+    _contentLength = 0;
+    _lock = xSemaphoreCreateRecursiveMutex();
+
+    xSemaphoreTake(camera_responses_lock, portMAX_DELAY);
+    _next = camera_responses_head;
+    camera_responses_head = this;
+    xSemaphoreGive(camera_responses_lock);
+}
+
+AsyncCameraResponse::~AsyncCameraResponse() {
+    // Waits for serviceCameraResponses() to finish with this response
+    xSemaphoreTake(camera_responses_lock, portMAX_DELAY);
+    AsyncCameraResponse** link = &camera_responses_head;
+    while (*link && *link != this) {
+        link = &(*link)->_next;
+    }
+    if (*link) {
+        *link = _next;
+    }
+    xSemaphoreGive(camera_responses_lock);
+
+    if (_ticket) {
+        releaseCameraRequest(_ticket);
+    }
+    vSemaphoreDelete(_lock);
+}
+
+void AsyncCameraResponse::_respond(AsyncWebServerRequest* request) {
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    _request = request;
+    startLocked();
+    xSemaphoreGiveRecursive(_lock);
+}
+
+size_t AsyncCameraResponse::_ack(AsyncWebServerRequest* request, size_t len, uint32_t time) {
+    // ACKs and polls from async_tcp race with resume() from the web task
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    size_t written = 0;
+    if (_started) {
+        written = AsyncAbstractResponse::_ack(request, len, time);
+    } else {
+        startLocked();      // Poll ticks enforce the timeout without the web task
+    }
+    xSemaphoreGiveRecursive(_lock);
+    return written;
+}
+
+void AsyncCameraResponse::close() {
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    _closed = true;
+    xSemaphoreGiveRecursive(_lock);
+}
+
+void AsyncCameraResponse::resume() {
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    if (!_closed && !_started && _request) {
+        startLocked();
+    }
+    xSemaphoreGiveRecursive(_lock);
+}
+
+// Collects the outcome, or gives up on a request still queued, and sends
+// the head with the body
+void AsyncCameraResponse::startLocked() {
+    if (_started || !_request) {
+        return;
+    }
+    CameraRequestOutcome outcome;
+    CameraRequestState state = cameraRequestState(_ticket, &outcome);
+    if (state == CAMERA_REQUEST_DONE) {
+        _ticket = 0;
+        _code = _build(_camera_request, outcome, _arg, &_body);
+    } else if (state == CAMERA_REQUEST_RUNNING) {
+        return;             // Already changing the sensor: let it finish
+    } else if (state == CAMERA_REQUEST_QUEUED && millis() - _wait_start < CAMERA_REQUEST_TIMEOUT_MS) {
+        return;
+    } else if (state == CAMERA_REQUEST_QUEUED && !cancelCameraRequest(_ticket)) {
+        return;             // Started just now
+    } else {
+        _ticket = 0;
+        _code = 503;
+        _body = "{\"error\":\"Camera busy, retry later\"}";
+        addHeader("Retry-After", String(CAMERA_RETRY_AFTER_S));
+    }
+
+    _started = true;
+    _contentType = "application/json";
+    _contentLength = _body.length();
+    addCORSHeaders(this);
+    metricsCountHttp(_request->url().c_str(), _code);
+    AsyncAbstractResponse::_respond(_request);
+}
+
+size_t AsyncCameraResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t len = min(maxLen, _body.length() - _offset);
+    memcpy(buf, _body.c_str() + _offset, len);
+    _offset += len;
+    return len;
+}
+
+void serviceCameraResponses() {
+    if (!camera_responses_lock || !camera_responses_head) {
+        return;
+    }
+    xSemaphoreTake(camera_responses_lock, portMAX_DELAY);
+    for (AsyncCameraResponse* response = camera_responses_head; response; response = response->_next) {
+        if (!__atomic_load_n(&response->_started, __ATOMIC_RELAXED)) {
+            response->resume();
+        }
+    }
+    xSemaphoreGive(camera_responses_lock);
+}
@@ -0,0 +1,152 @@
+#include "camera_settings.h"
+#include "app.h"
+
+// Accessors for a field backed by a sensor register
+#define SENSOR_ACCESSORS(name, status_field, setter, type) \
+    static int read_##name(const sensor_t* s) { return s->status.status_field; } \
+    static int write_##name(sensor_t* s, int value) { return s->setter(s, (type)value); }
+
+SENSOR_ACCESSORS(framesize, framesize, set_framesize, framesize_t)
+SENSOR_ACCESSORS(quality, quality, set_quality, int)
+SENSOR_ACCESSORS(brightness, brightness, set_brightness, int)
+SENSOR_ACCESSORS(contrast, contrast, set_contrast, int)
+SENSOR_ACCESSORS(saturation, saturation, set_saturation, int)
+SENSOR_ACCESSORS(gainceiling, gainceiling, set_gainceiling, gainceiling_t)
+SENSOR_ACCESSORS(colorbar, colorbar, set_colorbar, int)
+SENSOR_ACCESSORS(awb, awb, set_whitebal, int)
+SENSOR_ACCESSORS(agc, agc, set_gain_ctrl, int)
+SENSOR_ACCESSORS(aec, aec, set_exposure_ctrl, int)
+SENSOR_ACCESSORS(hmirror, hmirror, set_hmirror, int)
+SENSOR_ACCESSORS(vflip, vflip, set_vflip, int)
+SENSOR_ACCESSORS(awb_gain, awb_gain, set_awb_gain, int)
+SENSOR_ACCESSORS(agc_gain, agc_gain, set_agc_gain, int)
+SENSOR_ACCESSORS(aec_value, aec_value, set_aec_value, int)
+SENSOR_ACCESSORS(special_effect, special_effect, set_special_effect, int)
+SENSOR_ACCESSORS(wb_mode, wb_mode, set_wb_mode, int)
+SENSOR_ACCESSORS(ae_level, ae_level, set_ae_level, int)
+SENSOR_ACCESSORS(dcw, dcw, set_dcw, int)
+SENSOR_ACCESSORS(bpc, bpc, set_bpc, int)
+SENSOR_ACCESSORS(wpc, wpc, set_wpc, int)
+SENSOR_ACCESSORS(raw_gma, raw_gma, set_raw_gma, int)
+SENSOR_ACCESSORS(lenc, lenc, set_lenc, int)
+
+#define SENSOR_FIELD(name, lo, hi) { #name, &CameraSettings::name, lo, hi, read_##name, write_##name }
+#define CONFIG_FIELD(name, lo, hi) { #name, &CameraSettings::name, lo, hi, nullptr, nullptr }
+
+// Sensor fields in the order initCamera() has always written them.
+// camera.ready_framesize sizes the frame buffers and is not a setting here.
+// scripts/gen_setting_hash.py regenerates CAMERA_SETTING_SLOTS from this.
+static const CameraSettingField CAMERA_SETTING_TABLE[] = {
+    SENSOR_FIELD(framesize, 0, FRAMESIZE_UXGA),
+    SENSOR_FIELD(quality, 0, 63),
+    SENSOR_FIELD(brightness, -2, 2),
+    SENSOR_FIELD(contrast, -2, 2),
+    SENSOR_FIELD(saturation, -2, 2),
+    SENSOR_FIELD(gainceiling, 0, 6),
+    SENSOR_FIELD(colorbar, 0, 1),
+    SENSOR_FIELD(awb, 0, 1),
+    SENSOR_FIELD(agc, 0, 1),
+    SENSOR_FIELD(aec, 0, 1),
+    SENSOR_FIELD(hmirror, 0, 1),
+    SENSOR_FIELD(vflip, 0, 1),
+    SENSOR_FIELD(awb_gain, 0, 1),
+    SENSOR_FIELD(agc_gain, 0, 30),
+    SENSOR_FIELD(aec_value, 0, 1200),
+    SENSOR_FIELD(special_effect, 0, 6),
+    SENSOR_FIELD(wb_mode, 0, 4),
+    SENSOR_FIELD(ae_level, -2, 2),
+    SENSOR_FIELD(dcw, 0, 1),
+    SENSOR_FIELD(bpc, 0, 1),
+    SENSOR_FIELD(wpc, 0, 1),
+    SENSOR_FIELD(raw_gma, 0, 1),
+    SENSOR_FIELD(lenc, 0, 1),
+    CONFIG_FIELD(led_intensity, 0, 255)
+};
+
+static_assert(sizeof(CAMERA_SETTING_TABLE) / sizeof(CAMERA_SETTING_TABLE[0]) == CAMERA_SETTING_FIELDS,
+              "CAMERA_SETTING_FIELDS out of date");
+static_assert(CAMERA_SETTING_FIELDS <= 32, "CameraSettingMask has 32 bits");
+
+// Generated by scripts/gen_setting_hash.py: slot -> table index + 1, 0 empty
+#define CAMERA_SETTING_HASH_SEED 0x00000081
+static const uint8_t CAMERA_SETTING_SLOTS[CAMERA_SETTING_SLOT_COUNT] = {
+    14, 19,  0, 16,  9,  0, 10,  1,  0, 21, 17,  0,  8,  0,  0,  0,
+    11,  0,  0,  0,  0,  4,  3,  0,  0,  0,  5, 23,  0, 20, 13,  0,
+     0, 12,  0,  0, 24,  2,  0,  0,  0,  0,  0,  0,  0,  0,  7,  6,
+    18,  0,  0, 22,  0,  0,  0,  0, 15,  0,  0,  0,  0,  0,  0,  0
+};
+
+static uint32_t settingHash(const char* name) {
+    uint32_t h = 0x811C9DC5u ^ CAMERA_SETTING_HASH_SEED;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 0x01000193u;
+    }
+    return h;
+}
+
+const CameraSettingField* findCameraSetting(const char* name) {
+    if (!name) {
+        return nullptr;
+    }
+    uint8_t entry = CAMERA_SETTING_SLOTS[settingHash(name) >> (32 - CAMERA_SETTING_SLOT_BITS)];
+    if (!entry) {
+        return nullptr;
+    }
+    // Any name can land on an occupied slot; only the owner matches
+    const CameraSettingField* field = &CAMERA_SETTING_TABLE[entry - 1];
+    return strcmp(field->name, name) == 0 ? field : nullptr;
+}
+
+const CameraSettingField* cameraSettingField(int index) {
+    return index >= 0 && index < CAMERA_SETTING_FIELDS ? &CAMERA_SETTING_TABLE[index] : nullptr;
+}
+
+bool writeCameraSettings(sensor_t* s, const CameraSettings& target, CameraSettingMask mask,
+                         bool force, CameraSettingsResult* result) {
+    // Previous values of the writes made so far, for rollback
+    int written_index[CAMERA_SETTING_FIELDS];
+    int previous[CAMERA_SETTING_FIELDS];
+    int written = 0;
+
+    result->written = 0;
+    result->skipped = 0;
+    result->failed = nullptr;
+    result->rolled_back = 0;
+
+    for (int i = 0; i < CAMERA_SETTING_FIELDS; i++) {
+        const CameraSettingField& field = CAMERA_SETTING_TABLE[i];
+        if (!(mask & CAMERA_SETTING_BIT(i)) || !field.write) {
+            continue;
+        }
+        int value = target.*field.member;
+        int current = field.read(s);
+        if (!force && value == current) {
+            result->skipped++;
+            continue;
+        }
+        if (field.write(s, value) != 0) {
+            result->failed = &field;
+            break;
+        }
+        written_index[written] = i;
+        previous[written] = current;
+        written++;
+    }
+
+    if (!result->failed) {
+        result->written = written;
+        return true;
+    }
+
+    Serial.printf("Camera setting %s=%d failed, rolling back %d write(s)\n",
+                  result->failed->name, target.*result->failed->member, written);
+    while (written > 0) {
+        written--;
+        const CameraSettingField& field = CAMERA_SETTING_TABLE[written_index[written]];
+        if (field.write(s, previous[written]) == 0) {
+            result->rolled_back++;
+        }
+    }
+    return false;
+}
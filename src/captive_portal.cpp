@@ -1,6 +1,7 @@
 #include "captive_portal.h"
 #include "config.h"
 #include "app.h"
+#include "trace.h"
 
 DNSServer dnsServer;
 static bool captive_portal_active = false;
@@ -70,6 +71,7 @@ void handleCaptivePortal() {
 }
 
 bool connectToWiFi(const char* ssid, const char* password, int timeout_ms) {
+    TRACE_SCOPE("connectToWiFi");
     Serial.printf("Attempting to connect to WiFi: %s\n", ssid);
     
     // Keep AP mode active during connection attempt to maintain captive portal
@@ -109,6 +111,7 @@ bool connectToWiFi(const char* ssid, const char* password, int timeout_ms) {
 bool connectToWiFiWithStaticIP(const char* ssid, const char* password, 
                                  IPAddress ip, IPAddress gateway, 
                                  int timeout_ms) {
+    TRACE_SCOPE("connectToWiFiWithStaticIP");
     Serial.printf("Attempting to connect to WiFi with static IP: %s\n", ssid);
     Serial.printf("  Static IP: %s\n", ip.toString().c_str());
     Serial.printf("  Gateway: %s\n", gateway.toString().c_str());
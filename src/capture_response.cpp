@@ -0,0 +1,277 @@
+#include "capture_response.h"
+#include "app.h"
+#include "metrics.h"
+#include "memory_governor.h"
+#include "trace.h"
+#include "web_server.h"
+#include "frame_convert.h"
+
+static SemaphoreHandle_t capture_responses_lock = NULL;
+static AsyncCaptureResponse* capture_responses_head = nullptr;
+static uint32_t capture_timeouts = 0;
+static uint32_t capture_not_modified = 0;
+
+void initCaptureResponses() {
+    if (!capture_responses_lock) {
+        capture_responses_lock = xSemaphoreCreateMutex();
+    }
+}
+
+AsyncCaptureResponse::AsyncCaptureResponse(const CaptureOptions& options, FrameRef frame, uint32_t wait_seq)
+    : _options(options), _request(nullptr), _wait_seq(wait_seq), _wait_start(millis()), _started(false),
+      _closed(false), _frame(std::move(frame)), _bmp(nullptr), _offset(0), _next(nullptr) {
+    _code = 200;
+    _contentLength = 0;
+    _lock = xSemaphoreCreateRecursiveMutex();
+
+    xSemaphoreTake(capture_responses_lock, portMAX_DELAY);
+    _next = capture_responses_head;
+    capture_responses_head = this;
+    xSemaphoreGive(capture_responses_lock);
+}
+
+AsyncCaptureResponse::~AsyncCaptureResponse() {
+    // Waits for serviceCaptureResponses() to finish with this response
+    xSemaphoreTake(capture_responses_lock, portMAX_DELAY);
+    AsyncCaptureResponse** link = &capture_responses_head;
+    while (*link && *link != this) {
+        link = &(*link)->_next;
+    }
+    if (*link) {
+        *link = _next;
+    }
+    xSemaphoreGive(capture_responses_lock);
+
+    if (_bmp) {
+        bmpWriterDestroy(_bmp);
+    }
+    vSemaphoreDelete(_lock);
+}
+
+void AsyncCaptureResponse::_respond(AsyncWebServerRequest* request) {
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    _request = request;
+    startLocked();
+    xSemaphoreGiveRecursive(_lock);
+}
+
+size_t AsyncCaptureResponse::_ack(AsyncWebServerRequest* request, size_t len, uint32_t time) {
+    // ACKs and polls from async_tcp race with resume() from the web task
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    size_t written = 0;
+    if (_started) {
+        written = AsyncAbstractResponse::_ack(request, len, time);
+    } else {
+        startLocked();      // Poll ticks enforce the timeout without the web task
+    }
+    xSemaphoreGiveRecursive(_lock);
+    return written;
+}
+
+void AsyncCaptureResponse::close() {
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    _closed = true;
+    xSemaphoreGiveRecursive(_lock);
+}
+
+void AsyncCaptureResponse::resume() {
+    xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+    if (!_closed && !_started && _request) {
+        startLocked();
+    }
+    xSemaphoreGiveRecursive(_lock);
+}
+
+// Picks the frame, or gives up on it, and sends the head with the first
+// body bytes
+void AsyncCaptureResponse::startLocked() {
+    if (_started || !_request) {
+        return;
+    }
+    bool camera_up = camera_initialized && !camera_sleeping;
+    bool timed_out = millis() - _wait_start >= CAPTURE_WAIT_TIMEOUT_MS;
+    FrameRef frame = _frame ? std::move(_frame) : (camera_up ? acquireFrame(_wait_seq) : FrameRef());
+    if (frame) {
+        if (!prepare(frame)) {
+            // Conversion not ready: keep the frame for the next try
+            if (!timed_out) {
+                _frame = std::move(frame);
+                return;
+            }
+            capture_timeouts++;
+            prepareError(503, String("{\"error\":\"Cannot convert frame to ") +
+                         (_options.scale > 1 ? "thumbnail" : "ROI") + "\",\"reason\":\"timeout\"}", true);
+        }
+    } else if (camera_up && !timed_out) {
+        return;
+    } else {
+        capture_timeouts++;
+        prepareError(500, "{\"error\":\"Failed to capture frame\"}", false);
+    }
+
+    _started = true;
+    addCORSHeaders(this);
+    metricsCountHttp(_request->url().c_str(), _code);
+    AsyncAbstractResponse::_respond(_request);
+}
+
+// Sets up the reply for frame: 304 when the client has it, else the frame,
+// its converted copy or its BMP conversion. Returns false, with no header
+// added, while the conversion is pending; frame is kept by the caller then.
+bool AsyncCaptureResponse::prepare(FrameRef& frame) {
+    TRACE_SCOPE("capturePrepare");
+    const CaptureOptions& o = _options;
+    if (o.bmp) {
+        JpegDcResult result = JPEG_DC_CORRUPT;
+        {
+            FrameReadGuard guard(frame);
+            if (guard.ok()) {
+                _bmp = bmpWriterCreate(frame.data(), frame.length(), o.format, &result);
+            }
+        }
+        if (!_bmp) {
+            prepareError(result == JPEG_DC_NO_MEMORY ? 503 : 500,
+                         String("{\"error\":\"Cannot convert frame to BMP\",\"reason\":\"") +
+                         jpegDcResultName(result) + "\"}", result == JPEG_DC_NO_MEMORY);
+            return true;
+        }
+        // The writer reads the JPEG in place: the frame stays pinned
+        _frame = std::move(frame);
+        _contentType = "image/bmp";
+        _contentLength = _bmp->total;
+        addHeader("Content-Disposition", "inline; filename=capture.bmp");
+        addHeader("Cache-Control", "no-cache");
+        return true;
+    }
+
+    char etag[64];
+    if (o.scale > 1) {
+        snprintf(etag, sizeof(etag), "\"%08x-%u/%d\"", (unsigned)o.etag_boot, (unsigned)frame.seq(), o.scale);
+    } else if (roiActive(o.roi)) {
+        snprintf(etag, sizeof(etag), "\"%08x-%u/r%d,%d,%d,%d,%d\"", (unsigned)o.etag_boot,
+                 (unsigned)frame.seq(), o.roi.x, o.roi.y, o.roi.width, o.roi.height, o.roi.rotate);
+    } else {
+        snprintf(etag, sizeof(etag), "\"%08x-%u\"", (unsigned)o.etag_boot, (unsigned)frame.seq());
+    }
+
+    if (o.if_none_match.length() && o.if_none_match == etag) {
+        capture_not_modified++;
+        _code = 304;
+        addHeader("ETag", etag);
+        addHeader("Cache-Control", "no-cache");
+        return true;
+    }
+
+    // Tiles polling the same frame share one conversion (frame_convert.h).
+    // The copy owns its data, so the frame goes back to the driver now.
+    if (o.scale > 1 || roiActive(o.roi)) {
+        JpegDcResult result;
+        ConvertSpec spec = { o.scale, o.roi };
+        if (requestConversion(frame, spec, &_converted, &result) == CONVERT_PENDING) {
+            return false;
+        }
+        frame.reset();
+        if (!_converted) {
+            // The framesize shrank under the region since it was checked
+            prepareError(result == JPEG_DC_OUTSIDE ? 400 : result == JPEG_DC_NO_MEMORY ? 503 : 500,
+                         String("{\"error\":\"Cannot convert frame to ") + (o.scale > 1 ? "thumbnail" : "ROI") +
+                         "\",\"reason\":\"" + jpegDcResultName(result) + "\"}", result == JPEG_DC_NO_MEMORY);
+            return true;
+        }
+        if (o.scale <= 1) {
+            // The source region shown, after moving to MCU boundaries
+            const RoiView* view = static_cast<const RoiView*>(_converted.get());
+            char applied[48];
+            snprintf(applied, sizeof(applied), "%d,%d,%d,%d", view->applied.x, view->applied.y,
+                     view->applied.width, view->applied.height);
+            addHeader("X-ROI", applied);
+            const RoiSpec& asked = view->spec;
+            bool snapped = asked.width > 0 &&
+                           (view->applied.x != asked.x || view->applied.y != asked.y ||
+                            view->applied.width != asked.width || view->applied.height != asked.height);
+            addHeader("X-ROI-Snapped", snapped ? "true" : "false");
+        }
+        _contentLength = _converted->length;
+    } else {
+        // Sent straight from the driver buffer, pinned until the response
+        // is destroyed
+        _contentLength = frame.length();
+        _frame = std::move(frame);
+    }
+    _contentType = "image/jpeg";
+    addHeader("Content-Disposition", "inline; filename=capture.jpg");
+    addHeader("ETag", etag);
+    addHeader("Cache-Control", "no-cache");
+    return true;
+}
+
+void AsyncCaptureResponse::prepareError(int code, const String& body, bool retry_later) {
+    _code = code;
+    _contentType = "application/json";
+    _body = body;
+    _contentLength = _body.length();
+    if (retry_later) {
+        addHeader("Retry-After", String(MEM_RETRY_AFTER_S));
+    }
+}
+
+size_t AsyncCaptureResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    // Keeps the driver from freeing the frame while it is read; empty when
+    // the body is a converted copy or _body
+    FrameReadGuard guard(_frame);
+    if (_bmp) {
+        if (!guard.ok()) {
+            return 0;
+        }
+        return bmpWriterRead(_bmp, buf, maxLen);
+    }
+
+    const uint8_t* data;
+    size_t length;
+    if (_converted) {
+        data = _converted->data;
+        length = _converted->length;
+    } else if (_frame) {
+        if (!guard.ok()) {
+            return 0;       // The driver was deinitialized mid-response
+        }
+        data = _frame.data();
+        length = _frame.length();
+    } else {
+        data = (const uint8_t*)_body.c_str();
+        length = _body.length();
+    }
+    size_t len = min(maxLen, length - _offset);
+    memcpy(buf, data + _offset, len);
+    _offset += len;
+    return len;
+}
+
+void serviceCaptureResponses() {
+    if (!capture_responses_lock || !capture_responses_head) {
+        return;
+    }
+    xSemaphoreTake(capture_responses_lock, portMAX_DELAY);
+    for (AsyncCaptureResponse* response = capture_responses_head; response; response = response->_next) {
+        if (!__atomic_load_n(&response->_started, __ATOMIC_RELAXED)) {
+            response->resume();
+        }
+    }
+    xSemaphoreGive(capture_responses_lock);
+}
+
+void getCaptureResponseStats(CaptureResponseStats* stats) {
+    stats->timeouts = capture_timeouts;
+    stats->not_modified = capture_not_modified;
+    stats->waiting = 0;
+    if (!capture_responses_lock) {
+        return;
+    }
+    xSemaphoreTake(capture_responses_lock, portMAX_DELAY);
+    for (AsyncCaptureResponse* response = capture_responses_head; response; response = response->_next) {
+        if (!__atomic_load_n(&response->_started, __ATOMIC_RELAXED)) {
+            stats->waiting++;
+        }
+    }
+    xSemaphoreGive(capture_responses_lock);
+}
@@ -1,7 +1,16 @@
 #include "config.h"
 #include "storage.h"
+#include "metrics.h"
+#include "trace.h"
+#include "memory_governor.h"
+#include "camera_profiles.h"
+#include "camera_settings.h"
 #include <ArduinoJson.h>
+#include <IPAddress.h>
 #include <mbedtls/sha256.h>
+#include <limits.h>
+
+static bool config_save_deferred = false;
 
 void setDefaultConfiguration() {
     // Clear network list
@@ -33,6 +42,39 @@ void setDefaultConfiguration() {
     g_config.camera.raw_gma = 1;
     g_config.camera.lenc = 1;
     g_config.camera.led_intensity = 0;
+    g_config.camera.ready_framesize = DEFAULT_READY_FRAMESIZE;
+    
+    // Capture and stream adaptation defaults
+    g_config.stream.capture_fps = DEFAULT_CAPTURE_FPS;
+    g_config.stream.frame_pool_depth = DEFAULT_FRAME_POOL_DEPTH;
+    g_config.stream.adaptive = false;
+    g_config.stream.max_quality = DEFAULT_STREAM_MAX_QUALITY;
+    g_config.stream.min_framesize = DEFAULT_STREAM_MIN_FRAMESIZE;
+    
+    // Stream admission defaults
+    g_config.admission.max_clients = DEFAULT_STREAM_MAX_CLIENTS;
+    g_config.admission.max_kbps = DEFAULT_STREAM_MAX_KBPS;
+    memset(g_config.admission.operator_token, 0, sizeof(g_config.admission.operator_token));
+    g_config.admission.trusted_count = 0;
+    memset(g_config.admission.trusted_ips, 0, sizeof(g_config.admission.trusted_ips));
+    
+    // Pre-event ring defaults
+    g_config.clip.buffer_kb = DEFAULT_CLIP_BUFFER_KB;
+    g_config.clip.buffer_seconds = DEFAULT_CLIP_BUFFER_SECONDS;
+    
+    // Motion detection defaults
+    g_config.motion.enabled = false;
+    g_config.motion.threshold = DEFAULT_MOTION_THRESHOLD;
+    g_config.motion.trigger_permille = DEFAULT_MOTION_TRIGGER_PERMILLE;
+    g_config.motion.budget_us = DEFAULT_MOTION_BUDGET_US;
+    g_config.motion.hold_ms = DEFAULT_MOTION_HOLD_MS;
+    
+    // Activity-adaptive capture defaults
+    g_config.activity.enabled = false;
+    g_config.activity.idle_fps = DEFAULT_ACTIVITY_IDLE_FPS;
+    g_config.activity.idle_after_ms = DEFAULT_ACTIVITY_IDLE_AFTER_MS;
+    g_config.activity.size_percent = DEFAULT_ACTIVITY_SIZE_PERCENT;
+    g_config.activity.threshold = DEFAULT_ACTIVITY_THRESHOLD;
     
     // System defaults
     strcpy(g_config.admin_password_hash, "");
@@ -63,8 +105,60 @@ bool validateConfiguration(const JsonDocument& doc) {
     return true;
 }
 
+// Pulls a loaded value into [low, high], with a note when it was outside
+static void clampSetting(const char* name, int* value, int low, int high) {
+    int clamped = constrain(*value, low, high);
+    if (clamped != *value) {
+        Serial.printf("Config %s=%d out of range, using %d\n", name, *value, clamped);
+        *value = clamped;
+    }
+}
+
+// Holds a hand-edited config to the limits /control and the request
+// handlers use, so nothing downstream divides by a zero rate or budget
+static void clampConfiguration() {
+    for (int i = 0; i < CAMERA_SETTING_FIELDS; i++) {
+        const CameraSettingField* field = cameraSettingField(i);
+        clampSetting(field->name, &(g_config.camera.*field->member), field->min, field->max);
+    }
+    const CameraSettingField* framesize = cameraSettingField(CAMERA_SETTING_FRAMESIZE);
+    const CameraSettingField* quality = cameraSettingField(CAMERA_SETTING_QUALITY);
+    clampSetting("ready_framesize", &g_config.camera.ready_framesize, framesize->min, framesize->max);
+    
+    StreamSettings& stream = g_config.stream;
+    clampSetting("stream.capture_fps", &stream.capture_fps, 1, STREAM_MAX_FPS);
+    clampSetting("stream.frame_pool_depth", &stream.frame_pool_depth, 2, FRAME_POOL_MAX_DEPTH);
+    clampSetting("stream.max_quality", &stream.max_quality, quality->min, quality->max);
+    clampSetting("stream.min_framesize", &stream.min_framesize, framesize->min, framesize->max);
+    
+    AdmissionSettings& admission = g_config.admission;
+    clampSetting("admission.max_clients", &admission.max_clients, 0, ADMISSION_MAX_CLIENTS);
+    clampSetting("admission.max_kbps", &admission.max_kbps, 0, INT_MAX);
+    
+    ClipSettings& clip = g_config.clip;
+    clampSetting("clip.buffer_kb", &clip.buffer_kb, 0, CLIP_MAX_BUFFER_KB);
+    clampSetting("clip.buffer_seconds", &clip.buffer_seconds, 1, CLIP_MAX_BUFFER_SECONDS);
+    
+    MotionSettings& motion = g_config.motion;
+    clampSetting("motion.threshold", &motion.threshold, 1, 255);
+    clampSetting("motion.trigger_permille", &motion.trigger_permille, 1, 1000);
+    clampSetting("motion.budget_us", &motion.budget_us, MOTION_MIN_BUDGET_US, MOTION_MAX_BUDGET_US);
+    clampSetting("motion.hold_ms", &motion.hold_ms, 0, 3600000);
+    
+    ActivitySettings& activity = g_config.activity;
+    clampSetting("activity.idle_fps", &activity.idle_fps, 1, STREAM_MAX_FPS);
+    clampSetting("activity.idle_after_ms", &activity.idle_after_ms, 0, 3600000);
+    clampSetting("activity.size_percent", &activity.size_percent, 0, 100);
+    clampSetting("activity.threshold", &activity.threshold, 0, 255);
+}
+
 bool loadConfiguration() {
-    StaticJsonDocument<CONFIG_JSON_SIZE> doc;
+    // Too large for the loop task's stack
+    DynamicJsonDocument doc(CONFIG_JSON_SIZE);
+    if (doc.capacity() == 0) {
+        Serial.println("No memory for the config document");
+        return false;
+    }
     
     // Try SD card first
     if (isSDCardMounted()) {
@@ -167,6 +261,71 @@ parse_config:
         g_config.camera.raw_gma = camera["raw_gma"] | 1;
         g_config.camera.lenc = camera["lenc"] | 1;
         g_config.camera.led_intensity = camera["led_intensity"] | 0;
+        g_config.camera.ready_framesize = camera["ready_framesize"] | DEFAULT_READY_FRAMESIZE;
+    }
+    
+    // Parse stream settings
+    if (doc.containsKey("stream")) {
+        JsonObjectConst stream = doc["stream"].as<JsonObjectConst>();
+        g_config.stream.capture_fps = stream["capture_fps"] | DEFAULT_CAPTURE_FPS;
+        g_config.stream.frame_pool_depth = stream["frame_pool_depth"] | DEFAULT_FRAME_POOL_DEPTH;
+        g_config.stream.adaptive = stream["adaptive"] | false;
+        g_config.stream.max_quality = stream["max_quality"] | DEFAULT_STREAM_MAX_QUALITY;
+        g_config.stream.min_framesize = stream["min_framesize"] | DEFAULT_STREAM_MIN_FRAMESIZE;
+    }
+    
+    // Parse stream admission settings
+    if (doc.containsKey("admission")) {
+        JsonObjectConst admission = doc["admission"].as<JsonObjectConst>();
+        g_config.admission.max_clients = admission["max_clients"] | DEFAULT_STREAM_MAX_CLIENTS;
+        g_config.admission.max_kbps = admission["max_kbps"] | DEFAULT_STREAM_MAX_KBPS;
+        strncpy(g_config.admission.operator_token, admission["operator_token"] | "", ADMISSION_TOKEN_LEN - 1);
+        
+        // Trusted client addresses as dotted-quad strings
+        g_config.admission.trusted_count = 0;
+        JsonArrayConst trusted = admission["trusted_ips"];
+        for (JsonVariantConst entry : trusted) {
+            IPAddress ip;
+            const char* address = entry | "";
+            if (g_config.admission.trusted_count >= ADMISSION_MAX_TRUSTED) {
+                break;
+            }
+            if (!ip.fromString(address)) {
+                Serial.printf("Ignoring invalid trusted_ips entry: %s\n", address);
+                continue;
+            }
+            for (int i = 0; i < 4; i++) {
+                g_config.admission.trusted_ips[g_config.admission.trusted_count][i] = ip[i];
+            }
+            g_config.admission.trusted_count++;
+        }
+    }
+    
+    // Parse pre-event ring settings
+    if (doc.containsKey("clip")) {
+        JsonObjectConst clip = doc["clip"].as<JsonObjectConst>();
+        g_config.clip.buffer_kb = clip["buffer_kb"] | DEFAULT_CLIP_BUFFER_KB;
+        g_config.clip.buffer_seconds = clip["buffer_seconds"] | DEFAULT_CLIP_BUFFER_SECONDS;
+    }
+    
+    // Parse motion detection settings
+    if (doc.containsKey("motion")) {
+        JsonObjectConst motion = doc["motion"].as<JsonObjectConst>();
+        g_config.motion.enabled = motion["enabled"] | false;
+        g_config.motion.threshold = motion["threshold"] | DEFAULT_MOTION_THRESHOLD;
+        g_config.motion.trigger_permille = motion["trigger_permille"] | DEFAULT_MOTION_TRIGGER_PERMILLE;
+        g_config.motion.budget_us = motion["budget_us"] | DEFAULT_MOTION_BUDGET_US;
+        g_config.motion.hold_ms = motion["hold_ms"] | DEFAULT_MOTION_HOLD_MS;
+    }
+    
+    // Parse activity-adaptive capture settings
+    if (doc.containsKey("activity")) {
+        JsonObjectConst activity = doc["activity"].as<JsonObjectConst>();
+        g_config.activity.enabled = activity["enabled"] | false;
+        g_config.activity.idle_fps = activity["idle_fps"] | DEFAULT_ACTIVITY_IDLE_FPS;
+        g_config.activity.idle_after_ms = activity["idle_after_ms"] | DEFAULT_ACTIVITY_IDLE_AFTER_MS;
+        g_config.activity.size_percent = activity["size_percent"] | DEFAULT_ACTIVITY_SIZE_PERCENT;
+        g_config.activity.threshold = activity["threshold"] | DEFAULT_ACTIVITY_THRESHOLD;
     }
     
     // Parse system settings
@@ -181,11 +340,25 @@ parse_config:
     g_config.use_https = doc["use_https"] | false;
     g_config.server_port = doc["server_port"] | 80;
     
+    clampConfiguration();
     return true;
 }
 
 bool saveConfiguration() {
-    StaticJsonDocument<CONFIG_JSON_SIZE> doc;
+    TRACE_SCOPE("saveConfiguration");
+    
+    // The serialized copy and file buffers may not fit under memory
+    // pressure; the governor re-queues the save once it clears
+    if (memoryDefersWrites()) {
+        if (!config_save_deferred) {
+            Serial.println("Configuration save deferred: memory pressure");
+        }
+        config_save_deferred = true;
+        return true;
+    }
+    config_save_deferred = false;
+    
+    DynamicJsonDocument doc(CONFIG_JSON_SIZE);
     
     // Build networks array
     JsonArray networks = doc.createNestedArray("networks");
@@ -232,6 +405,47 @@ bool saveConfiguration() {
     camera["raw_gma"] = g_config.camera.raw_gma;
     camera["lenc"] = g_config.camera.lenc;
     camera["led_intensity"] = g_config.camera.led_intensity;
+    camera["ready_framesize"] = g_config.camera.ready_framesize;
+    
+    // Stream settings
+    JsonObject stream = doc.createNestedObject("stream");
+    stream["capture_fps"] = g_config.stream.capture_fps;
+    stream["frame_pool_depth"] = g_config.stream.frame_pool_depth;
+    stream["adaptive"] = g_config.stream.adaptive;
+    stream["max_quality"] = g_config.stream.max_quality;
+    stream["min_framesize"] = g_config.stream.min_framesize;
+    
+    // Stream admission settings
+    JsonObject admission = doc.createNestedObject("admission");
+    admission["max_clients"] = g_config.admission.max_clients;
+    admission["max_kbps"] = g_config.admission.max_kbps;
+    admission["operator_token"] = g_config.admission.operator_token;
+    JsonArray trusted = admission.createNestedArray("trusted_ips");
+    for (int i = 0; i < g_config.admission.trusted_count; i++) {
+        trusted.add(IPAddress(g_config.admission.trusted_ips[i][0], g_config.admission.trusted_ips[i][1],
+                              g_config.admission.trusted_ips[i][2], g_config.admission.trusted_ips[i][3]).toString());
+    }
+    
+    // Pre-event ring settings
+    JsonObject clip = doc.createNestedObject("clip");
+    clip["buffer_kb"] = g_config.clip.buffer_kb;
+    clip["buffer_seconds"] = g_config.clip.buffer_seconds;
+    
+    // Motion detection settings
+    JsonObject motion = doc.createNestedObject("motion");
+    motion["enabled"] = g_config.motion.enabled;
+    motion["threshold"] = g_config.motion.threshold;
+    motion["trigger_permille"] = g_config.motion.trigger_permille;
+    motion["budget_us"] = g_config.motion.budget_us;
+    motion["hold_ms"] = g_config.motion.hold_ms;
+    
+    // Activity-adaptive capture settings
+    JsonObject activity = doc.createNestedObject("activity");
+    activity["enabled"] = g_config.activity.enabled;
+    activity["idle_fps"] = g_config.activity.idle_fps;
+    activity["idle_after_ms"] = g_config.activity.idle_after_ms;
+    activity["size_percent"] = g_config.activity.size_percent;
+    activity["threshold"] = g_config.activity.threshold;
     
     // System settings
     doc["admin_password_hash"] = g_config.admin_password_hash;
@@ -241,6 +455,14 @@ bool saveConfiguration() {
     doc["use_https"] = g_config.use_https;
     doc["server_port"] = g_config.server_port;
     
+    // A document missing fields would be loaded back as their defaults
+    if (doc.overflowed()) {
+        Serial.printf("Configuration does not fit in %u bytes, not saved\n", (unsigned)doc.capacity());
+        metricAdd(metric_config_saves);
+        metricAdd(metric_config_save_failures);
+        return false;
+    }
+    
     // Serialize to string
     String output;
     serializeJsonPretty(doc, output);
@@ -261,9 +483,17 @@ bool saveConfiguration() {
         Serial.println("Configuration saved to NVS");
     }
     
+    metricAdd(metric_config_saves);
+    if (!savedToSD && !savedToNVS) {
+        metricAdd(metric_config_save_failures);
+    }
     return savedToSD || savedToNVS;
 }
 
+bool configSaveDeferred() {
+    return config_save_deferred;
+}
+
 bool resetConfiguration() {
     setDefaultConfiguration();
     
@@ -275,6 +505,7 @@ bool resetConfiguration() {
     
     // Clear NVS
     clearNVS();
+    clearCameraProfiles();
     
     return true;
 }
@@ -0,0 +1,282 @@
+#include "frame_broadcaster.h"
+#include "config.h"
+#include <esp_heap_caps.h>
+#include <new>
+
+// Descriptor pool, allocated once. Descriptors stay in internal RAM: the
+// ESP32 cannot do atomic compare-and-swap on PSRAM, and the JPEG data they
+// point at already lives in the driver's PSRAM buffers.
+static FrameSlot* slots = nullptr;
+static int pool_depth = 0;
+static std::atomic<FrameSlot*> latest_slot(nullptr);
+static std::atomic<uint32_t> driver_generation(0);
+static std::atomic<int> returns_in_flight(0);
+static std::atomic<int> frame_readers(0);
+static std::atomic<int> stream_clients(0);
+static std::atomic<uint32_t> frame_seq(0);
+static int slot_limit = 1;
+
+// Pool counters
+static std::atomic<uint32_t> pool_exhausted(0);
+static std::atomic<uint32_t> pool_dropped(0);
+static std::atomic<uint32_t> pool_bad_releases(0);
+static bool producer_stalled = false;
+
+static void releaseFrameSlot(FrameSlot* slot);
+
+ConvertedFrame::~ConvertedFrame() {
+    heap_caps_free(data);
+}
+
+// Takes a reference unless the count already dropped to zero, in which
+// case the slot is being recycled and must not be revived.
+static bool tryReference(FrameSlot* slot) {
+    int refs = slot->refs.load();
+    while (refs > 0) {
+        if (slot->refs.compare_exchange_weak(refs, refs + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Removes the mailbox's own reference from the newest frame, if it is
+// still the one we expect.
+static void retireLatest(FrameSlot* expected) {
+    if (expected && latest_slot.compare_exchange_strong(expected, nullptr)) {
+        releaseFrameSlot(expected);
+    }
+}
+
+void initFrameBroadcaster() {
+    if (!slots) {
+        // One descriptor more than driver buffers so frames from a flushed
+        // driver generation can drain while the next one is published
+        int depth = constrain(g_config.stream.frame_pool_depth, 2, FRAME_POOL_MAX_DEPTH);
+        void* mem = heap_caps_calloc(depth, sizeof(FrameSlot), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!mem) {
+            depth = 2;
+            mem = heap_caps_calloc(depth, sizeof(FrameSlot), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        slots = static_cast<FrameSlot*>(mem);
+        for (int i = 0; i < depth; i++) {
+            FrameSlot* slot = new (&slots[i]) FrameSlot();
+            slot->fb = nullptr;
+            slot->refs.store(0);
+            slot->in_use.store(false);
+        }
+        pool_depth = depth;
+        Serial.printf("Frame pool: %d descriptors\n", pool_depth);
+    }
+    slot_limit = psramFound() ? pool_depth - 1 : 1;
+}
+
+void flushFrameBroadcaster() {
+    // Called under cameraMutex right before esp_camera_deinit(): no buffer
+    // of the current generation may be handed back to the driver after it.
+    retireLatest(latest_slot.load());
+    driver_generation++;
+
+    // Wait out releases that checked the generation before the bump, and
+    // readers still copying from a buffer of the old generation. A guard
+    // opened after the bump sees the frame invalid and reads nothing.
+    while (returns_in_flight.load() > 0 || frame_readers.load() > 0) {
+        vTaskDelay(1);
+    }
+}
+
+int frameBufferCount() {
+    return slot_limit;
+}
+
+bool frameSlotAvailable() {
+    uint32_t generation = driver_generation.load();
+    int held = 0;
+    for (int i = 0; i < pool_depth; i++) {
+        if (slots[i].in_use.load() && slots[i].generation == generation) {
+            held++;
+        }
+    }
+    if (held < slot_limit) {
+        producer_stalled = false;
+        return true;
+    }
+
+    // Only the mailbox holds the newest frame - retire it so the driver
+    // gets a buffer back instead of stalling the producer.
+    FrameSlot* latest = latest_slot.load();
+    if (latest && latest->refs.load() == 1) {
+        retireLatest(latest);
+        producer_stalled = false;
+        return true;
+    }
+
+    // Count each stall once, not every poll while it lasts
+    if (!producer_stalled) {
+        producer_stalled = true;
+        pool_exhausted++;
+    }
+    return false;
+}
+
+void publishFrame(camera_fb_t* fb, int motion, uint32_t scene) {
+    if (!fb) {
+        return;
+    }
+
+    FrameSlot* slot = nullptr;
+    for (int i = 0; i < pool_depth; i++) {
+        if (!slots[i].in_use.load()) {
+            slot = &slots[i];
+            break;
+        }
+    }
+
+    if (!slot) {
+        // No free slot - the frame cannot be shared, give it straight back
+        pool_dropped++;
+        esp_camera_fb_return(fb);
+        return;
+    }
+
+    // Single producer: nobody else claims free slots, and consumers cannot
+    // take a reference while refs is zero.
+    slot->in_use.store(true);
+    slot->fb = fb;
+    slot->buf = fb->buf;
+    slot->len = fb->len;
+    slot->seq = frame_seq.load() + 1;
+    slot->timestamp = millis();
+    slot->generation = driver_generation.load();
+    slot->motion = (int16_t)motion;
+    slot->scene = scene;
+    slot->refs.store(1);  // Held by the mailbox until superseded
+    frame_seq.store(slot->seq);
+
+    FrameSlot* previous = latest_slot.exchange(slot);
+    if (previous) {
+        releaseFrameSlot(previous);
+    }
+}
+
+FrameRef acquireFrame(uint32_t last_seq) {
+    while (true) {
+        FrameSlot* slot = latest_slot.load();
+        if (!slot) {
+            return FrameRef();
+        }
+        if (!tryReference(slot)) {
+            continue;  // Superseded and released under us - reload
+        }
+        if (latest_slot.load() != slot) {
+            releaseFrameSlot(slot);  // Recycled between load and reference
+            continue;
+        }
+        if (slot->seq <= last_seq) {
+            releaseFrameSlot(slot);
+            return FrameRef();
+        }
+        return FrameRef(slot);
+    }
+}
+
+static void releaseFrameSlot(FrameSlot* slot) {
+    // Decrement unless already zero, so a stray release can never hand
+    // the same buffer back to the driver twice
+    int refs = slot->refs.load();
+    do {
+        if (refs <= 0) {
+            pool_bad_releases++;
+            Serial.println("Frame released twice, ignoring");
+            return;
+        }
+    } while (!slot->refs.compare_exchange_weak(refs, refs - 1));
+
+    if (refs != 1) {
+        return;
+    }
+
+    camera_fb_t* fb = slot->fb;
+    slot->fb = nullptr;
+
+    returns_in_flight++;
+    if (fb && slot->generation == driver_generation.load()) {
+        esp_camera_fb_return(fb);
+    }
+    returns_in_flight--;
+
+    slot->in_use.store(false);
+}
+
+FrameRef& FrameRef::operator=(FrameRef&& other) {
+    if (this != &other) {
+        reset();
+        _slot = other._slot;
+        other._slot = nullptr;
+    }
+    return *this;
+}
+
+bool FrameRef::valid() const {
+    return _slot && _slot->fb && _slot->generation == driver_generation.load();
+}
+
+FrameRef FrameRef::share() const {
+    if (!_slot) {
+        return FrameRef();
+    }
+    _slot->refs++;  // We already hold one, so the count cannot be zero
+    return FrameRef(_slot);
+}
+
+void FrameRef::reset() {
+    if (_slot) {
+        releaseFrameSlot(_slot);
+        _slot = nullptr;
+    }
+}
+
+FrameReadGuard::FrameReadGuard(const FrameRef& frame) : _held((bool)frame), _ok(false) {
+    if (_held) {
+        // Counted before the generation is checked: either the flush sees
+        // this reader and waits, or this reader sees the new generation
+        frame_readers++;
+        _ok = frame.valid();
+    }
+}
+
+FrameReadGuard::~FrameReadGuard() {
+    if (_held) {
+        frame_readers--;
+    }
+}
+
+void addStreamClient() {
+    stream_clients++;
+}
+
+void removeStreamClient() {
+    stream_clients--;
+}
+
+int getStreamClientCount() {
+    return stream_clients.load();
+}
+
+uint32_t getFramesPublished() {
+    return frame_seq.load();
+}
+
+void getFramePoolStats(FramePoolStats* stats) {
+    int in_use = 0;
+    for (int i = 0; i < pool_depth; i++) {
+        if (slots[i].in_use.load()) {
+            in_use++;
+        }
+    }
+    stats->depth = pool_depth;
+    stats->in_use = in_use;
+    stats->exhausted = pool_exhausted.load();
+    stats->dropped = pool_dropped.load();
+    stats->bad_releases = pool_bad_releases.load();
+}
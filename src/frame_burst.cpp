@@ -0,0 +1,162 @@
+#include "frame_burst.h"
+#include "config.h"
+#include <atomic>
+#include <esp_heap_caps.h>
+
+enum BurstState {
+    BURST_IDLE,
+    BURST_PENDING,     // Requested, camera task has not started yet
+    BURST_CAPTURING,
+    BURST_DONE         // All frames captured, response still sending
+};
+
+struct BurstFrame {
+    size_t offset;
+    size_t len;
+    unsigned long timestamp_us;
+};
+
+static uint8_t* burst_data = nullptr;
+static size_t burst_capacity = 0;
+static size_t burst_used = 0;
+static BurstFrame burst_frames[BURST_MAX_FRAMES];
+
+static std::atomic<int> burst_state(BURST_IDLE);
+static std::atomic<int> burst_captured(0);
+static std::atomic<bool> burst_cancelled(false);
+static int burst_requested = 0;
+static uint32_t burst_interval_ms = 0;
+static bool burst_truncated = false;
+
+bool initBurstBuffer() {
+    if (burst_data) {
+        return true;
+    }
+    if (!psramFound()) {
+        return false;
+    }
+
+    burst_capacity = BURST_BUFFER_KB * 1024;
+    burst_data = (uint8_t*)heap_caps_malloc(burst_capacity, MALLOC_CAP_SPIRAM);
+    if (!burst_data) {
+        Serial.printf("Burst buffer: failed to allocate %d KB in PSRAM\n", BURST_BUFFER_KB);
+        burst_capacity = 0;
+        return false;
+    }
+    return true;
+}
+
+bool requestBurst(int count, uint32_t interval_ms) {
+    if (!burst_data) {
+        return false;
+    }
+
+    int idle = BURST_IDLE;
+    if (!burst_state.compare_exchange_strong(idle, BURST_PENDING)) {
+        return false;
+    }
+
+    burst_requested = constrain(count, 1, BURST_MAX_FRAMES);
+    burst_interval_ms = interval_ms;
+    burst_used = 0;
+    burst_truncated = false;
+    burst_captured.store(0);
+    burst_cancelled.store(false);
+    return true;
+}
+
+void releaseBurst() {
+    // A burst still capturing is stopped by the camera task; a finished one
+    // is freed right here. Whichever side sees DONE last frees it.
+    burst_cancelled.store(true);
+    int done = BURST_DONE;
+    burst_state.compare_exchange_strong(done, BURST_IDLE);
+}
+
+int getBurstFrameCount() {
+    return burst_captured.load();
+}
+
+bool getBurstFrame(int index, BurstFrameInfo* info) {
+    if (index < 0 || index >= burst_captured.load()) {
+        return false;
+    }
+    info->data = burst_data + burst_frames[index].offset;
+    info->len = burst_frames[index].len;
+    info->timestamp_us = burst_frames[index].timestamp_us;
+    return true;
+}
+
+bool burstComplete() {
+    return burst_state.load() == BURST_DONE;
+}
+
+void getBurstSummary(BurstSummary* summary) {
+    int captured = burst_captured.load();
+
+    summary->requested = burst_requested;
+    summary->captured = captured;
+    summary->interval_ms = burst_interval_ms;
+    summary->mean_interval_us = 0;
+    summary->min_interval_us = 0;
+    summary->max_interval_us = 0;
+    summary->truncated = burst_truncated;
+
+    if (captured < 2) {
+        return;
+    }
+
+    uint32_t min_us = UINT32_MAX;
+    uint32_t max_us = 0;
+    for (int i = 1; i < captured; i++) {
+        uint32_t gap = burst_frames[i].timestamp_us - burst_frames[i - 1].timestamp_us;
+        min_us = min(min_us, gap);
+        max_us = max(max_us, gap);
+    }
+    summary->mean_interval_us = (burst_frames[captured - 1].timestamp_us - burst_frames[0].timestamp_us) / (captured - 1);
+    summary->min_interval_us = min_us;
+    summary->max_interval_us = max_us;
+}
+
+bool takeBurstRequest(int* count, uint32_t* interval_ms) {
+    int pending = BURST_PENDING;
+    if (!burst_state.compare_exchange_strong(pending, BURST_CAPTURING)) {
+        return false;
+    }
+    *count = burst_requested;
+    *interval_ms = burst_interval_ms;
+    return true;
+}
+
+bool storeBurstFrame(const uint8_t* data, size_t len, unsigned long timestamp_us) {
+    int index = burst_captured.load();
+    if (index >= burst_requested || burst_used + len > burst_capacity) {
+        burst_truncated = true;
+        return false;
+    }
+
+    memcpy(burst_data + burst_used, data, len);
+    burst_frames[index].offset = burst_used;
+    burst_frames[index].len = len;
+    burst_frames[index].timestamp_us = timestamp_us;
+    burst_used += len;
+
+    // Publishes the frame to the sending side
+    burst_captured.store(index + 1);
+    return true;
+}
+
+bool burstCancelled() {
+    return burst_cancelled.load();
+}
+
+void finishBurst() {
+    if (burst_captured.load() < burst_requested) {
+        burst_truncated = true;
+    }
+    burst_state.store(BURST_DONE);
+    if (burst_cancelled.load()) {
+        int done = BURST_DONE;
+        burst_state.compare_exchange_strong(done, BURST_IDLE);
+    }
+}
@@ -0,0 +1,174 @@
+#include "frame_convert.h"
+#include "app.h"
+#include "config.h"
+#include "trace.h"
+
+struct ConvertJob {
+    bool used;
+    ConvertState state;
+    uint32_t seq;
+    ConvertSpec spec;
+    FrameRef frame;            // Released once converted
+    ConvertedFrameRef output;
+    JpegDcResult result;
+    unsigned long queued;      // millis()
+    unsigned long finished;
+};
+
+static SemaphoreHandle_t convert_lock = nullptr;
+static TaskHandle_t convert_task = nullptr;
+static ConvertJob jobs[CONVERT_MAX_JOBS];
+static ConvertStats convert_stats = {0, 0, 0, 0, 0, 0};
+
+static bool sameConversion(const ConvertSpec& a, const ConvertSpec& b) {
+    if (a.scale > 1 || b.scale > 1) {
+        return a.scale == b.scale;
+    }
+    return a.roi.x == b.roi.x && a.roi.y == b.roi.y && a.roi.width == b.roi.width &&
+           a.roi.height == b.roi.height && a.roi.rotate == b.roi.rotate;
+}
+
+// Oldest queued job, or null. Caller holds convert_lock.
+static ConvertJob* nextJob() {
+    ConvertJob* next = nullptr;
+    for (ConvertJob& job : jobs) {
+        if (job.used && job.state == CONVERT_PENDING && (!next || (long)(job.queued - next->queued) < 0)) {
+            next = &job;
+        }
+    }
+    return next;
+}
+
+// A free slot, else the finished job that finished longest ago. Caller
+// holds convert_lock.
+static ConvertJob* freeJob() {
+    ConvertJob* oldest = nullptr;
+    for (ConvertJob& job : jobs) {
+        if (!job.used) {
+            return &job;
+        }
+        if (job.state != CONVERT_PENDING && (!oldest || (long)(job.finished - oldest->finished) < 0)) {
+            oldest = &job;
+        }
+    }
+    return oldest;
+}
+
+static void convertTask(void* parameter) {
+    Serial.println("Convert task started on core " + String(xPortGetCoreID()));
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true) {
+            xSemaphoreTake(convert_lock, portMAX_DELAY);
+            ConvertJob* job = nextJob();
+            if (!job) {
+                xSemaphoreGive(convert_lock);
+                break;
+            }
+            // Only this task finishes or recycles a pending job, so it stays
+            // put while it is converted without the lock
+            FrameRef frame = job->frame.share();
+            ConvertSpec spec = job->spec;
+            xSemaphoreGive(convert_lock);
+
+            ConvertedFrameRef output;
+            JpegDcResult result;
+            {
+                TRACE_SCOPE("convertFrame");
+                if (spec.scale > 1) {
+                    output = getThumbnail(frame, spec.scale, &result);
+                } else {
+                    output = getRoiView(frame, spec.roi, &result);
+                }
+            }
+
+            xSemaphoreTake(convert_lock, portMAX_DELAY);
+            job->output = output;
+            job->result = result;
+            job->state = output ? CONVERT_DONE : CONVERT_FAILED;
+            job->finished = millis();
+            job->frame.reset();
+            convert_stats.last_wait_ms = job->finished - job->queued;
+            convert_stats.max_wait_ms = max(convert_stats.max_wait_ms, convert_stats.last_wait_ms);
+            xSemaphoreGive(convert_lock);
+            frame.reset();
+
+            // Waiting /stream and /capture responses resume from there
+            if (webServerTaskHandle) {
+                xTaskNotifyGive(webServerTaskHandle);
+            }
+        }
+    }
+}
+
+void initFrameConvert() {
+    if (!convert_lock) {
+        convert_lock = xSemaphoreCreateMutex();
+    }
+    if (!convert_task) {
+        xTaskCreatePinnedToCore(convertTask, "ConvertTask", CONVERT_TASK_STACK, NULL, CONVERT_TASK_PRIORITY,
+                                &convert_task, CONVERT_CORE);
+    }
+}
+
+ConvertState requestConversion(const FrameRef& frame, const ConvertSpec& spec, ConvertedFrameRef* out,
+                               JpegDcResult* result) {
+    if (!convert_lock || !convert_task) {
+        *result = JPEG_DC_UNSUPPORTED;
+        return CONVERT_FAILED;
+    }
+
+    xSemaphoreTake(convert_lock, portMAX_DELAY);
+    for (ConvertJob& job : jobs) {
+        if (job.used && job.seq == frame.seq() && sameConversion(job.spec, spec)) {
+            ConvertState state = job.state;
+            if (state == CONVERT_DONE) {
+                *out = job.output;
+            } else if (state == CONVERT_FAILED) {
+                *result = job.result;
+            }
+            convert_stats.shared++;
+            xSemaphoreGive(convert_lock);
+            return state;
+        }
+    }
+
+    ConvertJob* job = freeJob();
+    if (!job) {
+        // Every slot is converting or queued: try again on the next callback
+        convert_stats.busy++;
+        xSemaphoreGive(convert_lock);
+        return CONVERT_PENDING;
+    }
+    job->used = true;
+    job->state = CONVERT_PENDING;
+    job->seq = frame.seq();
+    job->spec = spec;
+    job->frame = frame.share();
+    job->output.reset();
+    job->result = JPEG_DC_OK;
+    job->queued = millis();
+    convert_stats.jobs++;
+    xSemaphoreGive(convert_lock);
+
+    xTaskNotifyGive(convert_task);
+    return CONVERT_PENDING;
+}
+
+void getConvertStats(ConvertStats* stats) {
+    if (!convert_lock) {
+        *stats = convert_stats;
+        return;
+    }
+    xSemaphoreTake(convert_lock, portMAX_DELAY);
+    *stats = convert_stats;
+    stats->pending = 0;
+    for (const ConvertJob& job : jobs) {
+        if (job.used && job.state == CONVERT_PENDING) {
+            stats->pending++;
+        }
+    }
+    xSemaphoreGive(convert_lock);
+}
@@ -0,0 +1,282 @@
+#include "frame_ring.h"
+#include "config.h"
+#include <esp_heap_caps.h>
+#include "freertos/semphr.h"
+
+static uint8_t* ring_data = nullptr;
+static size_t ring_capacity = 0;
+static size_t ring_granted = 0;     // Capacity allocated at init
+static size_t ring_write_pos = 0;   // Where the next frame goes
+static size_t ring_used = 0;
+
+// Circular index, oldest entry at index_tail
+static RingFrameInfo* ring_index = nullptr;
+static int index_size = 0;
+static int index_tail = 0;
+static int index_count = 0;
+
+static unsigned long ring_retention_ms = 0;
+static uint32_t ring_oversized = 0;
+static uint32_t ring_resize_dropped = 0;
+static SemaphoreHandle_t ring_lock = nullptr;
+
+bool initFrameRing() {
+    if (ring_data) {
+        return true;
+    }
+    if (g_config.clip.buffer_kb <= 0 || g_config.clip.buffer_seconds <= 0 || !psramFound()) {
+        return false;
+    }
+
+    // Enough index entries for the retention window at the highest rate
+    size_t capacity = (size_t)g_config.clip.buffer_kb * 1024;
+    int entries = g_config.clip.buffer_seconds * STREAM_MAX_FPS;
+
+    // Allocated ahead of the burst buffer and the driver's frame buffers:
+    // leave them and the memory governor's headroom their share of PSRAM
+    size_t reserve = (size_t)(BURST_BUFFER_KB + CLIP_PSRAM_RESERVE_KB) * 1024 + entries * sizeof(RingFrameInfo);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    size_t spare = largest > reserve ? largest - reserve : 0;
+    if (capacity > spare) {
+        if (spare < (size_t)CLIP_MIN_BUFFER_KB * 1024) {
+            Serial.printf("Frame ring: %d KB requested, only %u KB of PSRAM to spare, disabled\n",
+                          g_config.clip.buffer_kb, (unsigned)(spare / 1024));
+            return false;
+        }
+        Serial.printf("Frame ring: %d KB requested, reduced to the %u KB of PSRAM to spare\n",
+                      g_config.clip.buffer_kb, (unsigned)(spare / 1024));
+        capacity = spare & ~(size_t)1023;
+    }
+
+    ring_data = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+    ring_index = (RingFrameInfo*)heap_caps_malloc(entries * sizeof(RingFrameInfo), MALLOC_CAP_SPIRAM);
+    if (!ring_data || !ring_index) {
+        Serial.printf("Frame ring: failed to allocate %u KB in PSRAM\n", (unsigned)(capacity / 1024));
+        heap_caps_free(ring_data);
+        heap_caps_free(ring_index);
+        ring_data = nullptr;
+        ring_index = nullptr;
+        return false;
+    }
+
+    ring_capacity = capacity;
+    ring_granted = capacity;
+    index_size = entries;
+    ring_retention_ms = (unsigned long)g_config.clip.buffer_seconds * 1000;
+    ring_lock = xSemaphoreCreateMutex();
+
+    Serial.printf("Frame ring: %u KB, %d s\n", (unsigned)(capacity / 1024), g_config.clip.buffer_seconds);
+    return true;
+}
+
+bool frameRingEnabled() {
+    return ring_data != nullptr;
+}
+
+size_t frameRingGrantedCapacity() {
+    return ring_granted;
+}
+
+static void evictOldest() {
+    ring_used -= ring_index[index_tail].len;
+    index_tail = (index_tail + 1) % index_size;
+    index_count--;
+}
+
+// Packs the buffered frames to the start of the buffer so that they fit
+// in capacity bytes, evicting the oldest ones that do not. Frames are
+// moved in offset order, which never overwrites one not yet moved: this
+// lap's frames first, then the older previous-lap frames after them.
+// That is again a valid ring, with the write position after the newest.
+static int compactRing(size_t capacity) {
+    int dropped = 0;
+    while (ring_used > capacity) {
+        evictOldest();
+        dropped++;
+    }
+    if (!index_count) {
+        ring_write_pos = 0;
+        return dropped;
+    }
+
+    // The first frame of this lap: where the offsets wrapped
+    int wrap = 0;
+    for (int i = 1; i < index_count; i++) {
+        if (ring_index[(index_tail + i) % index_size].offset < ring_index[(index_tail + i - 1) % index_size].offset) {
+            wrap = i;
+            break;
+        }
+    }
+
+    size_t pos = 0;
+    for (int n = 0; n < index_count; n++) {
+        RingFrameInfo& entry = ring_index[(index_tail + (wrap + n) % index_count) % index_size];
+        memmove(ring_data + pos, ring_data + entry.offset, entry.len);
+        entry.offset = pos;
+        pos += entry.len;
+        if (n == index_count - wrap - 1) {
+            ring_write_pos = pos;    // After the newest frame
+        }
+    }
+    return dropped;
+}
+
+bool resizeFrameRing(size_t capacity) {
+    if (!ring_data) {
+        return false;
+    }
+    if (capacity == ring_capacity) {
+        return true;
+    }
+
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+    // The newest frames that fit stay; realloc keeps the packed prefix
+    // when shrinking in place and copies it when a grow moves the buffer
+    int dropped = capacity < ring_capacity ? compactRing(capacity) : 0;
+    uint8_t* data = (uint8_t*)heap_caps_realloc(ring_data, capacity, MALLOC_CAP_SPIRAM);
+    if (data) {
+        ring_data = data;
+        ring_capacity = capacity;
+    }
+    ring_resize_dropped += dropped;
+    int kept = index_count;
+    xSemaphoreGive(ring_lock);
+
+    if (data) {
+        Serial.printf("Frame ring: resized to %u KB, kept %d frame(s), dropped %d\n", (unsigned)(capacity / 1024),
+                      kept, dropped);
+    }
+    return data != nullptr;
+}
+
+static RingFrameInfo* oldestEntry() {
+    return index_count ? &ring_index[index_tail] : nullptr;
+}
+
+void appendRingFrame(const FrameRef& frame) {
+    if (!ring_data || !frame) {
+        return;
+    }
+
+    size_t len = frame.length();
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+
+    // Checked under the lock: the memory governor resizes the ring
+    if (len > ring_capacity) {
+        ring_oversized++;
+        xSemaphoreGive(ring_lock);
+        return;
+    }
+
+    // Already buffered (the publish was dropped and this is the old frame)
+    if (index_count && ring_index[(index_tail + index_count - 1) % index_size].seq >= frame.seq()) {
+        xSemaphoreGive(ring_lock);
+        return;
+    }
+
+    // Age out frames past the retention window, and make room in the index
+    unsigned long now = millis();
+    while (index_count && (now - oldestEntry()->timestamp > ring_retention_ms || index_count == index_size)) {
+        evictOldest();
+    }
+
+    // Frames from the previous lap sit at offsets >= ring_write_pos and are
+    // all older than this lap's. Skipping the tail on wraparound drops them.
+    size_t pos = ring_write_pos;
+    if (pos + len > ring_capacity) {
+        while (index_count && oldestEntry()->offset >= pos) {
+            evictOldest();
+        }
+        pos = 0;
+    }
+
+    // Evict previous-lap frames the new one overlaps
+    while (index_count && oldestEntry()->offset >= pos && oldestEntry()->offset < pos + len) {
+        evictOldest();
+    }
+
+    memcpy(ring_data + pos, frame.data(), len);
+
+    RingFrameInfo* entry = &ring_index[(index_tail + index_count) % index_size];
+    entry->offset = pos;
+    entry->len = len;
+    entry->seq = frame.seq();
+    entry->timestamp = frame.timestamp();
+    index_count++;
+    ring_used += len;
+    ring_write_pos = pos + len;
+
+    xSemaphoreGive(ring_lock);
+}
+
+bool findRingFrame(uint32_t after_seq, unsigned long not_before, RingFrameInfo* info) {
+    if (!ring_data) {
+        return false;
+    }
+
+    bool found = false;
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+    for (int i = 0; i < index_count; i++) {
+        const RingFrameInfo& entry = ring_index[(index_tail + i) % index_size];
+        if (entry.seq > after_seq && (long)(entry.timestamp - not_before) >= 0) {
+            *info = entry;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(ring_lock);
+    return found;
+}
+
+size_t copyRingFrame(uint32_t seq, size_t offset, uint8_t* dst, size_t len) {
+    if (!ring_data) {
+        return 0;
+    }
+
+    size_t copied = 0;
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+    if (index_count) {
+        // Sequence numbers are consecutive unless a frame was oversized,
+        // so try the direct slot before scanning
+        uint32_t oldest_seq = ring_index[index_tail].seq;
+        const RingFrameInfo* entry = nullptr;
+        if (seq >= oldest_seq && seq - oldest_seq < (uint32_t)index_count) {
+            const RingFrameInfo& guess = ring_index[(index_tail + (seq - oldest_seq)) % index_size];
+            if (guess.seq == seq) {
+                entry = &guess;
+            }
+        }
+        for (int i = 0; !entry && i < index_count; i++) {
+            const RingFrameInfo& candidate = ring_index[(index_tail + i) % index_size];
+            if (candidate.seq == seq) {
+                entry = &candidate;
+            }
+        }
+
+        if (entry && offset < entry->len) {
+            copied = min(len, entry->len - offset);
+            memcpy(dst, ring_data + entry->offset + offset, copied);
+        }
+    }
+    xSemaphoreGive(ring_lock);
+    return copied;
+}
+
+void getFrameRingStats(FrameRingStats* stats) {
+    stats->enabled = ring_data != nullptr;
+    stats->capacity = ring_capacity;
+    stats->oversized = ring_oversized;
+    stats->resize_dropped = ring_resize_dropped;
+    if (!ring_data) {
+        stats->used = 0;
+        stats->frames = 0;
+        stats->oldest_timestamp = 0;
+        return;
+    }
+
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+    stats->used = ring_used;
+    stats->frames = index_count;
+    stats->oldest_timestamp = index_count ? ring_index[index_tail].timestamp : 0;
+    xSemaphoreGive(ring_lock);
+}
@@ -0,0 +1,293 @@
+#include "jpeg_dc.h"
+#include "jpeg_entropy.h"
+#include "esp_heap_caps.h"
+
+static const char* const RESULT_NAMES[] = { "ok", "unsupported", "corrupt", "too_large", "timeout", "no_memory",
+                                             "outside" };
+
+const uint8_t JPEG_NATURAL_ORDER[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static inline uint16_t be16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Canonical Huffman table from the DHT code-length counts
+static bool buildHuffTable(JpegHuffTable* table, const uint8_t* counts, const uint8_t* values, int total) {
+    memset(table->lookup, 0, sizeof(table->lookup));
+    memcpy(table->values, values, total);
+
+    int32_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        table->valoffset[len] = k - code;
+        for (int i = 0; i < counts[len - 1]; i++) {
+            if (code >= (1 << len)) {
+                return false;   // Over-subscribed
+            }
+            if (len <= JPEG_HUFF_LOOKAHEAD) {
+                int shift = JPEG_HUFF_LOOKAHEAD - len;
+                uint16_t entry = (uint16_t)((len << 8) | values[k]);
+                for (int fill = 0; fill < (1 << shift); fill++) {
+                    table->lookup[(code << shift) | fill] = entry;
+                }
+            }
+            code++;
+            k++;
+        }
+        table->maxcode[len] = counts[len - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    table->maxcode[17] = 0x7FFFFFFF;
+    table->defined = true;
+    return true;
+}
+
+JpegDcResult jpegParseFrame(JpegDcDecoder* decoder, const uint8_t* jpeg, size_t len, JpegFrame* frame) {
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        return JPEG_DC_CORRUPT;
+    }
+
+    JpegComponent components[JPEG_MAX_COMPONENTS];
+    int component_count = 0;
+    int scan_count = 0;
+    uint16_t restart_interval = 0;
+    uint16_t width = 0, height = 0;
+    size_t pos = 2;
+
+    // Marker segments up to the start of scan
+    while (true) {
+        while (pos < len && jpeg[pos] != 0xFF) {
+            pos++;
+        }
+        while (pos < len && jpeg[pos] == 0xFF) {
+            pos++;
+        }
+        if (pos >= len) {
+            return JPEG_DC_CORRUPT;
+        }
+        uint8_t marker = jpeg[pos++];
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue;                       // No length
+        }
+        if (marker == 0xD9 || pos + 2 > len) {
+            return JPEG_DC_CORRUPT;         // End of image before a scan
+        }
+        size_t segment_len = be16(jpeg + pos);
+        if (segment_len < 2 || pos + segment_len > len) {
+            return JPEG_DC_CORRUPT;
+        }
+        const uint8_t* seg = jpeg + pos + 2;
+        size_t n = segment_len - 2;
+        pos += segment_len;
+
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (n < 6 || seg[0] != 8) {
+                return JPEG_DC_UNSUPPORTED;
+            }
+            height = be16(seg + 1);
+            width = be16(seg + 3);
+            component_count = seg[5];
+            if ((component_count != 1 && component_count != 3) || n < 6 + 3 * (size_t)component_count) {
+                return JPEG_DC_UNSUPPORTED;
+            }
+            for (int c = 0; c < component_count; c++) {
+                components[c].id = seg[6 + c * 3];
+                components[c].h = seg[7 + c * 3] >> 4;
+                components[c].v = seg[7 + c * 3] & 0x0F;
+                components[c].quant = seg[8 + c * 3] & 0x03;
+                if (components[c].h < 1 || components[c].h > 2 || components[c].v < 1 || components[c].v > 2) {
+                    return JPEG_DC_UNSUPPORTED;
+                }
+            }
+        } else if ((marker >= 0xC2 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            return JPEG_DC_UNSUPPORTED;     // Progressive, lossless or arithmetic
+        } else if (marker == 0xC4) {
+            while (n >= 17) {
+                uint8_t cls = seg[0] >> 4;
+                uint8_t id = seg[0] & 0x03;
+                int total = 0;
+                for (int i = 1; i <= 16; i++) {
+                    total += seg[i];
+                }
+                if (cls > 1 || total > 256 || n < 17 + (size_t)total) {
+                    return JPEG_DC_CORRUPT;
+                }
+                JpegHuffTable* table = cls ? &decoder->ac[id] : &decoder->dc[id];
+                if (!buildHuffTable(table, seg + 1, seg + 17, total)) {
+                    return JPEG_DC_CORRUPT;
+                }
+                seg += 17 + total;
+                n -= 17 + total;
+            }
+        } else if (marker == 0xDB) {
+            while (n >= 65) {
+                uint8_t precision = seg[0] >> 4;
+                uint8_t id = seg[0] & 0x03;
+                size_t table_len = precision ? 129 : 65;
+                if (n < table_len) {
+                    return JPEG_DC_CORRUPT;
+                }
+                for (int k = 0; k < 64; k++) {
+                    decoder->quant[id][k] = precision ? be16(seg + 1 + k * 2) : seg[1 + k];
+                }
+                seg += table_len;
+                n -= table_len;
+            }
+        } else if (marker == 0xDD) {
+            if (n < 2) {
+                return JPEG_DC_CORRUPT;
+            }
+            restart_interval = be16(seg);
+        } else if (marker == 0xDA) {
+            if (!component_count || n < 1) {
+                return JPEG_DC_CORRUPT;
+            }
+            scan_count = seg[0];
+            if (scan_count < 1 || scan_count > component_count || n < 1 + 2 * (size_t)scan_count + 3) {
+                return JPEG_DC_CORRUPT;
+            }
+            // Components are kept in scan order
+            for (int s = 0; s < scan_count; s++) {
+                int found = -1;
+                for (int c = 0; c < component_count; c++) {
+                    if (components[c].id == seg[1 + s * 2]) {
+                        found = c;
+                    }
+                }
+                if (found < 0) {
+                    return JPEG_DC_CORRUPT;
+                }
+                JpegComponent& comp = frame->components[s];
+                comp = components[found];
+                comp.dc_table = seg[2 + s * 2] >> 4 & 0x03;
+                comp.ac_table = seg[2 + s * 2] & 0x03;
+                if (!decoder->dc[comp.dc_table].defined || !decoder->ac[comp.ac_table].defined) {
+                    return JPEG_DC_CORRUPT;
+                }
+            }
+            break;
+        }
+    }
+
+    // A scan of all components, or a single-component image
+    if (scan_count != component_count || width == 0 || height == 0) {
+        return JPEG_DC_UNSUPPORTED;
+    }
+    JpegComponent* comps = frame->components;
+    if (component_count == 1) {
+        // Non-interleaved: one block per MCU whatever the sampling says
+        comps[0].h = comps[0].v = 1;
+        frame->mcu_w = frame->mcu_h = 8;
+    } else {
+        int hmax = 1, vmax = 1;
+        int blocks_per_mcu = 0;
+        for (int c = 0; c < component_count; c++) {
+            hmax = max(hmax, (int)comps[c].h);
+            vmax = max(vmax, (int)comps[c].v);
+            blocks_per_mcu += comps[c].h * comps[c].v;
+        }
+        if (comps[0].h != hmax || comps[0].v != vmax || blocks_per_mcu > JPEG_MAX_BLOCKS_PER_MCU) {
+            return JPEG_DC_UNSUPPORTED;
+        }
+        frame->mcu_w = 8 * hmax;
+        frame->mcu_h = 8 * vmax;
+    }
+    frame->width = width;
+    frame->height = height;
+    frame->component_count = component_count;
+    frame->restart_interval = restart_interval;
+    frame->mcus_x = (width + frame->mcu_w - 1) / frame->mcu_w;
+    frame->mcus_y = (height + frame->mcu_h - 1) / frame->mcu_h;
+    frame->data = jpeg + pos;
+    frame->end = jpeg + len;
+    return JPEG_DC_OK;
+}
+
+JpegDcResult jpegDecodeDC(JpegDcDecoder* decoder, const uint8_t* jpeg, size_t len,
+                          JpegDcImage* image, uint32_t deadline_us) {
+    JpegFrame frame;
+    JpegDcResult result = jpegParseFrame(decoder, jpeg, len, &frame);
+    if (result != JPEG_DC_OK) {
+        return result;
+    }
+
+    const JpegComponent& luma = frame.components[0];
+    image->width = frame.width;
+    image->height = frame.height;
+    image->blocks_x = frame.mcus_x * luma.h;
+    image->blocks_y = frame.mcus_y * luma.v;
+    if ((size_t)image->blocks_x * image->blocks_y > image->capacity) {
+        return JPEG_DC_TOO_LARGE;
+    }
+
+    JpegBitReader br = { frame.data, frame.end, 0, 0, false };
+    int predictor[JPEG_MAX_COMPONENTS] = { 0, 0, 0 };
+    int32_t luma_quant = decoder->quant[luma.quant][0];
+    uint8_t* out = image->luma;
+    int blocks_x = image->blocks_x;
+    int restarts_left = frame.restart_interval;
+
+    for (int my = 0; my < frame.mcus_y; my++) {
+        if (deadline_us && (int32_t)(micros() - deadline_us) > 0) {
+            return JPEG_DC_TIMEOUT;
+        }
+        for (int mx = 0; mx < frame.mcus_x; mx++) {
+            if (frame.restart_interval) {
+                if (restarts_left == 0) {
+                    if (!jpegRestart(br)) {
+                        return JPEG_DC_CORRUPT;
+                    }
+                    predictor[0] = predictor[1] = predictor[2] = 0;
+                    restarts_left = frame.restart_interval;
+                }
+                restarts_left--;
+            }
+
+            for (int c = 0; c < frame.component_count; c++) {
+                const JpegComponent& comp = frame.components[c];
+                const JpegHuffTable& dc = decoder->dc[comp.dc_table];
+                const JpegHuffTable& ac = decoder->ac[comp.ac_table];
+
+                for (int by = 0; by < comp.v; by++) {
+                    for (int bx = 0; bx < comp.h; bx++) {
+                        if (!jpegDecodeDcDiff(br, dc, &predictor[c])) {
+                            return JPEG_DC_CORRUPT;
+                        }
+                        if (c == 0) {
+                            // DC is 8x the level-shifted block mean
+                            int mean = predictor[0] * luma_quant / 8 + 128;
+                            out[(my * comp.v + by) * blocks_x + mx * comp.h + bx] =
+                                (uint8_t)(mean < 0 ? 0 : mean > 255 ? 255 : mean);
+                        }
+                        // AC coefficients: decoded only to be skipped
+                        if (!jpegSkipAc(br, ac)) {
+                            return JPEG_DC_CORRUPT;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return JPEG_DC_OK;
+}
+
+const char* jpegDcResultName(JpegDcResult result) {
+    return result <= JPEG_DC_OUTSIDE ? RESULT_NAMES[result] : "unknown";
+}
+
+JpegDcDecoder* cameraDcDecoder() {
+    static JpegDcDecoder* decoder = nullptr;
+    if (!decoder) {
+        // The Huffman lookups are the hot path
+        decoder = (JpegDcDecoder*)heap_caps_calloc(1, sizeof(JpegDcDecoder), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!decoder) {
+            decoder = (JpegDcDecoder*)heap_caps_calloc(1, sizeof(JpegDcDecoder), MALLOC_CAP_8BIT);
+        }
+    }
+    return decoder;
+}
@@ -0,0 +1,399 @@
+#include "jpeg_encode.h"
+
+// ITU T.81 Annex K.3 tables
+static const uint8_t LUMA_DC_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t CHROMA_DC_BITS[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t LUMA_AC_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t LUMA_AC_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+static const uint8_t CHROMA_AC_BITS[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t CHROMA_AC_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+struct HuffSpec {
+    const uint8_t* bits;
+    const uint8_t* values;
+    uint8_t count;
+    uint8_t dht_id;                  // Class << 4 | table
+};
+
+// Same order as JpegEncoder::codes
+static const HuffSpec HUFF_SPECS[4] = {
+    { LUMA_DC_BITS, DC_VALUES, sizeof(DC_VALUES), 0x00 },
+    { LUMA_AC_BITS, LUMA_AC_VALUES, sizeof(LUMA_AC_VALUES), 0x10 },
+    { CHROMA_DC_BITS, DC_VALUES, sizeof(DC_VALUES), 0x01 },
+    { CHROMA_AC_BITS, CHROMA_AC_VALUES, sizeof(CHROMA_AC_VALUES), 0x11 }
+};
+
+// jfdctint.c
+#define CONST_BITS 13
+#define PASS1_BITS 2
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+#define DESCALE(x, n) (((x) + (1 << ((n) - 1))) >> (n))
+
+static inline void putByte(JpegEncoder* encoder, uint8_t byte) {
+    if (encoder->len < encoder->capacity) {
+        encoder->out[encoder->len++] = byte;
+    } else {
+        encoder->overflow = true;
+    }
+}
+
+static void put16(JpegEncoder* encoder, uint16_t value) {
+    putByte(encoder, value >> 8);
+    putByte(encoder, value & 0xFF);
+}
+
+// Entropy-coded bits, MSB first, with 0xFF stuffing. len is at most 16.
+static inline void putBits(JpegEncoder* encoder, uint32_t value, int len) {
+    encoder->bits = (encoder->bits << len) | (value & ((1u << len) - 1));
+    encoder->count += len;
+    while (encoder->count >= 8) {
+        encoder->count -= 8;
+        uint8_t byte = (uint8_t)(encoder->bits >> encoder->count);
+        putByte(encoder, byte);
+        if (byte == 0xFF) {
+            putByte(encoder, 0x00);
+        }
+    }
+}
+
+static void buildCodes(const HuffSpec& spec, JpegHuffCode* codes) {
+    memset(codes, 0, 256 * sizeof(JpegHuffCode));
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < spec.bits[len - 1]; i++) {
+            codes[spec.values[k++]] = { code++, (uint8_t)len };
+        }
+        code <<= 1;
+    }
+}
+
+static void writeHeaders(JpegEncoder* encoder, const uint16_t (*quant)[64]) {
+    putByte(encoder, 0xFF);
+    putByte(encoder, 0xD8);
+
+    // DQT, one per table in use; baseline tables are 8-bit
+    bool written[4] = { false, false, false, false };
+    for (int c = 0; c < encoder->component_count; c++) {
+        int id = encoder->components[c].quant;
+        if (written[id]) {
+            continue;
+        }
+        written[id] = true;
+        putByte(encoder, 0xFF);
+        putByte(encoder, 0xDB);
+        put16(encoder, 2 + 65);
+        putByte(encoder, id);
+        for (int k = 0; k < 64; k++) {
+            uint8_t q = (uint8_t)constrain(quant[id][k], 1, 255);
+            putByte(encoder, q);
+            encoder->divisors[id][JPEG_NATURAL_ORDER[k]] = q * 8;
+        }
+    }
+
+    putByte(encoder, 0xFF);
+    putByte(encoder, 0xC0);
+    put16(encoder, 8 + 3 * encoder->component_count);
+    putByte(encoder, 8);
+    put16(encoder, encoder->height);
+    put16(encoder, encoder->width);
+    putByte(encoder, encoder->component_count);
+    for (int c = 0; c < encoder->component_count; c++) {
+        const JpegComponent& comp = encoder->components[c];
+        putByte(encoder, comp.id);
+        putByte(encoder, (comp.h << 4) | comp.v);
+        putByte(encoder, comp.quant);
+    }
+
+    int tables = encoder->component_count > 1 ? 4 : 2;
+    for (int t = 0; t < tables; t++) {
+        const HuffSpec& spec = HUFF_SPECS[t];
+        putByte(encoder, 0xFF);
+        putByte(encoder, 0xC4);
+        put16(encoder, 2 + 1 + 16 + spec.count);
+        putByte(encoder, spec.dht_id);
+        for (int i = 0; i < 16; i++) {
+            putByte(encoder, spec.bits[i]);
+        }
+        for (int i = 0; i < spec.count; i++) {
+            putByte(encoder, spec.values[i]);
+        }
+    }
+
+    putByte(encoder, 0xFF);
+    putByte(encoder, 0xDA);
+    put16(encoder, 6 + 2 * encoder->component_count);
+    putByte(encoder, encoder->component_count);
+    for (int c = 0; c < encoder->component_count; c++) {
+        putByte(encoder, encoder->components[c].id);
+        putByte(encoder, c == 0 ? 0x00 : 0x11);
+    }
+    putByte(encoder, 0);        // Spectral selection 0-63, no approximation
+    putByte(encoder, 63);
+    putByte(encoder, 0);
+}
+
+bool jpegEncodeBegin(JpegEncoder* encoder, uint8_t* out, size_t capacity, int width, int height,
+                     const JpegComponent* components, int component_count, const uint16_t (*quant)[64]) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535 ||
+        component_count < 1 || component_count > JPEG_MAX_COMPONENTS) {
+        return false;
+    }
+    encoder->out = out;
+    encoder->capacity = capacity;
+    encoder->len = 0;
+    encoder->overflow = false;
+    encoder->bits = 0;
+    encoder->count = 0;
+    encoder->width = width;
+    encoder->height = height;
+    encoder->component_count = component_count;
+    int hmax = 1, vmax = 1;
+    for (int c = 0; c < component_count; c++) {
+        encoder->components[c] = components[c];
+        encoder->predictor[c] = 0;
+        hmax = max(hmax, (int)components[c].h);
+        vmax = max(vmax, (int)components[c].v);
+    }
+    encoder->mcus_x = (width + hmax * 8 - 1) / (hmax * 8);
+    encoder->mcus_y = (height + vmax * 8 - 1) / (vmax * 8);
+    encoder->rows_done = 0;
+    for (int t = 0; t < 4; t++) {
+        buildCodes(HUFF_SPECS[t], encoder->codes[t]);
+    }
+    writeHeaders(encoder, quant);
+    return !encoder->overflow;
+}
+
+// Forward DCT of 8x8 level-shifted samples in place; outputs are scaled
+// up by 8
+static void fdctBlock(int32_t* data) {
+    int32_t* p = data;
+    for (int r = 0; r < 8; r++, p += 8) {
+        int32_t tmp0 = p[0] + p[7];
+        int32_t tmp7 = p[0] - p[7];
+        int32_t tmp1 = p[1] + p[6];
+        int32_t tmp6 = p[1] - p[6];
+        int32_t tmp2 = p[2] + p[5];
+        int32_t tmp5 = p[2] - p[5];
+        int32_t tmp3 = p[3] + p[4];
+        int32_t tmp4 = p[3] - p[4];
+        int32_t tmp10 = tmp0 + tmp3;
+        int32_t tmp13 = tmp0 - tmp3;
+        int32_t tmp11 = tmp1 + tmp2;
+        int32_t tmp12 = tmp1 - tmp2;
+        p[0] = (tmp10 + tmp11) * (1 << PASS1_BITS);
+        p[4] = (tmp10 - tmp11) * (1 << PASS1_BITS);
+        int32_t z1 = (tmp12 + tmp13) * FIX_0_541196100;
+        p[2] = DESCALE(z1 + tmp13 * FIX_0_765366865, CONST_BITS - PASS1_BITS);
+        p[6] = DESCALE(z1 - tmp12 * FIX_1_847759065, CONST_BITS - PASS1_BITS);
+
+        z1 = tmp4 + tmp7;
+        int32_t z2 = tmp5 + tmp6;
+        int32_t z3 = tmp4 + tmp6;
+        int32_t z4 = tmp5 + tmp7;
+        int32_t z5 = (z3 + z4) * FIX_1_175875602;
+        tmp4 *= FIX_0_298631336;
+        tmp5 *= FIX_2_053119869;
+        tmp6 *= FIX_3_072711026;
+        tmp7 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        p[7] = DESCALE(tmp4 + z1 + z3, CONST_BITS - PASS1_BITS);
+        p[5] = DESCALE(tmp5 + z2 + z4, CONST_BITS - PASS1_BITS);
+        p[3] = DESCALE(tmp6 + z2 + z3, CONST_BITS - PASS1_BITS);
+        p[1] = DESCALE(tmp7 + z1 + z4, CONST_BITS - PASS1_BITS);
+    }
+
+    p = data;
+    for (int c = 0; c < 8; c++, p++) {
+        int32_t tmp0 = p[0] + p[56];
+        int32_t tmp7 = p[0] - p[56];
+        int32_t tmp1 = p[8] + p[48];
+        int32_t tmp6 = p[8] - p[48];
+        int32_t tmp2 = p[16] + p[40];
+        int32_t tmp5 = p[16] - p[40];
+        int32_t tmp3 = p[24] + p[32];
+        int32_t tmp4 = p[24] - p[32];
+        int32_t tmp10 = tmp0 + tmp3;
+        int32_t tmp13 = tmp0 - tmp3;
+        int32_t tmp11 = tmp1 + tmp2;
+        int32_t tmp12 = tmp1 - tmp2;
+        p[0] = DESCALE(tmp10 + tmp11, PASS1_BITS);
+        p[32] = DESCALE(tmp10 - tmp11, PASS1_BITS);
+        int32_t z1 = (tmp12 + tmp13) * FIX_0_541196100;
+        p[16] = DESCALE(z1 + tmp13 * FIX_0_765366865, CONST_BITS + PASS1_BITS);
+        p[48] = DESCALE(z1 - tmp12 * FIX_1_847759065, CONST_BITS + PASS1_BITS);
+
+        z1 = tmp4 + tmp7;
+        int32_t z2 = tmp5 + tmp6;
+        int32_t z3 = tmp4 + tmp6;
+        int32_t z4 = tmp5 + tmp7;
+        int32_t z5 = (z3 + z4) * FIX_1_175875602;
+        tmp4 *= FIX_0_298631336;
+        tmp5 *= FIX_2_053119869;
+        tmp6 *= FIX_3_072711026;
+        tmp7 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        p[56] = DESCALE(tmp4 + z1 + z3, CONST_BITS + PASS1_BITS);
+        p[40] = DESCALE(tmp5 + z2 + z4, CONST_BITS + PASS1_BITS);
+        p[24] = DESCALE(tmp6 + z2 + z3, CONST_BITS + PASS1_BITS);
+        p[8] = DESCALE(tmp7 + z1 + z4, CONST_BITS + PASS1_BITS);
+    }
+}
+
+static inline int magnitudeBits(int value) {
+    int size = 0;
+    for (unsigned v = value < 0 ? -value : value; v; v >>= 1) {
+        size++;
+    }
+    return size;
+}
+
+static inline void putCoefficient(JpegEncoder* encoder, int value, int size) {
+    putBits(encoder, value < 0 ? value - 1 : value, size);
+}
+
+// Huffman-codes one block of quantised coefficients, zigzag order
+static void encodeCoefficients(JpegEncoder* encoder, const int16_t* coef, int c) {
+    const JpegHuffCode* dc = encoder->codes[c == 0 ? 0 : 2];
+    const JpegHuffCode* ac = encoder->codes[c == 0 ? 1 : 3];
+    int diff = coef[0] - encoder->predictor[c];
+    encoder->predictor[c] = coef[0];
+    int size = magnitudeBits(diff);
+    putBits(encoder, dc[size].code, dc[size].len);
+    if (size) {
+        putCoefficient(encoder, diff, size);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int value = coef[k];
+        if (!value) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            putBits(encoder, ac[0xF0].code, ac[0xF0].len);
+            run -= 16;
+        }
+        size = magnitudeBits(value);
+        const JpegHuffCode& code = ac[(run << 4) | size];
+        putBits(encoder, code.code, code.len);
+        putCoefficient(encoder, value, size);
+        run = 0;
+    }
+    if (run) {
+        putBits(encoder, ac[0x00].code, ac[0x00].len);
+    }
+}
+
+static void encodeBlock(JpegEncoder* encoder, const uint8_t* samples, int stride, int c) {
+    int32_t block[64];
+    for (int y = 0; y < 8; y++, samples += stride) {
+        for (int x = 0; x < 8; x++) {
+            block[y * 8 + x] = samples[x] - 128;
+        }
+    }
+    fdctBlock(block);
+
+    // Quantise with libjpeg's rounding (jcdctmgr.c)
+    const uint16_t* divisors = encoder->divisors[encoder->components[c].quant];
+    int16_t coef[64];
+    for (int k = 0; k < 64; k++) {
+        int n = JPEG_NATURAL_ORDER[k];
+        int32_t value = block[n];
+        int32_t divisor = divisors[n];
+        value = value < 0 ? -((-value + (divisor >> 1)) / divisor) : (value + (divisor >> 1)) / divisor;
+        // Only reachable with quantisers of 1; keep within the Huffman tables
+        coef[k] = k ? constrain(value, -1023, 1023) : constrain(value, -1024, 1023);
+    }
+    encodeCoefficients(encoder, coef, c);
+}
+
+void jpegEncodeRow(JpegEncoder* encoder, uint8_t* const* planes, const int* stride) {
+    if (encoder->rows_done >= encoder->mcus_y) {
+        return;
+    }
+    for (int mx = 0; mx < encoder->mcus_x; mx++) {
+        for (int c = 0; c < encoder->component_count; c++) {
+            const JpegComponent& comp = encoder->components[c];
+            for (int by = 0; by < comp.v; by++) {
+                for (int bx = 0; bx < comp.h; bx++) {
+                    encodeBlock(encoder, planes[c] + by * 8 * stride[c] + (mx * comp.h + bx) * 8, stride[c], c);
+                }
+            }
+        }
+    }
+    encoder->rows_done++;
+}
+
+void jpegEncodeCoefficientRow(JpegEncoder* encoder, const int16_t* const* blocks, const int* stride) {
+    if (encoder->rows_done >= encoder->mcus_y) {
+        return;
+    }
+    for (int mx = 0; mx < encoder->mcus_x; mx++) {
+        for (int c = 0; c < encoder->component_count; c++) {
+            const JpegComponent& comp = encoder->components[c];
+            for (int by = 0; by < comp.v; by++) {
+                for (int bx = 0; bx < comp.h; bx++) {
+                    encodeCoefficients(encoder, blocks[c] + (by * stride[c] + mx * comp.h + bx) * 64, c);
+                }
+            }
+        }
+    }
+    encoder->rows_done++;
+}
+
+size_t jpegEncodeEnd(JpegEncoder* encoder) {
+    if (encoder->count) {
+        putBits(encoder, 0x7F, 8 - encoder->count);   // Pad with ones
+    }
+    putByte(encoder, 0xFF);
+    putByte(encoder, 0xD9);
+    if (encoder->overflow || encoder->rows_done != encoder->mcus_y) {
+        return 0;
+    }
+    return encoder->len;
+}
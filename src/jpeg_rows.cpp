@@ -0,0 +1,410 @@
+#include "jpeg_rows.h"
+#include "jpeg_entropy.h"
+#include "esp_heap_caps.h"
+
+// jidctint.c: Loeffler-Ligtenberg-Moschytz with 13-bit constants
+#define CONST_BITS 13
+#define PASS1_BITS 2
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+// jidctred.c
+#define FIX_0_211164243 1730
+#define FIX_0_509795579 4176
+#define FIX_0_601344887 4926
+#define FIX_0_720959822 5906
+#define FIX_0_850430095 6967
+#define FIX_1_061594337 8697
+#define FIX_1_272758580 10426
+#define FIX_1_451774981 11893
+#define FIX_2_172734803 17799
+#define FIX_3_624509785 29692
+#define DESCALE(x, n) (((x) + (1 << ((n) - 1))) >> (n))
+
+// Valid 8-bit data keeps dequantised coefficients within 12 bits and the
+// first pass's outputs within 14; clamping corrupt data to these keeps the
+// 32-bit arithmetic from overflowing
+#define COEF_LIMIT 4095
+#define PASS1_LIMIT 16383
+
+static inline uint8_t clampSample(int32_t value) {
+    return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static inline int32_t clampTo(int32_t value, int32_t limit) {
+    return value < -limit ? -limit : value > limit ? limit : value;
+}
+
+// One stage of the 8-point IDCT over in[0], in[step] .. in[7 * step].
+// Leaves the 8 outputs, scaled by 2^CONST_BITS, in out.
+static inline void idct8(const int32_t* in, int step, int32_t* out) {
+    int32_t z2 = in[2 * step];
+    int32_t z3 = in[6 * step];
+    int32_t z1 = (z2 + z3) * FIX_0_541196100;
+    int32_t tmp2 = z1 - z3 * FIX_1_847759065;
+    int32_t tmp3 = z1 + z2 * FIX_0_765366865;
+    int32_t tmp0 = (in[0] + in[4 * step]) * (1 << CONST_BITS);
+    int32_t tmp1 = (in[0] - in[4 * step]) * (1 << CONST_BITS);
+    int32_t tmp10 = tmp0 + tmp3;
+    int32_t tmp13 = tmp0 - tmp3;
+    int32_t tmp11 = tmp1 + tmp2;
+    int32_t tmp12 = tmp1 - tmp2;
+
+    tmp0 = in[7 * step];
+    tmp1 = in[5 * step];
+    tmp2 = in[3 * step];
+    tmp3 = in[step];
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    int32_t z4 = tmp1 + tmp3;
+    int32_t z5 = (z3 + z4) * FIX_1_175875602;
+    tmp0 *= FIX_0_298631336;
+    tmp1 *= FIX_2_053119869;
+    tmp2 *= FIX_3_072711026;
+    tmp3 *= FIX_1_501321110;
+    z1 *= -FIX_0_899976223;
+    z2 *= -FIX_2_562915447;
+    z3 = z3 * -FIX_1_961570560 + z5;
+    z4 = z4 * -FIX_0_390180644 + z5;
+    tmp0 += z1 + z3;
+    tmp1 += z2 + z4;
+    tmp2 += z2 + z3;
+    tmp3 += z1 + z4;
+
+    out[0] = tmp10 + tmp3;
+    out[7] = tmp10 - tmp3;
+    out[1] = tmp11 + tmp2;
+    out[6] = tmp11 - tmp2;
+    out[2] = tmp12 + tmp1;
+    out[5] = tmp12 - tmp1;
+    out[3] = tmp13 + tmp0;
+    out[4] = tmp13 - tmp0;
+}
+
+// Dequantised coefficients (natural order) to 8x8 samples
+static void idctBlock(const int32_t* coef, uint8_t* out, int stride) {
+    int32_t ws[64];
+    int32_t column[8];
+
+    for (int c = 0; c < 8; c++) {
+        const int32_t* in = coef + c;
+        if (!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+            // DC only: the column is flat
+            int32_t dc = in[0] * (1 << PASS1_BITS);
+            for (int r = 0; r < 8; r++) {
+                ws[r * 8 + c] = dc;
+            }
+            continue;
+        }
+        idct8(in, 8, column);
+        for (int r = 0; r < 8; r++) {
+            ws[r * 8 + c] = clampTo(DESCALE(column[r], CONST_BITS - PASS1_BITS), PASS1_LIMIT);
+        }
+    }
+
+    for (int r = 0; r < 8; r++, out += stride) {
+        const int32_t* in = ws + r * 8;
+        if (!(in[1] | in[2] | in[3] | in[4] | in[5] | in[6] | in[7])) {
+            memset(out, clampSample(DESCALE(in[0], PASS1_BITS + 3) + 128), 8);
+            continue;
+        }
+        int32_t row[8];
+        idct8(in, 1, row);
+        for (int x = 0; x < 8; x++) {
+            out[x] = clampSample(DESCALE(row[x], CONST_BITS + PASS1_BITS + 3) + 128);
+        }
+    }
+}
+
+// Odd part of the 4-point IDCT from inputs 1, 3, 5 and 7 of an 8-point one
+static inline void idct4Odd(int32_t z4, int32_t z3, int32_t z2, int32_t z1, int32_t* tmp0, int32_t* tmp2) {
+    *tmp0 = z1 * -FIX_0_211164243 + z2 * FIX_1_451774981 + z3 * -FIX_2_172734803 + z4 * FIX_1_061594337;
+    *tmp2 = z1 * -FIX_0_509795579 + z2 * -FIX_0_601344887 + z3 * FIX_0_899976223 + z4 * FIX_2_562915447;
+}
+
+// 8x8 coefficients to 4x4 samples (jpeg_idct_4x4)
+static void idctBlock4(const int32_t* coef, uint8_t* out, int stride) {
+    int32_t ws[32];
+    int32_t tmp0, tmp2;
+
+    for (int c = 0; c < 8; c++) {
+        if (c == 4) {
+            continue;   // The second pass does not use column 4
+        }
+        const int32_t* in = coef + c;
+        if (!(in[8] | in[16] | in[24] | in[40] | in[48] | in[56])) {
+            int32_t dc = in[0] * (1 << PASS1_BITS);
+            ws[c] = ws[8 + c] = ws[16 + c] = ws[24 + c] = dc;
+            continue;
+        }
+        int32_t even = in[0] * (1 << (CONST_BITS + 1));
+        int32_t tmp = in[16] * FIX_1_847759065 + in[48] * -FIX_0_765366865;
+        int32_t tmp10 = even + tmp;
+        int32_t tmp12 = even - tmp;
+        idct4Odd(in[8], in[24], in[40], in[56], &tmp0, &tmp2);
+        ws[c] = clampTo(DESCALE(tmp10 + tmp2, CONST_BITS - PASS1_BITS + 1), PASS1_LIMIT);
+        ws[24 + c] = clampTo(DESCALE(tmp10 - tmp2, CONST_BITS - PASS1_BITS + 1), PASS1_LIMIT);
+        ws[8 + c] = clampTo(DESCALE(tmp12 + tmp0, CONST_BITS - PASS1_BITS + 1), PASS1_LIMIT);
+        ws[16 + c] = clampTo(DESCALE(tmp12 - tmp0, CONST_BITS - PASS1_BITS + 1), PASS1_LIMIT);
+    }
+
+    for (int r = 0; r < 4; r++, out += stride) {
+        const int32_t* in = ws + r * 8;
+        if (!(in[1] | in[2] | in[3] | in[5] | in[6] | in[7])) {
+            memset(out, clampSample(DESCALE(in[0], PASS1_BITS + 3) + 128), 4);
+            continue;
+        }
+        int32_t even = in[0] * (1 << (CONST_BITS + 1));
+        int32_t tmp = in[2] * FIX_1_847759065 + in[6] * -FIX_0_765366865;
+        int32_t tmp10 = even + tmp;
+        int32_t tmp12 = even - tmp;
+        idct4Odd(in[1], in[3], in[5], in[7], &tmp0, &tmp2);
+        out[0] = clampSample(DESCALE(tmp10 + tmp2, CONST_BITS + PASS1_BITS + 3 + 1) + 128);
+        out[3] = clampSample(DESCALE(tmp10 - tmp2, CONST_BITS + PASS1_BITS + 3 + 1) + 128);
+        out[1] = clampSample(DESCALE(tmp12 + tmp0, CONST_BITS + PASS1_BITS + 3 + 1) + 128);
+        out[2] = clampSample(DESCALE(tmp12 - tmp0, CONST_BITS + PASS1_BITS + 3 + 1) + 128);
+    }
+}
+
+// Odd part of the 2-point IDCT from inputs 1, 3, 5 and 7 of an 8-point one
+static inline int32_t idct2Odd(int32_t in1, int32_t in3, int32_t in5, int32_t in7) {
+    return in7 * -FIX_0_720959822 + in5 * FIX_0_850430095 + in3 * -FIX_1_272758580 + in1 * FIX_3_624509785;
+}
+
+// 8x8 coefficients to 2x2 samples (jpeg_idct_2x2)
+static void idctBlock2(const int32_t* coef, uint8_t* out, int stride) {
+    int32_t ws[16];
+
+    for (int c = 0; c < 8; c++) {
+        if (c == 2 || c == 4 || c == 6) {
+            continue;   // Only the odd columns and column 0 are used
+        }
+        const int32_t* in = coef + c;
+        if (!(in[8] | in[24] | in[40] | in[56])) {
+            ws[c] = ws[8 + c] = in[0] * (1 << PASS1_BITS);
+            continue;
+        }
+        int32_t tmp10 = in[0] * (1 << (CONST_BITS + 2));
+        int32_t tmp0 = idct2Odd(in[8], in[24], in[40], in[56]);
+        ws[c] = clampTo(DESCALE(tmp10 + tmp0, CONST_BITS - PASS1_BITS + 2), PASS1_LIMIT);
+        ws[8 + c] = clampTo(DESCALE(tmp10 - tmp0, CONST_BITS - PASS1_BITS + 2), PASS1_LIMIT);
+    }
+
+    for (int r = 0; r < 2; r++, out += stride) {
+        const int32_t* in = ws + r * 8;
+        if (!(in[1] | in[3] | in[5] | in[7])) {
+            out[0] = out[1] = clampSample(DESCALE(in[0], PASS1_BITS + 3) + 128);
+            continue;
+        }
+        int32_t tmp10 = in[0] * (1 << (CONST_BITS + 2));
+        int32_t tmp0 = idct2Odd(in[1], in[3], in[5], in[7]);
+        out[0] = clampSample(DESCALE(tmp10 + tmp0, CONST_BITS + PASS1_BITS + 3 + 2) + 128);
+        out[1] = clampSample(DESCALE(tmp10 - tmp0, CONST_BITS + PASS1_BITS + 3 + 2) + 128);
+    }
+}
+
+// Huffman-decodes one block's AC coefficients into coef, dequantised
+static inline bool decodeAc(JpegBitReader& br, const JpegHuffTable& ac, const uint16_t* quant, int32_t* coef) {
+    for (int k = 1; k < 64;) {
+        br.fill();
+        int rs = jpegDecodeSymbol(br, ac);
+        if (rs < 0) {
+            return false;
+        }
+        int run = rs >> 4;
+        int size = rs & 0x0F;
+        if (size) {
+            k += run;
+            if (k > 63 || size > 10) {
+                return false;
+            }
+            if (br.count < size) {
+                br.fill();
+            }
+            coef[JPEG_NATURAL_ORDER[k]] = clampTo(jpegExtend((int)br.take(size), size) * quant[k], COEF_LIMIT);
+            k++;
+        } else if (run == 15) {
+            k += 16;
+        } else {
+            break;          // End of block
+        }
+    }
+    return true;
+}
+
+static void saveCheckpoint(JpegRowCheckpoint* cp, const JpegBitReader& br, const JpegFrame& frame,
+                           int restarts_left, const int* predictor) {
+    cp->offset = br.p - frame.data;
+    cp->bits = br.bits;
+    cp->count = (int8_t)br.count;
+    cp->at_marker = br.at_marker;
+    cp->restarts_left = (uint16_t)restarts_left;
+    for (int c = 0; c < JPEG_MAX_COMPONENTS; c++) {
+        cp->predictor[c] = (int16_t)predictor[c];
+    }
+}
+
+// Walks one MCU row from the reader's position. Without transform the
+// blocks are only entropy-decoded.
+static bool walkRow(JpegRowDecoder* decoder, JpegBitReader& br, int* restarts_left, int* predictor,
+                    bool transform) {
+    const JpegFrame& frame = decoder->frame;
+    int scale = decoder->scale;
+    int size = 8 / scale;             // Output samples per block side
+    int32_t coef[64];
+
+    for (int mx = 0; mx < frame.mcus_x; mx++) {
+        if (frame.restart_interval) {
+            if (*restarts_left == 0) {
+                if (!jpegRestart(br)) {
+                    return false;
+                }
+                predictor[0] = predictor[1] = predictor[2] = 0;
+                *restarts_left = frame.restart_interval;
+            }
+            (*restarts_left)--;
+        }
+
+        for (int c = 0; c < frame.component_count; c++) {
+            const JpegComponent& comp = frame.components[c];
+            const JpegHuffTable& dc = decoder->tables.dc[comp.dc_table];
+            const JpegHuffTable& ac = decoder->tables.ac[comp.ac_table];
+            const uint16_t* quant = decoder->tables.quant[comp.quant];
+            bool full = transform && (c == 0 || !decoder->luma_only);
+
+            for (int by = 0; by < comp.v; by++) {
+                for (int bx = 0; bx < comp.h; bx++) {
+                    if (!jpegDecodeDcDiff(br, dc, &predictor[c])) {
+                        return false;
+                    }
+                    int32_t dc_value = clampTo(clampTo(predictor[c], 2047) * quant[0], COEF_LIMIT);
+                    if (!full || scale == 8) {
+                        if (!jpegSkipAc(br, ac)) {
+                            return false;
+                        }
+                        if (full) {
+                            // 1x1: the block mean (jpeg_idct_1x1)
+                            int stride = decoder->stride[c];
+                            decoder->planes[c][by * stride + mx * comp.h + bx] =
+                                clampSample(DESCALE(dc_value, 3) + 128);
+                        }
+                        continue;
+                    }
+                    memset(coef, 0, sizeof(coef));
+                    coef[0] = dc_value;
+                    if (!decodeAc(br, ac, quant, coef)) {
+                        return false;
+                    }
+                    int stride = decoder->stride[c];
+                    uint8_t* out = decoder->planes[c] + by * size * stride + (mx * comp.h + bx) * size;
+                    if (scale == 1) {
+                        idctBlock(coef, out, stride);
+                    } else if (scale == 2) {
+                        idctBlock4(coef, out, stride);
+                    } else {
+                        idctBlock2(coef, out, stride);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+JpegDcResult jpegRowsBegin(JpegRowDecoder* decoder, const uint8_t* jpeg, size_t len, bool luma_only,
+                           int scale, bool sequential) {
+    jpegRowsEnd(decoder);
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        return JPEG_DC_UNSUPPORTED;
+    }
+    JpegDcResult result = jpegParseFrame(&decoder->tables, jpeg, len, &decoder->frame);
+    if (result != JPEG_DC_OK) {
+        return result;
+    }
+    const JpegFrame& frame = decoder->frame;
+    decoder->luma_only = luma_only || frame.component_count == 1;
+    decoder->scale = scale;
+    decoder->sequential = sequential;
+
+    size_t checkpoints = sequential ? 0 : frame.mcus_y * sizeof(JpegRowCheckpoint);
+    size_t size = checkpoints;
+    int planes = decoder->luma_only ? 1 : frame.component_count;
+    for (int c = 0; c < planes; c++) {
+        decoder->stride[c] = frame.mcus_x * frame.components[c].h * 8 / scale;
+        size += (size_t)decoder->stride[c] * frame.components[c].v * 8 / scale;
+    }
+    decoder->buffer = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!decoder->buffer) {
+        decoder->buffer = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    if (!decoder->buffer) {
+        return JPEG_DC_NO_MEMORY;
+    }
+    decoder->buffer_size = size;
+    uint8_t* plane = decoder->buffer + checkpoints;
+    for (int c = 0; c < JPEG_MAX_COMPONENTS; c++) {
+        decoder->planes[c] = c < planes ? plane : nullptr;
+        if (c < planes) {
+            plane += (size_t)decoder->stride[c] * frame.components[c].v * 8 / scale;
+        }
+    }
+
+    JpegBitReader br = { frame.data, frame.end, 0, 0, false };
+    int predictor[JPEG_MAX_COMPONENTS] = { 0, 0, 0 };
+    int restarts_left = frame.restart_interval;
+    if (sequential) {
+        saveCheckpoint(&decoder->next, br, frame, restarts_left, predictor);
+        decoder->next_row = 0;
+        return JPEG_DC_OK;
+    }
+
+    // Index pass: where each MCU row starts, and whether the data holds up
+    decoder->checkpoints = (JpegRowCheckpoint*)decoder->buffer;
+    for (int row = 0; row < frame.mcus_y; row++) {
+        saveCheckpoint(&decoder->checkpoints[row], br, frame, restarts_left, predictor);
+        if (!walkRow(decoder, br, &restarts_left, predictor, false)) {
+            jpegRowsEnd(decoder);
+            return JPEG_DC_CORRUPT;
+        }
+    }
+    return JPEG_DC_OK;
+}
+
+JpegDcResult jpegRowsDecode(JpegRowDecoder* decoder, int row) {
+    if (!decoder->buffer || row < 0 || row >= decoder->frame.mcus_y ||
+        (decoder->sequential && row != decoder->next_row)) {
+        return JPEG_DC_CORRUPT;
+    }
+    const JpegRowCheckpoint& cp = decoder->sequential ? decoder->next : decoder->checkpoints[row];
+    JpegBitReader br = { decoder->frame.data + cp.offset, decoder->frame.end, cp.bits, cp.count, cp.at_marker };
+    int predictor[JPEG_MAX_COMPONENTS] = { cp.predictor[0], cp.predictor[1], cp.predictor[2] };
+    int restarts_left = cp.restarts_left;
+    if (!walkRow(decoder, br, &restarts_left, predictor, true)) {
+        return JPEG_DC_CORRUPT;
+    }
+    if (decoder->sequential) {
+        saveCheckpoint(&decoder->next, br, decoder->frame, restarts_left, predictor);
+        decoder->next_row = row + 1;
+    }
+    return JPEG_DC_OK;
+}
+
+void jpegRowsEnd(JpegRowDecoder* decoder) {
+    heap_caps_free(decoder->buffer);
+    decoder->buffer = nullptr;
+    decoder->buffer_size = 0;
+    decoder->checkpoints = nullptr;
+    for (int c = 0; c < JPEG_MAX_COMPONENTS; c++) {
+        decoder->planes[c] = nullptr;
+    }
+}
@@ -0,0 +1,303 @@
+#include "jpeg_transform.h"
+#include "jpeg_entropy.h"
+#include "jpeg_encode.h"
+#include "esp_heap_caps.h"
+
+#define OUTPUT_SLACK_PER_BLOCK 8     // Output reserve over the source size, per block
+
+// Tables and coder state, too large for the caller's stack
+struct TransformWork {
+    JpegDcDecoder tables;
+    JpegFrame frame;
+    JpegEncoder encoder;
+};
+
+static void* allocPreferInternal(size_t size) {
+    void* p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return p ? p : heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+static void* allocPreferPsram(size_t size) {
+    return heap_caps_malloc(size, psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT);
+}
+
+// Huffman-decodes one block's AC coefficients into coef, quantised, zigzag
+// order
+static inline bool decodeAcCoefficients(JpegBitReader& br, const JpegHuffTable& ac, int16_t* coef) {
+    for (int k = 1; k < 64;) {
+        br.fill();
+        int rs = jpegDecodeSymbol(br, ac);
+        if (rs < 0) {
+            return false;
+        }
+        int run = rs >> 4;
+        int size = rs & 0x0F;
+        if (size) {
+            k += run;
+            if (k > 63 || size > 10) {
+                return false;
+            }
+            if (br.count < size) {
+                br.fill();
+            }
+            coef[k++] = (int16_t)jpegExtend((int)br.take(size), size);
+        } else if (run == 15) {
+            k += 16;
+        } else {
+            break;          // End of block
+        }
+    }
+    return true;
+}
+
+// Pixel span [start, start + size) on one axis of extent `extent`, moved to
+// an MCU boundary. Mirrored spans are whole MCUs. False if none fits.
+static bool alignSpan(int start, int size, int extent, int mcu, bool mirrored, int* first_mcu, int* span) {
+    start = constrain(start, 0, extent - 1);
+    size = size > 0 ? min(size, extent - start) : extent - start;
+    int first = start / mcu;
+    int length = start + size - first * mcu;
+    if (mirrored) {
+        length = (length + mcu - 1) / mcu * mcu;
+        if (first * mcu + length > extent) {
+            length -= mcu;
+        }
+        if (length <= 0 && first > 0) {
+            // Only a partial MCU at the edge: take the whole one before it
+            first--;
+            length = mcu;
+        }
+        if (length <= 0) {
+            return false;
+        }
+    }
+    *first_mcu = first;
+    *span = length;
+    return true;
+}
+
+// Entropy-decodes the frame up to the region's last MCU row, keeping the
+// coefficients of the region's blocks. Component c's blocks go to
+// coef[c], row-major in a grid of grid_w[c] blocks per row.
+static bool readRegion(const JpegDcDecoder& tables, const JpegFrame& frame, int mx0, int my0, int mcus_x,
+                       int mcus_y, int16_t* const* coef, const int* grid_w) {
+    JpegBitReader br = { frame.data, frame.end, 0, 0, false };
+    int predictor[JPEG_MAX_COMPONENTS] = { 0, 0, 0 };
+    int restarts_left = frame.restart_interval;
+
+    for (int my = 0; my < my0 + mcus_y; my++) {
+        for (int mx = 0; mx < frame.mcus_x; mx++) {
+            if (frame.restart_interval) {
+                if (restarts_left == 0) {
+                    if (!jpegRestart(br)) {
+                        return false;
+                    }
+                    predictor[0] = predictor[1] = predictor[2] = 0;
+                    restarts_left = frame.restart_interval;
+                }
+                restarts_left--;
+            }
+            bool inside = my >= my0 && mx >= mx0 && mx < mx0 + mcus_x;
+
+            for (int c = 0; c < frame.component_count; c++) {
+                const JpegComponent& comp = frame.components[c];
+                const JpegHuffTable& dc = tables.dc[comp.dc_table];
+                const JpegHuffTable& ac = tables.ac[comp.ac_table];
+                for (int by = 0; by < comp.v; by++) {
+                    for (int bx = 0; bx < comp.h; bx++) {
+                        if (!jpegDecodeDcDiff(br, dc, &predictor[c])) {
+                            return false;
+                        }
+                        if (!inside) {
+                            if (!jpegSkipAc(br, ac)) {
+                                return false;
+                            }
+                            continue;
+                        }
+                        int row = (my - my0) * comp.v + by;
+                        int column = (mx - mx0) * comp.h + bx;
+                        int16_t* block = coef[c] + ((size_t)row * grid_w[c] + column) * 64;
+                        memset(block, 0, 64 * sizeof(int16_t));
+                        block[0] = (int16_t)constrain(predictor[c], -1024, 1023);
+                        if (!decodeAcCoefficients(br, ac, block)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Where output coefficient k (zigzag) comes from in the source block, and
+// its sign, for a rotation
+static void buildPermutation(JpegRotation rotation, uint8_t* source, int8_t* sign) {
+    uint8_t zigzag[64];
+    for (int k = 0; k < 64; k++) {
+        zigzag[JPEG_NATURAL_ORDER[k]] = k;
+    }
+    bool transpose = rotation == JPEG_ROTATE_90 || rotation == JPEG_ROTATE_270;
+    for (int k = 0; k < 64; k++) {
+        int n = JPEG_NATURAL_ORDER[k];
+        int i = n >> 3;                    // Vertical frequency
+        int j = n & 7;                     // Horizontal frequency
+        source[k] = zigzag[transpose ? j * 8 + i : n];
+        // 90: transpose then mirror horizontally; 270: transpose then
+        // mirror vertically; 180: mirror both
+        int odd = rotation == JPEG_ROTATE_90 ? j : rotation == JPEG_ROTATE_180 ? i + j :
+                  rotation == JPEG_ROTATE_270 ? i : 0;
+        sign[k] = (odd & 1) ? -1 : 1;
+    }
+}
+
+JpegDcResult jpegTransform(const uint8_t* jpeg, size_t len, const JpegRect& region, JpegRotation rotation,
+                           uint8_t** out, size_t* out_len, JpegRect* applied) {
+    TransformWork* work = (TransformWork*)allocPreferInternal(sizeof(TransformWork));
+    if (!work) {
+        return JPEG_DC_NO_MEMORY;
+    }
+    memset(work, 0, sizeof(TransformWork));
+    const JpegFrame& frame = work->frame;
+    JpegDcResult result = jpegParseFrame(&work->tables, jpeg, len, &work->frame);
+    if (result != JPEG_DC_OK) {
+        heap_caps_free(work);
+        return result;
+    }
+
+    if (region.x >= frame.width || region.y >= frame.height) {
+        heap_caps_free(work);
+        return JPEG_DC_OUTSIDE;
+    }
+
+    bool transpose = rotation == JPEG_ROTATE_90 || rotation == JPEG_ROTATE_270;
+    bool mirror_x = rotation == JPEG_ROTATE_180 || rotation == JPEG_ROTATE_270;
+    bool mirror_y = rotation == JPEG_ROTATE_90 || rotation == JPEG_ROTATE_180;
+    int mx0, my0, crop_w, crop_h;
+    if (!alignSpan(region.x, region.width, frame.width, frame.mcu_w, mirror_x, &mx0, &crop_w) ||
+        !alignSpan(region.y, region.height, frame.height, frame.mcu_h, mirror_y, &my0, &crop_h)) {
+        heap_caps_free(work);
+        return JPEG_DC_UNSUPPORTED;
+    }
+    int mcus_x = (crop_w + frame.mcu_w - 1) / frame.mcu_w;
+    int mcus_y = (crop_h + frame.mcu_h - 1) / frame.mcu_h;
+
+    // Source blocks of the region, then one output MCU row
+    int16_t* coef[JPEG_MAX_COMPONENTS] = { nullptr, nullptr, nullptr };
+    int grid_w[JPEG_MAX_COMPONENTS];
+    int grid_h[JPEG_MAX_COMPONENTS];
+    int16_t* row[JPEG_MAX_COMPONENTS] = { nullptr, nullptr, nullptr };
+    int row_stride[JPEG_MAX_COMPONENTS];
+    JpegComponent components[JPEG_MAX_COMPONENTS];
+    int out_mcus_x = transpose ? mcus_y : mcus_x;
+    int out_mcus_y = transpose ? mcus_x : mcus_y;
+    size_t blocks = 0, row_blocks = 0;
+    for (int c = 0; c < frame.component_count; c++) {
+        components[c] = frame.components[c];
+        if (transpose) {
+            components[c].h = frame.components[c].v;
+            components[c].v = frame.components[c].h;
+        }
+        grid_w[c] = mcus_x * frame.components[c].h;
+        grid_h[c] = mcus_y * frame.components[c].v;
+        row_stride[c] = out_mcus_x * components[c].h;
+        blocks += (size_t)grid_w[c] * grid_h[c];
+        row_blocks += (size_t)row_stride[c] * components[c].v;
+    }
+    int16_t* coef_buffer = (int16_t*)allocPreferPsram(blocks * 64 * sizeof(int16_t));
+    int16_t* row_buffer = (int16_t*)allocPreferInternal(row_blocks * 64 * sizeof(int16_t));
+    size_t capacity = 1024 + len + blocks * OUTPUT_SLACK_PER_BLOCK;
+    uint8_t* output = (uint8_t*)allocPreferPsram(capacity);
+    if (!coef_buffer || !row_buffer || !output) {
+        result = JPEG_DC_NO_MEMORY;
+    } else {
+        int16_t* p = coef_buffer;
+        int16_t* q = row_buffer;
+        for (int c = 0; c < frame.component_count; c++) {
+            coef[c] = p;
+            row[c] = q;
+            p += (size_t)grid_w[c] * grid_h[c] * 64;
+            q += (size_t)row_stride[c] * components[c].v * 64;
+        }
+        if (!readRegion(work->tables, frame, mx0, my0, mcus_x, mcus_y, coef, grid_w)) {
+            result = JPEG_DC_CORRUPT;
+        }
+    }
+
+    // Transposed blocks need transposed quant tables
+    uint16_t quant[4][64];
+    uint8_t source[64];
+    int8_t sign[64];
+    buildPermutation(rotation, source, sign);
+    for (int t = 0; t < 4; t++) {
+        for (int k = 0; k < 64; k++) {
+            quant[t][k] = work->tables.quant[t][transpose ? source[k] : k];
+        }
+    }
+
+    int out_w = transpose ? crop_h : crop_w;
+    int out_h = transpose ? crop_w : crop_h;
+    JpegEncoder& encoder = work->encoder;
+    if (result == JPEG_DC_OK &&
+        !jpegEncodeBegin(&encoder, output, capacity, out_w, out_h, components, frame.component_count, quant)) {
+        result = JPEG_DC_TOO_LARGE;
+    }
+
+    for (int out_row = 0; out_row < out_mcus_y && result == JPEG_DC_OK; out_row++) {
+        for (int c = 0; c < frame.component_count; c++) {
+            for (int by = 0; by < components[c].v; by++) {
+                for (int bx = 0; bx < row_stride[c]; bx++) {
+                    // Output block (ox, oy) of this component's grid
+                    int ox = bx;
+                    int oy = out_row * components[c].v + by;
+                    int sx = ox, sy = oy;
+                    if (rotation == JPEG_ROTATE_90) {
+                        sx = oy;
+                        sy = grid_h[c] - 1 - ox;
+                    } else if (rotation == JPEG_ROTATE_180) {
+                        sx = grid_w[c] - 1 - ox;
+                        sy = grid_h[c] - 1 - oy;
+                    } else if (rotation == JPEG_ROTATE_270) {
+                        sx = grid_w[c] - 1 - oy;
+                        sy = ox;
+                    }
+                    const int16_t* in = coef[c] + ((size_t)sy * grid_w[c] + sx) * 64;
+                    int16_t* block = row[c] + ((size_t)by * row_stride[c] + bx) * 64;
+                    if (rotation == JPEG_ROTATE_NONE) {
+                        memcpy(block, in, 64 * sizeof(int16_t));
+                    } else {
+                        for (int k = 0; k < 64; k++) {
+                            block[k] = in[source[k]] * sign[k];
+                        }
+                    }
+                }
+            }
+        }
+        jpegEncodeCoefficientRow(&encoder, row, row_stride);
+    }
+
+    size_t length = 0;
+    if (result == JPEG_DC_OK) {
+        length = jpegEncodeEnd(&encoder);
+        if (!length) {
+            result = JPEG_DC_TOO_LARGE;
+        }
+    }
+    applied->x = mx0 * frame.mcu_w;
+    applied->y = my0 * frame.mcu_h;
+    applied->width = crop_w;
+    applied->height = crop_h;
+    heap_caps_free(coef_buffer);
+    heap_caps_free(row_buffer);
+    heap_caps_free(work);
+    if (result != JPEG_DC_OK) {
+        heap_caps_free(output);
+        return result;
+    }
+
+    // Give back the reserve
+    uint8_t* shrunk = (uint8_t*)heap_caps_realloc(output, length, psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT);
+    *out = shrunk ? shrunk : output;
+    *out_len = length;
+    return JPEG_DC_OK;
+}
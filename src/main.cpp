@@ -20,6 +20,12 @@
 #include "storage.h"
 #include "captive_portal.h"
 #include "web_server.h"
+#include "camera_profiles.h"
+#include "motion_detect.h"
+#include "thumbnail.h"
+#include "roi_view.h"
+#include "frame_convert.h"
+#include "trace.h"
 
 // Global variables
 TaskHandle_t cameraTaskHandle = NULL;
@@ -84,6 +90,12 @@ void setup() {
         Serial.println("Configuration loaded successfully");
         g_config_loaded = true;
     }
+    initCameraProfiles();
+    initCameraRequests();
+    initMotionDetect();
+    initThumbnails();
+    initRoiViews();
+    initFrameConvert();
     
     // Print memory info
     printMemoryInfo();
@@ -129,7 +141,7 @@ void setup() {
     xTaskCreatePinnedToCore(
         cameraTask,
         "CameraTask",
-        8192,
+        CAMERA_TASK_STACK,
         NULL,
         CAMERA_TASK_PRIORITY,
         &cameraTaskHandle,
@@ -139,7 +151,7 @@ void setup() {
     xTaskCreatePinnedToCore(
         webServerTask,
         "WebServerTask",
-        8192,
+        WEB_TASK_STACK,
         NULL,
         WEB_TASK_PRIORITY,
         &webServerTaskHandle,
@@ -149,7 +161,7 @@ void setup() {
     xTaskCreatePinnedToCore(
         watchdogTask,
         "WatchdogTask",
-        4096,
+        WATCHDOG_TASK_STACK,
         NULL,
         WATCHDOG_TASK_PRIORITY,
         &watchdogTaskHandle,
@@ -201,6 +213,7 @@ void loop() {
     // Process events from queue
     Event event;
     if (xQueueReceive(eventQueue, &event, 0) == pdTRUE) {
+        TRACE_SCOPE("loopEvent");
         switch (event.type) {
             case EVENT_WIFI_CONNECTED:
                 wifi_connected = true;
@@ -243,6 +256,14 @@ void loop() {
                 saveConfiguration();
                 break;
                 
+            case EVENT_MOTION_DETECTED:
+                Serial.printf("Motion detected: %d.%d%% of the frame changed\n", event.data / 10, event.data % 10);
+                break;
+                
+            case EVENT_MOTION_ENDED:
+                Serial.printf("Motion ended after %d.%d s\n", event.data / 1000, event.data % 1000 / 100);
+                break;
+                
             case EVENT_RESTART_REQUESTED:
                 Serial.println("Restart requested, rebooting in 2 seconds...");
                 delay(2000);
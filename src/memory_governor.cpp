@@ -0,0 +1,153 @@
+#include "memory_governor.h"
+#include "app.h"
+#include "frame_ring.h"
+#include <esp_heap_caps.h>
+
+struct MemoryThresholds {
+    uint32_t free_bytes;
+    uint32_t largest_block;
+};
+
+// A level is entered when either figure drops below its entry; indexed by
+// level, MEM_NORMAL unused. Internal RAM must keep room for TCP buffers,
+// request objects and JSON replies; PSRAM for clips, bursts and frames.
+static const MemoryThresholds INTERNAL_THRESHOLDS[MEM_LEVEL_COUNT] = {
+    { 0, 0 },
+    { 48 * 1024, 20 * 1024 },
+    { 32 * 1024, 12 * 1024 },
+    { 20 * 1024, 8 * 1024 }
+};
+static const MemoryThresholds PSRAM_THRESHOLDS[MEM_LEVEL_COUNT] = {
+    { 0, 0 },
+    { 512 * 1024, 256 * 1024 },
+    { 256 * 1024, 160 * 1024 },
+    { 128 * 1024, 96 * 1024 }
+};
+
+static const char* const LEVEL_NAMES[MEM_LEVEL_COUNT] = {
+    "normal", "elevated", "high", "critical"
+};
+
+// Written by the web server task only; read from anywhere
+static MemoryGovernorState governor = {};
+static bool flush_queued = false;
+
+static MemoryLevel regionLevel(MemoryLevel current, uint32_t free_bytes, uint32_t largest_block,
+                               const MemoryThresholds* thresholds) {
+    int entered = MEM_NORMAL;
+    for (int level = MEM_CRITICAL; level > MEM_NORMAL; level--) {
+        if (free_bytes < thresholds[level].free_bytes || largest_block < thresholds[level].largest_block) {
+            entered = level;
+            break;
+        }
+    }
+    if (entered >= current) {
+        return (MemoryLevel)entered;
+    }
+
+    // Falling: step down once clear of the current level with margin
+    const MemoryThresholds& t = thresholds[current];
+    if ((uint64_t)free_bytes * 100 >= (uint64_t)t.free_bytes * (100 + MEM_HYSTERESIS_PERCENT) &&
+        (uint64_t)largest_block * 100 >= (uint64_t)t.largest_block * (100 + MEM_HYSTERESIS_PERCENT)) {
+        return (MemoryLevel)(current - 1);
+    }
+    return current;
+}
+
+static void sampleRegion(MemoryRegionState& region, uint32_t caps, const MemoryThresholds* thresholds) {
+    region.free_bytes = heap_caps_get_free_size(caps);
+    region.largest_block = heap_caps_get_largest_free_block(caps);
+    region.min_free = heap_caps_get_minimum_free_size(caps);
+    region.level = regionLevel(region.level, region.free_bytes, region.largest_block, thresholds);
+}
+
+// The /clip ring is the one large PSRAM allocation that can give memory
+// back without losing a function
+static void updateFrameRing() {
+    if (!frameRingEnabled()) {
+        return;
+    }
+    size_t configured = frameRingGrantedCapacity();
+
+    if (!governor.ring_shrunk && governor.psram.level >= MEM_HIGH) {
+        if (resizeFrameRing(configured / MEM_RING_SHRINK_DIVISOR)) {
+            governor.ring_shrunk = true;
+            governor.ring_shrinks++;
+            governor.ring_shrink_level = governor.psram.level;
+        }
+    } else if (governor.ring_shrunk && governor.psram.level == MEM_NORMAL) {
+        // Growing may not fit yet; retried on the next sample
+        if (resizeFrameRing(configured)) {
+            governor.ring_shrunk = false;
+        }
+    }
+}
+
+// Hands a deferred config save back to loop() once pressure has cleared
+static void flushDeferredConfig() {
+    if (!configSaveDeferred()) {
+        flush_queued = false;
+        return;
+    }
+    if (governor.level == MEM_NORMAL && !flush_queued) {
+        Event event = { EVENT_CONFIG_UPDATED, 0, nullptr };
+        flush_queued = xQueueSend(eventQueue, &event, 0) == pdTRUE;
+    }
+}
+
+void updateMemoryGovernor() {
+    sampleRegion(governor.internal, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, INTERNAL_THRESHOLDS);
+    governor.psram_present = psramFound();
+    if (governor.psram_present) {
+        sampleRegion(governor.psram, MALLOC_CAP_SPIRAM, PSRAM_THRESHOLDS);
+    }
+
+    MemoryLevel level = max(governor.internal.level, governor.psram.level);
+    if (level != governor.level) {
+        Serial.printf("Memory pressure: %s -> %s (internal %u free, %u block; psram %u free, %u block)\n",
+                      LEVEL_NAMES[governor.level], LEVEL_NAMES[level],
+                      (unsigned)governor.internal.free_bytes, (unsigned)governor.internal.largest_block,
+                      (unsigned)governor.psram.free_bytes, (unsigned)governor.psram.largest_block);
+        __atomic_store_n(&governor.level, level, __ATOMIC_RELAXED);
+        governor.transitions++;
+        governor.last_change = millis();
+    }
+
+    governor.adapt_steps = memoryAdaptSteps();
+    updateFrameRing();
+    flushDeferredConfig();
+}
+
+MemoryLevel memoryLevel() {
+    return __atomic_load_n(&governor.level, __ATOMIC_RELAXED);
+}
+
+const char* memoryLevelName(MemoryLevel level) {
+    return level < MEM_LEVEL_COUNT ? LEVEL_NAMES[level] : "unknown";
+}
+
+bool memoryAdmitsStream() {
+    if (memoryLevel() < MEM_ELEVATED) {
+        return true;
+    }
+    __atomic_fetch_add(&governor.streams_refused, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+bool memoryDefersWrites() {
+    return memoryLevel() >= MEM_ELEVATED;
+}
+
+int memoryAdaptSteps() {
+    switch (memoryLevel()) {
+        case MEM_HIGH:     return MEM_HIGH_ADAPT_STEPS;
+        case MEM_CRITICAL: return MEM_CRITICAL_ADAPT_STEPS;
+        default:           return 0;
+    }
+}
+
+void getMemoryGovernorState(MemoryGovernorState* state) {
+    *state = governor;
+    state->streams_refused = __atomic_load_n(&governor.streams_refused, __ATOMIC_RELAXED);
+    state->config_deferred = configSaveDeferred();
+}
@@ -0,0 +1,297 @@
+#include "metrics.h"
+#include "app.h"
+#include "frame_broadcaster.h"
+#include "frame_ring.h"
+#include "memory_governor.h"
+#include "scene_activity.h"
+#include "thumbnail.h"
+#include "roi_view.h"
+#include <WiFi.h>
+#include <stdarg.h>
+
+// Bucket bounds in each histogram's base unit, at most METRICS_MAX_BUCKETS each
+static const uint32_t CAPTURE_LATENCY_BOUNDS_US[] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+static const uint32_t FRAME_SIZE_BOUNDS[] = {
+    4096, 8192, 16384, 32768, 65536, 131072, 262144
+};
+static const uint32_t STREAM_SEND_BOUNDS_MS[] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000
+};
+static const uint32_t CONTROL_APPLY_BOUNDS_US[] = {
+    100, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+static const uint32_t MOTION_ANALYSIS_BOUNDS_US[] = {
+    1000, 2000, 4000, 6000, 8000, 12000, 16000, 24000, 32000, 50000
+};
+
+#define HISTOGRAM(bounds) { bounds, (uint8_t)(sizeof(bounds) / sizeof(bounds[0])), {}, {}, 0, {} }
+
+MetricHistogram metric_capture_latency = HISTOGRAM(CAPTURE_LATENCY_BOUNDS_US);
+MetricHistogram metric_frame_size = HISTOGRAM(FRAME_SIZE_BOUNDS);
+MetricHistogram metric_stream_send = HISTOGRAM(STREAM_SEND_BOUNDS_MS);
+MetricHistogram metric_control_apply = HISTOGRAM(CONTROL_APPLY_BOUNDS_US);
+MetricHistogram metric_motion_analysis = HISTOGRAM(MOTION_ANALYSIS_BOUNDS_US);
+MetricCounter metric_stream_dropped;
+MetricCounter metric_stream_denied;
+MetricCounter metric_stream_evicted;
+MetricCounter metric_stream_static_skipped;
+MetricCounter metric_stream_bytes_saved;
+MetricCounter metric_capture_failures;
+MetricCounter metric_motion_events;
+MetricCounter metric_config_saves;
+MetricCounter metric_config_save_failures;
+MetricCounter metric_wifi_disconnects;
+MetricCounter metric_wifi_reconnects;
+
+// Status classes 2xx..5xx; anything else lands in 5xx
+#define HTTP_CLASSES 4
+
+static MetricCounter http_responses[ROUTE_COUNT][HTTP_CLASSES];
+
+static const char* const ROUTE_PATHS[ROUTE_COUNT] = {
+    "/", "/status", "/sleepstatus", "/capture", "/stream", "/clip", "/burst", "/bmp",
+    "/control", "/sleep", "/wake", "/restart", "/factory-reset", "/wifi-connect", "/metrics",
+    "/trace", "/tasks", "/sessions", "/profile", "/profiles", "/profiles/schedule", "/motion", "other"
+};
+
+uint64_t metricValue(const MetricCounter& counter) {
+    uint64_t total = 0;
+    for (int core = 0; core < METRICS_CORES; core++) {
+        total += __atomic_load_n(&counter.value[core], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+void metricsCountHttp(const char* url, int code) {
+    int route = ROUTE_OTHER;
+    for (int i = 0; i < ROUTE_OTHER; i++) {
+        if (strcmp(url, ROUTE_PATHS[i]) == 0) {
+            route = i;
+            break;
+        }
+    }
+    int status_class = code >= 200 && code < 500 ? code / 100 - 2 : HTTP_CLASSES - 1;
+    metricAdd(http_responses[route][status_class]);
+}
+
+void metricsPollWiFi() {
+    static bool was_connected = false;
+    static bool ever_connected = false;
+
+    bool connected = WiFi.status() == WL_CONNECTED;
+    if (connected != was_connected) {
+        if (connected && ever_connected) {
+            metricAdd(metric_wifi_reconnects);
+        } else if (!connected) {
+            metricAdd(metric_wifi_disconnects);
+        }
+        ever_connected = ever_connected || connected;
+        was_connected = connected;
+    }
+}
+
+// Exposition
+
+static void appendLine(String& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendLine(String& out, const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += line;
+}
+
+static void appendHeader(String& out, const char* name, const char* type, const char* help) {
+    appendLine(out, "# HELP %s %s\n", name, help);
+    appendLine(out, "# TYPE %s %s\n", name, type);
+}
+
+static void appendCounter(String& out, const char* name, const char* help, uint64_t value) {
+    appendHeader(out, name, "counter", help);
+    appendLine(out, "%s %llu\n", name, (unsigned long long)value);
+}
+
+static void appendGauge(String& out, const char* name, const char* help, double value) {
+    appendHeader(out, name, "gauge", help);
+    appendLine(out, "%s %.15g\n", name, value);
+}
+
+// scale converts the histogram's base unit to the exported unit
+static void appendHistogram(String& out, const char* name, const char* help,
+                            MetricHistogram& histogram, double scale) {
+    // Widen the 32-bit per-core sums: the unsigned difference since the last
+    // scrape is correct across one wrap
+    for (int core = 0; core < METRICS_CORES; core++) {
+        uint32_t sum = __atomic_load_n(&histogram.sum[core], __ATOMIC_RELAXED);
+        histogram.sum_total += (uint32_t)(sum - histogram.sum_seen[core]);
+        histogram.sum_seen[core] = sum;
+    }
+
+    appendHeader(out, name, "histogram", help);
+    uint64_t cumulative = 0;
+    for (uint8_t i = 0; i <= histogram.bucket_count; i++) {
+        for (int core = 0; core < METRICS_CORES; core++) {
+            cumulative += __atomic_load_n(&histogram.counts[core][i], __ATOMIC_RELAXED);
+        }
+        if (i < histogram.bucket_count) {
+            appendLine(out, "%s_bucket{le=\"%g\"} %llu\n", name, histogram.bounds[i] * scale,
+                       (unsigned long long)cumulative);
+        } else {
+            appendLine(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cumulative);
+        }
+    }
+    appendLine(out, "%s_sum %.15g\n", name, histogram.sum_total * scale);
+    appendLine(out, "%s_count %llu\n", name, (unsigned long long)cumulative);
+}
+
+String renderMetrics() {
+    String out;
+    out.reserve(6144);
+
+    appendHistogram(out, "esp32cam_capture_latency_seconds",
+                    "Time spent in esp_camera_fb_get()", metric_capture_latency, 1e-6);
+    appendHistogram(out, "esp32cam_frame_size_bytes",
+                    "Size of captured JPEG frames", metric_frame_size, 1.0);
+    appendHistogram(out, "esp32cam_stream_frame_send_seconds",
+                    "Time to hand one frame to one /stream client's TCP connection",
+                    metric_stream_send, 1e-3);
+    appendHistogram(out, "esp32cam_control_apply_seconds",
+                    "Time the camera task takes to apply one /control request to the sensor",
+                    metric_control_apply, 1e-6);
+    appendHistogram(out, "esp32cam_motion_analysis_seconds",
+                    "Time to decode and score one frame for motion detection",
+                    metric_motion_analysis, 1e-6);
+
+    appendCounter(out, "esp32cam_capture_failures_total", "Captures where the driver returned no frame",
+                  metricValue(metric_capture_failures));
+    appendCounter(out, "esp32cam_motion_events_total", "Motion events started",
+                  metricValue(metric_motion_events));
+    appendCounter(out, "esp32cam_frames_published_total", "Frames published by the camera task",
+                  getFramesPublished());
+    appendCounter(out, "esp32cam_stream_frames_dropped_total",
+                  "Frames skipped for /stream clients whose link could not keep up",
+                  metricValue(metric_stream_dropped));
+
+    FramePoolStats pool;
+    getFramePoolStats(&pool);
+    appendCounter(out, "esp32cam_frame_pool_dropped_total", "Captured frames returned unpublished",
+                  pool.dropped);
+    appendCounter(out, "esp32cam_frame_pool_exhausted_total", "Times the camera task waited for a frame descriptor",
+                  pool.exhausted);
+    appendGauge(out, "esp32cam_frame_pool_in_use", "Frame descriptors currently held", pool.in_use);
+
+    uint32_t cache_hits, cache_misses;
+    getCaptureCacheStats(&cache_hits, &cache_misses);
+    appendCounter(out, "esp32cam_capture_cache_hits_total", "/capture requests served from the cached frame",
+                  cache_hits);
+    appendCounter(out, "esp32cam_capture_cache_misses_total", "/capture requests that waited for a new frame",
+                  cache_misses);
+
+    appendHeader(out, "esp32cam_http_responses_total", "counter", "HTTP responses by route and status class");
+    for (int route = 0; route < ROUTE_COUNT; route++) {
+        for (int status_class = 0; status_class < HTTP_CLASSES; status_class++) {
+            uint64_t count = metricValue(http_responses[route][status_class]);
+            if (count) {
+                appendLine(out, "esp32cam_http_responses_total{route=\"%s\",code=\"%dxx\"} %llu\n",
+                           ROUTE_PATHS[route], status_class + 2, (unsigned long long)count);
+            }
+        }
+    }
+
+    appendCounter(out, "esp32cam_config_saves_total", "Configuration saves",
+                  metricValue(metric_config_saves));
+    appendCounter(out, "esp32cam_config_save_failures_total", "Configuration saves that reached no storage",
+                  metricValue(metric_config_save_failures));
+    appendCounter(out, "esp32cam_wifi_disconnects_total", "Station link losses seen by the watchdog",
+                  metricValue(metric_wifi_disconnects));
+    appendCounter(out, "esp32cam_wifi_reconnects_total", "Station link recoveries after a loss",
+                  metricValue(metric_wifi_reconnects));
+
+    appendCounter(out, "esp32cam_stream_denied_total", "Stream clients denied by admission limits",
+                  metricValue(metric_stream_denied));
+    appendCounter(out, "esp32cam_stream_evicted_total", "Stream clients evicted for a higher-priority client",
+                  metricValue(metric_stream_evicted));
+
+    appendCounter(out, "esp32cam_stream_static_skipped_total",
+                  "Unchanged frames left out for skip_static clients",
+                  metricValue(metric_stream_static_skipped));
+    appendCounter(out, "esp32cam_stream_static_saved_bytes_total",
+                  "JPEG bytes of frames left out for skip_static clients",
+                  metricValue(metric_stream_bytes_saved));
+
+    ThumbnailStats thumbnails[THUMBNAIL_SCALES];
+    getThumbnailStats(thumbnails);
+    appendHeader(out, "esp32cam_thumbnail_conversions_total", "counter", "Frames converted for ?scale=, by scale");
+    for (const ThumbnailStats& t : thumbnails) {
+        appendLine(out, "esp32cam_thumbnail_conversions_total{scale=\"%d\"} %u\n", t.scale, (unsigned)t.conversions);
+    }
+    appendHeader(out, "esp32cam_thumbnail_cache_hits_total", "counter", "?scale= requests served from the cache");
+    for (const ThumbnailStats& t : thumbnails) {
+        appendLine(out, "esp32cam_thumbnail_cache_hits_total{scale=\"%d\"} %u\n", t.scale, (unsigned)t.cache_hits);
+    }
+    appendHeader(out, "esp32cam_thumbnail_conversion_seconds_total", "counter", "Time spent converting, by scale");
+    for (const ThumbnailStats& t : thumbnails) {
+        appendLine(out, "esp32cam_thumbnail_conversion_seconds_total{scale=\"%d\"} %.6f\n", t.scale,
+                   t.total_us / 1e6);
+    }
+    appendHeader(out, "esp32cam_thumbnail_bytes", "gauge", "Size of the last thumbnail, by scale");
+    for (const ThumbnailStats& t : thumbnails) {
+        appendLine(out, "esp32cam_thumbnail_bytes{scale=\"%d\"} %u\n", t.scale, (unsigned)t.last_bytes);
+    }
+
+    RoiStats roi;
+    getRoiStats(&roi);
+    appendCounter(out, "esp32cam_roi_transforms_total", "Frames cropped or rotated for ?roi= and ?rotate=",
+                  roi.transforms);
+    appendCounter(out, "esp32cam_roi_cache_hits_total", "?roi= and ?rotate= requests served from the cache",
+                  roi.cache_hits);
+    appendHeader(out, "esp32cam_roi_transform_seconds_total", "counter", "Time spent cropping and rotating");
+    appendLine(out, "esp32cam_roi_transform_seconds_total %.6f\n", roi.total_us / 1e6);
+    appendCounter(out, "esp32cam_roi_saved_bytes_total", "Full-frame bytes not sent thanks to ?roi=",
+                  roi.bytes_saved);
+
+    ActivityStats activity;
+    getSceneActivityStats(&activity);
+    if (activity.enabled) {
+        appendGauge(out, "esp32cam_activity_idle", "1 while the static scene holds capture at activity.idle_fps",
+                    activity.idle);
+        appendCounter(out, "esp32cam_activity_idle_seconds_total", "Time spent at the idle capture rate",
+                      activity.idle_ms / 1000);
+        appendCounter(out, "esp32cam_activity_frames_avoided_total",
+                      "Captures not taken while idle (estimate)", activity.frames_avoided);
+    }
+
+    appendGauge(out, "esp32cam_stream_clients", "Connected /stream clients", getStreamClientCount());
+    appendGauge(out, "esp32cam_camera_up", "1 when the camera is initialized and awake",
+                camera_initialized && !camera_sleeping);
+    appendGauge(out, "esp32cam_heap_free_bytes", "Free internal heap", ESP.getFreeHeap());
+    appendGauge(out, "esp32cam_heap_min_free_bytes", "Lowest free internal heap since boot", ESP.getMinFreeHeap());
+    appendGauge(out, "esp32cam_heap_largest_free_block_bytes", "Largest allocatable internal heap block",
+                ESP.getMaxAllocHeap());
+    if (psramFound()) {
+        appendGauge(out, "esp32cam_psram_free_bytes", "Free PSRAM", ESP.getFreePsram());
+        appendGauge(out, "esp32cam_psram_largest_free_block_bytes", "Largest allocatable PSRAM block",
+                    ESP.getMaxAllocPsram());
+    }
+
+    MemoryGovernorState mem;
+    getMemoryGovernorState(&mem);
+    appendGauge(out, "esp32cam_memory_pressure_level", "Memory governor level (0 normal .. 3 critical)", mem.level);
+    appendCounter(out, "esp32cam_stream_refused_total", "Stream clients refused under memory pressure",
+                  mem.streams_refused);
+    FrameRingStats ring;
+    getFrameRingStats(&ring);
+    if (ring.enabled) {
+        appendGauge(out, "esp32cam_clip_buffer_used_bytes", "Bytes held by the /clip pre-event ring", ring.used);
+    }
+    if (wifi_connected) {
+        appendGauge(out, "esp32cam_wifi_rssi_dbm", "Station RSSI", WiFi.RSSI());
+    }
+    appendGauge(out, "esp32cam_uptime_seconds", "Seconds since boot", getUptimeSeconds());
+
+    return out;
+}
@@ -0,0 +1,1012 @@
+#include "mjpeg_stream.h"
+#include "metrics.h"
+#include "trace.h"
+#include "memory_governor.h"
+#include "frame_convert.h"
+
+static const char MJPEG_TRAILER[] = "\r\n";
+static const size_t MJPEG_TRAILER_LEN = sizeof(MJPEG_TRAILER) - 1;
+
+// Boundary and part headers for one JPEG of len bytes, with its motion
+// score (per mille, sent as a percentage) when it was analysed
+static size_t formatPartHeader(char* header, size_t size, size_t len, int motion) {
+    int n;
+    if (motion >= 0) {
+        n = snprintf(header, size,
+                     "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                     "X-Motion-Score: %d.%d\r\n\r\n",
+                     (unsigned)len, motion / 10, motion % 10);
+    } else {
+        n = snprintf(header, size,
+                     "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                     (unsigned)len);
+    }
+    return n > 0 ? (size_t)n : 0;
+}
+
+MjpegStreamWriter::MjpegStreamWriter()
+    : _stage(STAGE_HEADER), _offset(0), _header_len(0), _last_seq(0) {
+    _header[0] = '\0';
+}
+
+MjpegStreamWriter::~MjpegStreamWriter() {
+    abort();
+}
+
+void MjpegStreamWriter::begin(FrameRef frame, ConvertedFrameRef converted) {
+    abort();
+    if (!frame) {
+        return;
+    }
+
+    _stage = STAGE_HEADER;
+    _offset = 0;
+    if (converted) {
+        // A copy; let the driver have its buffer back
+        _header_len = formatPartHeader(_header, sizeof(_header), converted->length, frame.motion());
+        _converted = std::move(converted);
+        return;
+    }
+    _frame = std::move(frame);
+    _header_len = formatPartHeader(_header, sizeof(_header), _frame.length(), _frame.motion());
+}
+
+size_t MjpegStreamWriter::write(uint8_t* buffer, size_t maxLen) {
+    if (idle()) {
+        return 0;
+    }
+
+    // The driver buffer cannot be freed while this copies from it
+    FrameReadGuard guard(_frame);
+    if (_frame && !guard.ok()) {
+        // The driver was deinitialized while this frame was in flight
+        abort();
+        return 0;
+    }
+
+    size_t pos = 0;
+
+    while (pos < maxLen && !idle()) {
+        size_t space = maxLen - pos;
+        size_t n;
+
+        switch (_stage) {
+            case STAGE_HEADER:
+                n = min(space, _header_len - _offset);
+                memcpy(buffer + pos, _header + _offset, n);
+                break;
+
+            case STAGE_BODY:
+                n = min(space, bodyLength() - _offset);
+                memcpy(buffer + pos, bodyData() + _offset, n);
+                break;
+
+            case STAGE_TRAILER:
+            default:
+                n = min(space, MJPEG_TRAILER_LEN - _offset);
+                memcpy(buffer + pos, MJPEG_TRAILER + _offset, n);
+                break;
+        }
+
+        pos += n;
+        _offset += n;
+
+        if (_stage == STAGE_HEADER && _offset == _header_len) {
+            _stage = STAGE_BODY;
+            _offset = 0;
+        } else if (_stage == STAGE_BODY && _offset == bodyLength()) {
+            _stage = STAGE_TRAILER;
+            _offset = 0;
+        } else if (_stage == STAGE_TRAILER && _offset == MJPEG_TRAILER_LEN) {
+            // Part complete - unpin the frame
+            _last_seq = _converted ? _converted->seq : _frame.seq();
+            _frame.reset();
+            _converted.reset();
+        }
+    }
+
+    return pos;
+}
+
+size_t MjpegStreamWriter::remaining() const {
+    if (idle()) {
+        return 0;
+    }
+
+    switch (_stage) {
+        case STAGE_HEADER:
+            return _header_len - _offset + bodyLength() + MJPEG_TRAILER_LEN;
+        case STAGE_BODY:
+            return bodyLength() - _offset + MJPEG_TRAILER_LEN;
+        case STAGE_TRAILER:
+        default:
+            return MJPEG_TRAILER_LEN - _offset;
+    }
+}
+
+void MjpegStreamWriter::abort() {
+    _frame.reset();
+    _converted.reset();
+    _stage = STAGE_HEADER;
+    _offset = 0;
+}
+
+// Unacknowledged bytes above which a client does not start a new frame.
+// Holding back until the link drains means the next part always carries
+// the newest frame instead of queueing stale ones behind a slow link.
+#define STREAM_BACKLOG_LIMIT 2048
+
+// Adaptation hysteresis, in one-second samples
+#define ADAPT_DEGRADE_SAMPLES 3
+#define ADAPT_RECOVER_SAMPLES 10
+#define ADAPT_QUALITY_STEP 5
+
+// Egress weight per StreamClass
+static const uint32_t STREAM_CLASS_WEIGHTS[STREAM_CLASS_COUNT] = { 1, 2, 4 };
+static const char* const STREAM_CLASS_NAMES[STREAM_CLASS_COUNT] = { "guest", "trusted", "operator" };
+
+// Newest client first
+static AsyncMjpegResponse* stream_clients_head = nullptr;
+static AsyncClipResponse* clip_clients_head = nullptr;
+static SemaphoreHandle_t stream_clients_lock = nullptr;
+static uint32_t next_session_id = 1;
+
+static StreamAdaptationState adaptation = {false, 0, 0, 0, 0, 0, "none", 0};
+static int congested_samples = 0;
+static int clear_samples = 0;
+
+// Adaptation step queued for the camera task, 0 when none; the state above
+// takes its quality and framesize once it has been applied
+static uint32_t adapt_ticket = 0;
+static int adapt_quality = 0;
+static int adapt_framesize = 0;
+
+void initMjpegStreaming() {
+    if (!stream_clients_lock) {
+        stream_clients_lock = xSemaphoreCreateMutex();
+    }
+}
+
+AsyncMjpegResponse::AsyncMjpegResponse(int fps, StreamClass stream_class, IPAddress remote_ip, bool skip_static,
+                                       int scale, const RoiSpec& roi)
+    : _request(nullptr), _next_due(0), _waiting(false), _backlogged(false),
+      _congested(false), _closed(false), _bytes_written(0), _bytes_acked(0),
+      _sample_acked(0), _sample_time(millis()), _throughput(0), _frames_sent(0),
+      _frames_dropped(0), _sample_dropped(0), _latency_ms(0), _frame_timestamp(0),
+      _send_start(0), _sample_sent(0), _fps_measured(0), _frame_len(0), _scale(scale),
+      _roi(roi), _skip_static(skip_static), _last_scene(0), _static_skipped(0), _bytes_saved(0),
+      _id(next_session_id++), _class(stream_class), _remote_ip(remote_ip),
+      _connected(millis()), _evicted(false), _share(0), _share_fixed(false),
+      _credit(0), _credit_time(millis()), _next(nullptr) {
+    _code = 200;
+    _contentType = MJPEG_CONTENT_TYPE;
+    _contentLength = 0;
+    _sendContentLength = false;
+    _chunked = false;
+
+    _fps = constrain(fps, 1, STREAM_MAX_FPS);
+    _interval_ms = 1000 / _fps;
+    _lock = xSemaphoreCreateMutex();
+
+    addStreamClient();
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    _next = stream_clients_head;
+    stream_clients_head = this;
+    xSemaphoreGive(stream_clients_lock);
+}
+
+AsyncMjpegResponse::~AsyncMjpegResponse() {
+    // Waits for serviceStreamClients() to finish with this client
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    AsyncMjpegResponse** link = &stream_clients_head;
+    while (*link && *link != this) {
+        link = &(*link)->_next;
+    }
+    if (*link) {
+        *link = _next;
+    }
+    xSemaphoreGive(stream_clients_lock);
+
+    _writer.abort();
+    removeStreamClient();
+    vSemaphoreDelete(_lock);
+}
+
+void AsyncMjpegResponse::_respond(AsyncWebServerRequest* request) {
+    _request = request;
+    AsyncAbstractResponse::_respond(request);
+}
+
+size_t AsyncMjpegResponse::_ack(AsyncWebServerRequest* request, size_t len, uint32_t time) {
+    // ACKs and polls from async_tcp race with resume() from the web task
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    size_t written = sendLocked(request, len, time);
+    xSemaphoreGive(_lock);
+    return written;
+}
+
+size_t AsyncMjpegResponse::sendLocked(AsyncWebServerRequest* request, size_t len, uint32_t time) {
+    _bytes_acked += len;
+    size_t written = AsyncAbstractResponse::_ack(request, len, time);
+    _bytes_written += written;
+    return written;
+}
+
+size_t AsyncMjpegResponse::backlog() const {
+    size_t in_flight = _bytes_written > _bytes_acked ? _bytes_written - _bytes_acked : 0;
+    return in_flight + _writer.remaining();
+}
+
+// Token bucket refilled at a client's egress share. A frame may start
+// whenever the credit is not negative and its length is then charged in
+// full, so a share below one frame still gets frames, just fewer of them.
+static bool refillCredit(int32_t* credit, unsigned long* credit_time, uint32_t share, unsigned long now) {
+    unsigned long elapsed = now - *credit_time;
+    *credit_time = now;
+    if (!share) {
+        *credit = 0;
+        return true;
+    }
+
+    // At most one second of unused share carries over
+    int64_t refilled = *credit + (int64_t)share * elapsed / 1000;
+    *credit = (int32_t)min(refilled, (int64_t)share);
+    return *credit >= 0;
+}
+
+bool AsyncMjpegResponse::hasCredit(unsigned long now) {
+    return refillCredit(&_credit, &_credit_time, __atomic_load_n(&_share, __ATOMIC_RELAXED), now);
+}
+
+size_t AsyncMjpegResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    TRACE_SCOPE("streamFill");
+    if (_writer.idle()) {
+        if (!camera_initialized || camera_sleeping) {
+            return 0;  // End stream
+        }
+        if (__atomic_load_n(&_evicted, __ATOMIC_RELAXED)) {
+            return 0;  // Displaced by a higher-priority client
+        }
+
+        unsigned long now = millis();
+        if ((long)(now - _next_due) < 0) {
+            _waiting = true;
+            return RESPONSE_TRY_AGAIN;
+        }
+
+        // Latest frame wins: let the link drain before picking a frame.
+        // The next ACK calls back in, so this never stalls the client.
+        if (_bytes_written - _bytes_acked > STREAM_BACKLOG_LIMIT) {
+            _backlogged = true;
+            _waiting = true;
+            return RESPONSE_TRY_AGAIN;
+        }
+
+        // Over its egress share: skip frames until the bucket refills
+        if (!hasCredit(now)) {
+            _waiting = true;
+            return RESPONSE_TRY_AGAIN;
+        }
+
+        // A frame picked earlier whose conversion was not ready yet
+        FrameRef frame = std::move(_converting);
+        bool picked = (bool)frame;
+        if (!picked) {
+            frame = acquireFrame(_writer.lastSeq());
+        }
+        if (!frame) {
+            _waiting = true;
+            return RESPONSE_TRY_AGAIN;
+        }
+
+        // Nothing new in the picture: skip it, but keep the connection
+        // and the client's view alive with a frame now and then
+        if (!picked && _skip_static && frame.scene() && frame.scene() == _last_scene &&
+            now - _send_start < STREAM_STATIC_KEEPALIVE_MS) {
+            // A converting client would have been sent about its last size
+            bool converting = _scale > 1 || roiActive(_roi);
+            size_t saved = converting && _frame_len ? _frame_len : frame.length();
+            _writer.skip(frame);
+            _static_skipped++;
+            _bytes_saved += saved;
+            metricAdd(metric_stream_static_skipped);
+            metricAdd(metric_stream_bytes_saved, saved);
+            _waiting = true;
+            return RESPONSE_TRY_AGAIN;
+        }
+
+        // Shared with every other client at this scale or region. The
+        // conversion task wakes the web server task when it is done.
+        ConvertedFrameRef converted;
+        if (_scale > 1 || roiActive(_roi)) {
+            JpegDcResult result;
+            ConvertSpec spec = { _scale, _roi };
+            ConvertState state = requestConversion(frame, spec, &converted, &result);
+            if (state == CONVERT_PENDING) {
+                _converting = std::move(frame);
+                _waiting = true;
+                return RESPONSE_TRY_AGAIN;
+            }
+            if (state == CONVERT_FAILED) {
+                _writer.skip(frame);
+                _waiting = true;
+                return RESPONSE_TRY_AGAIN;
+            }
+        }
+        _waiting = false;
+
+        unsigned long late = now - _next_due;
+        if (_backlogged && _frames_sent > 0 && late >= _interval_ms) {
+            // Deadlines missed while the link was full are dropped frames
+            _frames_dropped += late / _interval_ms;
+            metricAdd(metric_stream_dropped, late / _interval_ms);
+        }
+        _backlogged = false;
+
+        // Keep the cadence when slightly late, restart it after a stall
+        if (late < _interval_ms) {
+            _next_due += _interval_ms;
+        } else {
+            _next_due = now + _interval_ms;
+        }
+
+        // The frame stays pinned until its last byte has been sent
+        _frame_timestamp = frame.timestamp();
+        _frame_len = converted ? converted->length : frame.length();
+        _last_scene = frame.scene();
+        _send_start = now;
+        _credit -= (int32_t)min(_frame_len, (size_t)INT32_MAX);
+        _writer.begin(std::move(frame), std::move(converted));
+    }
+
+    // Large frames simply span several callbacks
+    size_t written = _writer.write(buf, maxLen);
+    if (written == 0) {
+        Serial.println("Stream frame invalidated, ending stream");
+    } else if (_writer.idle()) {
+        _frames_sent++;
+        unsigned long done = millis();
+        _latency_ms = done - _frame_timestamp;
+        metricObserve(metric_stream_send, done - _send_start);
+    }
+    return written;
+}
+
+void AsyncMjpegResponse::close() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _closed = true;
+    xSemaphoreGive(_lock);
+}
+
+void AsyncMjpegResponse::resume() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (!_closed && _waiting && _request && _request->client()->canSend()) {
+        sendLocked(_request, 0, 0);
+    }
+    xSemaphoreGive(_lock);
+}
+
+void serviceStreamClients() {
+    if (!stream_clients_lock) {
+        return;
+    }
+
+    unsigned long now = millis();
+    uint32_t newest = getFramesPublished();
+    bool camera_down = !camera_initialized || camera_sleeping;
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+        if (client->_waiting && __atomic_load_n(&client->_evicted, __ATOMIC_RELAXED)) {
+            client->resume();  // Ends the response
+            continue;
+        }
+        if (!client->_waiting || (long)(now - client->_next_due) < 0) {
+            continue;
+        }
+        // Only wake clients that have something to send, or a stream to end
+        if (camera_down || newest > client->_writer.lastSeq()) {
+            client->resume();
+        }
+    }
+    xSemaphoreGive(stream_clients_lock);
+}
+
+// Next smaller framesize, skipping the square sensor modes
+static int smallerFramesize(int framesize) {
+    do {
+        framesize--;
+    } while (framesize == FRAMESIZE_240X240 || framesize == FRAMESIZE_96X96);
+    return framesize;
+}
+
+// Computes the settings for an adaptation level. Level 0 is the configured
+// quality/framesize; each level above first raises the quality number,
+// then steps the framesize down. Returns false past the configured bounds.
+static bool adaptationSettings(int level, int* quality, int* framesize) {
+    *quality = g_config.camera.quality;
+    *framesize = g_config.camera.framesize;
+    int max_quality = max(g_config.stream.max_quality, *quality);
+
+    for (int i = 0; i < level; i++) {
+        if (*quality < max_quality) {
+            *quality = min(*quality + ADAPT_QUALITY_STEP, max_quality);
+        } else if (smallerFramesize(*framesize) >= g_config.stream.min_framesize) {
+            *framesize = smallerFramesize(*framesize);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Takes up the queued adaptation step once the camera task has run it
+static void collectAdaptation() {
+    if (!adapt_ticket) {
+        return;
+    }
+    CameraRequestOutcome outcome;
+    CameraRequestState state = cameraRequestState(adapt_ticket, &outcome);
+    if (state == CAMERA_REQUEST_QUEUED || state == CAMERA_REQUEST_RUNNING) {
+        return;
+    }
+    adapt_ticket = 0;
+    if (state != CAMERA_REQUEST_DONE || !outcome.ok) {
+        Serial.printf("Stream adaptation: quality %d framesize %d not applied\n", adapt_quality, adapt_framesize);
+        return;
+    }
+    adaptation.quality = adapt_quality;
+    adaptation.framesize = adapt_framesize;
+}
+
+// Queues an adaptation level as a transient settings update: buffer
+// provisioning and the stale-frame discard apply, the config stays. Sets
+// *quality and *framesize to the level's settings.
+static void applyAdaptationLevel(int level, int* quality, int* framesize) {
+    CameraSettings target = g_config.camera;
+    adaptationSettings(level, &target.quality, &target.framesize);
+    *quality = target.quality;
+    *framesize = target.framesize;
+
+    int current_quality = adapt_ticket ? adapt_quality : adaptation.quality;
+    int current_framesize = adapt_ticket ? adapt_framesize : adaptation.framesize;
+    if (target.quality == current_quality && target.framesize == current_framesize) {
+        return;
+    }
+    if (adapt_ticket) {
+        // Superseded: it still runs, ahead of this one
+        releaseCameraRequest(adapt_ticket);
+    }
+
+    CameraRequest request;
+    memset(&request, 0, sizeof(request));
+    request.type = CAMERA_REQUEST_SETTINGS;
+    request.target = target;
+    request.mask = CAMERA_SETTING_BIT(CAMERA_SETTING_FRAMESIZE) | CAMERA_SETTING_BIT(CAMERA_SETTING_QUALITY);
+    request.persist = false;
+    adapt_ticket = requestCamera(request, true);
+    adapt_quality = target.quality;
+    adapt_framesize = target.framesize;
+    if (!adapt_ticket) {
+        Serial.printf("Stream adaptation: quality %d framesize %d not applied, camera busy\n",
+                      target.quality, target.framesize);
+    }
+}
+
+void updateStreamAdaptation() {
+    if (!stream_clients_lock) {
+        return;
+    }
+
+    unsigned long now = millis();
+    int congested = 0;
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+        unsigned long elapsed = now - client->_sample_time;
+        if (elapsed == 0) {
+            continue;
+        }
+        uint32_t acked = client->_bytes_acked;
+        client->_throughput = (uint32_t)((uint64_t)(acked - client->_sample_acked) * 1000 / elapsed);
+        client->_sample_acked = acked;
+        client->_sample_time = now;
+        client->_fps_measured = (client->_frames_sent - client->_sample_sent) * 1000.0f / elapsed;
+        client->_sample_sent = client->_frames_sent;
+
+        // Congested: losing a quarter of the requested frames, or frames
+        // taking longer than three intervals from capture to the socket
+        uint32_t dropped = client->_frames_dropped - client->_sample_dropped;
+        client->_sample_dropped = client->_frames_dropped;
+        client->_congested = dropped * 4 >= (uint32_t)max(client->_fps, 4) ||
+                             (client->_frames_sent > 0 &&
+                              client->_latency_ms > 3 * client->_interval_ms + 100);
+        if (client->_congested) {
+            congested++;
+        }
+    }
+    xSemaphoreGive(stream_clients_lock);
+
+    adaptation.congested_clients = congested;
+    adaptation.enabled = g_config.stream.adaptive;
+    collectAdaptation();
+
+    if (!camera_initialized || camera_sleeping) {
+        congested_samples = 0;
+        clear_samples = 0;
+        return;
+    }
+
+    int quality, framesize;
+
+    // Memory pressure holds a minimum level, even with adaptation off
+    int memory_floor = memoryAdaptSteps();
+    while (memory_floor > 0 && !adaptationSettings(memory_floor, &quality, &framesize)) {
+        memory_floor--;
+    }
+    if (memory_floor != adaptation.memory_floor) {
+        adaptation.memory_floor = memory_floor;
+        adaptation.last_action = memory_floor ? "memory" : "memory_clear";
+        adaptation.last_change = now;
+        applyAdaptationLevel(max(adaptation.level, memory_floor), &quality, &framesize);
+        Serial.printf("Stream adaptation: memory floor %d (quality %d, framesize %d)\n",
+                      memory_floor, quality, framesize);
+    }
+
+    if (!adaptation.enabled) {
+        congested_samples = 0;
+        clear_samples = 0;
+        return;
+    }
+
+    if (congested > 0) {
+        congested_samples++;
+        clear_samples = 0;
+    } else {
+        clear_samples++;
+        congested_samples = 0;
+    }
+
+    bool can_degrade = adaptationSettings(adaptation.level + 1, &quality, &framesize);
+
+    if (congested_samples >= ADAPT_DEGRADE_SAMPLES && can_degrade) {
+        adaptation.level++;
+        adaptation.last_action = "degrade";
+        adaptation.last_change = now;
+        congested_samples = 0;
+        applyAdaptationLevel(max(adaptation.level, memory_floor), &quality, &framesize);
+        Serial.printf("Stream adaptation: degrade to level %d (quality %d, framesize %d)\n",
+                      adaptation.level, quality, framesize);
+    } else if (clear_samples >= ADAPT_RECOVER_SAMPLES && adaptation.level > 0) {
+        adaptation.level--;
+        adaptation.last_action = "recover";
+        adaptation.last_change = now;
+        clear_samples = 0;
+        applyAdaptationLevel(max(adaptation.level, memory_floor), &quality, &framesize);
+        Serial.printf("Stream adaptation: recover to level %d (quality %d, framesize %d)\n",
+                      adaptation.level, quality, framesize);
+    }
+}
+
+void resetStreamAdaptation() {
+    // Called after the sensor was (re)configured from g_config
+    adaptation.level = 0;
+    adaptation.memory_floor = 0;
+    adaptation.quality = g_config.camera.quality;
+    adaptation.framesize = g_config.camera.framesize;
+    adaptation.last_action = "none";
+    congested_samples = 0;
+    clear_samples = 0;
+}
+
+void getStreamAdaptation(StreamAdaptationState* state) {
+    *state = adaptation;
+    state->enabled = g_config.stream.adaptive;
+}
+
+int getStreamClientStats(StreamClientStats* out, int max_clients) {
+    if (!stream_clients_lock) {
+        return 0;
+    }
+
+    int count = 0;
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    for (AsyncMjpegResponse* client = stream_clients_head; client && count < max_clients;
+         client = client->_next) {
+        StreamClientStats &stats = out[count++];
+        stats.id = client->_id;
+        stats.stream_class = client->_class;
+        stats.remote_ip = client->_remote_ip;
+        stats.fps = client->_fps;
+        stats.fps_measured = client->_fps_measured;
+        stats.frames_sent = client->_frames_sent;
+        stats.frames_dropped = client->_frames_dropped;
+        stats.bytes_sent = client->_bytes_written;
+        stats.throughput = client->_throughput;
+        stats.share = __atomic_load_n(&client->_share, __ATOMIC_RELAXED);
+        stats.backlog = client->backlog();
+        stats.latency_ms = client->_latency_ms;
+        stats.connected_ms = millis() - client->_connected;
+        stats.congested = client->_congested;
+        stats.evicted = __atomic_load_n(&client->_evicted, __ATOMIC_RELAXED);
+        stats.scale = client->_scale;
+        stats.roi = client->_roi;
+        stats.skip_static = client->_skip_static;
+        stats.static_skipped = client->_static_skipped;
+        stats.bytes_saved = client->_bytes_saved;
+    }
+    xSemaphoreGive(stream_clients_lock);
+    return count;
+}
+
+static uint32_t maxEgress() {
+    return (uint32_t)max(g_config.admission.max_kbps, 0) * 1024;
+}
+
+StreamAdmission admitStreamClient(StreamClass stream_class) {
+    if (!stream_clients_lock) {
+        return STREAM_ADMIT;
+    }
+
+    int max_clients = g_config.admission.max_clients;
+    uint32_t max_egress = maxEgress();
+    int active = 0;
+    uint32_t weights = STREAM_CLASS_WEIGHTS[stream_class];
+    uint32_t min_weight = weights;
+    size_t frame_len = 0;
+    AsyncMjpegResponse* victim = nullptr;
+    StreamAdmission result = STREAM_ADMIT;
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+        if (__atomic_load_n(&client->_evicted, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        active++;
+        weights += STREAM_CLASS_WEIGHTS[client->_class];
+        min_weight = min(min_weight, STREAM_CLASS_WEIGHTS[client->_class]);
+        frame_len = max(frame_len, client->_frame_len);
+
+        // Newest first, so the first client of the lowest class is the newest
+        if (client->_class < stream_class && (!victim || client->_class < victim->_class)) {
+            victim = client;
+        }
+    }
+    // Clips take a place and a share but are never evicted
+    for (AsyncClipResponse* clip = clip_clients_head; clip; clip = clip->_next) {
+        active++;
+        weights += STREAM_CLASS_WEIGHTS[clip->_class];
+        min_weight = min(min_weight, STREAM_CLASS_WEIGHTS[clip->_class]);
+        frame_len = max(frame_len, clip->_frame_len);
+    }
+
+    if (max_clients > 0 && active >= max_clients) {
+        result = STREAM_DENY_CLIENTS;
+    } else if (max_egress && (uint64_t)max_egress * min_weight / weights < frame_len) {
+        // The smallest share would no longer carry one frame per second
+        result = STREAM_DENY_BANDWIDTH;
+    }
+
+    if (result != STREAM_ADMIT && victim) {
+        __atomic_store_n(&victim->_evicted, true, __ATOMIC_RELAXED);
+        Serial.printf("Stream session %u (%s) evicted for a new %s client\n", (unsigned)victim->_id,
+                      STREAM_CLASS_NAMES[victim->_class], STREAM_CLASS_NAMES[stream_class]);
+        result = STREAM_ADMIT_EVICT;
+    }
+    xSemaphoreGive(stream_clients_lock);
+
+    if (result == STREAM_ADMIT_EVICT) {
+        metricAdd(metric_stream_evicted);
+    } else if (result != STREAM_ADMIT) {
+        metricAdd(metric_stream_denied);
+    }
+    return result;
+}
+
+void getStreamAdmissionStats(StreamAdmissionStats* stats) {
+    stats->clients = 0;
+    stats->clips = 0;
+    stats->egress = 0;
+    stats->max_clients = g_config.admission.max_clients;
+    stats->max_egress = maxEgress();
+    stats->denied = metricValue(metric_stream_denied);
+    stats->evicted = metricValue(metric_stream_evicted);
+    if (!stream_clients_lock) {
+        return;
+    }
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+        if (!__atomic_load_n(&client->_evicted, __ATOMIC_RELAXED)) {
+            stats->clients++;
+        }
+        stats->egress += client->_throughput;
+    }
+    for (AsyncClipResponse* clip = clip_clients_head; clip; clip = clip->_next) {
+        stats->clients++;
+        stats->clips++;
+    }
+    xSemaphoreGive(stream_clients_lock);
+}
+
+const char* streamClassName(StreamClass stream_class) {
+    return stream_class < STREAM_CLASS_COUNT ? STREAM_CLASS_NAMES[stream_class] : "unknown";
+}
+
+void scheduleStreamEgress() {
+    if (!stream_clients_lock) {
+        return;
+    }
+
+    uint32_t remaining = maxEgress();
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    uint32_t all_weights = 0;
+    for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+        client->_share_fixed = false;
+        all_weights += STREAM_CLASS_WEIGHTS[client->_class];
+        if (!remaining) {
+            __atomic_store_n(&client->_share, 0, __ATOMIC_RELAXED);
+        }
+    }
+
+    // A clip sends as fast as it may, so it is held to its weighted share
+    // of everything and /stream clients split what is left
+    for (AsyncClipResponse* clip = clip_clients_head; clip; clip = clip->_next) {
+        all_weights += STREAM_CLASS_WEIGHTS[clip->_class];
+    }
+    uint32_t total = remaining;
+    for (AsyncClipResponse* clip = clip_clients_head; clip; clip = clip->_next) {
+        uint32_t share = total ? max((uint32_t)((uint64_t)total * STREAM_CLASS_WEIGHTS[clip->_class] / all_weights),
+                                    (uint32_t)1) : 0;
+        __atomic_store_n(&clip->_share, share, __ATOMIC_RELAXED);
+        remaining -= min(share, remaining);
+    }
+
+    // Water-filling: a client whose demand (its fps at its last frame size)
+    // fits its weighted share is given that, with a quarter's headroom for
+    // frame size changes; the rest is split again until nobody fits
+    bool fixed_any = remaining > 0;
+    while (fixed_any) {
+        fixed_any = false;
+        uint32_t weights = 0;
+        for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+            if (!client->_share_fixed) {
+                weights += STREAM_CLASS_WEIGHTS[client->_class];
+            }
+        }
+        if (!weights) {
+            break;
+        }
+
+        uint32_t pool = remaining;
+        for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+            if (client->_share_fixed) {
+                continue;
+            }
+            uint32_t fair = (uint64_t)pool * STREAM_CLASS_WEIGHTS[client->_class] / weights;
+            uint64_t demand = (uint64_t)client->_frame_len * client->_fps;
+            if (client->_frame_len && demand <= fair) {
+                uint32_t share = (uint32_t)min(demand + demand / 4, (uint64_t)fair);
+                __atomic_store_n(&client->_share, share, __ATOMIC_RELAXED);
+                client->_share_fixed = true;
+                remaining -= share;
+                fixed_any = true;
+            }
+        }
+
+        if (!fixed_any) {
+            for (AsyncMjpegResponse* client = stream_clients_head; client; client = client->_next) {
+                if (!client->_share_fixed) {
+                    uint32_t share = (uint64_t)pool * STREAM_CLASS_WEIGHTS[client->_class] / weights;
+                    __atomic_store_n(&client->_share, max(share, (uint32_t)1), __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+    xSemaphoreGive(stream_clients_lock);
+}
+
+AsyncClipResponse::AsyncClipResponse(unsigned long start_time, unsigned long end_time, StreamClass stream_class)
+    : _start_time(start_time), _end_time(end_time), _last_seq(0), _stage(STAGE_IDLE),
+      _offset(0), _header_len(0), _class(stream_class), _frame_len(0), _share(0), _credit(0),
+      _credit_time(millis()), _next(nullptr) {
+    _code = 200;
+    _contentType = MJPEG_CONTENT_TYPE;
+    _contentLength = 0;
+    _sendContentLength = false;
+    _chunked = false;
+    _header[0] = '\0';
+
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    _next = clip_clients_head;
+    clip_clients_head = this;
+    xSemaphoreGive(stream_clients_lock);
+    // Held to a share from the start, not only after the next schedule
+    scheduleStreamEgress();
+}
+
+AsyncClipResponse::~AsyncClipResponse() {
+    xSemaphoreTake(stream_clients_lock, portMAX_DELAY);
+    AsyncClipResponse** link = &clip_clients_head;
+    while (*link && *link != this) {
+        link = &(*link)->_next;
+    }
+    if (*link) {
+        *link = _next;
+    }
+    xSemaphoreGive(stream_clients_lock);
+}
+
+size_t AsyncClipResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t pos = 0;
+
+    while (pos < maxLen) {
+        if (_stage == STAGE_IDLE) {
+            // Out of share: ACKs and poll ticks call back in
+            if (!refillCredit(&_credit, &_credit_time, __atomic_load_n(&_share, __ATOMIC_RELAXED), millis())) {
+                return pos ? pos : RESPONSE_TRY_AGAIN;
+            }
+            if (!findRingFrame(_last_seq, _start_time, &_frame)) {
+                if ((long)(millis() - _end_time) > 0 || !camera_initialized || camera_sleeping) {
+                    break;  // Nothing more will arrive - end after this buffer
+                }
+                // Live part of the clip: wait for the camera task
+                return pos ? pos : RESPONSE_TRY_AGAIN;
+            }
+            if ((long)(_frame.timestamp - _end_time) > 0) {
+                break;  // Past the requested window
+            }
+            _header_len = formatPartHeader(_header, sizeof(_header), _frame.len, -1);
+            _frame_len = _frame.len;
+            _credit -= (int32_t)min(_frame.len, (size_t)INT32_MAX);
+            _stage = STAGE_HEADER;
+            _offset = 0;
+        }
+
+        size_t space = maxLen - pos;
+        size_t n;
+
+        switch (_stage) {
+            case STAGE_HEADER:
+                n = min(space, _header_len - _offset);
+                memcpy(buf + pos, _header + _offset, n);
+                break;
+
+            case STAGE_BODY:
+                n = copyRingFrame(_frame.seq, _offset, buf + pos, min(space, _frame.len - _offset));
+                if (n == 0) {
+                    // Overwritten by newer frames before we got it out
+                    Serial.println("Clip frame evicted from ring, ending clip");
+                    return 0;
+                }
+                break;
+
+            case STAGE_TRAILER:
+            default:
+                n = min(space, MJPEG_TRAILER_LEN - _offset);
+                memcpy(buf + pos, MJPEG_TRAILER + _offset, n);
+                break;
+        }
+
+        pos += n;
+        _offset += n;
+
+        if (_stage == STAGE_HEADER && _offset == _header_len) {
+            _stage = STAGE_BODY;
+            _offset = 0;
+        } else if (_stage == STAGE_BODY && _offset == _frame.len) {
+            _stage = STAGE_TRAILER;
+            _offset = 0;
+        } else if (_stage == STAGE_TRAILER && _offset == MJPEG_TRAILER_LEN) {
+            _last_seq = _frame.seq;
+            _stage = STAGE_IDLE;
+        }
+    }
+
+    return pos;
+}
+
+AsyncBurstResponse::AsyncBurstResponse()
+    : _index(0), _summary_sent(false), _closed(false), _body(nullptr), _body_len(0),
+      _header_len(0), _offset(MJPEG_TRAILER_LEN) {  // No part in progress yet
+    _code = 200;
+    _contentType = "multipart/mixed; boundary=" STREAM_BOUNDARY;
+    _contentLength = 0;
+    _sendContentLength = false;
+    _chunked = false;
+    _header[0] = '\0';
+    _summary[0] = '\0';
+}
+
+AsyncBurstResponse::~AsyncBurstResponse() {
+    releaseBurst();
+}
+
+// Sets up the next part: a captured frame, the summary once the burst is
+// complete, or the closing boundary. Returns false if the next frame has
+// not been captured yet.
+bool AsyncBurstResponse::nextPart() {
+    BurstFrameInfo frame;
+
+    if (getBurstFrame(_index, &frame)) {
+        int n = snprintf(_header, sizeof(_header),
+                         "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                         "X-Frame-Index: %d\r\nX-Timestamp-Us: %lu\r\n\r\n",
+                         (unsigned)frame.len, _index, frame.timestamp_us);
+        _header_len = n > 0 ? (size_t)n : 0;
+        _body = frame.data;
+        _body_len = frame.len;
+        _index++;
+        return true;
+    }
+
+    if (!burstComplete()) {
+        return false;
+    }
+
+    if (!_summary_sent) {
+        BurstSummary summary;
+        getBurstSummary(&summary);
+        int len = snprintf(_summary, sizeof(_summary),
+                           "{\"requested\":%d,\"captured\":%d,\"interval_ms\":%u,"
+                           "\"achieved_interval_ms\":%.2f,\"min_interval_ms\":%.2f,"
+                           "\"max_interval_ms\":%.2f,\"truncated\":%s}",
+                           summary.requested, summary.captured, (unsigned)summary.interval_ms,
+                           summary.mean_interval_us / 1000.0, summary.min_interval_us / 1000.0,
+                           summary.max_interval_us / 1000.0, summary.truncated ? "true" : "false");
+        _body = (const uint8_t*)_summary;
+        _body_len = len > 0 ? min((size_t)len, sizeof(_summary) - 1) : 0;
+        int n = snprintf(_header, sizeof(_header),
+                         "--" STREAM_BOUNDARY "\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n",
+                         (unsigned)_body_len);
+        _header_len = n > 0 ? (size_t)n : 0;
+        _summary_sent = true;
+        return true;
+    }
+
+    // Closing delimiter; the trailing CRLF below completes it
+    _header_len = snprintf(_header, sizeof(_header), "--" STREAM_BOUNDARY "--");
+    _body = nullptr;
+    _body_len = 0;
+    _closed = true;
+    return true;
+}
+
+size_t AsyncBurstResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    size_t pos = 0;
+    size_t part_len = _header_len + _body_len + MJPEG_TRAILER_LEN;
+
+    while (pos < maxLen) {
+        if (_offset == part_len) {
+            if (_closed) {
+                break;  // Everything sent - returning 0 next ends the response
+            }
+            if (!nextPart()) {
+                // Capture is still running; ACKs and polls call back in
+                return pos ? pos : RESPONSE_TRY_AGAIN;
+            }
+            part_len = _header_len + _body_len + MJPEG_TRAILER_LEN;
+            _offset = 0;
+        }
+
+        size_t n;
+        if (_offset < _header_len) {
+            n = min(maxLen - pos, _header_len - _offset);
+            memcpy(buf + pos, _header + _offset, n);
+        } else if (_offset < _header_len + _body_len) {
+            size_t body_offset = _offset - _header_len;
+            n = min(maxLen - pos, _body_len - body_offset);
+            memcpy(buf + pos, _body + body_offset, n);
+        } else {
+            size_t trailer_offset = _offset - _header_len - _body_len;
+            n = min(maxLen - pos, MJPEG_TRAILER_LEN - trailer_offset);
+            memcpy(buf + pos, MJPEG_TRAILER + trailer_offset, n);
+        }
+        pos += n;
+        _offset += n;
+    }
+
+    return pos;
+}
@@ -0,0 +1,292 @@
+#include "motion_detect.h"
+#include "jpeg_dc.h"
+#include "app.h"
+#include "metrics.h"
+#include "trace.h"
+#include "esp_heap_caps.h"
+
+// Camera task only
+static uint8_t* luma = nullptr;          // Block means of the frame being analysed
+static uint16_t* background = nullptr;   // Block means, 8.8 fixed point
+static uint8_t* changed = nullptr;       // Over the threshold, before the neighbour test
+static uint8_t* mask_work = nullptr;
+static size_t capacity = 0;              // Blocks the buffers hold
+static int warmup = 0;
+static int over_trigger = 0;             // Consecutive analysed frames over the trigger
+static int countdown = 0;                // Frames to skip before the next analysis
+static unsigned long motion_started = 0;
+static unsigned long last_motion = 0;
+static bool reset_requested = false;
+
+// Published results, under motion_lock
+static SemaphoreHandle_t motion_lock = nullptr;
+static MotionStats motion = { false, false, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, "none" };
+static uint8_t* mask = nullptr;
+static size_t mask_len = 0;
+
+void initMotionDetect() {
+    if (!motion_lock) {
+        motion_lock = xSemaphoreCreateMutex();
+    }
+}
+
+static void lockStats() {
+    xSemaphoreTake(motion_lock, portMAX_DELAY);
+}
+
+static void unlockStats() {
+    xSemaphoreGive(motion_lock);
+}
+
+static void postMotionEvent(EventType type, int data) {
+    Event event = { type, data, nullptr };
+    xQueueSend(eventQueue, &event, 0);
+}
+
+static void freeBuffers() {
+    heap_caps_free(luma);
+    heap_caps_free(background);
+    heap_caps_free(changed);
+    heap_caps_free(mask_work);
+    luma = changed = mask_work = nullptr;
+    background = nullptr;
+    capacity = 0;
+}
+
+// Sized for the frame's block grid
+static bool ensureBuffers(size_t blocks) {
+    if (!cameraDcDecoder()) {
+        return false;
+    }
+    if (blocks <= capacity) {
+        return true;
+    }
+
+    freeBuffers();
+    uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+    luma = (uint8_t*)heap_caps_malloc(blocks, caps);
+    background = (uint16_t*)heap_caps_malloc(blocks * sizeof(uint16_t), caps);
+    changed = (uint8_t*)heap_caps_malloc(blocks, caps);
+    mask_work = (uint8_t*)heap_caps_malloc((blocks + 7) / 8, caps);
+    uint8_t* published = (uint8_t*)heap_caps_malloc((blocks + 7) / 8, caps);
+    if (!luma || !background || !changed || !mask_work || !published) {
+        heap_caps_free(published);
+        freeBuffers();
+        return false;
+    }
+    capacity = blocks;
+
+    lockStats();
+    heap_caps_free(mask);
+    mask = published;
+    mask_len = 0;
+    motion.blocks_x = motion.blocks_y = 0;
+    unlockStats();
+    return true;
+}
+
+void resetMotionModel() {
+    __atomic_store_n(&reset_requested, true, __ATOMIC_RELAXED);
+}
+
+// Ends a running event, e.g. when detection is switched off
+static void endMotion(unsigned long now) {
+    lockStats();
+    bool was_active = motion.active;
+    motion.active = false;
+    unlockStats();
+    if (was_active) {
+        postMotionEvent(EVENT_MOTION_ENDED, now - motion_started);
+    }
+}
+
+static void recordFailure(JpegDcResult result, int stride) {
+    lockStats();
+    if (result == JPEG_DC_TIMEOUT) {
+        motion.timeouts++;
+    } else {
+        motion.errors++;
+    }
+    motion.last_error = jpegDcResultName(result);
+    motion.stride = stride;
+    unlockStats();
+}
+
+int analyzeMotionFrame(const camera_fb_t* fb) {
+    const MotionSettings& settings = g_config.motion;
+    if (!settings.enabled || !motion_lock) {
+        if (motion.enabled) {
+            endMotion(millis());
+            lockStats();
+            motion.enabled = false;
+            unlockStats();
+            resetMotionModel();
+        }
+        return -1;
+    }
+    if (!motion.enabled) {
+        lockStats();
+        motion.enabled = true;
+        unlockStats();
+    }
+    if (!fb || fb->format != PIXFORMAT_JPEG) {
+        return -1;
+    }
+    if (countdown > 0) {
+        countdown--;
+        lockStats();
+        motion.skipped++;
+        unlockStats();
+        return -1;
+    }
+
+    TRACE_SCOPE("analyzeMotion");
+    uint32_t started = micros();
+    uint32_t budget = max(settings.budget_us, 500);
+
+    // Upper bound of the grid: MCUs are at most 16x16
+    size_t blocks = (size_t)((fb->width + 15) / 16 * 2) * ((fb->height + 15) / 16 * 2);
+    if (blocks > MOTION_MAX_BLOCKS || !ensureBuffers(blocks)) {
+        countdown = MOTION_MAX_STRIDE - 1;
+        recordFailure(blocks > MOTION_MAX_BLOCKS ? JPEG_DC_TOO_LARGE : JPEG_DC_NO_MEMORY, MOTION_MAX_STRIDE);
+        return -1;
+    }
+
+    // A frame that would need more than MOTION_MAX_STRIDE is not worth finishing
+    uint32_t deadline = started + budget * MOTION_MAX_STRIDE;
+    JpegDcImage image = { 0, 0, 0, 0, luma, capacity };
+    JpegDcResult result = jpegDecodeDC(cameraDcDecoder(), fb->buf, fb->len, &image, deadline ? deadline : 1);
+    if (result != JPEG_DC_OK) {
+        int stride = result == JPEG_DC_TIMEOUT ? MOTION_MAX_STRIDE : 1;
+        countdown = stride - 1;
+        recordFailure(result, stride);
+        return -1;
+    }
+
+    int bx = image.blocks_x;
+    int by = image.blocks_y;
+    int n = bx * by;
+    if (__atomic_exchange_n(&reset_requested, false, __ATOMIC_RELAXED) ||
+        bx != motion.blocks_x || by != motion.blocks_y) {
+        for (int i = 0; i < n; i++) {
+            background[i] = luma[i] << 8;
+        }
+        warmup = MOTION_WARMUP_FRAMES;
+        over_trigger = 0;
+    }
+
+    // Global brightness shift (exposure, gain) is not motion
+    int32_t shift_sum = 0;
+    for (int i = 0; i < n; i++) {
+        shift_sum += luma[i] - (background[i] >> 8);
+    }
+    int shift = shift_sum / n;
+
+    int threshold = settings.threshold;
+    for (int i = 0; i < n; i++) {
+        int diff = luma[i] - (background[i] >> 8) - shift;
+        changed[i] = diff > threshold || diff < -threshold;
+    }
+
+    // Keep changed blocks with a changed 4-neighbour
+    int count = 0;
+    memset(mask_work, 0, (n + 7) / 8);
+    for (int y = 0, i = 0; y < by; y++) {
+        for (int x = 0; x < bx; x++, i++) {
+            if (!changed[i]) {
+                continue;
+            }
+            if ((x > 0 && changed[i - 1]) || (x + 1 < bx && changed[i + 1]) ||
+                (y > 0 && changed[i - bx]) || (y + 1 < by && changed[i + bx])) {
+                mask_work[i >> 3] |= 0x80 >> (i & 7);
+                count++;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        int32_t target = luma[i] << 8;
+        int rate = changed[i] ? MOTION_LEARN_SHIFT_CHANGED : MOTION_LEARN_SHIFT;
+        background[i] += (target - background[i]) >> rate;
+    }
+
+    uint32_t elapsed = micros() - started;
+    int stride = constrain((int)((elapsed + budget - 1) / budget), 1, MOTION_MAX_STRIDE);
+    countdown = stride - 1;
+    metricObserve(metric_motion_analysis, elapsed);
+
+    int score = warmup > 0 ? -1 : count * 1000 / n;
+    if (warmup > 0) {
+        warmup--;
+    }
+
+    // Event edges
+    unsigned long now = millis();
+    bool over = score >= 0 && score >= settings.trigger_permille;
+    over_trigger = over ? over_trigger + 1 : 0;
+    bool started_event = false, ended_event = false;
+    if (!motion.active && over_trigger >= MOTION_TRIGGER_FRAMES) {
+        started_event = true;
+        motion_started = last_motion = now;
+    } else if (motion.active) {
+        if (over) {
+            last_motion = now;
+        } else if (now - last_motion >= (unsigned long)settings.hold_ms) {
+            ended_event = true;
+        }
+    }
+
+    lockStats();
+    motion.score = score;
+    motion.blocks_changed = count;
+    motion.blocks_x = bx;
+    motion.blocks_y = by;
+    motion.analyzed++;
+    motion.last_us = elapsed;
+    motion.stride = stride;
+    memcpy(mask, mask_work, (n + 7) / 8);
+    mask_len = (n + 7) / 8;
+    if (started_event) {
+        motion.active = true;
+        motion.events++;
+        motion.last_event = now;
+    } else if (ended_event) {
+        motion.active = false;
+    }
+    unlockStats();
+
+    if (started_event) {
+        metricAdd(metric_motion_events);
+        postMotionEvent(EVENT_MOTION_DETECTED, score);
+    } else if (ended_event) {
+        postMotionEvent(EVENT_MOTION_ENDED, now - motion_started);
+    }
+    return score;
+}
+
+void getMotionStats(MotionStats* stats) {
+    if (!motion_lock) {
+        *stats = motion;
+        return;
+    }
+    lockStats();
+    *stats = motion;
+    unlockStats();
+}
+
+size_t getMotionMask(uint8_t* out, size_t size, int* blocks_x, int* blocks_y) {
+    if (!motion_lock) {
+        return 0;
+    }
+    lockStats();
+    size_t len = mask_len;
+    if (len && len <= size) {
+        memcpy(out, mask, len);
+        *blocks_x = motion.blocks_x;
+        *blocks_y = motion.blocks_y;
+    } else {
+        len = 0;
+    }
+    unlockStats();
+    return len;
+}
@@ -0,0 +1,147 @@
+#include "roi_view.h"
+#include <new>
+#include "esp_heap_caps.h"
+
+// Held across transforms, so a second viewer of the same region waits for
+// the first transform and then hits the cache
+static SemaphoreHandle_t roi_lock = nullptr;
+static RoiViewRef cached[ROI_CACHE_ENTRIES];
+static RoiStats stats;
+
+void initRoiViews() {
+    if (!roi_lock) {
+        roi_lock = xSemaphoreCreateMutex();
+    }
+    stats.last_error = "none";
+}
+
+bool roiActive(const RoiSpec& spec) {
+    return spec.width > 0 || spec.rotate != 0;
+}
+
+static bool sameSpec(const RoiSpec& a, const RoiSpec& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height && a.rotate == b.rotate;
+}
+
+static JpegRotation rotation(int degrees) {
+    return degrees == 90 ? JPEG_ROTATE_90 : degrees == 180 ? JPEG_ROTATE_180 :
+           degrees == 270 ? JPEG_ROTATE_270 : JPEG_ROTATE_NONE;
+}
+
+RoiView* createRoiView(const uint8_t* jpeg, size_t len, const RoiSpec& spec, JpegDcResult* result) {
+    JpegRect region = { spec.x, spec.y, spec.width, spec.height };
+    JpegRect applied;
+    uint8_t* out = nullptr;
+    size_t out_len = 0;
+    *result = jpegTransform(jpeg, len, region, rotation(spec.rotate), &out, &out_len, &applied);
+    if (*result != JPEG_DC_OK) {
+        return nullptr;
+    }
+    RoiView* view = new (std::nothrow) RoiView();
+    if (!view) {
+        heap_caps_free(out);
+        *result = JPEG_DC_NO_MEMORY;
+        return nullptr;
+    }
+    bool transpose = spec.rotate == 90 || spec.rotate == 270;
+    view->data = out;
+    view->length = out_len;
+    view->spec = spec;
+    view->applied = applied;
+    view->width = transpose ? applied.height : applied.width;
+    view->height = transpose ? applied.width : applied.height;
+    return view;
+}
+
+// Slot for a new view of spec: the one holding spec, else an empty one,
+// else the one with the oldest frame
+static int cacheSlot(const RoiSpec& spec) {
+    int oldest = 0;
+    for (int i = 0; i < ROI_CACHE_ENTRIES; i++) {
+        if (!cached[i] || sameSpec(cached[i]->spec, spec)) {
+            return i;
+        }
+        if ((int32_t)(cached[i]->seq - cached[oldest]->seq) < 0) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+// Caller holds roi_lock
+static void countServed(const RoiView& view, size_t source_length) {
+    stats.served++;
+    if (source_length > view.length) {
+        stats.bytes_saved += source_length - view.length;
+    }
+}
+
+RoiViewRef getRoiView(const FrameRef& frame, const RoiSpec& spec, JpegDcResult* result) {
+    if (!roi_lock) {
+        *result = JPEG_DC_UNSUPPORTED;
+        return RoiViewRef();
+    }
+    xSemaphoreTake(roi_lock, portMAX_DELAY);
+    for (int i = 0; i < ROI_CACHE_ENTRIES; i++) {
+        if (cached[i] && cached[i]->seq == frame.seq() && sameSpec(cached[i]->spec, spec)) {
+            RoiViewRef hit = cached[i];
+            stats.cache_hits++;
+            countServed(*hit, frame.length());
+            xSemaphoreGive(roi_lock);
+            *result = JPEG_DC_OK;
+            return hit;
+        }
+    }
+
+    RoiView* view = nullptr;
+    uint32_t started = micros();
+    {
+        // The driver cannot be torn down mid-transform
+        FrameReadGuard guard(frame);
+        if (!guard.ok()) {
+            *result = JPEG_DC_CORRUPT;
+        } else {
+            view = createRoiView(frame.data(), frame.length(), spec, result);
+        }
+    }
+    uint32_t elapsed = micros() - started;
+
+    RoiViewRef ref;
+    if (view) {
+        view->seq = frame.seq();
+        view->timestamp = frame.timestamp();
+        ref = RoiViewRef(view);
+        // Only move forward: a slow viewer must not evict a newer frame
+        int slot = cacheSlot(spec);
+        if (!cached[slot] || !sameSpec(cached[slot]->spec, spec) ||
+            (int32_t)(frame.seq() - cached[slot]->seq) > 0) {
+            cached[slot] = ref;
+        }
+        stats.transforms++;
+        stats.last_us = elapsed;
+        stats.max_us = max(stats.max_us, elapsed);
+        stats.total_us += elapsed;
+        stats.last_bytes = view->length;
+        stats.source_bytes = frame.length();
+        countServed(*view, frame.length());
+    } else {
+        stats.failures++;
+        stats.last_error = jpegDcResultName(*result);
+    }
+    xSemaphoreGive(roi_lock);
+    if (!view) {
+        Serial.printf("ROI %d,%d,%dx%d rotate %d of frame %u failed: %s\n", spec.x, spec.y, spec.width,
+                      spec.height, spec.rotate, (unsigned)frame.seq(), jpegDcResultName(*result));
+    }
+    return ref;
+}
+
+void getRoiStats(RoiStats* out) {
+    if (!roi_lock) {
+        *out = stats;
+        return;
+    }
+    xSemaphoreTake(roi_lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(roi_lock);
+}
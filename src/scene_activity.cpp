@@ -0,0 +1,241 @@
+#include "scene_activity.h"
+#include "config.h"
+#include "jpeg_dc.h"
+#include "trace.h"
+#include "esp_heap_caps.h"
+
+#define SIGNATURE_CELLS (ACTIVITY_SIGNATURE_W * ACTIVITY_SIGNATURE_H)
+#define MAX_BLOCKS ((1600 / 8) * (1200 / 8))  // UXGA
+
+// Camera task only
+static uint8_t* luma = nullptr;          // Block means of the frame being classified
+static size_t capacity = 0;
+static uint32_t cell_sum[SIGNATURE_CELLS];
+static uint16_t cell_count[SIGNATURE_CELLS];
+static uint8_t signature[SIGNATURE_CELLS];
+static uint8_t reference[SIGNATURE_CELLS];
+static bool reference_valid = false;
+static size_t reference_len = 0;         // JPEG size of the reference frame
+static int reference_bx = 0;
+static int reference_by = 0;
+static uint32_t scene = 0;
+static unsigned long static_since = 0;   // millis() of the last changed frame
+static unsigned long mode_since = 0;
+static unsigned long last_frame = 0;
+static uint32_t average_len = 0;         // Frame size EMA, 1/8 weight
+static uint32_t avoided_milli = 0;       // Fractions of avoided frames and KB
+static uint32_t avoided_bytes = 0;
+
+// Written by the camera task, copied without a lock like camera.cpp's stats
+static ActivityStats activity = { false, false, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static bool ensureLuma(size_t blocks) {
+    if (!cameraDcDecoder()) {
+        return false;
+    }
+    if (blocks <= capacity) {
+        return true;
+    }
+    heap_caps_free(luma);
+    uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+    luma = (uint8_t*)heap_caps_malloc(blocks, caps);
+    capacity = luma ? blocks : 0;
+    return luma != nullptr;
+}
+
+// Decodes fb's block means and averages them into the signature grid.
+// False when the frame could not be read in time.
+static bool computeSignature(const camera_fb_t* fb, int* blocks_x, int* blocks_y) {
+    TRACE_SCOPE("activitySignature");
+    size_t blocks = (size_t)((fb->width + 15) / 16 * 2) * ((fb->height + 15) / 16 * 2);
+    if (blocks > MAX_BLOCKS || !ensureLuma(blocks)) {
+        return false;
+    }
+
+    uint32_t deadline = micros() + ACTIVITY_DECODE_DEADLINE_US;
+    JpegDcImage image = { 0, 0, 0, 0, luma, capacity };
+    if (jpegDecodeDC(cameraDcDecoder(), fb->buf, fb->len, &image, deadline ? deadline : 1) != JPEG_DC_OK) {
+        return false;
+    }
+
+    int bx = image.blocks_x;
+    int by = image.blocks_y;
+    memset(cell_sum, 0, sizeof(cell_sum));
+    memset(cell_count, 0, sizeof(cell_count));
+    for (int y = 0; y < by; y++) {
+        const uint8_t* row = luma + y * bx;
+        int cell_row = y * ACTIVITY_SIGNATURE_H / by * ACTIVITY_SIGNATURE_W;
+        for (int x = 0; x < bx; x++) {
+            int cell = cell_row + x * ACTIVITY_SIGNATURE_W / bx;
+            cell_sum[cell] += row[x];
+            cell_count[cell]++;
+        }
+    }
+    // Grids smaller than the signature leave cells empty; they stay 0 in both
+    for (int i = 0; i < SIGNATURE_CELLS; i++) {
+        signature[i] = cell_count[i] ? (cell_sum[i] + cell_count[i] / 2) / cell_count[i] : 0;
+    }
+    *blocks_x = bx;
+    *blocks_y = by;
+    return true;
+}
+
+// Largest cell change against the reference, after removing the mean
+// change (exposure and gain steps)
+static int signatureDistance() {
+    int32_t shift_sum = 0;
+    for (int i = 0; i < SIGNATURE_CELLS; i++) {
+        shift_sum += signature[i] - reference[i];
+    }
+    int shift = shift_sum / SIGNATURE_CELLS;
+
+    int distance = 0;
+    for (int i = 0; i < SIGNATURE_CELLS; i++) {
+        int diff = abs(signature[i] - reference[i] - shift);
+        distance = max(distance, diff);
+    }
+    return distance;
+}
+
+static bool frameChanged(const camera_fb_t* fb, const ActivitySettings& settings) {
+    if (fb->format != PIXFORMAT_JPEG) {
+        return true;
+    }
+
+    // Size first: most changes show up in the entropy-coded length
+    if (reference_valid) {
+        size_t diff = fb->len > reference_len ? fb->len - reference_len : reference_len - fb->len;
+        if (diff * 100 > (size_t)max(settings.size_percent, 0) * reference_len) {
+            reference_valid = false;  // The next frame becomes the reference
+            return true;
+        }
+    }
+
+    int bx, by;
+    activity.signatures++;
+    if (!computeSignature(fb, &bx, &by)) {
+        activity.signature_failures++;
+        reference_valid = false;
+        return true;
+    }
+
+    bool changed = !reference_valid || bx != reference_bx || by != reference_by ||
+                   signatureDistance() > settings.threshold;
+    if (changed) {
+        memcpy(reference, signature, sizeof(reference));
+        reference_valid = true;
+        reference_len = fb->len;
+        reference_bx = bx;
+        reference_by = by;
+    }
+    return changed;
+}
+
+// Books the time since the last mode change to the current mode
+static void accrueModeTime(unsigned long now) {
+    uint32_t elapsed = now - mode_since;
+    if (activity.idle) {
+        activity.idle_ms += elapsed;
+    } else {
+        activity.active_ms += elapsed;
+    }
+    mode_since = now;
+}
+
+static void setIdle(bool idle, unsigned long now) {
+    if (activity.idle != idle) {
+        accrueModeTime(now);
+        activity.idle = idle;
+    }
+}
+
+// Captures the configured rate would have taken since the last idle frame,
+// and their bytes at the average frame size. Gaps longer than two idle
+// intervals (standby, a burst) count as two.
+static void countAvoidedFrames(unsigned long now) {
+    int full_fps = constrain(g_config.stream.capture_fps, 1, STREAM_MAX_FPS);
+    uint32_t interval = min(now - last_frame, 2000UL / activityCaptureFps());
+    uint32_t expected = interval * full_fps;  // Milli-frames
+    if (expected <= 1000) {
+        return;
+    }
+    avoided_milli += expected - 1000;
+    uint32_t frames = avoided_milli / 1000;
+    avoided_milli %= 1000;
+    activity.frames_avoided += frames;
+
+    avoided_bytes += frames * average_len;
+    activity.kb_avoided += avoided_bytes / 1024;
+    avoided_bytes %= 1024;
+}
+
+uint32_t updateSceneActivity(const camera_fb_t* fb) {
+    const ActivitySettings& settings = g_config.activity;
+    unsigned long now = millis();
+
+    if (!settings.enabled) {
+        if (activity.enabled) {
+            accrueModeTime(now);
+            activity.idle = false;
+            activity.enabled = false;
+            reference_valid = false;
+        }
+        activity.capture_fps = activityCaptureFps();
+        return ++scene;
+    }
+    if (!activity.enabled) {
+        activity.enabled = true;
+        mode_since = static_since = last_frame = now;
+    }
+    if (!fb) {
+        return scene;
+    }
+
+    if (activity.idle) {
+        countAvoidedFrames(now);
+    }
+    last_frame = now;
+    average_len = average_len ? average_len + ((int32_t)fb->len - (int32_t)average_len) / 8 : fb->len;
+
+    if (frameChanged(fb, settings)) {
+        scene++;
+        activity.frames_changed++;
+        activity.last_change = static_since = now;
+        if (activity.idle) {
+            // The next capture is already back on the configured rate
+            setIdle(false, now);
+            activity.wakes++;
+        }
+    } else {
+        activity.frames_static++;
+        if (!activity.idle && now - static_since >= (unsigned long)max(settings.idle_after_ms, 0)) {
+            setIdle(true, now);
+            activity.idle_entries++;
+        }
+    }
+    activity.capture_fps = activityCaptureFps();
+    return scene;
+}
+
+int activityCaptureFps() {
+    int fps = constrain(g_config.stream.capture_fps, 1, STREAM_MAX_FPS);
+    if (activity.idle && g_config.activity.enabled) {
+        fps = constrain(g_config.activity.idle_fps, 1, fps);
+    }
+    return fps;
+}
+
+void getSceneActivityStats(ActivityStats* stats) {
+    *stats = activity;
+    if (stats->enabled) {
+        uint32_t elapsed = millis() - mode_since;
+        if (stats->idle) {
+            stats->idle_ms += elapsed;
+        } else {
+            stats->active_ms += elapsed;
+        }
+    }
+    if (!stats->capture_fps) {
+        stats->capture_fps = activityCaptureFps();
+    }
+}
@@ -0,0 +1,221 @@
+#include "task_stats.h"
+#include "config.h"
+#include "freertos/semphr.h"
+
+#ifndef ARDUINO_LOOP_STACK_SIZE
+#define ARDUINO_LOOP_STACK_SIZE 8192   // Arduino core default
+#endif
+
+static SemaphoreHandle_t task_stats_lock = NULL;
+static TaskStatsSnapshot task_stats;      // Latest sample, guarded by task_stats_lock
+static bool task_stats_valid = false;
+
+#if configUSE_TRACE_FACILITY
+
+struct KnownStack {
+    const char* name;
+    uint32_t size;
+};
+
+// FreeRTOS records how much of a stack was never touched, not how big it
+// is, so sizes come from where the tasks are created
+static const KnownStack KNOWN_STACKS[] = {
+    { "CameraTask", CAMERA_TASK_STACK },
+    { "WebServerTask", WEB_TASK_STACK },
+    { "WatchdogTask", WATCHDOG_TASK_STACK },
+    { "SDCardTask", SD_TASK_STACK },
+    { "ConvertTask", CONVERT_TASK_STACK },
+    { "async_tcp", ASYNC_TCP_TASK_STACK },
+    { "loopTask", ARDUINO_LOOP_STACK_SIZE }
+};
+
+// Watchdog-task only
+static TaskStatus_t task_status[TASK_STATS_MAX_TASKS];
+static TaskHandle_t prev_handles[TASK_STATS_MAX_TASKS];
+static uint32_t prev_runtime[TASK_STATS_MAX_TASKS];
+static bool prev_near_overflow[TASK_STATS_MAX_TASKS];
+static int prev_count = 0;
+static uint32_t prev_total = 0;
+static unsigned long prev_sample_ms = 0;
+
+static uint32_t knownStackSize(const char* name) {
+    for (size_t i = 0; i < sizeof(KNOWN_STACKS) / sizeof(KNOWN_STACKS[0]); i++) {
+        if (strcmp(name, KNOWN_STACKS[i].name) == 0) {
+            return KNOWN_STACKS[i].size;
+        }
+    }
+    return 0;
+}
+
+static int findPrevious(TaskHandle_t handle) {
+    for (int i = 0; i < prev_count; i++) {
+        if (prev_handles[i] == handle) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void classifyStack(TaskStat& stat) {
+    if (stat.stack_free_min < TASK_STACK_MIN_FREE) {
+        stat.flag = STACK_NEAR_OVERFLOW;
+    } else if (!stat.stack_size) {
+        stat.flag = STACK_SIZE_UNKNOWN;
+    } else {
+        stat.flag = STACK_OK;
+    }
+    if (!stat.stack_size) {
+        stat.stack_recommended = 0;
+        return;
+    }
+
+    uint32_t used = stat.stack_size > stat.stack_free_min ? stat.stack_size - stat.stack_free_min : 0;
+    uint32_t headroom = max((uint32_t)TASK_STACK_HEADROOM, used / 4);
+    stat.stack_recommended = (used + headroom + TASK_STACK_ROUNDING - 1) / TASK_STACK_ROUNDING * TASK_STACK_ROUNDING;
+
+    // Worth shrinking only if it gives back at least one more rounding step
+    if (stat.flag == STACK_OK && stat.stack_recommended + TASK_STACK_ROUNDING < stat.stack_size) {
+        stat.flag = STACK_OVER_PROVISIONED;
+    }
+}
+
+void sampleTaskStats() {
+    if (!task_stats_lock) {
+        task_stats_lock = xSemaphoreCreateMutex();
+        if (!task_stats_lock) {
+            return;
+        }
+    }
+
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(task_status, TASK_STATS_MAX_TASKS, &total);
+    if (!count) {
+        // FreeRTOS fills nothing if the array cannot hold every task
+        Serial.printf("Task stats: %u tasks, only %d tracked\n",
+                      (unsigned)uxTaskGetNumberOfTasks(), TASK_STATS_MAX_TASKS);
+        return;
+    }
+    unsigned long now = millis();
+    uint32_t elapsed = total - prev_total;
+    bool have_interval = prev_count > 0 && elapsed > 0;
+#if configGENERATE_RUN_TIME_STATS
+    bool runtime_stats = true;
+#else
+    bool runtime_stats = false;
+#endif
+
+    xSemaphoreTake(task_stats_lock, portMAX_DELAY);
+    task_stats.interval_ms = have_interval ? now - prev_sample_ms : 0;
+    task_stats.runtime_stats = runtime_stats;
+    task_stats.task_count = count;
+
+    bool near_overflow[TASK_STATS_MAX_TASKS];
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& status = task_status[i];
+        TaskStat& stat = task_stats.tasks[i];
+        strncpy(stat.name, status.pcTaskName, sizeof(stat.name) - 1);
+        stat.name[sizeof(stat.name) - 1] = '\0';
+        stat.state = status.eCurrentState;
+        stat.priority = status.uxCurrentPriority;
+        BaseType_t affinity = xTaskGetAffinity(status.xHandle);
+        stat.core = affinity == tskNO_AFFINITY ? -1 : affinity;
+        stat.stack_size = knownStackSize(stat.name);
+        stat.stack_free_min = status.usStackHighWaterMark;
+        classifyStack(stat);
+
+        stat.cpu_percent = -1;
+        int prev = findPrevious(status.xHandle);
+        if (runtime_stats && have_interval && prev >= 0) {
+            stat.cpu_percent = 100.0f * (uint32_t)(status.ulRunTimeCounter - prev_runtime[prev]) / elapsed;
+        }
+
+        near_overflow[i] = stat.flag == STACK_NEAR_OVERFLOW;
+        if (near_overflow[i] && (prev < 0 || !prev_near_overflow[prev])) {
+            Serial.printf("WARNING: Task %s stack nearly exhausted (%u bytes never used)\n",
+                          stat.name, (unsigned)stat.stack_free_min);
+        }
+    }
+
+    // Core load from the idle tasks where the port has them, otherwise from
+    // the tasks pinned to the core
+    for (int core = 0; core < 2; core++) {
+        task_stats.core_load[core] = -1;
+        if (!runtime_stats || !have_interval) {
+            continue;
+        }
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        float pinned = 0;
+        for (UBaseType_t i = 0; i < count; i++) {
+            const TaskStat& stat = task_stats.tasks[i];
+            if (stat.cpu_percent < 0) {
+                continue;
+            }
+            if (idle && task_status[i].xHandle == idle) {
+                task_stats.core_load[core] = constrain(100.0f - stat.cpu_percent, 0.0f, 100.0f);
+                break;
+            }
+            if (stat.core == core) {
+                pinned += stat.cpu_percent;
+            }
+        }
+        if (!idle) {
+            task_stats.core_load[core] = min(pinned, 100.0f);
+        }
+    }
+    task_stats_valid = true;
+    xSemaphoreGive(task_stats_lock);
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        prev_handles[i] = task_status[i].xHandle;
+        prev_runtime[i] = task_status[i].ulRunTimeCounter;
+        prev_near_overflow[i] = near_overflow[i];
+    }
+    prev_count = count;
+    prev_total = total;
+    prev_sample_ms = now;
+}
+
+#else
+
+void sampleTaskStats() {
+    static bool warned = false;
+    if (!warned) {
+        warned = true;
+        Serial.println("Task stats unavailable: FreeRTOS built without configUSE_TRACE_FACILITY");
+    }
+}
+
+#endif // configUSE_TRACE_FACILITY
+
+bool getTaskStats(TaskStatsSnapshot* snapshot) {
+    if (!task_stats_lock) {
+        return false;
+    }
+    xSemaphoreTake(task_stats_lock, portMAX_DELAY);
+    bool valid = task_stats_valid;
+    if (valid) {
+        *snapshot = task_stats;
+    }
+    xSemaphoreGive(task_stats_lock);
+    return valid;
+}
+
+const char* taskStackFlagName(TaskStackFlag flag) {
+    switch (flag) {
+        case STACK_OK:               return "ok";
+        case STACK_NEAR_OVERFLOW:    return "near_overflow";
+        case STACK_OVER_PROVISIONED: return "over_provisioned";
+        default:                     return "size_unknown";
+    }
+}
+
+const char* taskStateName(eTaskState state) {
+    switch (state) {
+        case eRunning:   return "running";
+        case eReady:     return "ready";
+        case eBlocked:   return "blocked";
+        case eSuspended: return "suspended";
+        case eDeleted:   return "deleted";
+        default:         return "unknown";
+    }
+}
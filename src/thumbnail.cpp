@@ -0,0 +1,231 @@
+#include "thumbnail.h"
+#include <new>
+#include "jpeg_rows.h"
+#include "jpeg_encode.h"
+#include "esp_heap_caps.h"
+
+// Decoder and encoder state, too large for the web server stack
+struct ThumbnailWork {
+    JpegRowDecoder decoder;
+    JpegEncoder encoder;
+};
+
+// Held across conversions, so a second viewer of the same frame waits for
+// the first conversion and then hits the cache
+static SemaphoreHandle_t thumbnail_lock = nullptr;
+static ThumbnailRef cached[THUMBNAIL_SCALES];
+static ThumbnailStats stats[THUMBNAIL_SCALES];
+
+void initThumbnails() {
+    if (!thumbnail_lock) {
+        thumbnail_lock = xSemaphoreCreateMutex();
+    }
+    for (int i = 0; i < THUMBNAIL_SCALES; i++) {
+        stats[i].scale = 2 << i;
+        stats[i].last_error = "none";
+    }
+}
+
+bool isThumbnailScale(int scale) {
+    return scale == 2 || scale == 4 || scale == 8;
+}
+
+static int scaleIndex(int scale) {
+    return scale == 2 ? 0 : scale == 4 ? 1 : 2;
+}
+
+static void* allocPreferInternal(size_t size) {
+    void* p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return p ? p : heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+// Copies the decoded MCU row into the strip from luma line `first` on,
+// replicating the last column into the padding
+static void copyRow(const JpegRowDecoder& decoder, uint8_t* const* strip, const int* strip_stride, int first) {
+    const JpegFrame& frame = decoder.frame;
+    for (int c = 0; c < frame.component_count; c++) {
+        const JpegComponent& comp = frame.components[c];
+        int lines = comp.v * 8 / decoder.scale;
+        int width = min(decoder.stride[c], strip_stride[c]);
+        for (int y = 0; y < lines; y++) {
+            uint8_t* out = strip[c] + (first * comp.v / (frame.mcu_h / 8) + y) * strip_stride[c];
+            memcpy(out, decoder.planes[c] + y * decoder.stride[c], width);
+            memset(out + width, out[width - 1], strip_stride[c] - width);
+        }
+    }
+}
+
+Thumbnail* createThumbnail(const uint8_t* jpeg, size_t len, int scale, JpegDcResult* result) {
+    ThumbnailWork* work = (ThumbnailWork*)allocPreferInternal(sizeof(ThumbnailWork));
+    if (!work) {
+        *result = JPEG_DC_NO_MEMORY;
+        return nullptr;
+    }
+    memset(work, 0, sizeof(ThumbnailWork));
+    JpegRowDecoder& decoder = work->decoder;
+    *result = jpegRowsBegin(&decoder, jpeg, len, false, scale, true);
+    if (*result != JPEG_DC_OK) {
+        heap_caps_free(work);
+        return nullptr;
+    }
+
+    // Same MCU layout at the reduced size; one output MCU row takes `scale`
+    // input rows
+    const JpegFrame& frame = decoder.frame;
+    int width = (frame.width + scale - 1) / scale;
+    int height = (frame.height + scale - 1) / scale;
+    int out_mcus_x = (width + frame.mcu_w - 1) / frame.mcu_w;
+    int out_mcus_y = (height + frame.mcu_h - 1) / frame.mcu_h;
+    int vmax = frame.mcu_h / 8;
+    uint8_t* strip[JPEG_MAX_COMPONENTS] = { nullptr, nullptr, nullptr };
+    int strip_stride[JPEG_MAX_COMPONENTS];
+    size_t strip_size = 0;
+    size_t blocks = 0;
+    for (int c = 0; c < frame.component_count; c++) {
+        const JpegComponent& comp = frame.components[c];
+        strip_stride[c] = out_mcus_x * comp.h * 8;
+        strip_size += (size_t)strip_stride[c] * comp.v * 8;
+        blocks += (size_t)out_mcus_x * out_mcus_y * comp.h * comp.v;
+    }
+    uint8_t* strip_buffer = (uint8_t*)allocPreferInternal(strip_size);
+    size_t capacity = 1024 + blocks * THUMBNAIL_MAX_BYTES_PER_BLOCK;
+    uint8_t* out = (uint8_t*)heap_caps_malloc(capacity, psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT);
+    if (!strip_buffer || !out) {
+        *result = JPEG_DC_NO_MEMORY;
+    }
+    size_t offset = 0;
+    for (int c = 0; c < frame.component_count && strip_buffer; c++) {
+        strip[c] = strip_buffer + offset;
+        offset += (size_t)strip_stride[c] * frame.components[c].v * 8;
+    }
+
+    JpegEncoder& encoder = work->encoder;
+    if (*result == JPEG_DC_OK &&
+        !jpegEncodeBegin(&encoder, out, capacity, width, height, frame.components, frame.component_count,
+                         decoder.tables.quant)) {
+        *result = JPEG_DC_TOO_LARGE;
+    }
+
+    int row = 0;
+    int lines_per_row = frame.mcu_h / scale;      // Luma lines each input MCU row adds
+    for (int out_row = 0; out_row < out_mcus_y && *result == JPEG_DC_OK; out_row++) {
+        int line = 0;
+        for (int i = 0; i < scale && row < frame.mcus_y; i++, row++) {
+            *result = jpegRowsDecode(&decoder, row);
+            if (*result != JPEG_DC_OK) {
+                break;
+            }
+            copyRow(decoder, strip, strip_stride, line);
+            line += lines_per_row;
+        }
+        // Past the bottom of the source: repeat the last line
+        for (int c = 0; c < frame.component_count && *result == JPEG_DC_OK; c++) {
+            const JpegComponent& comp = frame.components[c];
+            int filled = line * comp.v / vmax;
+            for (int y = filled; filled > 0 && y < comp.v * 8; y++) {
+                memcpy(strip[c] + y * strip_stride[c], strip[c] + (filled - 1) * strip_stride[c], strip_stride[c]);
+            }
+        }
+        if (*result == JPEG_DC_OK) {
+            jpegEncodeRow(&encoder, strip, strip_stride);
+        }
+    }
+
+    size_t length = 0;
+    if (*result == JPEG_DC_OK) {
+        length = jpegEncodeEnd(&encoder);
+        if (!length) {
+            *result = JPEG_DC_TOO_LARGE;
+        }
+    }
+    jpegRowsEnd(&decoder);
+    heap_caps_free(work);
+    heap_caps_free(strip_buffer);
+    if (*result != JPEG_DC_OK) {
+        heap_caps_free(out);
+        return nullptr;
+    }
+
+    // Give back the reserve
+    uint8_t* shrunk = (uint8_t*)heap_caps_realloc(out, length, psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT);
+    Thumbnail* thumbnail = new (std::nothrow) Thumbnail();
+    if (!thumbnail) {
+        heap_caps_free(shrunk ? shrunk : out);
+        *result = JPEG_DC_NO_MEMORY;
+        return nullptr;
+    }
+    thumbnail->data = shrunk ? shrunk : out;
+    thumbnail->length = length;
+    thumbnail->scale = scale;
+    thumbnail->width = width;
+    thumbnail->height = height;
+    return thumbnail;
+}
+
+ThumbnailRef getThumbnail(const FrameRef& frame, int scale, JpegDcResult* result) {
+    if (!isThumbnailScale(scale) || !thumbnail_lock) {
+        *result = JPEG_DC_UNSUPPORTED;
+        return ThumbnailRef();
+    }
+    int index = scaleIndex(scale);
+    xSemaphoreTake(thumbnail_lock, portMAX_DELAY);
+    if (cached[index] && cached[index]->seq == frame.seq()) {
+        ThumbnailRef hit = cached[index];
+        stats[index].cache_hits++;
+        xSemaphoreGive(thumbnail_lock);
+        *result = JPEG_DC_OK;
+        return hit;
+    }
+
+    Thumbnail* thumbnail = nullptr;
+    uint32_t started = micros();
+    {
+        // The driver cannot be torn down mid-conversion
+        FrameReadGuard guard(frame);
+        if (!guard.ok()) {
+            *result = JPEG_DC_CORRUPT;
+        } else {
+            thumbnail = createThumbnail(frame.data(), frame.length(), scale, result);
+        }
+    }
+    uint32_t elapsed = micros() - started;
+
+    ThumbnailStats& s = stats[index];
+    ThumbnailRef ref;
+    if (thumbnail) {
+        thumbnail->seq = frame.seq();
+        thumbnail->timestamp = frame.timestamp();
+        ref = ThumbnailRef(thumbnail);
+        // Only move forward: a slow viewer must not evict a newer frame
+        if (!cached[index] || (int32_t)(frame.seq() - cached[index]->seq) > 0) {
+            cached[index] = ref;
+        }
+        s.conversions++;
+        s.last_us = elapsed;
+        s.max_us = max(s.max_us, elapsed);
+        s.total_us += elapsed;
+        s.last_bytes = thumbnail->length;
+        s.source_bytes = frame.length();
+        s.width = thumbnail->width;
+        s.height = thumbnail->height;
+    } else {
+        s.failures++;
+        s.last_error = jpegDcResultName(*result);
+    }
+    xSemaphoreGive(thumbnail_lock);
+    if (!thumbnail) {
+        Serial.printf("Thumbnail 1/%d of frame %u failed: %s\n", scale, (unsigned)frame.seq(),
+                      jpegDcResultName(*result));
+    }
+    return ref;
+}
+
+void getThumbnailStats(ThumbnailStats* out) {
+    if (!thumbnail_lock) {
+        memcpy(out, stats, sizeof(stats));
+        return;
+    }
+    xSemaphoreTake(thumbnail_lock, portMAX_DELAY);
+    memcpy(out, stats, sizeof(stats));
+    xSemaphoreGive(thumbnail_lock);
+}
@@ -0,0 +1,242 @@
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include <esp_heap_caps.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TRACE_CORES      2
+#define TRACE_MAX_TASKS  24
+
+struct TraceRecord {
+    uint32_t ts_us;
+    TaskHandle_t task;
+    char phase;
+    const char* name;    // Written last; NULL until the record is complete
+};
+
+struct TraceRing {
+    TraceRecord* records;
+    uint32_t head;       // Records claimed this window; slot is head % size
+};
+
+// (core, task) pairs seen in the window; the tid of a record is its index + 1
+struct TraceTask {
+    TaskHandle_t task;
+    int core;
+};
+
+bool trace_recording = false;
+
+static bool trace_claimed = false;
+static TraceRing trace_rings[TRACE_CORES];
+static uint32_t trace_ring_size = 0;      // Power of two
+static uint32_t trace_start_us = 0;
+
+// Snapshot taken when the window ends, read by the response
+static uint32_t trace_heads[TRACE_CORES];
+static TraceTask trace_tasks[TRACE_MAX_TASKS];
+static int trace_task_count = 0;
+
+void traceRecord(const char* name, char phase) {
+    TraceRing& ring = trace_rings[xPortGetCoreID() & (TRACE_CORES - 1)];
+    uint32_t slot = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED) & (trace_ring_size - 1);
+    TraceRecord& record = ring.records[slot];
+    record.ts_us = micros();
+    record.task = xTaskGetCurrentTaskHandle();
+    record.phase = phase;
+    __atomic_store_n(&record.name, name, __ATOMIC_RELEASE);
+}
+
+static bool allocTraceRings() {
+    bool psram = psramFound();
+    uint32_t records = psram ? TRACE_RING_RECORDS : TRACE_RING_RECORDS_DRAM;
+    uint32_t caps = psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+
+    for (int core = 0; core < TRACE_CORES; core++) {
+        trace_rings[core].records = (TraceRecord*)heap_caps_malloc(records * sizeof(TraceRecord), caps);
+        if (!trace_rings[core].records) {
+            for (int i = 0; i < core; i++) {
+                heap_caps_free(trace_rings[i].records);
+                trace_rings[i].records = nullptr;
+            }
+            Serial.println("Trace: failed to allocate rings");
+            return false;
+        }
+    }
+    trace_ring_size = records;
+    Serial.printf("Trace rings: %u records per core (%u KB total)\n", (unsigned)records,
+                  (unsigned)(TRACE_CORES * records * sizeof(TraceRecord) / 1024));
+    return true;
+}
+
+bool traceStart() {
+    if (__atomic_exchange_n(&trace_claimed, true, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    if (!trace_ring_size && !allocTraceRings()) {
+        __atomic_store_n(&trace_claimed, false, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    for (int core = 0; core < TRACE_CORES; core++) {
+        memset(trace_rings[core].records, 0, trace_ring_size * sizeof(TraceRecord));
+        trace_rings[core].head = 0;
+    }
+    trace_task_count = 0;
+    trace_start_us = micros();
+    __atomic_store_n(&trace_recording, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void traceStop() {
+    __atomic_store_n(&trace_recording, false, __ATOMIC_RELEASE);
+}
+
+void traceRelease() {
+    traceStop();
+    __atomic_store_n(&trace_claimed, false, __ATOMIC_RELEASE);
+}
+
+static uint32_t oldestRecord(int core) {
+    return trace_heads[core] > trace_ring_size ? trace_heads[core] - trace_ring_size : 0;
+}
+
+static const TraceRecord* traceRecordAt(int core, uint32_t seq) {
+    const TraceRecord* record = &trace_rings[core].records[seq & (trace_ring_size - 1)];
+    return __atomic_load_n(&record->name, __ATOMIC_ACQUIRE) ? record : nullptr;
+}
+
+static uint32_t traceTid(TaskHandle_t task, int core) {
+    for (int i = 0; i < trace_task_count; i++) {
+        if (trace_tasks[i].task == task && trace_tasks[i].core == core) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Freezes the ring heads and lists the tasks that recorded events
+static void snapshotTrace() {
+    for (int core = 0; core < TRACE_CORES; core++) {
+        trace_heads[core] = __atomic_load_n(&trace_rings[core].head, __ATOMIC_ACQUIRE);
+        for (uint32_t seq = oldestRecord(core); seq < trace_heads[core]; seq++) {
+            const TraceRecord* record = traceRecordAt(core, seq);
+            if (record && !traceTid(record->task, core) && trace_task_count < TRACE_MAX_TASKS) {
+                trace_tasks[trace_task_count].task = record->task;
+                trace_tasks[trace_task_count].core = core;
+                trace_task_count++;
+            }
+        }
+    }
+}
+
+AsyncTraceResponse::AsyncTraceResponse(uint32_t window_ms)
+    : _end_time(millis() + window_ms), _window_ms(window_ms), _stage(STAGE_RECORDING),
+      _core(0), _index(0), _task(0), _line_len(0), _line_offset(0) {
+    _code = 200;
+    _contentType = "application/json";
+    _contentLength = 0;
+    _sendContentLength = false;
+    _chunked = false;
+    _line[0] = '\0';
+}
+
+AsyncTraceResponse::~AsyncTraceResponse() {
+    traceRelease();
+}
+
+// Formats the next piece of JSON into _line. Returns false at the end.
+bool AsyncTraceResponse::nextLine() {
+    int n = 0;
+    while (n == 0) {
+        switch (_stage) {
+            case STAGE_HEADER: {
+                uint32_t dropped = 0;
+                for (int core = 0; core < TRACE_CORES; core++) {
+                    dropped += oldestRecord(core);
+                }
+                n = snprintf(_line, sizeof(_line),
+                             "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"window_ms\":%u,\"dropped\":%u},"
+                             "\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                             "\"args\":{\"name\":\"core 0\"}},{\"name\":\"process_name\",\"ph\":\"M\","
+                             "\"pid\":1,\"args\":{\"name\":\"core 1\"}}",
+                             (unsigned)_window_ms, (unsigned)dropped);
+                _stage = STAGE_TASKS;
+                break;
+            }
+
+            case STAGE_TASKS:
+                if (_task >= trace_task_count) {
+                    _stage = STAGE_EVENTS;
+                    _core = 0;
+                    _index = oldestRecord(0);
+                    break;
+                }
+                n = snprintf(_line, sizeof(_line),
+                             ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                             trace_tasks[_task].core, _task + 1, pcTaskGetName(trace_tasks[_task].task));
+                _task++;
+                break;
+
+            case STAGE_EVENTS: {
+                if (_index >= trace_heads[_core]) {
+                    if (++_core >= TRACE_CORES) {
+                        _stage = STAGE_FOOTER;
+                    } else {
+                        _index = oldestRecord(_core);
+                    }
+                    break;
+                }
+                const TraceRecord* record = traceRecordAt(_core, _index++);
+                if (!record) {
+                    break;  // Claimed but never completed
+                }
+                n = snprintf(_line, sizeof(_line),
+                             ",{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":%d,\"tid\":%u%s}",
+                             record->name, record->phase, (unsigned)(record->ts_us - trace_start_us),
+                             _core, (unsigned)traceTid(record->task, _core),
+                             record->phase == 'i' ? ",\"s\":\"t\"" : "");
+                break;
+            }
+
+            case STAGE_FOOTER:
+                n = snprintf(_line, sizeof(_line), "]}\n");
+                _stage = STAGE_DONE;
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    _line_len = min((size_t)n, sizeof(_line) - 1);
+    _line_offset = 0;
+    return true;
+}
+
+size_t AsyncTraceResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+    if (_stage == STAGE_RECORDING) {
+        if ((long)(millis() - _end_time) < 0) {
+            return RESPONSE_TRY_AGAIN;
+        }
+        traceStop();
+        snapshotTrace();
+        _stage = STAGE_HEADER;
+    }
+
+    size_t written = 0;
+    while (written < maxLen) {
+        if (_line_offset == _line_len && !nextLine()) {
+            break;
+        }
+        size_t len = min(maxLen - written, _line_len - _line_offset);
+        memcpy(buf + written, _line + _line_offset, len);
+        written += len;
+        _line_offset += len;
+    }
+    return written;
+}
+
+#endif // ENABLE_TRACE
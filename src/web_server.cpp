@@ -2,9 +2,26 @@
 #include "app.h"
 #include "config.h"
 #include "captive_portal.h"
+#include "frame_broadcaster.h"
+#include "mjpeg_stream.h"
+#include "metrics.h"
+#include "trace.h"
+#include "task_stats.h"
+#include "memory_governor.h"
+#include "camera_settings.h"
+#include "camera_profiles.h"
+#include "motion_detect.h"
+#include "scene_activity.h"
+#include "bmp_stream.h"
+#include "thumbnail.h"
+#include "roi_view.h"
+#include "capture_response.h"
+#include "camera_response.h"
+#include "frame_convert.h"
 #include <ArduinoJson.h>
 #include <esp_camera.h>
 #include <mbedtls/sha256.h>
+#include <esp_system.h>
 
 AsyncWebServer server(80);
 
@@ -15,6 +32,63 @@ void addCORSHeaders(AsyncWebServerResponse *response) {
     response->addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization, X-CSRF-Token");
 }
 
+// Sends a response and counts it by route and status class for /metrics
+static void sendResponse(AsyncWebServerRequest *request, int code, AsyncWebServerResponse *response) {
+    metricsCountHttp(request->url().c_str(), code);
+    request->send(response);
+}
+
+static void sendResponse(AsyncWebServerRequest *request, int code, const char *contentType, const String &content) {
+    sendResponse(request, code, request->beginResponse(code, contentType, content));
+}
+
+// Refuses a new stream client while the memory governor is shedding load
+static bool admitStream(AsyncWebServerRequest *request) {
+    if (memoryAdmitsStream()) {
+        return true;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(503, "application/json", "{\"error\":\"Low memory, retry later\"}");
+    response->addHeader("Retry-After", String(MEM_RETRY_AFTER_S));
+    addCORSHeaders(response);
+    sendResponse(request, 503, response);
+    return false;
+}
+
+// Gathers a JSON POST body chunk by chunk into the request's own buffer
+// (_tempObject, freed with the request). Returns the body once its last
+// chunk is in, else null. Answers 413 to a body over max_len and 503 when
+// there is no memory for it; its later chunks are then ignored.
+static char* collectBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total,
+                         size_t max_len) {
+    if (index == 0) {
+        free(request->_tempObject);
+        request->_tempObject = nullptr;
+        if (total > max_len) {
+            sendResponse(request, 413, "application/json",
+                         String("{\"error\":\"Body larger than ") + max_len + " bytes\"}");
+            return nullptr;
+        }
+        request->_tempObject = malloc(total + 1);
+        if (!request->_tempObject) {
+            AsyncWebServerResponse *response = request->beginResponse(503, "application/json",
+                                                                      "{\"error\":\"Low memory, retry later\"}");
+            response->addHeader("Retry-After", String(MEM_RETRY_AFTER_S));
+            sendResponse(request, 503, response);
+            return nullptr;
+        }
+    }
+    char* body = (char*)request->_tempObject;
+    if (!body || index + len > total) {
+        return nullptr;
+    }
+    memcpy(body + index, data, len);
+    if (index + len != total) {
+        return nullptr;
+    }
+    body[total] = '\0';
+    return body;
+}
+
 // Simple authentication check
 bool checkAuthentication(AsyncWebServerRequest *request) {
     // If no password is set, allow access
@@ -32,6 +106,12 @@ bool checkAuthentication(AsyncWebServerRequest *request) {
     return false;
 }
 
+// Random per-boot prefix so a /capture ETag never matches a frame from a
+// previous boot with the same sequence number
+static uint32_t capture_etag_boot = 0;
+
+static void saveProfile(AsyncWebServerRequest *request, JsonObject overrides);
+
 String generateCSRFToken() {
     // Simple token generation - should be enhanced
     return String(random(0x7FFFFFFF), HEX);
@@ -43,11 +123,17 @@ bool validateCSRFToken(const String& token) {
 }
 
 void initWebServer() {
+    capture_etag_boot = esp_random();
+    
+    initMjpegStreaming();
+    initCaptureResponses();
+    initCameraResponses();
+    
     // CORS preflight
     server.on("/", HTTP_OPTIONS, [](AsyncWebServerRequest *request) {
         AsyncWebServerResponse *response = request->beginResponse(200);
         addCORSHeaders(response);
-        request->send(response);
+        sendResponse(request, 200, response);
     });
     
     // Main page - captive portal or status
@@ -106,22 +192,79 @@ void initWebServer() {
         html += "function factoryReset(){if(confirm('WARNING: This will erase ALL WiFi configurations and return to setup mode.\\n\\nAre you sure?')){if(confirm('This action cannot be undone. Continue?')){fetch('/factory-reset').then(r=>r.json()).then(d=>{alert(d.message);setTimeout(()=>location.href='http://192.168.4.1',5000);}).catch(e=>alert('Reset initiated'));}}}";
         html += "</script></body></html>";
         
-        request->send(200, "text/html", html);
+        sendResponse(request, 200, "text/html", html);
     });
     
     // API endpoints
     server.on("/status", HTTP_GET, handleStatus);
+    server.on("/metrics", HTTP_GET, handleMetrics);
+    server.on("/trace", HTTP_GET, handleTrace);
+    server.on("/tasks", HTTP_GET, handleTasks);
+    server.on("/sessions", HTTP_GET, handleSessions);
     server.on("/sleepstatus", HTTP_GET, handleSleepStatus);
     server.on("/capture", HTTP_GET, handleCapture);
     server.on("/stream", HTTP_GET, handleStream);
+    server.on("/clip", HTTP_GET, handleClip);
+    server.on("/burst", HTTP_GET, handleBurst);
     server.on("/bmp", HTTP_GET, handleBMP);
     server.on("/control", HTTP_GET, handleControl);
     server.on("/sleep", HTTP_GET, handleSleep);
     server.on("/wake", HTTP_GET, handleWake);
     server.on("/restart", HTTP_GET, handleRestart);
     server.on("/factory-reset", HTTP_GET, handleFactoryReset);
+    server.on("/profiles", HTTP_GET, handleProfiles);
+    server.on("/profile", HTTP_GET, handleProfile);
+    server.on("/profile", HTTP_DELETE, handleProfileDelete);
+    server.on("/motion", HTTP_GET, handleMotion);
     
-    // POST endpoint with body handler
+    // POST endpoints with body handler
+    server.on("/control", HTTP_POST,
+        [](AsyncWebServerRequest *request) {
+            // JSON bodies are answered from the body handler; form-encoded
+            // and empty ones never reach it
+            const String& type = request->contentType();
+            if (request->contentLength() == 0 || type.startsWith("application/x-www-form-urlencoded") ||
+                type.startsWith("multipart/")) {
+                sendResponse(request, 415, "application/json",
+                             "{\"error\":\"Send the settings as a JSON object (Content-Type: application/json)\"}");
+            }
+        },
+        nullptr,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+            handleControlBatch(request, data, len, index, total);
+        }
+    );
+    server.on("/profile", HTTP_POST,
+        [](AsyncWebServerRequest *request) {
+            // No body: save the running settings as they are
+            const String& type = request->contentType();
+            if (request->contentLength() == 0) {
+                StaticJsonDocument<16> empty;
+                saveProfile(request, empty.to<JsonObject>());
+            } else if (type.startsWith("application/x-www-form-urlencoded") || type.startsWith("multipart/")) {
+                sendResponse(request, 415, "application/json",
+                             "{\"error\":\"Send overrides as a JSON object (Content-Type: application/json)\"}");
+            }
+        },
+        nullptr,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+            handleProfileSave(request, data, len, index, total);
+        }
+    );
+    server.on("/profiles/schedule", HTTP_POST,
+        [](AsyncWebServerRequest *request) {
+            const String& type = request->contentType();
+            if (request->contentLength() == 0 || type.startsWith("application/x-www-form-urlencoded") ||
+                type.startsWith("multipart/")) {
+                sendResponse(request, 415, "application/json",
+                             "{\"error\":\"Send the schedule as a JSON object (Content-Type: application/json)\"}");
+            }
+        },
+        nullptr,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+            handleProfileSchedule(request, data, len, index, total);
+        }
+    );
     server.on("/wifi-connect", HTTP_POST, 
         [](AsyncWebServerRequest *request) {
             // This is called after body is received
@@ -137,9 +280,28 @@ void initWebServer() {
     server.begin();
 }
 
-void handleStatus(AsyncWebServerRequest *request) {
-    StaticJsonDocument<1024> doc;
-    
+static void addMotionStats(JsonObject out, const MotionStats& stats) {
+    out["enabled"] = stats.enabled;
+    out["active"] = stats.active;
+    if (stats.score >= 0) {
+        out["score"] = stats.score / 10.0;
+    } else {
+        out["score"] = nullptr;
+    }
+    out["blocks_changed"] = stats.blocks_changed;
+    out["events"] = stats.events;
+    out["last_event_ms_ago"] = stats.last_event ? millis() - stats.last_event : 0;
+    out["analysis_ms"] = stats.last_us / 1000.0;
+    out["stride"] = stats.stride;
+    out["analyzed"] = stats.analyzed;
+    out["skipped"] = stats.skipped;
+    out["timeouts"] = stats.timeouts;
+    out["errors"] = stats.errors;
+    out["last_error"] = stats.last_error;
+}
+
+// Fills the /status document; sessions are the stream clients to list
+static void buildStatus(JsonDocument& doc, const StreamClientStats* clients, int client_count) {
     doc["camera_initialized"] = camera_initialized;
     doc["camera_sleeping"] = camera_sleeping;
     doc["uptime"] = getUptimeSeconds();
@@ -164,24 +326,451 @@ void handleStatus(AsyncWebServerRequest *request) {
         networks.add(g_config.networks[i].ssid);
     }
     
+    // Stream clients and bandwidth adaptation decisions
+    JsonObject stream = doc.createNestedObject("stream");
+    StreamAdaptationState adapt;
+    getStreamAdaptation(&adapt);
+    stream["clients"] = getStreamClientCount();
+    stream["frames_captured"] = getFramesPublished();
+    JsonObject adaptation = stream.createNestedObject("adaptation");
+    adaptation["enabled"] = adapt.enabled;
+    adaptation["level"] = adapt.level;
+    adaptation["memory_floor"] = adapt.memory_floor;
+    adaptation["quality"] = adapt.quality;
+    adaptation["framesize"] = adapt.framesize;
+    adaptation["congested_clients"] = adapt.congested_clients;
+    adaptation["last_action"] = adapt.last_action;
+    adaptation["last_change_ms_ago"] = adapt.last_change ? millis() - adapt.last_change : 0;
+    
+    CameraBufferStats buffer_stats;
+    getCameraBufferStats(&buffer_stats);
+    JsonObject buffers = stream.createNestedObject("frame_buffers");
+    buffers["count"] = buffer_stats.fb_count;
+    buffers["bytes"] = buffer_stats.buffer_bytes;
+    buffers["sized_for"] = buffer_stats.buffer_framesize;
+    buffers["ready_framesize"] = buffer_stats.ready_framesize;
+    buffers["ready"] = buffer_stats.ready;
+    buffers["reconfigs"] = buffer_stats.reconfigs;
+    buffers["reprovisions"] = buffer_stats.reprovisions;
+    buffers["failed"] = buffer_stats.failed;
+    buffers["frames_discarded"] = buffer_stats.frames_discarded;
+    buffers["last_path"] = buffer_stats.last_path ? buffer_stats.last_path : "none";
+    buffers["last_reconfig_ms"] = buffer_stats.last_reconfig_us / 1000.0;
+    
+    FramePoolStats pool_stats;
+    getFramePoolStats(&pool_stats);
+    JsonObject pool = stream.createNestedObject("pool");
+    pool["depth"] = pool_stats.depth;
+    pool["in_use"] = pool_stats.in_use;
+    pool["exhausted"] = pool_stats.exhausted;
+    pool["dropped"] = pool_stats.dropped;
+    pool["bad_releases"] = pool_stats.bad_releases;
+    
+    JsonArray sessions = stream.createNestedArray("sessions");
+    for (int i = 0; i < client_count; i++) {
+        JsonObject session = sessions.createNestedObject();
+        session["fps"] = clients[i].fps;
+        session["frames_sent"] = clients[i].frames_sent;
+        session["frames_dropped"] = clients[i].frames_dropped;
+        session["throughput"] = clients[i].throughput;
+        session["backlog"] = clients[i].backlog;
+        session["latency_ms"] = clients[i].latency_ms;
+        session["congested"] = clients[i].congested;
+    }
+    
+    // Pre-event ring for /clip
+    FrameRingStats ring_stats;
+    getFrameRingStats(&ring_stats);
+    JsonObject ring = doc.createNestedObject("clip_buffer");
+    ring["enabled"] = ring_stats.enabled;
+    ring["capacity"] = ring_stats.capacity;
+    ring["used"] = ring_stats.used;
+    ring["frames"] = ring_stats.frames;
+    ring["oldest_ms_ago"] = ring_stats.frames ? millis() - ring_stats.oldest_timestamp : 0;
+    ring["oversized"] = ring_stats.oversized;
+    ring["resize_dropped"] = ring_stats.resize_dropped;
+    
+    // Motion detection on captured frames
+    MotionStats motion_stats;
+    getMotionStats(&motion_stats);
+    JsonObject motion = doc.createNestedObject("motion");
+    addMotionStats(motion, motion_stats);
+    
+    // Capture rate held down while the scene is static
+    ActivityStats activity_stats;
+    getSceneActivityStats(&activity_stats);
+    JsonObject activity = doc.createNestedObject("activity");
+    activity["enabled"] = activity_stats.enabled;
+    activity["mode"] = activity_stats.idle ? "idle" : "active";
+    activity["capture_fps"] = activity_stats.capture_fps;
+    activity["idle_s"] = activity_stats.idle_ms / 1000;
+    activity["active_s"] = activity_stats.active_ms / 1000;
+    uint32_t tracked_ms = activity_stats.idle_ms + activity_stats.active_ms;
+    activity["idle_percent"] = tracked_ms ? round(activity_stats.idle_ms * 1000.0 / tracked_ms) / 10.0 : 0;
+    activity["idle_entries"] = activity_stats.idle_entries;
+    activity["wakes"] = activity_stats.wakes;
+    activity["last_change_ms_ago"] = activity_stats.last_change ? millis() - activity_stats.last_change : 0;
+    activity["frames_static"] = activity_stats.frames_static;
+    activity["frames_changed"] = activity_stats.frames_changed;
+    activity["signatures"] = activity_stats.signatures;
+    activity["signature_failures"] = activity_stats.signature_failures;
+    activity["frames_avoided"] = activity_stats.frames_avoided;
+    activity["kb_avoided"] = activity_stats.kb_avoided;
+    activity["static_skipped"] = (uint32_t)metricValue(metric_stream_static_skipped);
+    activity["kb_skipped"] = (uint32_t)(metricValue(metric_stream_bytes_saved) / 1024);
+    
+    // /capture snapshot cache
+    uint32_t cache_hits, cache_misses;
+    getCaptureCacheStats(&cache_hits, &cache_misses);
+    CaptureResponseStats capture_stats;
+    getCaptureResponseStats(&capture_stats);
+    JsonObject capture = doc.createNestedObject("capture");
+    capture["cache_hits"] = cache_hits;
+    capture["cache_misses"] = cache_misses;
+    capture["not_modified"] = capture_stats.not_modified;
+    capture["waiting"] = capture_stats.waiting;
+    capture["wait_timeouts"] = capture_stats.timeouts;
+    
+    // /capture?scale= and /stream?scale= conversions, per scale
+    ThumbnailStats thumbnail_stats[THUMBNAIL_SCALES];
+    getThumbnailStats(thumbnail_stats);
+    JsonArray thumbnails = doc.createNestedArray("thumbnails");
+    for (const ThumbnailStats& t : thumbnail_stats) {
+        JsonObject entry = thumbnails.createNestedObject();
+        entry["scale"] = t.scale;
+        entry["conversions"] = t.conversions;
+        entry["cache_hits"] = t.cache_hits;
+        entry["failures"] = t.failures;
+        entry["last_ms"] = t.last_us / 1000.0;
+        entry["max_ms"] = t.max_us / 1000.0;
+        entry["avg_ms"] = t.conversions ? t.total_us / 1000.0 / t.conversions : 0;
+        entry["last_bytes"] = t.last_bytes;
+        entry["source_bytes"] = t.source_bytes;
+        entry["width"] = t.width;
+        entry["height"] = t.height;
+        entry["last_error"] = t.last_error;
+    }
+    
+    // /capture?roi= and /stream?roi= crops and rotations
+    RoiStats roi_stats;
+    getRoiStats(&roi_stats);
+    JsonObject roi = doc.createNestedObject("roi");
+    roi["transforms"] = roi_stats.transforms;
+    roi["cache_hits"] = roi_stats.cache_hits;
+    roi["failures"] = roi_stats.failures;
+    roi["last_ms"] = roi_stats.last_us / 1000.0;
+    roi["max_ms"] = roi_stats.max_us / 1000.0;
+    roi["avg_ms"] = roi_stats.transforms ? roi_stats.total_us / 1000.0 / roi_stats.transforms : 0;
+    roi["last_bytes"] = roi_stats.last_bytes;
+    roi["source_bytes"] = roi_stats.source_bytes;
+    roi["served"] = roi_stats.served;
+    roi["kb_saved"] = (uint32_t)(roi_stats.bytes_saved / 1024);
+    roi["last_error"] = roi_stats.last_error;
+    
+    // Conversion task behind both
+    ConvertStats convert_stats;
+    getConvertStats(&convert_stats);
+    JsonObject conversions = doc.createNestedObject("conversions");
+    conversions["jobs"] = convert_stats.jobs;
+    conversions["shared"] = convert_stats.shared;
+    conversions["busy"] = convert_stats.busy;
+    conversions["pending"] = convert_stats.pending;
+    conversions["last_wait_ms"] = convert_stats.last_wait_ms;
+    conversions["max_wait_ms"] = convert_stats.max_wait_ms;
+    
+    // Memory governor level and the load shedding in force
+    MemoryGovernorState mem;
+    getMemoryGovernorState(&mem);
+    JsonObject memory = doc.createNestedObject("memory");
+    memory["level"] = memoryLevelName(mem.level);
+    JsonObject internal = memory.createNestedObject("internal");
+    internal["free"] = mem.internal.free_bytes;
+    internal["largest_block"] = mem.internal.largest_block;
+    internal["min_free"] = mem.internal.min_free;
+    internal["level"] = memoryLevelName(mem.internal.level);
+    if (mem.psram_present) {
+        JsonObject psram = memory.createNestedObject("psram");
+        psram["free"] = mem.psram.free_bytes;
+        psram["largest_block"] = mem.psram.largest_block;
+        psram["min_free"] = mem.psram.min_free;
+        psram["level"] = memoryLevelName(mem.psram.level);
+    }
+    JsonObject actions = memory.createNestedObject("actions");
+    actions["refuse_streams"] = mem.level >= MEM_ELEVATED;
+    actions["defer_config"] = mem.level >= MEM_ELEVATED;
+    actions["adapt_steps"] = mem.adapt_steps;
+    actions["ring_shrunk"] = mem.ring_shrunk;
+    actions["ring_shrinks"] = mem.ring_shrinks;
+    actions["ring_shrink_level"] = memoryLevelName(mem.ring_shrink_level);
+    memory["config_deferred"] = mem.config_deferred;
+    memory["streams_refused"] = mem.streams_refused;
+    memory["transitions"] = mem.transitions;
+    memory["last_change_ms_ago"] = mem.last_change ? millis() - mem.last_change : 0;
+}
+
+void handleStatus(AsyncWebServerRequest *request) {
+    TRACE_SCOPE("handleStatus");
+    StreamClientStats clients[STATUS_MAX_SESSIONS];
+    int client_count = getStreamClientStats(clients, STATUS_MAX_SESSIONS);
+    
+    // Sized for the sessions listed; grown rather than sent with fields
+    // silently missing if something outgrew the estimate
+    String output;
+    size_t capacity = STATUS_JSON_SIZE + client_count * STATUS_SESSION_JSON_SIZE;
+    while (true) {
+        DynamicJsonDocument doc(capacity);
+        buildStatus(doc, clients, client_count);
+        if (!doc.overflowed()) {
+            serializeJson(doc, output);
+            break;
+        }
+        if (capacity >= STATUS_JSON_MAX_SIZE) {
+            Serial.printf("/status does not fit in %u bytes\n", (unsigned)capacity);
+            sendResponse(request, 500, "application/json", "{\"error\":\"Status document too large\"}");
+            return;
+        }
+        Serial.printf("/status overflowed %u bytes, retrying larger\n", (unsigned)capacity);
+        capacity = min(capacity * 2, (size_t)STATUS_JSON_MAX_SIZE);
+    }
+    
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
+    addCORSHeaders(response);
+    sendResponse(request, 200, response);
+}
+
+void handleMetrics(AsyncWebServerRequest *request) {
+    sendResponse(request, 200, "text/plain; version=0.0.4", renderMetrics());
+}
+
+void handleTrace(AsyncWebServerRequest *request) {
+#ifdef ENABLE_TRACE
+    uint32_t window = TRACE_DEFAULT_WINDOW_MS;
+    if (request->hasParam("ms")) {
+        long requested = request->getParam("ms")->value().toInt();
+        window = constrain(requested, 1L, (long)TRACE_MAX_WINDOW_MS);
+    }
+    
+    if (!traceStart()) {
+        sendResponse(request, 409, "application/json", "{\"error\":\"A trace is already running or trace buffers are unavailable\"}");
+        return;
+    }
+    
+    // Recorded while the response waits; sent once the window closes
+    AsyncTraceResponse *response = new AsyncTraceResponse(window);
+    response->addHeader("Content-Disposition", "inline; filename=trace.json");
+    addCORSHeaders(response);
+    sendResponse(request, 200, response);
+#else
+    sendResponse(request, 501, "application/json", "{\"error\":\"Tracing is not compiled in (build with -DENABLE_TRACE)\"}");
+#endif
+}
+
+void handleTasks(AsyncWebServerRequest *request) {
+    std::unique_ptr<TaskStatsSnapshot> stats(new TaskStatsSnapshot);
+    if (!getTaskStats(stats.get())) {
+        sendResponse(request, 503, "application/json", "{\"error\":\"No task sample yet (taken every 5 s)\"}");
+        return;
+    }
+    
+    DynamicJsonDocument doc(1024 + stats->task_count * 256);
+    doc["interval_ms"] = stats->interval_ms;
+    doc["runtime_stats"] = stats->runtime_stats;
+    JsonArray cores = doc.createNestedArray("cores");
+    for (int core = 0; core < 2; core++) {
+        JsonObject entry = cores.createNestedObject();
+        entry["core"] = core;
+        if (stats->core_load[core] >= 0) {
+            entry["load"] = round(stats->core_load[core] * 10) / 10.0;
+        } else {
+            entry["load"] = nullptr;
+        }
+    }
+    
+    uint32_t reclaimable = 0;
+    JsonArray tasks = doc.createNestedArray("tasks");
+    for (int i = 0; i < stats->task_count; i++) {
+        const TaskStat& stat = stats->tasks[i];
+        JsonObject task = tasks.createNestedObject();
+        task["name"] = stat.name;
+        task["state"] = taskStateName(stat.state);
+        task["priority"] = stat.priority;
+        if (stat.core >= 0) {
+            task["core"] = stat.core;
+        } else {
+            task["core"] = nullptr;
+        }
+        if (stat.cpu_percent >= 0) {
+            task["cpu"] = round(stat.cpu_percent * 10) / 10.0;
+        } else {
+            task["cpu"] = nullptr;
+        }
+        if (stat.stack_size) {
+            task["stack_size"] = stat.stack_size;
+            task["stack_used"] = stat.stack_size - min(stat.stack_free_min, stat.stack_size);
+            task["stack_recommended"] = stat.stack_recommended;
+        }
+        task["stack_free_min"] = stat.stack_free_min;
+        task["stack"] = taskStackFlagName(stat.flag);
+        if (stat.flag == STACK_OVER_PROVISIONED) {
+            reclaimable += stat.stack_size - stat.stack_recommended;
+        }
+    }
+    doc["stack_reclaimable"] = reclaimable;
+    
     String output;
     serializeJson(doc, output);
     
     AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
     addCORSHeaders(response);
-    request->send(response);
+    sendResponse(request, 200, response);
+}
+
+void handleSessions(AsyncWebServerRequest *request) {
+    StreamAdmissionStats admission;
+    getStreamAdmissionStats(&admission);
+    std::unique_ptr<StreamClientStats[]> clients(new StreamClientStats[STREAM_MAX_SESSIONS]);
+    int count = getStreamClientStats(clients.get(), STREAM_MAX_SESSIONS);
+    
+    DynamicJsonDocument doc(512 + count * 448);
+    doc["clients"] = admission.clients;
+    doc["clips"] = admission.clips;
+    doc["max_clients"] = admission.max_clients;
+    doc["egress"] = admission.egress;
+    doc["max_egress"] = admission.max_egress;
+    doc["denied"] = admission.denied;
+    doc["evicted"] = admission.evicted;
+    
+    JsonArray sessions = doc.createNestedArray("sessions");
+    for (int i = 0; i < count; i++) {
+        const StreamClientStats& client = clients[i];
+        JsonObject session = sessions.createNestedObject();
+        session["id"] = client.id;
+        session["class"] = streamClassName(client.stream_class);
+        session["ip"] = client.remote_ip.toString();
+        session["fps_requested"] = client.fps;
+        session["fps"] = round(client.fps_measured * 10) / 10.0;
+        session["bytes_sent"] = client.bytes_sent;
+        session["throughput"] = client.throughput;
+        session["share"] = client.share;
+        session["frames_dropped"] = client.frames_dropped;
+        session["connected_s"] = client.connected_ms / 1000;
+        session["evicted"] = client.evicted;
+        session["scale"] = client.scale;
+        if (client.roi.width > 0) {
+            char roi[48];           // Copied into the document, being non-const
+            snprintf(roi, sizeof(roi), "%d,%d,%d,%d", client.roi.x, client.roi.y, client.roi.width,
+                     client.roi.height);
+            session["roi"] = roi;
+        } else {
+            session["roi"] = nullptr;
+        }
+        session["rotate"] = client.roi.rotate;
+        session["skip_static"] = client.skip_static;
+        session["static_skipped"] = client.static_skipped;
+        session["bytes_saved"] = client.bytes_saved;
+    }
+    
+    String output;
+    serializeJson(doc, output);
+    
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
+    addCORSHeaders(response);
+    sendResponse(request, 200, response);
 }
 
 void handleSleepStatus(AsyncWebServerRequest *request) {
-    StaticJsonDocument<200> doc;
+    static const char* const POWER_MODE_NAMES[] = { "active", "standby", "off" };
+    CameraPowerStats power;
+    getCameraPowerStats(&power);
+    
+    StaticJsonDocument<384> doc;
     doc["sleeping"] = camera_sleeping;
     doc["uptime"] = getUptimeSeconds();
+    doc["mode"] = POWER_MODE_NAMES[power.mode];
+    doc["mode_duration_s"] = (millis() - power.since) / 1000;
+    doc["wakes"] = power.wakes;
+    doc["last_wake_path"] = power.last_wake_path;
+    doc["last_wake_ms"] = power.last_wake_us / 1000.0;
+    doc["registers_restored"] = power.registers_restored;
     
     String output;
     serializeJson(doc, output);
     
     AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
     addCORSHeaders(response);
+    sendResponse(request, 200, response);
+}
+
+// ?scale= of /capture and /stream: 1 or a thumbnail scale. Replies 400 to
+// anything else and returns false.
+static bool parseScaleParam(AsyncWebServerRequest *request, int *scale) {
+    *scale = 1;
+    if (!request->hasParam("scale")) {
+        return true;
+    }
+    int requested = request->getParam("scale")->value().toInt();
+    if (requested != 1 && !isThumbnailScale(requested)) {
+        sendResponse(request, 400, "application/json", "{\"error\":\"scale must be 1, 2, 4 or 8\"}");
+        return false;
+    }
+    *scale = requested;
+    return true;
+}
+
+// ?roi=x,y,w,h and ?rotate= of /capture and /stream. The region is in
+// source pixels and must overlap the current framesize; rotate is 0, 90,
+// 180 or 270 degrees clockwise. Neither combines with a scale. Replies 400
+// to anything else and returns false.
+static bool parseRoiParams(AsyncWebServerRequest *request, int scale, RoiSpec *roi) {
+    *roi = RoiSpec();
+    if (request->hasParam("roi")) {
+        int x, y, w, h;
+        char extra;
+        String value = request->getParam("roi")->value();
+        if (sscanf(value.c_str(), "%d,%d,%d,%d%c", &x, &y, &w, &h, &extra) != 4 || x < 0 || y < 0 ||
+            w <= 0 || h <= 0) {
+            sendResponse(request, 400, "application/json",
+                         "{\"error\":\"roi must be x,y,width,height with a positive size\"}");
+            return false;
+        }
+        sensor_t *s = esp_camera_sensor_get();
+        if (s) {
+            const resolution_info_t& res = resolution[s->status.framesize];
+            if (x >= res.width || y >= res.height) {
+                sendResponse(request, 400, "application/json", String("{\"error\":\"roi lies outside the ") +
+                             res.width + "x" + res.height + " frame\"}");
+                return false;
+            }
+        }
+        roi->x = x;
+        roi->y = y;
+        roi->width = w;
+        roi->height = h;
+    }
+    if (request->hasParam("rotate")) {
+        int rotate = request->getParam("rotate")->value().toInt();
+        if (rotate != 0 && rotate != 90 && rotate != 180 && rotate != 270) {
+            sendResponse(request, 400, "application/json", "{\"error\":\"rotate must be 0, 90, 180 or 270\"}");
+            return false;
+        }
+        roi->rotate = rotate;
+    }
+    if (roiActive(*roi) && scale > 1) {
+        sendResponse(request, 400, "application/json", "{\"error\":\"roi and rotate cannot be combined with scale\"}");
+        return false;
+    }
+    return true;
+}
+
+// Replies with a cached frame at most max_age ms old, or with the camera
+// task's next one. Never waits here: a response that needs a new frame is
+// started later from the web server task (capture_response.h).
+static void sendCapture(AsyncWebServerRequest *request, const CaptureOptions& options, uint32_t max_age) {
+    uint32_t wait_seq = 0;
+    FrameRef frame = captureFrame(max_age, &wait_seq);
+    AsyncCaptureResponse *response = new AsyncCaptureResponse(options, std::move(frame), wait_seq);
+    request->onDisconnect([response]() { response->close(); });
+    // Counted for /metrics once its status is known
     request->send(response);
 }
 
@@ -190,148 +779,733 @@ void handleCapture(AsyncWebServerRequest *request) {
         AsyncWebServerResponse *response = request->beginResponse(503, "application/json", 
             "{\"error\":\"Camera is sleeping or not initialized\"}");
         addCORSHeaders(response);
-        request->send(response);
+        sendResponse(request, 503, response);
         return;
     }
     
-    camera_fb_t *fb = captureFrame();
-    if (!fb) {
-        AsyncWebServerResponse *response = request->beginResponse(500, "application/json", 
-            "{\"error\":\"Failed to capture frame\"}");
-        addCORSHeaders(response);
-        request->send(response);
+    int scale;
+    RoiSpec roi;
+    if (!parseScaleParam(request, &scale) || !parseRoiParams(request, scale, &roi)) {
         return;
     }
     
-    AsyncWebServerResponse *response = request->beginResponse(200, "image/jpeg", fb->buf, fb->len);
-    addCORSHeaders(response);
-    response->addHeader("Content-Disposition", "inline; filename=capture.jpg");
-    request->send(response);
+    // Pollers may accept a cached frame up to max_age ms old; a stale cache
+    // waits for the camera task's next capture instead
+    uint32_t max_age = DEFAULT_CAPTURE_MAX_AGE_MS;
+    if (request->hasParam("max_age")) {
+        long requested = request->getParam("max_age")->value().toInt();
+        max_age = requested > 0 ? (uint32_t)requested : 0;
+    }
     
-    releaseFrame(fb);
+    CaptureOptions options;
+    options.bmp = false;
+    options.scale = scale;
+    options.roi = roi;
+    options.format = BMP_RGB24;
+    options.etag_boot = capture_etag_boot;
+    if (request->hasHeader("If-None-Match")) {
+        options.if_none_match = request->header("If-None-Match");
+    }
+    sendCapture(request, options, max_age);
+}
+
+// Priority class of a /stream request: the operator token, as ?token= or a
+// Bearer header, ranks above a trusted source address
+static StreamClass classifyStreamClient(AsyncWebServerRequest *request) {
+    const char* token = g_config.admission.operator_token;
+    if (token[0]) {
+        String presented;
+        if (request->hasParam("token")) {
+            presented = request->getParam("token")->value();
+        } else if (request->hasHeader("Authorization")) {
+            String auth = request->header("Authorization");
+            if (auth.startsWith("Bearer ")) {
+                presented = auth.substring(7);
+            }
+        }
+        if (presented == token) {
+            return STREAM_CLASS_OPERATOR;
+        }
+    }
+    
+    IPAddress remote = request->client()->remoteIP();
+    for (int i = 0; i < g_config.admission.trusted_count; i++) {
+        const uint8_t* ip = g_config.admission.trusted_ips[i];
+        if (remote == IPAddress(ip[0], ip[1], ip[2], ip[3])) {
+            return STREAM_CLASS_TRUSTED;
+        }
+    }
+    return STREAM_CLASS_GUEST;
+}
+
+// Admission for /stream and /clip: answers 503 and returns false when the
+// client cap or the egress budget has no room for the request's class
+static bool admitStreamRequest(AsyncWebServerRequest *request, StreamClass *stream_class) {
+    *stream_class = classifyStreamClient(request);
+    StreamAdmission admission = admitStreamClient(*stream_class);
+    if (admission == STREAM_DENY_CLIENTS || admission == STREAM_DENY_BANDWIDTH) {
+        const char* body = admission == STREAM_DENY_CLIENTS
+            ? "{\"error\":\"Stream client limit reached\",\"reason\":\"clients\"}"
+            : "{\"error\":\"Stream bandwidth limit reached\",\"reason\":\"bandwidth\"}";
+        AsyncWebServerResponse *response = request->beginResponse(503, "application/json", body);
+        response->addHeader("Retry-After", String(STREAM_RETRY_AFTER_S));
+        addCORSHeaders(response);
+        sendResponse(request, 503, response);
+        return false;
+    }
+    return true;
 }
 
 void handleStream(AsyncWebServerRequest *request) {
     if (!camera_initialized || camera_sleeping) {
-        request->send(503, "text/plain", "Camera is sleeping or not initialized");
+        sendResponse(request, 503, "text/plain", "Camera is sleeping or not initialized");
+        return;
+    }
+    int scale;
+    RoiSpec roi;
+    if (!parseScaleParam(request, &scale) || !parseRoiParams(request, scale, &roi)) {
+        return;
+    }
+    if (!admitStream(request)) {
         return;
     }
     
-    AsyncWebServerResponse *response = request->beginChunkedResponse("multipart/x-mixed-replace; boundary=frame",
-        [](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-            // Capture a new frame
-            camera_fb_t *fb = esp_camera_fb_get();
-            if (!fb) {
-                Serial.println("Camera capture failed");
-                return 0; // End stream
-            }
-            
-            // Build the multipart response
-            String header = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: " + String(fb->len) + "\r\n\r\n";
-            
-            // Calculate total size needed
-            size_t totalSize = header.length() + fb->len + 2; // +2 for \r\n
-            
-            // Check if buffer is large enough
-            if (totalSize > maxLen) {
-                esp_camera_fb_return(fb);
-                return 0;
-            }
-            
-            // Copy header
-            size_t pos = 0;
-            memcpy(buffer + pos, header.c_str(), header.length());
-            pos += header.length();
-            
-            // Copy image data
-            memcpy(buffer + pos, fb->buf, fb->len);
-            pos += fb->len;
-            
-            // Add closing CRLF
-            buffer[pos++] = '\r';
-            buffer[pos++] = '\n';
-            
-            // Return frame buffer
-            esp_camera_fb_return(fb);
-            
-            // Small delay for frame rate control (~15 FPS)
-            delay(66);
-            
-            return pos;
-        });
+    StreamClass stream_class;
+    if (!admitStreamRequest(request, &stream_class)) {
+        return;
+    }
+    
+    // Each client gets its own frame rate; all share the same captures
+    int fps = DEFAULT_FRAMERATE;
+    if (request->hasParam("fps")) {
+        int requested = request->getParam("fps")->value().toInt();
+        if (requested > 0) {
+            fps = requested;
+        }
+    }
+    
+    // Leave out frames that show nothing new (scene_activity.h)
+    bool skip_static = request->hasParam("skip_static") &&
+                       request->getParam("skip_static")->value().toInt() == 1;
     
+    AsyncMjpegResponse *response = new AsyncMjpegResponse(fps, stream_class, request->client()->remoteIP(),
+                                                          skip_static, scale, roi);
     response->addHeader("Access-Control-Allow-Origin", "*");
-    request->send(response);
+    request->onDisconnect([response]() { response->close(); });
+    sendResponse(request, 200, response);
+}
+
+void handleClip(AsyncWebServerRequest *request) {
+    if (!frameRingEnabled()) {
+        sendResponse(request, 503, "application/json", "{\"error\":\"Pre-event buffer is disabled\"}");
+        return;
+    }
+    if (!admitStream(request)) {
+        return;
+    }
+    StreamClass stream_class;
+    if (!admitStreamRequest(request, &stream_class)) {
+        return;
+    }
+    
+    // Seconds of history before the request and live seconds after it
+    int before = 5;
+    int after = 5;
+    if (request->hasParam("before")) {
+        before = constrain((int)request->getParam("before")->value().toInt(), 0, g_config.clip.buffer_seconds);
+    }
+    if (request->hasParam("after")) {
+        after = constrain((int)request->getParam("after")->value().toInt(), 0, CLIP_MAX_AFTER_SECONDS);
+    }
+    
+    unsigned long now = millis();
+    AsyncClipResponse *response = new AsyncClipResponse(now - before * 1000UL, now + after * 1000UL, stream_class);
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    response->addHeader("Content-Disposition", "inline; filename=clip.mjpeg");
+    sendResponse(request, 200, response);
+}
+
+void handleBurst(AsyncWebServerRequest *request) {
+    if (!camera_initialized || camera_sleeping) {
+        sendResponse(request, 503, "application/json", "{\"error\":\"Camera is sleeping or not initialized\"}");
+        return;
+    }
+    
+    // interval_ms=0 captures back to back at the sensor rate
+    int count = 10;
+    int interval_ms = 0;
+    if (request->hasParam("n")) {
+        count = constrain((int)request->getParam("n")->value().toInt(), 1, BURST_MAX_FRAMES);
+    }
+    if (request->hasParam("interval_ms")) {
+        interval_ms = constrain((int)request->getParam("interval_ms")->value().toInt(), 0, BURST_MAX_INTERVAL_MS);
+    }
+    
+    if (!requestBurst(count, interval_ms)) {
+        sendResponse(request, 503, "application/json", "{\"error\":\"Burst already running or burst buffer unavailable\"}");
+        return;
+    }
+    
+    AsyncBurstResponse *response = new AsyncBurstResponse();
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    sendResponse(request, 200, response);
 }
 
+// The frame is converted while it is sent: each filler call decodes only
+// the MCU rows its scanlines need (bmp_stream.h), so no RGB frame buffer
 void handleBMP(AsyncWebServerRequest *request) {
-    // BMP conversion is complex - for now return JPEG
-    handleCapture(request);
+    if (!camera_initialized || camera_sleeping) {
+        AsyncWebServerResponse *response = request->beginResponse(503, "application/json", 
+            "{\"error\":\"Camera is sleeping or not initialized\"}");
+        addCORSHeaders(response);
+        sendResponse(request, 503, response);
+        return;
+    }
+    
+    BmpFormat format = BMP_RGB24;
+    if (request->hasParam("format") && !parseBmpFormat(request->getParam("format")->value(), &format)) {
+        sendResponse(request, 400, "application/json", "{\"error\":\"format must be rgb24, gray or rgb565\"}");
+        return;
+    }
+    
+    uint32_t max_age = DEFAULT_CAPTURE_MAX_AGE_MS;
+    if (request->hasParam("max_age")) {
+        long requested = request->getParam("max_age")->value().toInt();
+        max_age = requested > 0 ? (uint32_t)requested : 0;
+    }
+    
+    CaptureOptions options;
+    options.bmp = true;
+    options.scale = 1;
+    options.format = format;
+    options.etag_boot = capture_etag_boot;
+    sendCapture(request, options, max_age);
+}
+
+// Hands a change to the camera task (app.h) and replies once it has run
+static void sendCameraRequest(AsyncWebServerRequest *request, const CameraRequest& camera_request,
+                              CameraReplyBuilder build, int arg) {
+    uint32_t ticket = requestCamera(camera_request, true);
+    if (!ticket) {
+        AsyncWebServerResponse *response = request->beginResponse(503, "application/json",
+                                                                  "{\"error\":\"Camera busy, retry later\"}");
+        response->addHeader("Retry-After", String(CAMERA_RETRY_AFTER_S));
+        addCORSHeaders(response);
+        sendResponse(request, 503, response);
+        return;
+    }
+    AsyncCameraResponse *response = new AsyncCameraResponse(ticket, camera_request, build, arg);
+    request->onDisconnect([response]() { response->close(); });
+    request->send(response);
+}
+
+// Reply to a /control batch of requested settings
+static int controlReply(const CameraRequest& camera_request, const CameraRequestOutcome& outcome, int requested,
+                        String* body) {
+    const CameraSettingsResult& result = outcome.result;
+    metricObserve(metric_control_apply, outcome.elapsed_us);
+    
+    StaticJsonDocument<256> doc;
+    if (outcome.ok) {
+        doc["success"] = true;
+        doc["requested"] = requested;
+        doc["written"] = result.written;
+        doc["skipped"] = result.skipped;
+        doc["deferred"] = result.deferred;
+    } else if (result.failed) {
+        doc["error"] = "Sensor write failed, batch rolled back";
+        doc["field"] = result.failed->name;
+        doc["rolled_back"] = result.rolled_back;
+    } else {
+        doc["error"] = "Frame buffers for this framesize/quality unavailable";
+    }
+    doc["elapsed_us"] = outcome.elapsed_us;
+    
+    serializeJson(doc, *body);
+    return outcome.ok ? 200 : 500;
+}
+
+// Applies a validated /control batch and replies with what it did
+static void applyControl(AsyncWebServerRequest *request, const CameraSettings& target, CameraSettingMask mask,
+                         int requested) {
+    CameraRequest camera_request;
+    memset(&camera_request, 0, sizeof(camera_request));
+    camera_request.type = CAMERA_REQUEST_SETTINGS;
+    camera_request.target = target;
+    camera_request.mask = mask;
+    camera_request.persist = true;
+    sendCameraRequest(request, camera_request, controlReply, requested);
+}
+
+static void sendControlError(AsyncWebServerRequest *request, const char* error, const char* field,
+                             const CameraSettingField* range) {
+    StaticJsonDocument<192> doc;
+    doc["error"] = error;
+    if (field) {
+        doc["field"] = field;
+    }
+    if (range) {
+        doc["min"] = range->min;
+        doc["max"] = range->max;
+    }
+    String output;
+    serializeJson(doc, output);
+    sendResponse(request, 400, "application/json", output);
+}
+
+// Reads a JSON object of settings into target. Replies 400 and returns
+// false at the first unknown, non-integer or out-of-range one.
+static bool parseSettings(AsyncWebServerRequest *request, JsonObject settings, CameraSettings* target,
+                          CameraSettingMask* mask, int* requested) {
+    for (JsonPair kv : settings) {
+        const CameraSettingField* field = findCameraSetting(kv.key().c_str());
+        if (!field) {
+            sendControlError(request, "Unknown setting", kv.key().c_str(), nullptr);
+            return false;
+        }
+        JsonVariant value = kv.value();
+        if (!value.is<int>() && !value.is<bool>()) {
+            sendControlError(request, "Value must be an integer", field->name, nullptr);
+            return false;
+        }
+        int v = value.is<bool>() ? (int)value.as<bool>() : value.as<int>();
+        if (!cameraSettingInRange(field, v)) {
+            sendControlError(request, "Value out of range", field->name, field);
+            return false;
+        }
+        target->*field->member = v;
+        *mask |= CAMERA_SETTING_BIT(field - cameraSettingField(0));
+        (*requested)++;
+    }
+    return true;
 }
 
 void handleControl(AsyncWebServerRequest *request) {
     if (!request->hasParam("var") || !request->hasParam("val")) {
-        request->send(400, "application/json", "{\"error\":\"Missing parameters\"}");
+        sendResponse(request, 400, "application/json", "{\"error\":\"Missing parameters\"}");
         return;
     }
     
     String var = request->getParam("var")->value();
-    String val = request->getParam("val")->value();
-    
-    sensor_t *s = esp_camera_sensor_get();
-    if (!s) {
-        request->send(500, "application/json", "{\"error\":\"Camera not available\"}");
-        return;
-    }
-    
-    int res = 0;
-    
-    if (var == "framesize") {
-        res = s->set_framesize(s, (framesize_t)val.toInt());
-        g_config.camera.framesize = val.toInt();
-    } else if (var == "quality") {
-        res = s->set_quality(s, val.toInt());
-        g_config.camera.quality = val.toInt();
-    } else if (var == "brightness") {
-        res = s->set_brightness(s, val.toInt());
-        g_config.camera.brightness = val.toInt();
-    } else if (var == "contrast") {
-        res = s->set_contrast(s, val.toInt());
-        g_config.camera.contrast = val.toInt();
-    } else if (var == "saturation") {
-        res = s->set_saturation(s, val.toInt());
-        g_config.camera.saturation = val.toInt();
-    } else if (var == "hmirror") {
-        res = s->set_hmirror(s, val.toInt());
-        g_config.camera.hmirror = val.toInt();
-    } else if (var == "vflip") {
-        res = s->set_vflip(s, val.toInt());
-        g_config.camera.vflip = val.toInt();
-    } else if (var == "led_intensity") {
-        int intensity = val.toInt();
-        setLED(intensity);
-        g_config.camera.led_intensity = intensity;
-    }
-    
-    String response = res == 0 ? "{\"success\":true}" : "{\"error\":\"Failed to set " + var + "\"}";
-    request->send(res == 0 ? 200 : 500, "application/json", response);
+    const CameraSettingField* field = findCameraSetting(var.c_str());
+    if (!field) {
+        sendControlError(request, "Unknown setting", var.c_str(), nullptr);
+        return;
+    }
+    int value = request->getParam("val")->value().toInt();
+    if (!cameraSettingInRange(field, value)) {
+        sendControlError(request, "Value out of range", field->name, field);
+        return;
+    }
+    
+    CameraSettings target = g_config.camera;
+    target.*field->member = value;
+    applyControl(request, target, CAMERA_SETTING_BIT(field - cameraSettingField(0)), 1);
 }
 
-void handleSleep(AsyncWebServerRequest *request) {
-    deinitCamera();
-    request->send(200, "application/json", "{\"success\":true,\"message\":\"Camera sleeping\"}");
+void handleControlBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    char* body = collectBody(request, data, len, index, total, JSON_BODY_MAX);
+    if (!body) {
+        return;
+    }
+    
+    StaticJsonDocument<CONTROL_JSON_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, body);
+    if (error || !doc.is<JsonObject>()) {
+        sendControlError(request, "Body must be a JSON object of settings", nullptr, nullptr);
+        return;
+    }
+    
+    // Validate the whole batch before anything reaches the sensor
+    CameraSettings target = g_config.camera;
+    CameraSettingMask mask = 0;
+    int requested = 0;
+    if (!parseSettings(request, doc.as<JsonObject>(), &target, &mask, &requested)) {
+        return;
+    }
+    if (!requested) {
+        sendControlError(request, "No settings given", nullptr, nullptr);
+        return;
+    }
+    
+    applyControl(request, target, mask, requested);
 }
 
-void handleWake(AsyncWebServerRequest *request) {
-    if (reinitCamera()) {
-        request->send(200, "application/json", "{\"success\":true,\"message\":\"Camera awake\"}");
+// Profile name from ?name=; replies 400 and returns false without one
+static bool profileName(AsyncWebServerRequest *request, String* name) {
+    if (!request->hasParam("name") || request->getParam("name")->value().length() == 0) {
+        sendResponse(request, 400, "application/json", "{\"error\":\"Missing profile name\"}");
+        return false;
+    }
+    *name = request->getParam("name")->value();
+    return true;
+}
+
+static void addProfileSettings(JsonObject settings, const CameraProfile& profile) {
+    for (int i = 0; i < CAMERA_SETTING_FIELDS; i++) {
+        const CameraSettingField* field = cameraSettingField(i);
+        settings[field->name] = profile.camera.*field->member;
+    }
+    settings["ready_framesize"] = profile.camera.ready_framesize;
+}
+
+static void addProfileRule(JsonObject out, ProfileRule& rule) {
+    out["profile"] = rule.profile;
+    if (rule.type == PROFILE_RULE_TIME) {
+        char from[8], to[8];
+        snprintf(from, sizeof(from), "%02d:%02d", rule.from_minute / 60, rule.from_minute % 60);
+        snprintf(to, sizeof(to), "%02d:%02d", rule.to_minute / 60, rule.to_minute % 60);
+        out["from"] = from;
+        out["to"] = to;
+    } else {
+        out[profileRuleTypeName(rule.type)] = rule.light;
+    }
+}
+
+void handleProfiles(AsyncWebServerRequest *request) {
+    CameraProfileState state;
+    CameraSwitchStats timing;
+    ProfileSchedule schedule;
+    getCameraProfileState(&state);
+    getCameraSwitchStats(&timing);
+    getProfileSchedule(&schedule);
+    
+    DynamicJsonDocument doc(1024 + PROFILE_MAX * 896 + schedule.rule_count * 128);
+    doc["active"] = state.active;
+    doc["source"] = state.source;
+    doc["switches"] = state.switches;
+    if (state.switches) {
+        JsonObject last = doc.createNestedObject("last_switch");
+        last["ms_ago"] = millis() - state.last_switch;
+        last["written"] = state.written;
+        last["skipped"] = state.skipped;
+        last["deferred"] = state.deferred;
+        last["apply_ms"] = state.apply_us / 1000.0;
+        last["pending"] = timing.pending;
+        last["latency_ms"] = timing.latency_us / 1000.0;
+        last["frames_lost"] = timing.frames_lost;
+        last["frames_discarded"] = timing.frames_discarded;
+    }
+    if (state.light >= 0) {
+        doc["light"] = state.light;
     } else {
-        request->send(500, "application/json", "{\"error\":\"Failed to wake camera\"}");
+        doc["light"] = nullptr;
+    }
+    doc["clock_valid"] = state.clock_valid;
+    
+    JsonArray list = doc.createNestedArray("profiles");
+    for (int slot = 0; slot < PROFILE_MAX; slot++) {
+        CameraProfile profile;
+        if (!getCameraProfile(slot, &profile)) {
+            continue;
+        }
+        JsonObject entry = list.createNestedObject();
+        entry["name"] = profile.name;
+        entry["capture_fps"] = profile.capture_fps;
+        addProfileSettings(entry.createNestedObject("settings"), profile);
+    }
+    
+    JsonObject sched = doc.createNestedObject("schedule");
+    sched["enabled"] = schedule.enabled;
+    sched["tz"] = schedule.tz;
+    sched["matching_rule"] = state.rule;
+    JsonArray rules = sched.createNestedArray("rules");
+    for (int i = 0; i < schedule.rule_count; i++) {
+        addProfileRule(rules.createNestedObject(), schedule.rules[i]);
     }
+    
+    String output;
+    serializeJson(doc, output);
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
+    addCORSHeaders(response);
+    sendResponse(request, 200, response);
+}
+
+// Reply to GET /profile?name=
+static int profileReply(const CameraRequest& camera_request, const CameraRequestOutcome& outcome, int arg,
+                        String* body) {
+    const CameraSettingsResult& result = outcome.result;
+    StaticJsonDocument<256> doc;
+    if (outcome.ok) {
+        doc["success"] = true;
+        doc["profile"] = camera_request.profile;
+        doc["written"] = result.written;
+        doc["skipped"] = result.skipped;
+        doc["deferred"] = result.deferred;
+    } else if (result.failed) {
+        doc["error"] = "Sensor write failed, profile rolled back";
+        doc["field"] = result.failed->name;
+        doc["rolled_back"] = result.rolled_back;
+    } else {
+        doc["error"] = "Frame buffers for this framesize/quality unavailable";
+    }
+    doc["elapsed_us"] = outcome.elapsed_us;
+    
+    serializeJson(doc, *body);
+    return outcome.ok ? 200 : 500;
+}
+
+void handleProfile(AsyncWebServerRequest *request) {
+    String name;
+    if (!profileName(request, &name)) {
+        return;
+    }
+    CameraProfile profile;
+    if (!findCameraProfile(name.c_str(), &profile)) {
+        sendResponse(request, 404, "application/json", "{\"error\":\"Unknown profile\"}");
+        return;
+    }
+    
+    CameraRequest camera_request;
+    memset(&camera_request, 0, sizeof(camera_request));
+    camera_request.type = CAMERA_REQUEST_PROFILE;
+    strlcpy(camera_request.profile, profile.name, sizeof(camera_request.profile));
+    camera_request.source = "request";
+    sendCameraRequest(request, camera_request, profileReply, 0);
+}
+
+void handleProfileDelete(AsyncWebServerRequest *request) {
+    String name;
+    if (!profileName(request, &name)) {
+        return;
+    }
+    if (!deleteCameraProfile(name.c_str())) {
+        sendResponse(request, 404, "application/json", "{\"error\":\"Unknown profile\"}");
+        return;
+    }
+    sendResponse(request, 200, "application/json", "{\"success\":true}");
+}
+
+// Saves the running settings under ?name=, with any settings, capture_fps
+// and ready_framesize in the body taking their place
+static void saveProfile(AsyncWebServerRequest *request, JsonObject overrides) {
+    String name;
+    if (!profileName(request, &name)) {
+        return;
+    }
+    CameraProfile profile;
+    memset(&profile, 0, sizeof(profile));
+    if (name.length() >= sizeof(profile.name)) {
+        sendControlError(request, "Profile name too long", nullptr, nullptr);
+        return;
+    }
+    strlcpy(profile.name, name.c_str(), sizeof(profile.name));
+    profile.camera = g_config.camera;
+    profile.capture_fps = g_config.stream.capture_fps;
+    
+    if (overrides.containsKey("capture_fps")) {
+        profile.capture_fps = overrides["capture_fps"] | 0;
+        overrides.remove("capture_fps");
+        if (profile.capture_fps < 1 || profile.capture_fps > STREAM_MAX_FPS) {
+            sendControlError(request, "Value out of range", "capture_fps", nullptr);
+            return;
+        }
+    }
+    if (overrides.containsKey("ready_framesize")) {
+        profile.camera.ready_framesize = overrides["ready_framesize"] | -2;
+        overrides.remove("ready_framesize");
+        if (profile.camera.ready_framesize < -1 || profile.camera.ready_framesize > FRAMESIZE_UXGA) {
+            sendControlError(request, "Value out of range", "ready_framesize", nullptr);
+            return;
+        }
+    }
+    CameraSettingMask mask = 0;
+    int requested = 0;
+    if (!parseSettings(request, overrides, &profile.camera, &mask, &requested)) {
+        return;
+    }
+    
+    CameraProfile existing;
+    if (!findCameraProfile(profile.name, &existing) && getCameraProfileCount() >= PROFILE_MAX) {
+        sendResponse(request, 507, "application/json", "{\"error\":\"All profile slots in use\"}");
+        return;
+    }
+    if (!saveCameraProfile(profile)) {
+        sendControlError(request, "Invalid profile name (letters, digits, _ and -)", nullptr, nullptr);
+        return;
+    }
+    sendResponse(request, 200, "application/json", "{\"success\":true}");
+}
+
+void handleProfileSave(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    char* body = collectBody(request, data, len, index, total, JSON_BODY_MAX);
+    if (!body) {
+        return;
+    }
+    
+    StaticJsonDocument<CONTROL_JSON_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, body);
+    if (error || !doc.is<JsonObject>()) {
+        sendControlError(request, "Body must be a JSON object of settings", nullptr, nullptr);
+        return;
+    }
+    saveProfile(request, doc.as<JsonObject>());
+}
+
+// "HH:MM" to minutes since midnight, -1 if malformed
+static int parseMinuteOfDay(const char* text) {
+    int hour, minute;
+    char extra;
+    if (!text || sscanf(text, "%d:%d%c", &hour, &minute, &extra) != 2 ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        return -1;
+    }
+    return hour * 60 + minute;
+}
+
+void handleProfileSchedule(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    char* body = collectBody(request, data, len, index, total, JSON_BODY_MAX);
+    if (!body) {
+        return;
+    }
+    
+    StaticJsonDocument<PROFILE_JSON_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, body);
+    if (error || !doc.is<JsonObject>()) {
+        sendControlError(request, "Body must be a JSON schedule object", nullptr, nullptr);
+        return;
+    }
+    
+    ProfileSchedule schedule;
+    memset(&schedule, 0, sizeof(schedule));
+    schedule.enabled = doc["enabled"] | true;
+    const char* tz = doc["tz"] | "";
+    if (strlen(tz) >= sizeof(schedule.tz)) {
+        sendControlError(request, "Time zone too long", "tz", nullptr);
+        return;
+    }
+    strlcpy(schedule.tz, tz, sizeof(schedule.tz));
+    
+    JsonArray rules = doc["rules"];
+    if (rules.size() > PROFILE_RULE_MAX) {
+        sendControlError(request, "Too many rules", "rules", nullptr);
+        return;
+    }
+    for (JsonObject entry : rules) {
+        ProfileRule& rule = schedule.rules[schedule.rule_count];
+        const char* profile = entry["profile"] | "";
+        strlcpy(rule.profile, profile, sizeof(rule.profile));
+        if (entry.containsKey("from") || entry.containsKey("to")) {
+            int from = parseMinuteOfDay(entry["from"].as<const char*>());
+            int to = parseMinuteOfDay(entry["to"].as<const char*>());
+            if (from < 0 || to < 0) {
+                sendControlError(request, "Time rules need \"from\" and \"to\" as HH:MM", "rules", nullptr);
+                return;
+            }
+            rule.type = PROFILE_RULE_TIME;
+            rule.from_minute = from;
+            rule.to_minute = to;
+        } else if (entry["light_below"].is<int>()) {
+            rule.type = PROFILE_RULE_LIGHT_BELOW;
+            rule.light = entry["light_below"];
+        } else if (entry["light_above"].is<int>()) {
+            rule.type = PROFILE_RULE_LIGHT_ABOVE;
+            rule.light = entry["light_above"];
+        } else {
+            sendControlError(request, "Rule needs from/to, light_below or light_above", "rules", nullptr);
+            return;
+        }
+        if (strlen(profile) >= sizeof(rule.profile)) {
+            sendControlError(request, "Profile name too long", "rules", nullptr);
+            return;
+        }
+        schedule.rule_count++;
+    }
+    
+    if (!setProfileSchedule(schedule)) {
+        sendControlError(request, "Invalid rule profile name", "rules", nullptr);
+        return;
+    }
+    sendResponse(request, 200, "application/json", "{\"success\":true}");
+}
+
+// Motion stats plus the changed-block mask of the last analysed frame, one
+// hex string per block row (4 blocks per digit, MSB = leftmost)
+void handleMotion(AsyncWebServerRequest *request) {
+    MotionStats stats;
+    getMotionStats(&stats);
+    
+    std::unique_ptr<uint8_t[]> bits(new uint8_t[MOTION_MASK_MAX_BYTES]);
+    int blocks_x = 0, blocks_y = 0;
+    size_t mask_len = getMotionMask(bits.get(), MOTION_MASK_MAX_BYTES, &blocks_x, &blocks_y);
+    
+    int row_len = (blocks_x + 3) / 4;
+    DynamicJsonDocument doc(1024 + (mask_len ? blocks_y * (row_len + 1 + 16) : 0));
+    addMotionStats(doc.to<JsonObject>(), stats);
+    if (mask_len && blocks_x <= MOTION_MAX_BLOCKS_X) {
+        doc["blocks_x"] = blocks_x;
+        doc["blocks_y"] = blocks_y;
+        JsonArray rows = doc.createNestedArray("mask");
+        char row[MOTION_MAX_BLOCKS_X / 4 + 1];
+        for (int y = 0; y < blocks_y; y++) {
+            for (int digit = 0; digit < row_len; digit++) {
+                int nibble = 0;
+                for (int k = 0; k < 4; k++) {
+                    int x = digit * 4 + k;
+                    int i = y * blocks_x + x;
+                    nibble <<= 1;
+                    if (x < blocks_x && (bits[i >> 3] & (0x80 >> (i & 7)))) {
+                        nibble |= 1;
+                    }
+                }
+                row[digit] = "0123456789abcdef"[nibble];
+            }
+            row[row_len] = '\0';
+            rows.add(row);
+        }
+    }
+    
+    String output;
+    serializeJson(doc, output);
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
+    addCORSHeaders(response);
+    sendResponse(request, 200, response);
+}
+
+// Reply to /sleep and /wake
+static int powerReply(const CameraRequest& camera_request, const CameraRequestOutcome& outcome, int arg,
+                      String* body) {
+    switch (camera_request.type) {
+        case CAMERA_REQUEST_OFF:
+            *body = "{\"success\":true,\"message\":\"Camera off\"}";
+            return 200;
+        case CAMERA_REQUEST_STANDBY:
+            if (!outcome.ok) {
+                *body = "{\"error\":\"Camera is off\"}";
+                return 409;
+            }
+            *body = "{\"success\":true,\"message\":\"Camera in standby\"}";
+            return 200;
+        default:
+            if (!outcome.ok) {
+                *body = "{\"error\":\"Failed to wake camera\"}";
+                return 500;
+            }
+            *body = "{\"success\":true,\"message\":\"Camera awake\"}";
+            return 200;
+    }
+}
+
+void handleSleep(AsyncWebServerRequest *request) {
+    // Standby by default; mode=off releases the driver and frame buffers
+    CameraRequest camera_request;
+    memset(&camera_request, 0, sizeof(camera_request));
+    camera_request.type = CAMERA_REQUEST_STANDBY;
+    if (request->hasParam("mode") && request->getParam("mode")->value() == "off") {
+        camera_request.type = CAMERA_REQUEST_OFF;
+    }
+    sendCameraRequest(request, camera_request, powerReply, 0);
+}
+
+void handleWake(AsyncWebServerRequest *request) {
+    CameraRequest camera_request;
+    memset(&camera_request, 0, sizeof(camera_request));
+    camera_request.type = CAMERA_REQUEST_WAKE;
+    sendCameraRequest(request, camera_request, powerReply, 0);
 }
 
 void handleRestart(AsyncWebServerRequest *request) {
-    request->send(200, "application/json", "{\"success\":true,\"message\":\"Restarting...\"}");
+    sendResponse(request, 200, "application/json", "{\"success\":true,\"message\":\"Restarting...\"}");
     Event event;
     event.type = EVENT_RESTART_REQUESTED;
     xQueueSend(eventQueue, &event, 0);
@@ -352,7 +1526,7 @@ void handleFactoryReset(AsyncWebServerRequest *request) {
     AsyncWebServerResponse *response = request->beginResponse(200, "application/json", 
         "{\"success\":true,\"message\":\"Configuration reset. Device restarting in 3 seconds...\"}");
     addCORSHeaders(response);
-    request->send(response);
+    sendResponse(request, 200, response);
     
     // Restart after short delay
     Event event;
@@ -378,7 +1552,7 @@ void handleWiFiConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len
         if (error) {
             AsyncWebServerResponse *response = request->beginResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON\"}");
             addCORSHeaders(response);
-            request->send(response);
+            sendResponse(request, 400, response);
             return;
         }
         
@@ -388,7 +1562,7 @@ void handleWiFiConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len
         if (!ssid || !password || strlen(ssid) == 0 || strlen(password) == 0) {
             AsyncWebServerResponse *response = request->beginResponse(400, "application/json", "{\"success\":false,\"message\":\"SSID and password are required\"}");
             addCORSHeaders(response);
-            request->send(response);
+            sendResponse(request, 400, response);
             return;
         }
         
@@ -413,7 +1587,7 @@ void handleWiFiConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len
             } else {
                 AsyncWebServerResponse *response = request->beginResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid IP address format\"}");
                 addCORSHeaders(response);
-                request->send(response);
+                sendResponse(request, 400, response);
                 return;
             }
         } else {
@@ -448,12 +1622,12 @@ void handleWiFiConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len
             
             AsyncWebServerResponse *response = request->beginResponse(200, "application/json", "{\"success\":true,\"ip\":\"" + WiFi.localIP().toString() + "\"}");
             addCORSHeaders(response);
-            request->send(response);
+            sendResponse(request, 200, response);
         } else {
             Serial.println("========================================");
             AsyncWebServerResponse *response = request->beginResponse(200, "application/json", "{\"success\":false,\"message\":\"Unable to connect. Check SSID, password, and signal strength.\"}");
             addCORSHeaders(response);
-            request->send(response);
+            sendResponse(request, 200, response);
         }
     }
 }
@@ -461,8 +1635,9 @@ void handleWiFiConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len
 void handleNotFound(AsyncWebServerRequest *request) {
     // Redirect to root for captive portal
     if (ap_mode_active) {
+        metricsCountHttp(request->url().c_str(), 302);
         request->redirect("/");
     } else {
-        request->send(404, "application/json", "{\"error\":\"Not found\"}");
+        sendResponse(request, 404, "application/json", "{\"error\":\"Not found\"}");
     }
 }